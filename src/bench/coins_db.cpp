@@ -0,0 +1,76 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <crypto/common.h>
+#include <names/common.h>
+#include <script/script.h>
+#include <txdb.h>
+
+static const uint32_t NUM_COINS = 1000;
+
+static COutPoint MakeOutPoint(uint32_t i)
+{
+    uint256 hash;
+    WriteLE32(hash.begin(), i / 4);
+    return COutPoint(hash, i % 4);
+}
+
+static Coin MakeCoin(uint32_t i)
+{
+    CScript script;
+    script << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i & 0xff) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return Coin(CTxOut(i * 1000, script), i, false);
+}
+
+static uint256 MakeBlockHash(uint32_t n)
+{
+    uint256 hash;
+    WriteLE32(hash.begin(), n + 1);
+    return hash;
+}
+
+/** Write the given coins to the database, as a flush of the coins cache does. */
+static void WriteCoins(CCoinsViewDB& db, uint32_t n)
+{
+    CCoinsMap coins;
+    for (uint32_t i = 0; i < NUM_COINS; ++i) {
+        CCoinsCacheEntry& entry = coins[MakeOutPoint(i)];
+        entry.coin = MakeCoin(i + n);
+        entry.flags = CCoinsCacheEntry::DIRTY;
+    }
+    const CNameCache names;
+    db.BatchWrite(coins, MakeBlockHash(n), names);
+}
+
+// Flush of a thousand coins to an in-memory chain state database.
+static void CoinsViewDBBatchWrite(benchmark::State& state)
+{
+    // The database path is derived from the data directory of the selected chain.
+    SelectParams(CBaseChainParams::REGTEST);
+    CCoinsViewDB db(1 << 20, true, true);
+    uint32_t n = 0;
+    while (state.KeepRunning()) {
+        WriteCoins(db, n++);
+    }
+}
+
+// Point lookups of coins in an in-memory chain state database.
+static void CoinsViewDBGetCoin(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CCoinsViewDB db(1 << 20, true, true);
+    WriteCoins(db, 0);
+    uint32_t i = 0;
+    Coin coin;
+    while (state.KeepRunning()) {
+        bool found = db.GetCoin(MakeOutPoint(i++ % NUM_COINS), coin);
+        assert(found);
+    }
+}
+
+BENCHMARK(CoinsViewDBBatchWrite, 50);
+BENCHMARK(CoinsViewDBGetCoin, 300 * 1000);
@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <dbwrapper.h>
+#include <txdb.h>
+#include <util.h>
+
+#include <utility>
+#include <vector>
+
+static const uint32_t NUM_COINS = 20000;
+static const uint32_t NUM_HISTORIES = 2000;
+
+/**
+ * Fill an in-memory database with the chain state tuning with coin-sized
+ * records and large name history records, compacted into tables so that
+ * reads go through the block cache.
+ */
+static std::unique_ptr<CDBWrapper> MakeChainstateDB()
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    std::unique_ptr<CDBWrapper> db = MakeUnique<CDBWrapper>(GetDataDir() / "dbwrapper_bench", 2 << 20, true, true, true, GetChainstateDBTuning());
+    CDBBatch batch(*db);
+    for (uint32_t i = 0; i < NUM_COINS; ++i) {
+        batch.Write(std::make_pair('C', i), std::vector<unsigned char>(40, i & 0xff));
+    }
+    for (uint32_t i = 0; i < NUM_HISTORIES; ++i) {
+        batch.Write(std::make_pair('h', i), std::vector<unsigned char>(4000, i & 0xff));
+    }
+    db->WriteBatch(batch);
+    db->Compact(nullptr);
+    return db;
+}
+
+// Point lookups of coins, which the block cache holds after a warm-up.
+static void DBWrapperCoinLookup(benchmark::State& state)
+{
+    std::unique_ptr<CDBWrapper> db = MakeChainstateDB();
+    std::vector<unsigned char> value;
+    uint32_t i = 0;
+    while (state.KeepRunning()) {
+        bool found = db->Read(std::make_pair('C', (i++ * 7919) % NUM_COINS), value);
+        assert(found);
+    }
+}
+
+// Point lookups of coins, with a name history read every eighth lookup.
+static void DBWrapperCoinLookupWithNameHistory(benchmark::State& state)
+{
+    std::unique_ptr<CDBWrapper> db = MakeChainstateDB();
+    std::vector<unsigned char> value;
+    uint32_t i = 0;
+    while (state.KeepRunning()) {
+        if (i % 8 == 0) {
+            bool found = db->Read(std::make_pair('h', (i / 8 * 7919) % NUM_HISTORIES), value);
+            assert(found);
+        }
+        bool found = db->Read(std::make_pair('C', (i++ * 7919) % NUM_COINS), value);
+        assert(found);
+    }
+}
+
+BENCHMARK(DBWrapperCoinLookup, 200 * 1000);
+BENCHMARK(DBWrapperCoinLookupWithNameHistory, 100 * 1000);
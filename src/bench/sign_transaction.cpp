@@ -0,0 +1,82 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <key.h>
+#include <keystore.h>
+#include <primitives/transaction.h>
+#include <script/sign.h>
+#include <script/standard.h>
+#include <util.h>
+
+static const unsigned int NUM_INPUTS = 1000;
+static const unsigned int NUM_KEYS = 10;
+
+/**
+ * A consolidation transaction spending NUM_INPUTS outputs paid to NUM_KEYS
+ * keys of a key store, as P2PKH or P2WPKH outputs.
+ */
+static void BuildConsolidation(CBasicKeyStore& keystore, bool witness, CMutableTransaction& tx, std::vector<CTxOut>& spent_outputs)
+{
+    std::vector<CScript> scripts;
+    for (unsigned int i = 0; i < NUM_KEYS; ++i) {
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        const CPubKey pubkey = key.GetPubKey();
+        if (witness) {
+            scripts.push_back(GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID())));
+        } else {
+            scripts.push_back(GetScriptForDestination(pubkey.GetID()));
+        }
+    }
+
+    tx.vin.resize(NUM_INPUTS);
+    spent_outputs.resize(NUM_INPUTS);
+    for (unsigned int i = 0; i < NUM_INPUTS; ++i) {
+        tx.vin[i].prevout = COutPoint(uint256S(strprintf("%064x", i / 4 + 1)), i % 4);
+        spent_outputs[i] = CTxOut(1000 + i, scripts[i % NUM_KEYS]);
+    }
+    tx.vout.emplace_back(NUM_INPUTS * 1000, scripts[0]);
+}
+
+static void SignConsolidation(benchmark::State& state, bool witness, int threads)
+{
+    CBasicKeyStore keystore;
+    CMutableTransaction tx;
+    std::vector<CTxOut> spent_outputs;
+    BuildConsolidation(keystore, witness, tx, spent_outputs);
+
+    while (state.KeepRunning()) {
+        std::vector<SignatureData> sigdata(tx.vin.size());
+        ProduceSignatures(keystore, tx, spent_outputs, SIGHASH_ALL, sigdata, threads);
+        assert(sigdata.back().complete);
+    }
+}
+
+// Signing of the 1000 inputs of a transaction, in one thread and in four.
+static void SignTransaction1000Inputs(benchmark::State& state)
+{
+    SignConsolidation(state, false, 1);
+}
+
+static void SignTransaction1000InputsParallel(benchmark::State& state)
+{
+    SignConsolidation(state, false, 4);
+}
+
+static void SignWitnessTransaction1000Inputs(benchmark::State& state)
+{
+    SignConsolidation(state, true, 1);
+}
+
+static void SignWitnessTransaction1000InputsParallel(benchmark::State& state)
+{
+    SignConsolidation(state, true, 4);
+}
+
+BENCHMARK(SignTransaction1000Inputs, 1);
+BENCHMARK(SignTransaction1000InputsParallel, 1);
+BENCHMARK(SignWitnessTransaction1000Inputs, 1);
+BENCHMARK(SignWitnessTransaction1000InputsParallel, 1);
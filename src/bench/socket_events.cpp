@@ -0,0 +1,122 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <compat.h>
+#include <netbase.h>
+#include <socketevents.h>
+#include <util.h>
+
+#include <assert.h>
+#include <stdexcept>
+#include <string.h>
+#include <vector>
+
+// Number of connected loopback peers. Kept below FD_SETSIZE / 2 so that the
+// select() backend can watch both ends of every connection.
+static const int NUM_PEERS = 400;
+// Number of peers that send a message in each round.
+static const int NUM_ACTIVE_PEERS = 8;
+
+namespace {
+
+/** Loopback TCP connections, of which the accepted ends are watched for events. */
+class LoopbackPeers
+{
+public:
+    std::vector<SOCKET> vClients;
+    std::vector<SOCKET> vPeers;
+
+    explicit LoopbackPeers(int nPeers)
+    {
+        SetupNetworking();
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+
+        SOCKET hListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        socklen_t len = sizeof(addr);
+        if (hListen == INVALID_SOCKET ||
+            bind(hListen, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+            listen(hListen, SOMAXCONN) == SOCKET_ERROR ||
+            getsockname(hListen, (struct sockaddr*)&addr, &len) == SOCKET_ERROR) {
+            throw std::runtime_error("cannot listen on loopback");
+        }
+
+        for (int i = 0; i < nPeers; ++i) {
+            SOCKET hClient = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (hClient == INVALID_SOCKET || connect(hClient, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+                throw std::runtime_error("cannot connect to loopback");
+            }
+            SOCKET hPeer = accept(hListen, nullptr, nullptr);
+            if (hPeer == INVALID_SOCKET || !SetSocketNonBlocking(hPeer, true)) {
+                throw std::runtime_error("cannot accept loopback connection");
+            }
+            vClients.push_back(hClient);
+            vPeers.push_back(hPeer);
+        }
+        CloseSocket(hListen);
+    }
+
+    ~LoopbackPeers()
+    {
+        for (SOCKET& hSocket : vClients) CloseSocket(hSocket);
+        for (SOCKET& hSocket : vPeers) CloseSocket(hSocket);
+    }
+};
+
+} // namespace
+
+// In each round a few peers send one byte, and the socket events backend is
+// waited on until all of them have been received, as the socket handler does
+// for the connections of a busy node.
+static void SocketEvents(benchmark::State& state, SocketEventsMode mode)
+{
+    LoopbackPeers peers(NUM_PEERS);
+    std::unique_ptr<CSocketEvents> events = MakeSocketEvents(mode);
+    assert(events);
+    for (size_t i = 0; i < peers.vPeers.size(); ++i) {
+        bool fAdded = events->Add(peers.vPeers[i], &peers.vPeers[i], SOCKET_EVENT_RECV);
+        assert(fAdded);
+    }
+
+    std::vector<SocketEvent> vEvents;
+    size_t nNextPeer = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < NUM_ACTIVE_PEERS; ++i) {
+            const char ch = 0;
+            int nSent = send(peers.vClients[nNextPeer], &ch, 1, 0);
+            assert(nSent == 1);
+            nNextPeer = (nNextPeer + 1) % peers.vClients.size();
+        }
+        int nReceived = 0;
+        while (nReceived < NUM_ACTIVE_PEERS) {
+            bool fWaited = events->Wait(1000, vEvents);
+            assert(fWaited);
+            for (const SocketEvent& event : vEvents) {
+                char ch;
+                if (recv(*static_cast<SOCKET*>(event.data), &ch, 1, 0) == 1) ++nReceived;
+            }
+        }
+    }
+}
+
+static void SocketEventsSelect(benchmark::State& state)
+{
+    SocketEvents(state, SocketEventsMode::SELECT);
+}
+
+BENCHMARK(SocketEventsSelect, 2000);
+
+#ifdef USE_EPOLL
+static void SocketEventsEPoll(benchmark::State& state)
+{
+    SocketEvents(state, SocketEventsMode::EPOLL);
+}
+
+BENCHMARK(SocketEventsEPoll, 20000);
+#endif
@@ -5,9 +5,18 @@
 #include <blockfilter.h>
 #include <hash.h>
 #include <primitives/transaction.h>
+#include <script/names.h>
 #include <script/script.h>
 #include <streams.h>
 
+#include <map>
+#include <mutex>
+
+static const std::map<BlockFilterType, std::string> g_filter_types = {
+    {BlockFilterType::BASIC, "basic"},
+    {BlockFilterType::EXTENDED, "extended"},
+};
+
 /// SerType used to serialize parameters in GCS filter encoding.
 static constexpr int GCS_SER_TYPE = SER_NETWORK;
 
@@ -224,6 +233,76 @@ static GCSFilter::ElementSet BasicFilterElements(const CBlock& block,
     return elements;
 }
 
+/** Add the name and address of a name operation script to the elements. */
+static void AddNameElements(GCSFilter::ElementSet& elements, const CScript& script)
+{
+    const CNameScript nameOp(script);
+    if (!nameOp.isNameOp()) return;
+
+    const CScript& address = nameOp.getAddress();
+    if (!address.empty()) {
+        elements.emplace(address.begin(), address.end());
+    }
+    if (nameOp.isAnyUpdate()) {
+        elements.insert(nameOp.getOpName());
+    }
+}
+
+/** Add the data pushes of an OP_RETURN script to the elements. */
+static void AddDataElements(GCSFilter::ElementSet& elements, const CScript& script)
+{
+    CScript::const_iterator pc = script.begin() + 1;
+    opcodetype opcode;
+    std::vector<unsigned char> data;
+    while (script.GetOp(pc, opcode, data)) {
+        if (!data.empty()) {
+            elements.insert(data);
+        }
+    }
+}
+
+static GCSFilter::ElementSet ExtendedFilterElements(const CBlock& block,
+                                                    const CBlockUndo& block_undo)
+{
+    GCSFilter::ElementSet elements = BasicFilterElements(block, block_undo);
+
+    for (const CTransactionRef& tx : block.vtx) {
+        for (const CTxOut& txout : tx->vout) {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty()) continue;
+            if (script[0] == OP_RETURN) {
+                AddDataElements(elements, script);
+            } else {
+                AddNameElements(elements, script);
+            }
+        }
+    }
+
+    for (const CTxUndo& tx_undo : block_undo.vtxundo) {
+        for (const Coin& prevout : tx_undo.vprevout) {
+            AddNameElements(elements, prevout.out.scriptPubKey);
+        }
+    }
+
+    return elements;
+}
+
+BlockFilter::BlockFilter(BlockFilterType filter_type, const uint256& block_hash,
+                         std::vector<unsigned char> filter)
+    : m_filter_type(filter_type), m_block_hash(block_hash)
+{
+    switch (m_filter_type) {
+    case BlockFilterType::BASIC:
+    case BlockFilterType::EXTENDED:
+        m_filter = GCSFilter(m_block_hash.GetUint64(0), m_block_hash.GetUint64(1),
+                             BASIC_FILTER_P, BASIC_FILTER_M, std::move(filter));
+        break;
+
+    default:
+        throw std::invalid_argument("unknown filter_type");
+    }
+}
+
 BlockFilter::BlockFilter(BlockFilterType filter_type, const CBlock& block, const CBlockUndo& block_undo)
     : m_filter_type(filter_type), m_block_hash(block.GetHash())
 {
@@ -234,6 +313,12 @@ BlockFilter::BlockFilter(BlockFilterType filter_type, const CBlock& block, const
                              BasicFilterElements(block, block_undo));
         break;
 
+    case BlockFilterType::EXTENDED:
+        m_filter = GCSFilter(m_block_hash.GetUint64(0), m_block_hash.GetUint64(1),
+                             BASIC_FILTER_P, BASIC_FILTER_M,
+                             ExtendedFilterElements(block, block_undo));
+        break;
+
     default:
         throw std::invalid_argument("unknown filter_type");
     }
@@ -259,3 +344,53 @@ uint256 BlockFilter::ComputeHeader(const uint256& prev_header) const
         .Finalize(result.begin());
     return result;
 }
+
+const std::string& BlockFilterTypeName(BlockFilterType filter_type)
+{
+    static std::string unknown_retval = "";
+    auto it = g_filter_types.find(filter_type);
+    return it != g_filter_types.end() ? it->second : unknown_retval;
+}
+
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filter_type)
+{
+    for (const auto& entry : g_filter_types) {
+        if (entry.second == name) {
+            filter_type = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<BlockFilterType>& AllBlockFilterTypes()
+{
+    static std::vector<BlockFilterType> types;
+
+    static std::once_flag flag;
+    std::call_once(flag, []() {
+            types.reserve(g_filter_types.size());
+            for (auto entry : g_filter_types) {
+                types.push_back(entry.first);
+            }
+        });
+
+    return types;
+}
+
+const std::string& ListBlockFilterTypes()
+{
+    static std::string type_list;
+
+    static std::once_flag flag;
+    std::call_once(flag, []() {
+            bool first = true;
+            for (auto entry : g_filter_types) {
+                if (!first) type_list += ", ";
+                type_list += entry.second;
+                first = false;
+            }
+        });
+
+    return type_list;
+}
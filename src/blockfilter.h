@@ -7,6 +7,7 @@
 
 #include <set>
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 #include <primitives/block.h>
@@ -79,8 +80,27 @@ constexpr uint32_t BASIC_FILTER_M = 784931;
 enum BlockFilterType : uint8_t
 {
     BASIC = 0,
+    /**
+     * The basic filter elements plus the BST-specific data light clients
+     * need: the name and the address part of name operation scripts, and
+     * the data pushes of OP_RETURN outputs.  The basic filter itself stays
+     * as defined by BIP 158.
+     */
+    EXTENDED = 1,
 };
 
+/** Get the human-readable name for a filter type. Returns empty string for unknown types. */
+const std::string& BlockFilterTypeName(BlockFilterType filter_type);
+
+/** Find a filter type by its human-readable name. */
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filter_type);
+
+/** Get a list of known filter types. */
+const std::vector<BlockFilterType>& AllBlockFilterTypes();
+
+/** Get a comma-separated list of known filter type names. */
+const std::string& ListBlockFilterTypes();
+
 /**
  * Complete block filter struct as defined in BIP 157. Serialization matches
  * payload of "cfilter" messages.
@@ -94,10 +114,17 @@ private:
 
 public:
 
+    BlockFilter() = default;
+
+    // Reconstruct a BlockFilter from parts.
+    BlockFilter(BlockFilterType filter_type, const uint256& block_hash,
+                std::vector<unsigned char> filter);
+
     // Construct a new BlockFilter of the specified type from a block.
     BlockFilter(BlockFilterType filter_type, const CBlock& block, const CBlockUndo& block_undo);
 
     BlockFilterType GetFilterType() const { return m_filter_type; }
+    const uint256& GetBlockHash() const { return m_block_hash; }
 
     const GCSFilter& GetFilter() const { return m_filter; }
 
@@ -132,6 +159,7 @@ public:
 
         switch (m_filter_type) {
         case BlockFilterType::BASIC:
+        case BlockFilterType::EXTENDED:
             m_filter = GCSFilter(m_block_hash.GetUint64(0), m_block_hash.GetUint64(1),
                                  BASIC_FILTER_P, BASIC_FILTER_M, std::move(encoded_filter));
             break;
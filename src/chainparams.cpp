@@ -152,6 +152,11 @@ public:
             }
         };
 
+        snapshotData = {
+            {
+            }
+        };
+
         chainTxData = ChainTxData{
             0,
             0,
@@ -254,6 +259,11 @@ public:
             }
         };
 
+        snapshotData = {
+            {
+            }
+        };
+
         chainTxData = ChainTxData{
             // Data from rpc: getchaintxstats 4096 0000000000000037a8cd3e06cd5edbfe9dd1dbcc5dacab279376ef7cfc2b4c75
             /* nTime    */ 1531929919,
@@ -341,6 +351,11 @@ public:
             }
         };
 
+        snapshotData = {
+            {
+            }
+        };
+
         chainTxData = ChainTxData{
             0,
             0,
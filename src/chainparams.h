@@ -26,6 +26,17 @@ struct CCheckpointData {
     MapCheckpoints mapCheckpoints;
 };
 
+typedef std::map<int, uint256> MapSnapshotHashes;
+
+/**
+ * Known-good UTXO snapshot hashes (see dumptxoutset), keyed by the height
+ * of the snapshot's base block.  Only pinned snapshots can be loaded with
+ * -loadsnapshot.
+ */
+struct CSnapshotData {
+    MapSnapshotHashes mapSnapshotHashes;
+};
+
 /**
  * Holds various statistics on transactions within a chain. Used to estimate
  * verification progress during chain sync.
@@ -83,6 +94,7 @@ public:
     const std::string& Bech32HRP() const { return bech32_hrp; }
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
+    const CSnapshotData& Snapshots() const { return snapshotData; }
     const ChainTxData& TxData() const { return chainTxData; }
     void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout);
 protected:
@@ -102,6 +114,7 @@ protected:
     bool fRequireStandard;
     bool fMineBlocksOnDemand;
     CCheckpointData checkpointData;
+    CSnapshotData snapshotData;
     ChainTxData chainTxData;
     bool m_fallback_fee_enabled;
 };
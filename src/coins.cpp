@@ -7,6 +7,8 @@
 #include <consensus/consensus.h>
 #include <random.h>
 
+#include <algorithm>
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
@@ -41,7 +43,7 @@ bool CCoinsViewBacked::ValidateNameDB() const { return base->ValidateNameDB(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), fPartialFlushPending(false), nAccessTick(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -49,12 +51,15 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.nLastUsed = ++nAccessTick;
         return it;
+    }
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp))).first;
+    ret->second.nLastUsed = ++nAccessTick;
     if (ret->second.coin.IsSpent()) {
         // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
@@ -88,10 +93,13 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
         if (!it->second.coin.IsSpent()) {
             throw std::logic_error("Adding new coin that replaces non-pruned entry");
         }
-        fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
+        // While a partial flush is pending, the base view may still hold
+        // a coin that the flush is about to erase.
+        fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY) && !fPartialFlushPending;
     }
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.nLastUsed = ++nAccessTick;
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
@@ -158,6 +166,10 @@ bool CCoinsViewCache::GetName(const valtype &name, CNameData& data) const {
         return false;
     if (cacheNames.get(name, data))
         return true;
+    if (pendingNames.isDeleted(name))
+        return false;
+    if (pendingNames.get(name, data))
+        return true;
 
     /* Note: This does not attempt to cache name queries.  The cache
        only keeps track of changes!  */
@@ -168,6 +180,8 @@ bool CCoinsViewCache::GetName(const valtype &name, CNameData& data) const {
 bool CCoinsViewCache::GetNameHistory(const valtype &name, CNameHistory& data) const {
     if (cacheNames.getHistory(name, data))
         return true;
+    if (pendingNames.getHistory(name, data))
+        return true;
 
     /* Note: This does not attempt to cache backend queries.  The cache
        only keeps track of changes!  */
@@ -182,12 +196,13 @@ bool CCoinsViewCache::GetNamesForHeight(unsigned nHeight, std::set<valtype>& nam
     if (!base->GetNamesForHeight(nHeight, names))
         return false;
 
+    pendingNames.updateNamesForHeight(nHeight, names);
     cacheNames.updateNamesForHeight(nHeight, names);
     return true;
 }
 
 CNameIterator* CCoinsViewCache::IterateNames() const {
-    return cacheNames.iterateNames(base->IterateNames());
+    return cacheNames.iterateNames(pendingNames.iterateNames(base->IterateNames()));
 }
 
 /* undo is set if the change is due to disconnecting blocks / going back in
@@ -264,6 +279,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 entry.coin = std::move(it->second.coin);
                 cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                 entry.flags = CCoinsCacheEntry::DIRTY;
+                entry.nLastUsed = ++nAccessTick;
                 // We can mark it FRESH in the parent if it was FRESH in the child
                 // Otherwise it might have just been flushed from the parent's cache
                 // and already exist in the grandparent
@@ -293,6 +309,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 itUs->second.coin = std::move(it->second.coin);
                 cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                itUs->second.nLastUsed = ++nAccessTick;
                 // NOTE: It is possible the child has a FRESH flag here in
                 // the event the entry we found in the parent is pruned. But
                 // we must not copy that FRESH flag to the parent as that
@@ -313,6 +330,7 @@ bool CCoinsViewCache::Flush() {
     if (hashBlock.IsNull() && cacheCoins.empty() && cacheNames.empty())
         return true;
 
+    assert(!fPartialFlushPending);
     bool fOk = base->BatchWrite(cacheCoins, hashBlock, cacheNames);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
@@ -320,8 +338,97 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+bool CCoinsViewCache::Sync() {
+    /* Same special case as in Flush above.  */
+    if (hashBlock.IsNull() && cacheCoins.empty() && cacheNames.empty())
+        return true;
+
+    CCoinsMap dirty;
+    CNameCache names;
+    BeginPartialFlush(dirty, names);
+    bool fOk = base->BatchWrite(dirty, hashBlock, names);
+    EndPartialFlush();
+    return fOk;
+}
+
+void CCoinsViewCache::BeginPartialFlush(CCoinsMap &dirty, CNameCache &names) {
+    assert(!fPartialFlushPending);
+    dirty.clear();
+    for (auto& entry : cacheCoins) {
+        if (!(entry.second.flags & CCoinsCacheEntry::DIRTY)) {
+            continue;
+        }
+        CCoinsCacheEntry& copy = dirty[entry.first];
+        copy.coin = entry.second.coin;
+        copy.flags = entry.second.flags;
+        // Once the write is committed, the base view has this entry, so
+        // it is neither dirty nor fresh any more.
+        entry.second.flags = 0;
+        if (entry.second.coin.IsSpent()) {
+            pendingSpent.push_back(entry.first);
+        }
+    }
+    names = cacheNames;
+    pendingNames = std::move(cacheNames);
+    cacheNames.clear();
+    fPartialFlushPending = true;
+}
+
+void CCoinsViewCache::EndPartialFlush() {
+    assert(fPartialFlushPending);
+    for (const COutPoint& outpoint : pendingSpent) {
+        CCoinsMap::iterator it = cacheCoins.find(outpoint);
+        // Entries that were modified again in the meantime are kept.
+        if (it != cacheCoins.end() && it->second.flags == 0 && it->second.coin.IsSpent()) {
+            cacheCoins.erase(it);
+        }
+    }
+    pendingSpent.clear();
+    pendingNames.clear();
+    fPartialFlushPending = false;
+}
+
+size_t CCoinsViewCache::EvictLRU(size_t target_usage) {
+    if (fPartialFlushPending || DynamicMemoryUsage() <= target_usage) {
+        return 0;
+    }
+
+    // Estimate how many of the unmodified entries have to go, and find the
+    // access tick below which entries are evicted.
+    std::vector<uint32_t> ticks;
+    for (const auto& entry : cacheCoins) {
+        if (entry.second.flags == 0) {
+            ticks.push_back(entry.second.nLastUsed);
+        }
+    }
+    if (ticks.empty()) {
+        return 0;
+    }
+    const size_t usage = DynamicMemoryUsage();
+    size_t count = (size_t)((double)ticks.size() * (usage - target_usage) / usage) + 1;
+    count = std::min(count, ticks.size());
+    std::nth_element(ticks.begin(), ticks.begin() + (count - 1), ticks.end());
+    const uint32_t threshold = ticks[count - 1];
+
+    size_t evicted = 0;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end() && DynamicMemoryUsage() > target_usage;) {
+        if (it->second.flags == 0 && it->second.nLastUsed <= threshold) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+            ++evicted;
+        } else {
+            ++it;
+        }
+    }
+    return evicted;
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
+    // Entries that are part of a pending partial flush must stay cached.
+    if (fPartialFlushPending) {
+        return;
+    }
     CCoinsMap::iterator it = cacheCoins.find(hash);
     if (it != cacheCoins.end() && it->second.flags == 0) {
         cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
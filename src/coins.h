@@ -105,6 +105,7 @@ struct CCoinsCacheEntry
 {
     Coin coin; // The actual cached data.
     unsigned char flags;
+    uint32_t nLastUsed; // Access tick of the owning cache, used for LRU eviction.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
@@ -116,8 +117,8 @@ struct CCoinsCacheEntry
          */
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() : flags(0), nLastUsed(0) {}
+    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0), nLastUsed(0) {}
 };
 
 typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
@@ -236,6 +237,21 @@ protected:
     /** Name changes cache.  */
     CNameCache cacheNames;
 
+    /**
+     * Name changes handed to an in-flight partial flush.  They are consulted
+     * after cacheNames until the base view has committed them.
+     */
+    CNameCache pendingNames;
+
+    /** Spent entries whose erasure is part of the in-flight partial flush.  */
+    std::vector<COutPoint> pendingSpent;
+
+    /** Whether a partial flush is in flight (see BeginPartialFlush).  */
+    bool fPartialFlushPending;
+
+    /** Monotonic access counter stamped into entries for LRU eviction.  */
+    mutable uint32_t nAccessTick;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -301,6 +317,39 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, but keep
+     * the cache contents.  Written entries are marked clean and spent ones
+     * are dropped afterwards.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Start a non-wiping flush that is committed to the base view by the
+     * caller, possibly from another thread.  Copies of all dirty entries
+     * and the cached name changes are moved into dirty and names, and
+     * the cached entries are marked clean.  Until EndPartialFlush() is
+     * called, no entry is removed from the cache (so that reads never
+     * reach a base view that is only partially written), new entries are
+     * never marked FRESH and name reads also consult the pending changes.
+     */
+    void BeginPartialFlush(CCoinsMap &dirty, CNameCache &names);
+
+    //! Finish a partial flush after the base view has committed it.
+    void EndPartialFlush();
+
+    //! Whether BeginPartialFlush() was called without a matching EndPartialFlush().
+    bool IsPartialFlushPending() const { return fPartialFlushPending; }
+
+    /**
+     * Remove unmodified entries, least recently used first, until the
+     * dynamic memory usage drops to target_usage.  Does nothing while a
+     * partial flush is pending.
+     * @return The number of evicted entries.
+     */
+    size_t EvictLRU(size_t target_usage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
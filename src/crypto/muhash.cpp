@@ -0,0 +1,267 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <limits>
+#include <string.h>
+
+namespace {
+
+using limb_t = Num3072::limb_t;
+using double_limb_t = uint64_t;
+constexpr int LIMBS = Num3072::LIMBS;
+constexpr int LIMB_SIZE = Num3072::LIMB_SIZE;
+constexpr limb_t LIMB_MAX = std::numeric_limits<limb_t>::max();
+/** 2^3072 - 1103717 is the largest 3072-bit safe prime. */
+constexpr limb_t MAX_PRIME_DIFF = 1103717;
+
+/** a += b, returning the carry out of the top limb. b may exceed one limb. */
+limb_t AddSmall(limb_t* a, double_limb_t b)
+{
+    for (int i = 0; i < LIMBS && b != 0; ++i) {
+        const double_limb_t cur = (double_limb_t)a[i] + b;
+        a[i] = (limb_t)cur;
+        b = cur >> LIMB_SIZE;
+    }
+    return (limb_t)b;
+}
+
+/** a += b, returning the carry. */
+limb_t Add(limb_t* a, const limb_t* b)
+{
+    double_limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        const double_limb_t cur = (double_limb_t)a[i] + b[i] + carry;
+        a[i] = (limb_t)cur;
+        carry = cur >> LIMB_SIZE;
+    }
+    return (limb_t)carry;
+}
+
+/** a -= b, returning whether it borrowed. */
+bool Sub(limb_t* a, const limb_t* b)
+{
+    limb_t borrow = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        const double_limb_t cur = (double_limb_t)a[i] - b[i] - borrow;
+        a[i] = (limb_t)cur;
+        borrow = (cur >> LIMB_SIZE) != 0;
+    }
+    return borrow != 0;
+}
+
+int Compare(const limb_t* a, const limb_t* b)
+{
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/** a = (a + top * 2^3072) / 2 */
+void ShiftRight1(limb_t* a, limb_t top)
+{
+    for (int i = 0; i < LIMBS - 1; ++i) {
+        a[i] = (a[i] >> 1) | (a[i + 1] << (LIMB_SIZE - 1));
+    }
+    a[LIMBS - 1] = (a[LIMBS - 1] >> 1) | (top << (LIMB_SIZE - 1));
+}
+
+bool IsSmall(const limb_t* a, limb_t value)
+{
+    if (a[0] != value) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (a[i] != 0) return false;
+    }
+    return true;
+}
+
+struct Modulus {
+    limb_t limbs[LIMBS];
+    Modulus()
+    {
+        limbs[0] = LIMB_MAX - MAX_PRIME_DIFF + 1;
+        for (int i = 1; i < LIMBS; ++i) limbs[i] = LIMB_MAX;
+    }
+};
+
+const Modulus& GetModulus()
+{
+    static const Modulus modulus;
+    return modulus;
+}
+
+/** x = x / 2 (mod p), for x < p. */
+void HalveMod(limb_t* x)
+{
+    if (x[0] & 1) {
+        ShiftRight1(x, Add(x, GetModulus().limbs));
+    } else {
+        ShiftRight1(x, 0);
+    }
+}
+
+/** a = a - b (mod p), for a, b < p. */
+void SubMod(limb_t* a, const limb_t* b)
+{
+    if (Sub(a, b)) Add(a, GetModulus().limbs);
+}
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = ReadLE32(data + 4 * i);
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) limbs[i] = 0;
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= LIMB_MAX - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != LIMB_MAX) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // x - p = x + MAX_PRIME_DIFF - 2^3072, the carry being the 2^3072.
+    AddSmall(limbs, MAX_PRIME_DIFF);
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t t[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            const double_limb_t cur = (double_limb_t)limbs[i] * a.limbs[j] + t[i + j] + carry;
+            t[i + j] = (limb_t)cur;
+            carry = cur >> LIMB_SIZE;
+        }
+        t[i + LIMBS] = (limb_t)carry;
+    }
+
+    // As 2^3072 = MAX_PRIME_DIFF (mod p), lo + hi * 2^3072 = lo + hi * MAX_PRIME_DIFF.
+    double_limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        const double_limb_t cur = (double_limb_t)t[LIMBS + i] * MAX_PRIME_DIFF + t[i] + carry;
+        limbs[i] = (limb_t)cur;
+        carry = cur >> LIMB_SIZE;
+    }
+    // Fold what is left above 2^3072 the same way. Should that wrap around
+    // 2^3072 once more, the result is small, and folding the wrap-around
+    // cannot overflow again.
+    if (AddSmall(limbs, carry * MAX_PRIME_DIFF)) {
+        AddSmall(limbs, MAX_PRIME_DIFF);
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Binary extended Euclidean algorithm, keeping x1 * this = u and
+    // x2 * this = v (mod p) until u or v reaches one.
+    Num3072 x1, x2;
+    limb_t u[LIMBS], v[LIMBS];
+    memcpy(u, limbs, sizeof(u));
+    memcpy(v, GetModulus().limbs, sizeof(v));
+    for (int i = 0; i < LIMBS; ++i) x2.limbs[i] = 0;
+
+    if (IsSmall(u, 0)) return x2;
+
+    while (!IsSmall(u, 1) && !IsSmall(v, 1)) {
+        while (!(u[0] & 1)) {
+            ShiftRight1(u, 0);
+            HalveMod(x1.limbs);
+        }
+        while (!(v[0] & 1)) {
+            ShiftRight1(v, 0);
+            HalveMod(x2.limbs);
+        }
+        if (Compare(u, v) >= 0) {
+            Sub(u, v);
+            SubMod(x1.limbs, x2.limbs);
+        } else {
+            Sub(v, u);
+            SubMod(x2.limbs, x1.limbs);
+        }
+    }
+    return IsSmall(u, 1) ? x1 : x2;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        WriteLE32(out + 4 * i, limbs[i]);
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char expanded[Num3072::BYTE_SIZE];
+    ChaCha20(hash, sizeof(hash)).Output(expanded, sizeof(expanded));
+    return Num3072(expanded);
+}
+
+MuHash3072::MuHash3072(const unsigned char* data, size_t len) : numerator(ToNum3072(data, len))
+{
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(uint256& out)
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out.begin());
+}
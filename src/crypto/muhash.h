@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** A number modulo the prime 2^3072 - 1103717, kept fully reduced. */
+class Num3072
+{
+public:
+    static constexpr size_t BYTE_SIZE = 384;
+    static constexpr int LIMBS = 96;
+    static constexpr int LIMB_SIZE = 32;
+    typedef uint32_t limb_t;
+
+    limb_t limbs[LIMBS];
+
+    /** Construct the number one. */
+    Num3072() { SetToOne(); }
+    /** Construct from little-endian bytes, reduced modulo the prime. */
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    /** this = this * a (mod p) */
+    void Multiply(const Num3072& a);
+    /** this = this * a^-1 (mod p) */
+    void Divide(const Num3072& a);
+    /** The multiplicative inverse (zero for zero). Variable time. */
+    Num3072 GetInverse() const;
+    /** Write as little-endian bytes. */
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char data[BYTE_SIZE];
+        ToBytes(data);
+        s.write((const char*)data, BYTE_SIZE);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char data[BYTE_SIZE];
+        s.read((char*)data, BYTE_SIZE);
+        *this = Num3072(data);
+    }
+
+private:
+    /** Whether the value is at least the modulus. */
+    bool IsOverflow() const;
+    /** Subtract the modulus, for values between it and 2^3072. */
+    void FullReduce();
+};
+
+/**
+ * A rolling hash of a set of byte strings (MuHash3072).
+ *
+ * Each element is hashed to a number modulo a 3072-bit prime and the set is
+ * represented by the product of its elements, so elements can be added and
+ * removed in any order at the cost of one multiplication each. Removals are
+ * accumulated in a separate denominator, which is only inverted (an
+ * expensive operation) by Finalize.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    /** The hash of the empty set. */
+    MuHash3072() {}
+    /** The hash of the set containing just the given element. */
+    MuHash3072(const unsigned char* data, size_t len);
+
+    /** Add an element to the set. */
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    /** Remove an element from the set. */
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    /** Union of two disjoint sets. */
+    MuHash3072& operator*=(const MuHash3072& mul);
+    /** Difference of a set and one of its subsets. */
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    /** The 256-bit hash of the set: SHA256 of the reduced value, in little endian. */
+    void Finalize(uint256& out);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -35,54 +35,68 @@ ProcessUnspent::ProcessUnspent(CWallet* const pwallet, const std::vector<std::st
     LOCK2(cs_main, pwallet->cs_wallet);
 
     pwallet->AvailableCoins(vecOutputs, !include_unsafe, nullptr, nMinimumAmount, nMaximumAmount, nMinimumSumAmount, nMaximumCount, nMinDepth, nMaxDepth);
+    coins.reserve(vecOutputs.size());
     for (const COutput& out : vecOutputs)
     {
-        CTxDestination address;
-        const CScript& scriptPubKey = out.tx->tx->vout[out.i].scriptPubKey;
-        bool fValidAddress = ExtractDestination(scriptPubKey, address);
-
-        if (destinations.size() && (!fValidAddress || !destinations.count(address)))
+        const CTxOut& txout = out.tx->tx->vout[out.i];
+        if (destinations.size())
         {
-            continue;
+            CTxDestination address;
+            if (!ExtractDestination(txout.scriptPubKey, address) || !destinations.count(address))
+            {
+                continue;
+            }
         }
+        coins.push_back(Unspent{COutPoint(out.tx->GetHash(), out.i), txout, out.nDepth, out.fSpendable, out.fSolvable, out.fSafe});
+    }
+    // The JSON entries are only built for the coins getUtxForAmount picks.
+    std::sort(coins.begin(), coins.end(),
+    [](const Unspent& a, const Unspent& b)
+    {
+        return a.nDepth > b.nDepth;
+    });
+}
 
-        UniValue entry(UniValue::VOBJ);
-        entry.pushKV("txid", out.tx->GetHash().GetHex());
-        entry.pushKV("vout", out.i);
+UniValue ProcessUnspent::makeEntry(const Unspent& coin) const
+{
+    LOCK(wallet->cs_wallet);
 
-        if (fValidAddress) 
-        {
-            entry.pushKV("address", EncodeDestination(address));
+    CTxDestination address;
+    const CScript& scriptPubKey = coin.txout.scriptPubKey;
+    bool fValidAddress = ExtractDestination(scriptPubKey, address);
 
-            if (pwallet->mapAddressBook.count(address)) 
-            {
-                entry.pushKV("account", pwallet->mapAddressBook[address].name);
-            }
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKV("txid", coin.outpoint.hash.GetHex());
+    entry.pushKV("vout", (int)coin.outpoint.n);
 
-            if (scriptPubKey.IsPayToScriptHash(true))
+    if (fValidAddress) 
+    {
+        entry.pushKV("address", EncodeDestination(address));
+
+        auto it = wallet->mapAddressBook.find(address);
+        if (it != wallet->mapAddressBook.end()) 
+        {
+            entry.pushKV("account", it->second.name);
+        }
+
+        if (scriptPubKey.IsPayToScriptHash(true))
+        {
+            const CScriptID& hash = boost::get<CScriptID>(address);
+            CScript redeemScript;
+            if (wallet->GetCScript(hash, redeemScript)) 
             {
-                const CScriptID& hash = boost::get<CScriptID>(address);
-                CScript redeemScript;
-                if (pwallet->GetCScript(hash, redeemScript)) 
-                {
-                    entry.pushKV("redeemScript", HexStr(redeemScript.begin(), redeemScript.end()));
-                }
+                entry.pushKV("redeemScript", HexStr(redeemScript.begin(), redeemScript.end()));
             }
         }
-
-        entry.pushKV("scriptPubKey", HexStr(scriptPubKey.begin(), scriptPubKey.end()));
-        entry.pushKV("amount", ValueFromAmount(out.tx->tx->vout[out.i].nValue));
-        entry.pushKV("confirmations", out.nDepth);
-        entry.pushKV("spendable", out.fSpendable);
-        entry.pushKV("solvable", out.fSolvable);
-        entry.pushKV("safe", out.fSafe);
-        entryArray.push_back(entry);
     }
-    std::sort(entryArray.begin(), entryArray.end(),
-    [](const UniValue& a, const UniValue& b)
-    {
-        return a["confirmations"].get_int()> b["confirmations"].get_int();
-    });
+
+    entry.pushKV("scriptPubKey", HexStr(scriptPubKey.begin(), scriptPubKey.end()));
+    entry.pushKV("amount", ValueFromAmount(coin.txout.nValue));
+    entry.pushKV("confirmations", coin.nDepth);
+    entry.pushKV("spendable", coin.fSpendable);
+    entry.pushKV("solvable", coin.fSolvable);
+    entry.pushKV("safe", coin.fSafe);
+    return entry;
 }
 
 ProcessUnspent::~ProcessUnspent() {}
@@ -94,12 +108,13 @@ bool ProcessUnspent::getUtxForAmount(UniValue& utx, const CFeeRate& feeRate, siz
     
     fee=static_cast<double>(feeRate.GetFee(dataSize))/COIN;
 
-    size_t size=entryArray.size();
+    size_t size=coins.size();
     for(size_t i=0;i<size;++i)
     {
         double requiredAmount=amount+fee;
-        amountAvailable+=entryArray[i][std::string("amount")].get_real();
-        utx.push_back(entryArray[i]);
+        UniValue entry=makeEntry(coins[i]);
+        amountAvailable+=entry[std::string("amount")].get_real();
+        utx.push_back(entry);
         if(amountAvailable>=requiredAmount)
         {
             isEnoughAmount=true;
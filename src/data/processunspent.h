@@ -18,8 +18,21 @@ public:
     bool getUtxForAmount(UniValue& utx, const CFeeRate& feeRate, size_t dataSize, double amount, double& fee);
 
 private:
+    /** An available coin, whose JSON entry is built when it is picked. */
+    struct Unspent
+    {
+        COutPoint outpoint;
+        CTxOut txout;
+        int nDepth;
+        bool fSpendable;
+        bool fSolvable;
+        bool fSafe;
+    };
+
+    UniValue makeEntry(const Unspent& coin) const;
+
     CWallet* const wallet;
-    std::vector<UniValue> entryArray;
+    std::vector<Unspent> coins;
 };
 
 double computeFee(const CWallet& wallet, size_t dataSize);
@@ -97,12 +97,15 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static leveldb::Options GetOptions(size_t nCacheSize, const DBTuning& tuning)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    const size_t block_cache_size = nCacheSize / 100 * tuning.block_cache_percent;
+    options.block_cache = leveldb::NewLRUCache(block_cache_size);
+    options.write_buffer_size = (nCacheSize - block_cache_size) / 2; // up to two write buffers may be held in memory simultaneously
+    options.block_size = tuning.block_size;
+    options.block_restart_interval = tuning.block_restart_interval;
+    options.filter_policy = tuning.bloom_bits > 0 ? leveldb::NewBloomFilterPolicy(tuning.bloom_bits) : nullptr;
     options.compression = leveldb::kNoCompression;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -114,15 +117,22 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
-    : m_name(fs::basename(path))
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const DBTuning& tuning)
+    : m_name(fs::basename(path)), m_tuning(tuning)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
+    nofillreadoptions.verify_checksums = true;
+    nofillreadoptions.fill_cache = false;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    for (const DBKeyspace& keyspace : m_tuning.keyspaces) {
+        if (!keyspace.fill_cache) {
+            m_nofill_prefixes.set(static_cast<unsigned char>(keyspace.prefix));
+        }
+    }
+    options = GetOptions(nCacheSize, m_tuning);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -180,6 +190,15 @@ CDBWrapper::~CDBWrapper()
     options.env = nullptr;
 }
 
+CDBSnapshot::CDBSnapshot(const CDBWrapper& db) : pdb(db.pdb), snapshot(db.pdb->GetSnapshot())
+{
+}
+
+CDBSnapshot::~CDBSnapshot()
+{
+    pdb->ReleaseSnapshot(snapshot);
+}
+
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     const bool log_memory = LogAcceptCategory(BCLog::LEVELDB);
@@ -226,6 +245,25 @@ std::vector<unsigned char> CDBWrapper::CreateObfuscateKey() const
 
 }
 
+const DBKeyspace* CDBWrapper::FindKeyspace(const std::string& name) const
+{
+    for (const DBKeyspace& keyspace : m_tuning.keyspaces) {
+        if (keyspace.name == name) return &keyspace;
+    }
+    return nullptr;
+}
+
+void CDBWrapper::Compact(const DBKeyspace* keyspace) const
+{
+    LogPrintf("Starting compaction of %s in %s\n", keyspace ? keyspace->name : "all keyspaces", m_name);
+    if (keyspace) {
+        CompactRange(keyspace->prefix, static_cast<char>(keyspace->prefix + 1));
+    } else {
+        pdb->CompactRange(nullptr, nullptr);
+    }
+    LogPrintf("Finished compaction of %s in %s\n", keyspace ? keyspace->name : "all keyspaces", m_name);
+}
+
 bool CDBWrapper::IsEmpty()
 {
     std::unique_ptr<CDBIterator> it(NewIterator());
@@ -255,4 +293,19 @@ const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w)
     return w.obfuscate_key;
 }
 
+ThreadBuffers& GetThreadBuffers()
+{
+    static thread_local ThreadBuffers buffers;
+    return buffers;
+}
+
+void Xor(std::vector<unsigned char>& buf, const std::vector<unsigned char>& obfuscate_key)
+{
+    if (obfuscate_key.empty()) return;
+    for (size_t i = 0, j = 0; i != buf.size(); i++) {
+        buf[i] ^= obfuscate_key[j++];
+        if (j == obfuscate_key.size()) j = 0;
+    }
+}
+
 } // namespace dbwrapper_private
@@ -16,8 +16,44 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <bitset>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
+//! Buffers grown beyond this size by a large key or value are not kept for reuse
+static const size_t DBWRAPPER_MAX_REUSED_BUFFER_SIZE = 1 << 20;
+
+/**
+ * A logical table of a database: the records whose serialized key starts
+ * with a given prefix byte.
+ */
+struct DBKeyspace
+{
+    std::string name;
+    char prefix;
+    //! Whether point reads fill the block cache. Large records that are read
+    //! rarely should not evict those that are looked up all the time.
+    bool fill_cache;
+
+    DBKeyspace(const std::string& nameIn, char prefixIn, bool fill_cacheIn = true)
+        : name(nameIn), prefix(prefixIn), fill_cache(fill_cacheIn) {}
+};
+
+/** LevelDB tuning of a database, chosen for the access patterns of its keyspaces. */
+struct DBTuning
+{
+    //! Approximate size of the uncompressed data of a table block
+    size_t block_size;
+    //! Number of keys between restart points of the key delta encoding
+    int block_restart_interval;
+    //! Bits per key of the bloom filter, 0 for none
+    int bloom_bits;
+    //! Percentage of the cache size given to the block cache, the rest going to the write buffers
+    int block_cache_percent;
+    std::vector<DBKeyspace> keyspaces;
+
+    DBTuning() : block_size(4096), block_restart_interval(16), bloom_bits(10), block_cache_percent(50) {}
+};
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -41,6 +77,64 @@ void HandleError(const leveldb::Status& status);
  */
 const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w);
 
+/**
+ * Serialization buffers of the calling thread, reused for every key and value
+ * read or written through a CDBWrapper instead of allocating (and wiping on
+ * free) a CDataStream for each of them. Keys and values are not secret, so
+ * the buffers use the default allocator.
+ */
+struct ThreadBuffers
+{
+    std::vector<unsigned char> key;
+    std::vector<unsigned char> value;
+    std::string read;
+
+    ThreadBuffers()
+    {
+        key.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        value.reserve(DBWRAPPER_PREALLOC_VALUE_SIZE);
+    }
+};
+
+ThreadBuffers& GetThreadBuffers();
+
+/** XOR the contents of a buffer with an obfuscation key, as CDataStream::Xor does. */
+void Xor(std::vector<unsigned char>& buf, const std::vector<unsigned char>& obfuscate_key);
+
+/** Free a buffer that an unusually large key or value grew beyond DBWRAPPER_MAX_REUSED_BUFFER_SIZE. */
+template <typename T>
+void TrimBuffer(T& buf)
+{
+    if (buf.capacity() > DBWRAPPER_MAX_REUSED_BUFFER_SIZE) {
+        T().swap(buf);
+    }
+}
+
+/** Serialize an object into a buffer, returning a slice that is valid until the buffer is next used. */
+template <typename T>
+leveldb::Slice SerializeInto(std::vector<unsigned char>& buf, const T& obj)
+{
+    buf.clear();
+    CVectorWriter(SER_DISK, CLIENT_VERSION, buf, 0) << obj;
+    return leveldb::Slice(reinterpret_cast<const char*>(buf.data()), buf.size());
+}
+
+/** Deserialize an object from a copy of a slice in a buffer, after XORing it with an obfuscation key. */
+template <typename T>
+bool DeserializeFrom(std::vector<unsigned char>& buf, const leveldb::Slice& data, const std::vector<unsigned char>& obfuscate_key, T& obj)
+{
+    buf.assign(data.data(), data.data() + data.size());
+    Xor(buf, obfuscate_key);
+    bool ok = true;
+    try {
+        VectorReader(SER_DISK, CLIENT_VERSION, buf, 0) >> obj;
+    } catch (const std::exception&) {
+        ok = false;
+    }
+    TrimBuffer(buf);
+    return ok;
+}
+
 };
 
 /** Batch of changes queued to be written to a CDBWrapper */
@@ -52,16 +146,13 @@ private:
     const CDBWrapper &parent;
     leveldb::WriteBatch batch;
 
-    CDataStream ssKey;
-    CDataStream ssValue;
-
     size_t size_estimate;
 
 public:
     /**
      * @param[in] _parent   CDBWrapper that this batch is to be submitted to
      */
-    explicit CDBBatch(const CDBWrapper &_parent) : parent(_parent), ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), size_estimate(0) { };
+    explicit CDBBatch(const CDBWrapper &_parent) : parent(_parent), size_estimate(0) { };
 
     void Clear()
     {
@@ -72,14 +163,11 @@ public:
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+        dbwrapper_private::ThreadBuffers& buffers = dbwrapper_private::GetThreadBuffers();
+        leveldb::Slice slKey = dbwrapper_private::SerializeInto(buffers.key, key);
 
-        ssValue.reserve(DBWRAPPER_PREALLOC_VALUE_SIZE);
-        ssValue << value;
-        ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
-        leveldb::Slice slValue(ssValue.data(), ssValue.size());
+        leveldb::Slice slValue = dbwrapper_private::SerializeInto(buffers.value, value);
+        dbwrapper_private::Xor(buffers.value, dbwrapper_private::GetObfuscateKey(parent));
 
         batch.Put(slKey, slValue);
         // LevelDB serializes writes as:
@@ -90,8 +178,8 @@ public:
         // - byte[]: value
         // The formula below assumes the key and value are both less than 16k.
         size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
-        ssKey.clear();
-        ssValue.clear();
+        dbwrapper_private::TrimBuffer(buffers.key);
+        dbwrapper_private::TrimBuffer(buffers.value);
     }
 
     /* Write an empty value.  This is used for the expire-index
@@ -99,23 +187,21 @@ public:
     template <typename K>
     void Write(const K& key)
     {
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+        std::vector<unsigned char>& buf = dbwrapper_private::GetThreadBuffers().key;
+        leveldb::Slice slKey = dbwrapper_private::SerializeInto(buf, key);
 
         char dummy;
         leveldb::Slice slValue(&dummy, 0);
 
         batch.Put(slKey, slValue);
-        ssKey.clear();
+        dbwrapper_private::TrimBuffer(buf);
     }
 
     template <typename K>
     void Erase(const K& key)
     {
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+        std::vector<unsigned char>& buf = dbwrapper_private::GetThreadBuffers().key;
+        leveldb::Slice slKey = dbwrapper_private::SerializeInto(buf, key);
 
         batch.Delete(slKey);
         // LevelDB serializes erases as:
@@ -124,7 +210,7 @@ public:
         // - byte[]: key
         // The formula below assumes the key is less than 16kB.
         size_estimate += 2 + (slKey.size() > 127) + slKey.size();
-        ssKey.clear();
+        dbwrapper_private::TrimBuffer(buf);
     }
 
     size_t SizeEstimate() const { return size_estimate; }
@@ -151,36 +237,20 @@ public:
     void SeekToFirst();
 
     template<typename K> void Seek(const K& key) {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
-        piter->Seek(slKey);
+        std::vector<unsigned char>& buf = dbwrapper_private::GetThreadBuffers().key;
+        piter->Seek(dbwrapper_private::SerializeInto(buf, key));
+        dbwrapper_private::TrimBuffer(buf);
     }
 
     void Next();
 
     template<typename K> bool GetKey(K& key) {
-        leveldb::Slice slKey = piter->key();
-        try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            ssKey >> key;
-        } catch (const std::exception&) {
-            return false;
-        }
-        return true;
+        static const std::vector<unsigned char> no_obfuscation;
+        return dbwrapper_private::DeserializeFrom(dbwrapper_private::GetThreadBuffers().key, piter->key(), no_obfuscation, key);
     }
 
     template<typename V> bool GetValue(V& value) {
-        leveldb::Slice slValue = piter->value();
-        try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
-            ssValue >> value;
-        } catch (const std::exception&) {
-            return false;
-        }
-        return true;
+        return dbwrapper_private::DeserializeFrom(dbwrapper_private::GetThreadBuffers().value, piter->value(), dbwrapper_private::GetObfuscateKey(parent), value);
     }
 
     unsigned int GetValueSize() {
@@ -189,9 +259,33 @@ public:
 
 };
 
+class CDBWrapper;
+
+/**
+ * A consistent read-only view of a database as of its creation, which can be
+ * iterated by several iterators (see CDBWrapper::NewIterator) while the
+ * database is written to.
+ */
+class CDBSnapshot
+{
+private:
+    leveldb::DB* pdb;
+    const leveldb::Snapshot* snapshot;
+
+    friend class CDBWrapper;
+
+public:
+    explicit CDBSnapshot(const CDBWrapper& db);
+    ~CDBSnapshot();
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+};
+
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be nullptr in case of default environment)
     leveldb::Env* penv;
@@ -202,6 +296,9 @@ private:
     //! options used when reading from the database
     leveldb::ReadOptions readoptions;
 
+    //! options used when reading from keyspaces that do not fill the block cache
+    leveldb::ReadOptions nofillreadoptions;
+
     //! options used when iterating over values of the database
     leveldb::ReadOptions iteroptions;
 
@@ -217,6 +314,17 @@ private:
     //! the name of this database
     std::string m_name;
 
+    //! the tuning the database was opened with
+    DBTuning m_tuning;
+
+    //! the key prefixes whose point reads do not fill the block cache
+    std::bitset<256> m_nofill_prefixes;
+
+    const leveldb::ReadOptions& GetReadOptions(const leveldb::Slice& slKey) const
+    {
+        return !slKey.empty() && m_nofill_prefixes[static_cast<unsigned char>(slKey[0])] ? nofillreadoptions : readoptions;
+    }
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -236,8 +344,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] tuning      LevelDB options and keyspaces of the database.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const DBTuning& tuning = DBTuning());
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper&) = delete;
@@ -246,27 +355,21 @@ public:
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+        dbwrapper_private::ThreadBuffers& buffers = dbwrapper_private::GetThreadBuffers();
+        leveldb::Slice slKey = dbwrapper_private::SerializeInto(buffers.key, key);
 
-        std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        std::string& strValue = buffers.read;
+        leveldb::Status status = pdb->Get(GetReadOptions(slKey), slKey, &strValue);
+        dbwrapper_private::TrimBuffer(buffers.key);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
-        try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(obfuscate_key);
-            ssValue >> value;
-        } catch (const std::exception&) {
-            return false;
-        }
-        return true;
+        const bool ok = dbwrapper_private::DeserializeFrom(buffers.value, strValue, obfuscate_key, value);
+        dbwrapper_private::TrimBuffer(strValue);
+        return ok;
     }
 
     template <typename K, typename V>
@@ -280,13 +383,12 @@ public:
     template <typename K>
     bool Exists(const K& key) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey << key;
-        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+        dbwrapper_private::ThreadBuffers& buffers = dbwrapper_private::GetThreadBuffers();
+        leveldb::Slice slKey = dbwrapper_private::SerializeInto(buffers.key, key);
 
-        std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(GetReadOptions(slKey), slKey, &buffers.read);
+        dbwrapper_private::TrimBuffer(buffers.key);
+        dbwrapper_private::TrimBuffer(buffers.read);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -326,6 +428,13 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    CDBIterator *NewIterator(const CDBSnapshot& snapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot.snapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
@@ -347,6 +456,20 @@ public:
         return size;
     }
 
+    const DBTuning& GetTuning() const { return m_tuning; }
+
+    //! Find a keyspace of the database by name, returning nullptr if there is none.
+    const DBKeyspace* FindKeyspace(const std::string& name) const;
+
+    //! Get an estimate of the size on disk of a keyspace (in bytes).
+    size_t EstimateKeyspaceSize(const DBKeyspace& keyspace) const
+    {
+        return EstimateSize(keyspace.prefix, static_cast<char>(keyspace.prefix + 1));
+    }
+
+    //! Compact the tables holding a keyspace, or the whole database if keyspace is nullptr.
+    void Compact(const DBKeyspace* keyspace) const;
+
     /**
      * Compact a certain range of keys in the database.
      */
@@ -7,6 +7,7 @@
 #include <chainparams.h>
 #include <httpserver.h>
 #include <key_io.h>
+#include <rpc/jsonwriter.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <random.h>
@@ -84,6 +85,51 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
     req->WriteReply(nStatus, strReply);
 }
 
+/**
+ * Execute a single JSON-RPC request and reply to it. Handlers that support it
+ * stream their result (see StreamRPCResult): once a full chunk of the reply
+ * has been produced, it is sent as a chunked HTTP reply while the rest is
+ * still being written. Errors raised before that get a normal error reply.
+ */
+static void JSONRPCExecStreamed(HTTPRequest* req, JSONRPCRequest& jreq)
+{
+    JSONStreamWriter writer([req](const std::string& strChunk) {
+        if (!req->IsChunkedReply()) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->StartChunkedReply(HTTP_OK);
+        }
+        req->WriteReplyChunk(strChunk);
+    });
+    writer.BeginObject();
+    writer.Key("result");
+    jreq.resultWriter = &writer;
+
+    UniValue error;
+    try {
+        UniValue result = tableRPC.execute(jreq);
+        if (writer.IsKeyPending()) writer.Value(result);
+    } catch (const UniValue& objError) {
+        if (!writer.HasFlushed()) throw;
+        // The reply is already under way, so the error can only be reported
+        // in it, next to what was produced of the result.
+        LogPrintf("JSON-RPC %s failed while streaming its result\n", SanitizeString(jreq.strMethod));
+        writer.Unwind(1);
+        error = objError;
+    }
+    writer.Pair("error", error);
+    writer.Pair("id", jreq.id);
+    writer.EndObject();
+    const std::string strTail = writer.TakeBuffer() + "\n";
+
+    if (req->IsChunkedReply()) {
+        req->WriteReplyChunk(strTail);
+        req->EndChunkedReply();
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strTail);
+    }
+}
+
 //This function checks username and password against -rpcauth
 //entries from config file.
 static bool multiUserAuthorized(std::string strUserPass)
@@ -183,25 +229,22 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 
         // Set the URI
         jreq.URI = req->GetURI();
+        jreq.nTimeReceived = req->GetTimeReceived();
 
-        std::string strReply;
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq);
-
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            JSONRPCExecStreamed(req, jreq);
 
         // array of requests
-        } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(jreq, valRequest.get_array());
-        else
-            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+        } else if (valRequest.isArray()) {
+            std::string strReply = JSONRPCExecBatch(jreq, valRequest.get_array());
 
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, strReply);
+        } else
+            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
     } catch (const UniValue& objError) {
         JSONErrorReply(req, objError, jreq.id);
         return false;
@@ -20,6 +20,9 @@ void InterruptHTTPRPC();
  */
 void StopHTTPRPC();
 
+/** Default for -restmetrics, serving the RPC statistics to Prometheus at /rest/metrics */
+static const bool DEFAULT_REST_METRICS = false;
+
 /** Start HTTP REST subsystem.
  * Precondition; HTTP and RPC has been started.
  */
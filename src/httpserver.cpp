@@ -13,6 +13,7 @@
 #include <sync.h>
 #include <ui_interface.h>
 
+#include <atomic>
 #include <memory>
 #include <stdio.h>
 #include <stdlib.h>
@@ -96,6 +97,16 @@ public:
         cond.notify_one();
         return true;
     }
+    /** Number of items waiting for a thread */
+    size_t Depth()
+    {
+        LOCK(cs);
+        return queue.size();
+    }
+    size_t MaxDepth() const
+    {
+        return maxDepth;
+    }
     /** Thread function */
     void Run()
     {
@@ -144,6 +155,8 @@ struct evhttp* eventHTTP = nullptr;
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = nullptr;
+//! Number of requests rejected because the work queue was full
+static std::atomic<uint64_t> g_work_queue_rejected{0};
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
@@ -263,6 +276,7 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
         if (workQueue->Enqueue(item.get()))
             item.release(); /* if true, queue took ownership */
         else {
+            ++g_work_queue_rejected;
             LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
         }
@@ -496,6 +510,16 @@ struct event_base* EventBase()
     return eventBase;
 }
 
+HTTPWorkQueueStats GetHTTPWorkQueueStats()
+{
+    HTTPWorkQueueStats stats{0, 0, g_work_queue_rejected.load()};
+    if (workQueue) {
+        stats.nDepth = workQueue->Depth();
+        stats.nMaxDepth = workQueue->MaxDepth();
+    }
+    return stats;
+}
+
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
 {
     // Static handler: simply call inner handler
@@ -523,11 +547,16 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       nTimeReceived(GetTimeMicros())
 {
 }
 HTTPRequest::~HTTPRequest()
 {
+    if (chunkedReply && !replySent) {
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    }
     if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
@@ -574,6 +603,22 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** Re-enable reading from the socket once a reply has been sent. This is the
+ * second part of the libevent workaround in http_request_cb.
+ */
+static void http_reply_sent(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -589,17 +634,77 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
+        http_reply_sent(req_copy);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+/** State of a chunked reply, only accessed from the main http thread once the
+ * reply has started.
+ */
+struct HTTPChunkedReply
+{
+    struct evhttp_request* req;
+    /** Set when the connection was closed, after which req is freed by libevent. */
+    bool closed;
+
+    explicit HTTPChunkedReply(struct evhttp_request* reqIn) : req(reqIn), closed(false) {}
+};
+
+static void http_chunked_reply_closed(struct evhttp_connection* conn, void* arg)
+{
+    static_cast<HTTPChunkedReply*>(arg)->closed = true;
+}
+
+/* Like replies, chunks must be sent from the main http thread. Events are
+ * handled in the order they are triggered, so the chunks arrive in order.
+ */
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && !chunkedReply && req);
+    chunkedReply = std::make_shared<HTTPChunkedReply>(req);
+    auto reply = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [reply, nStatus]{
+        evhttp_connection* conn = evhttp_request_get_connection(reply->req);
+        if (conn) {
+            evhttp_connection_set_closecb(conn, http_chunked_reply_closed, reply.get());
+        }
+        evhttp_send_reply_start(reply->req, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && chunkedReply);
+    if (strChunk.empty()) return; // an empty chunk would end the reply
+    auto reply = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [reply, strChunk]{
+        if (reply->closed) return;
+        struct evbuffer* evb = evbuffer_new();
+        evbuffer_add(evb, strChunk.data(), strChunk.size());
+        evhttp_send_reply_chunk(reply->req, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(!replySent && chunkedReply);
+    auto reply = chunkedReply;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [reply]{
+        if (reply->closed) return;
+        evhttp_connection* conn = evhttp_request_get_connection(reply->req);
+        if (conn) {
+            evhttp_connection_set_closecb(conn, nullptr, nullptr);
         }
+        // Reading is re-enabled first, as ending the reply may free the
+        // request right away. Nothing is read before this event returns.
+        http_reply_sent(reply->req);
+        evhttp_send_reply_end(reply->req);
     });
     ev->trigger(nullptr);
     replySent = true;
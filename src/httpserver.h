@@ -5,6 +5,7 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <memory>
 #include <string>
 #include <stdint.h>
 #include <functional>
@@ -17,6 +18,7 @@ struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPChunkedReply;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -36,6 +38,20 @@ void StopHTTPServer();
  * libevent doesn't support debug logging.*/
 bool UpdateHTTPServerLogging(bool enable);
 
+/** State of the work queue of the HTTP server (-rpcworkqueue). */
+struct HTTPWorkQueueStats
+{
+    /** Requests waiting for a worker thread */
+    size_t nDepth;
+    /** Maximum number of waiting requests */
+    size_t nMaxDepth;
+    /** Requests rejected because the queue was full, since startup */
+    uint64_t nRejected;
+};
+
+/** Get the state of the HTTP work queue. All zero if the server is not running. */
+HTTPWorkQueueStats GetHTTPWorkQueueStats();
+
 /** Handler for requests to a certain HTTP path */
 typedef std::function<bool(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
 /** Register handler for prefix.
@@ -59,6 +75,9 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    int64_t nTimeReceived;
+    /** State shared with the main http thread while a chunked reply is in progress. */
+    std::shared_ptr<HTTPChunkedReply> chunkedReply;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req);
@@ -76,6 +95,10 @@ public:
      */
     std::string GetURI() const;
 
+    /** Get the time the request was received, in microseconds (GetTimeMicros).
+     */
+    int64_t GetTimeReceived() const { return nTimeReceived; }
+
     /** Get CService (address:ip) for the origin of the http request.
      */
     CService GetPeer() const;
@@ -114,6 +137,22 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply, for bodies that are produced incrementally.
+     * Headers must be written before this. The body is then sent with
+     * WriteReplyChunk and completed with EndChunkedReply; after the latter,
+     * the same restrictions apply as after WriteReply.
+     *
+     * @note Chunks are queued to the main http thread without waiting for
+     * the client to receive them, so a slow client never blocks the caller.
+     */
+    void StartChunkedReply(int nStatus);
+    void WriteReplyChunk(const std::string& strChunk);
+    void EndChunkedReply();
+
+    /** Whether StartChunkedReply has been called. */
+    bool IsChunkedReply() const { return chunkedReply != nullptr; }
 };
 
 /** Event handler closure.
@@ -60,7 +60,12 @@ bool BaseIndex::Init()
     }
 
     LOCK(cs_main);
-    m_best_block_index = FindForkInGlobalIndex(chainActive, locator);
+    if (locator.IsNull()) {
+        // Nothing is indexed yet, not even the genesis block
+        m_best_block_index = nullptr;
+    } else {
+        m_best_block_index = FindForkInGlobalIndex(chainActive, locator);
+    }
     m_synced = m_best_block_index.load() == chainActive.Tip();
     return true;
 }
@@ -246,7 +251,7 @@ bool BaseIndex::BlockUntilSyncedToCurrentChain()
     }
 
     LogPrintf("%s: %s is catching up on block notifications\n", __func__, GetName());
-    SyncWithValidationInterfaceQueue();
+    SyncWithValidationInterfaceQueue(*this);
     return true;
 }
 
@@ -259,7 +264,7 @@ void BaseIndex::Start()
 {
     // Need to register this ValidationInterface before running Init(), so that
     // callbacks are not missed if Init sets m_synced to true.
-    RegisterValidationInterface(this);
+    RegisterValidationInterface(this, GetName());
     if (!Init()) {
         FatalError("%s: %s failed to initialize", __func__, GetName());
         return;
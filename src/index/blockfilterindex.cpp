@@ -0,0 +1,226 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockfilterindex.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+/* The index database stores three items for each block: the encoded filter,
+ * its dSHA256 hash, and the header. Entries are indexed by block hash, so
+ * that the data of any block that becomes part of the active chain can
+ * always be retrieved, regardless of reorganisations.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+
+namespace {
+
+struct DBVal {
+    uint256 hash;
+    uint256 header;
+    std::vector<unsigned char> encoded_filter;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hash);
+        READWRITE(header);
+        READWRITE(encoded_filter);
+    }
+};
+
+} // namespace
+
+static std::map<BlockFilterType, BlockFilterIndex> g_filter_indexes;
+
+/**
+ * Access to a block filter index database (indexes/blockfilter/<type>/)
+ *
+ * Filters are stored by block hash together with their hash and header. The
+ * database also stores the block locator of the chain it is synced to, as
+ * for the other indexes.
+ */
+class BlockFilterIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(const fs::path& path, size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Read the filter entry of the block with the given hash.
+    bool ReadFilter(const uint256& block_hash, DBVal& value) const;
+
+    /// Write the filter entry of the block with the given hash.
+    bool WriteFilter(const uint256& block_hash, const DBVal& value);
+
+    /// Read the filter entries of the blocks from start_height up to stop_index,
+    /// together with the block hashes.
+    bool ReadFilterRange(int start_height, const CBlockIndex* stop_index,
+                         std::vector<std::pair<uint256, DBVal>>& values) const;
+};
+
+BlockFilterIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(path, n_cache_size, f_memory, f_wipe)
+{}
+
+bool BlockFilterIndex::DB::ReadFilter(const uint256& block_hash, DBVal& value) const
+{
+    return Read(std::make_pair(DB_BLOCK_HASH, block_hash), value);
+}
+
+bool BlockFilterIndex::DB::WriteFilter(const uint256& block_hash, const DBVal& value)
+{
+    return Write(std::make_pair(DB_BLOCK_HASH, block_hash), value);
+}
+
+bool BlockFilterIndex::DB::ReadFilterRange(int start_height, const CBlockIndex* stop_index,
+                                           std::vector<std::pair<uint256, DBVal>>& values) const
+{
+    if (start_height < 0) {
+        return error("%s: start height (%d) is negative", __func__, start_height);
+    }
+    if (start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is greater than stop height (%d)",
+                     __func__, start_height, stop_index->nHeight);
+    }
+
+    values.resize(stop_index->nHeight - start_height + 1);
+    const CBlockIndex* block_index = stop_index;
+    for (auto it = values.rbegin(); it != values.rend(); ++it) {
+        it->first = block_index->GetBlockHash();
+        if (!ReadFilter(it->first, it->second)) {
+            return error("%s: filter of block %s at height %d not found",
+                         __func__, block_index->GetBlockHash().ToString(), block_index->nHeight);
+        }
+        block_index = block_index->pprev;
+    }
+    return true;
+}
+
+BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type,
+                                   size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_filter_type(filter_type)
+{
+    const std::string& filter_name = BlockFilterTypeName(filter_type);
+    if (filter_name.empty()) throw std::invalid_argument("unknown filter_type");
+
+    m_name = filter_name + " block filter index";
+    m_db = MakeUnique<BlockFilterIndex::DB>(GetDataDir() / "indexes" / "blockfilter" / filter_name,
+                                            n_cache_size, f_memory, f_wipe);
+}
+
+BlockFilterIndex::~BlockFilterIndex() {}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    uint256 prev_header;
+
+    if (pindex->nHeight > 0) {
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+
+        DBVal prev_value;
+        if (!m_db->ReadFilter(pindex->pprev->GetBlockHash(), prev_value)) {
+            return error("%s: filter of previous block %s not found",
+                         __func__, pindex->pprev->GetBlockHash().ToString());
+        }
+        prev_header = prev_value.header;
+    }
+
+    BlockFilter filter(m_filter_type, block, block_undo);
+
+    DBVal value;
+    value.hash = filter.GetHash();
+    value.header = filter.ComputeHeader(prev_header);
+    value.encoded_filter = filter.GetEncodedFilter();
+    return m_db->WriteFilter(pindex->GetBlockHash(), value);
+}
+
+BaseIndex::DB& BlockFilterIndex::GetDB() const { return *m_db; }
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
+{
+    DBVal value;
+    if (!m_db->ReadFilter(block_index->GetBlockHash(), value)) {
+        return false;
+    }
+
+    filter_out = BlockFilter(m_filter_type, block_index->GetBlockHash(), std::move(value.encoded_filter));
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
+{
+    DBVal value;
+    if (!m_db->ReadFilter(block_index->GetBlockHash(), value)) {
+        return false;
+    }
+
+    header_out = value.header;
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* stop_index,
+                                         std::vector<BlockFilter>& filters_out) const
+{
+    std::vector<std::pair<uint256, DBVal>> values;
+    if (!m_db->ReadFilterRange(start_height, stop_index, values)) {
+        return false;
+    }
+
+    filters_out.clear();
+    filters_out.reserve(values.size());
+    for (auto& entry : values) {
+        filters_out.emplace_back(m_filter_type, entry.first, std::move(entry.second.encoded_filter));
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHeaderRange(int start_height, const CBlockIndex* stop_index,
+                                               std::vector<uint256>& headers_out) const
+{
+    std::vector<std::pair<uint256, DBVal>> values;
+    if (!m_db->ReadFilterRange(start_height, stop_index, values)) {
+        return false;
+    }
+
+    headers_out.clear();
+    headers_out.reserve(values.size());
+    for (const auto& entry : values) {
+        headers_out.push_back(entry.second.header);
+    }
+    return true;
+}
+
+BlockFilterIndex* GetBlockFilterIndex(BlockFilterType filter_type)
+{
+    auto it = g_filter_indexes.find(filter_type);
+    return it != g_filter_indexes.end() ? &it->second : nullptr;
+}
+
+void ForEachBlockFilterIndex(std::function<void (BlockFilterIndex&)> fn)
+{
+    for (auto& entry : g_filter_indexes) fn(entry.second);
+}
+
+bool InitBlockFilterIndex(BlockFilterType filter_type,
+                          size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    auto result = g_filter_indexes.emplace(std::piecewise_construct,
+                                           std::forward_as_tuple(filter_type),
+                                           std::forward_as_tuple(filter_type,
+                                                                 n_cache_size, f_memory, f_wipe));
+    return result.second;
+}
+
+bool DestroyBlockFilterIndex(BlockFilterType filter_type)
+{
+    return g_filter_indexes.erase(filter_type);
+}
+
+void DestroyAllBlockFilterIndexes()
+{
+    g_filter_indexes.clear();
+}
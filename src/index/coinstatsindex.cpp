@@ -0,0 +1,318 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+
+#include <chainparams.h>
+#include <coins.h>
+#include <games/modulo/moduloverify.h>
+#include <script/names.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+#include <map>
+
+/* The index database stores the statistics of each block by block hash, and
+ * the MuHash of the UTXO set after the last indexed block, which is written
+ * together with the block's statistics. Unlike the statistics, the MuHash
+ * state (numerator and denominator) is too large to be kept for every block.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_MUHASH = 'M';
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+/**
+ * Access to the coin stats index database (indexes/coinstats/)
+ */
+class CoinStatsIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Read the statistics after the block with the given hash.
+    bool ReadStats(const uint256& block_hash, CoinStatsEntry& stats) const;
+
+    /// Read the MuHash of the UTXO set and the block it belongs to.
+    bool ReadMuHash(uint256& block_hash, MuHash3072& muhash) const;
+
+    /// Write the statistics of a block together with the MuHash of the UTXO set after it.
+    bool WriteBlock(const uint256& block_hash, const CoinStatsEntry& stats, const MuHash3072& muhash);
+};
+
+CoinStatsIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "coinstats", n_cache_size, f_memory, f_wipe)
+{}
+
+bool CoinStatsIndex::DB::ReadStats(const uint256& block_hash, CoinStatsEntry& stats) const
+{
+    return Read(std::make_pair(DB_BLOCK_HASH, block_hash), stats);
+}
+
+bool CoinStatsIndex::DB::ReadMuHash(uint256& block_hash, MuHash3072& muhash) const
+{
+    std::pair<uint256, MuHash3072> value;
+    if (!Read(DB_MUHASH, value)) return false;
+    block_hash = value.first;
+    muhash = value.second;
+    return true;
+}
+
+bool CoinStatsIndex::DB::WriteBlock(const uint256& block_hash, const CoinStatsEntry& stats, const MuHash3072& muhash)
+{
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_BLOCK_HASH, block_hash), stats);
+    batch.Write(DB_MUHASH, std::make_pair(block_hash, muhash));
+    return WriteBatch(batch);
+}
+
+static void CoinHashElement(CDataStream& ss, const COutPoint& outpoint, const Coin& coin)
+{
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 2 + (coin.fCoinBase ? 1u : 0u));
+    ss << coin.out;
+}
+
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    CoinHashElement(ss, outpoint, coin);
+    muhash.Insert((const unsigned char*)ss.data(), ss.size());
+}
+
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    CoinHashElement(ss, outpoint, coin);
+    muhash.Remove((const unsigned char*)ss.data(), ss.size());
+}
+
+namespace {
+
+/** Applies the coins a block creates and spends to a MuHash and the statistics. */
+class CoinStatsUpdater
+{
+private:
+    MuHash3072& m_muhash;
+    CoinStatsEntry& m_stats;
+
+    /** Blocks read to find the outpoints of expired name coins, by height. */
+    std::map<int, CBlock> m_blocks;
+
+    void Update(const COutPoint& outpoint, const Coin& coin, bool fAdd)
+    {
+        if (fAdd) {
+            ApplyCoinHash(m_muhash, outpoint, coin);
+        } else {
+            RemoveCoinHash(m_muhash, outpoint, coin);
+        }
+
+        const uint64_t bogo_size = 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+                                   2 /* scriptPubKey len */ + coin.out.scriptPubKey.size() /* scriptPubKey */;
+        const uint64_t serialized_size = ::GetSerializeSize(coin, PROTOCOL_VERSION);
+        const CNameScript nameOp(coin.out.scriptPubKey);
+        CAmount& amount = nameOp.isNameOp() ? m_stats.nNameAmount : m_stats.nCoinAmount;
+        const uint64_t names = nameOp.isNameOp() && nameOp.isAnyUpdate() ? 1 : 0;
+
+        if (fAdd) {
+            m_stats.nTransactionOutputs++;
+            m_stats.nBogoSize += bogo_size;
+            m_stats.nSerializedSize += serialized_size;
+            m_stats.nNames += names;
+            amount += coin.out.nValue;
+        } else {
+            m_stats.nTransactionOutputs--;
+            m_stats.nBogoSize -= bogo_size;
+            m_stats.nSerializedSize -= serialized_size;
+            m_stats.nNames -= names;
+            amount -= coin.out.nValue;
+        }
+    }
+
+    /**
+     * The undo data of expired name coins does not record their outpoint. It
+     * is the output of the block that created the coin with the same script
+     * and value; should the name have been updated more than once in that
+     * block, the last of these outputs, as the others are spent by it.
+     */
+    bool FindExpiredOutpoint(const CBlockIndex* pindex, const Coin& coin, COutPoint& outpoint)
+    {
+        const CBlockIndex* pindex_coin = pindex->GetAncestor(coin.nHeight);
+        if (!pindex_coin) {
+            return error("%s: expired name coin of block %s has invalid height %d",
+                         __func__, pindex->GetBlockHash().ToString(), coin.nHeight);
+        }
+        auto it = m_blocks.find(coin.nHeight);
+        if (it == m_blocks.end()) {
+            it = m_blocks.emplace(coin.nHeight, CBlock()).first;
+            if (!ReadBlockFromDisk(it->second, pindex_coin, Params().GetConsensus())) {
+                return error("%s: failed to read block %s", __func__, pindex_coin->GetBlockHash().ToString());
+            }
+        }
+
+        bool found = false;
+        for (const CTransactionRef& tx : it->second.vtx) {
+            for (size_t o = 0; o < tx->vout.size(); ++o) {
+                if (tx->vout[o] == coin.out) {
+                    outpoint = COutPoint(tx->GetHash(), o);
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            return error("%s: expired name coin not found in block %s",
+                         __func__, pindex_coin->GetBlockHash().ToString());
+        }
+        return true;
+    }
+
+public:
+    CoinStatsUpdater(MuHash3072& muhash, CoinStatsEntry& stats) : m_muhash(muhash), m_stats(stats) {}
+
+    /**
+     * Add the coins created by the block and remove those it spends, or
+     * the other way around when disconnecting it. This mirrors ConnectBlock:
+     * payout (getbet) and message transactions spend no coins, unspendable
+     * outputs are not coins, and expired name coins are spent at the end of
+     * the block.
+     */
+    bool ApplyBlock(const CBlock& block, const CBlockUndo& block_undo, const CBlockIndex* pindex, bool fConnect)
+    {
+        if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: block %s and undo data inconsistent", __func__, pindex->GetBlockHash().ToString());
+        }
+
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            const CTransaction& tx = *block.vtx[i];
+            const uint256& hash = tx.GetHash();
+            for (size_t o = 0; o < tx.vout.size(); ++o) {
+                if (tx.vout[o].scriptPubKey.IsUnspendable()) continue;
+                Update(COutPoint(hash, o), Coin(tx.vout[o], pindex->nHeight, tx.IsCoinBase()), fConnect);
+            }
+
+            if (i == 0 || modulo::ver_2::isGetBetTx(tx) || tx.IsMsgTx()) continue;
+            const CTxUndo& txundo = block_undo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size()) {
+                return error("%s: transaction %s and undo data inconsistent", __func__, hash.ToString());
+            }
+            for (size_t j = 0; j < tx.vin.size(); ++j) {
+                Update(tx.vin[j].prevout, txundo.vprevout[j], !fConnect);
+            }
+        }
+
+        for (const Coin& coin : block_undo.vexpired) {
+            COutPoint outpoint;
+            if (!FindExpiredOutpoint(pindex, coin, outpoint)) return false;
+            Update(outpoint, coin, !fConnect);
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<CoinStatsIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+CoinStatsIndex::~CoinStatsIndex() {}
+
+bool CoinStatsIndex::Init()
+{
+    uint256 muhash_block;
+    if (m_db->ReadMuHash(muhash_block, m_muhash)) {
+        LOCK(cs_main);
+        m_muhash_block = LookupBlockIndex(muhash_block);
+        if (!m_muhash_block) {
+            return error("%s: block %s of the UTXO set hash not found", __func__, muhash_block.ToString());
+        }
+    }
+    return BaseIndex::Init();
+}
+
+bool CoinStatsIndex::RewindMuHash(const CBlockIndex* target)
+{
+    if (!m_muhash_block || m_muhash_block->GetAncestor(target->nHeight) != target) {
+        return error("%s: cannot move the UTXO set hash to block %s", __func__, target->GetBlockHash().ToString());
+    }
+
+    // Only the MuHash is moved; the statistics are read from the target's entry.
+    MuHash3072 muhash(m_muhash);
+    CoinStatsEntry stats;
+    CoinStatsUpdater updater(muhash, stats);
+    for (const CBlockIndex* pindex = m_muhash_block; pindex != target; pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()) ||
+            !UndoReadFromDisk(block_undo, pindex)) {
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!updater.ApplyBlock(block, block_undo, pindex, false)) return false;
+    }
+
+    m_muhash = muhash;
+    m_muhash_block = target;
+    return true;
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CoinStatsEntry stats;
+    // The outputs of the genesis block are not part of the UTXO set.
+    MuHash3072 muhash;
+
+    if (pindex->nHeight > 0) {
+        if (m_muhash_block != pindex->pprev && !RewindMuHash(pindex->pprev)) {
+            return false;
+        }
+        if (!m_db->ReadStats(pindex->pprev->GetBlockHash(), stats)) {
+            return error("%s: statistics of previous block %s not found",
+                         __func__, pindex->pprev->GetBlockHash().ToString());
+        }
+
+        CBlockUndo block_undo;
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+        muhash = m_muhash;
+        CoinStatsUpdater updater(muhash, stats);
+        if (!updater.ApplyBlock(block, block_undo, pindex, true)) {
+            return false;
+        }
+    }
+
+    // The winning bets of a block are paid out by the next block.
+    stats.nPendingPayouts = 0;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (modulo::ver_2::isMakeBetTx(*tx)) {
+            for (const CTxOut& out : tx->vout) {
+                if (out.scriptPubKey.IsUnspendable()) stats.nTotalBets += out.nValue;
+            }
+            modulo::ver_2::MakeBetWinningProcess winningProcess(*tx, pindex->GetBlockHash());
+            if (winningProcess.isMakeBetWinning()) {
+                stats.nPendingPayouts += winningProcess.getMakeBetPayoff();
+            }
+        } else if (modulo::ver_2::isGetBetTx(*tx)) {
+            stats.nTotalPayouts += tx->GetValueOut();
+        }
+    }
+
+    MuHash3072 finalized(muhash);
+    finalized.Finalize(stats.muhash);
+
+    if (!m_db->WriteBlock(pindex->GetBlockHash(), stats, muhash)) {
+        return error("%s: failed to write statistics of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    m_muhash = muhash;
+    m_muhash_block = pindex;
+    return true;
+}
+
+BaseIndex::DB& CoinStatsIndex::GetDB() const { return *m_db; }
+
+bool CoinStatsIndex::LookupStats(const CBlockIndex* block_index, CoinStatsEntry& stats) const
+{
+    return m_db->ReadStats(block_index->GetBlockHash(), stats);
+}
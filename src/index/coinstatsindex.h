@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_COINSTATSINDEX_H
+#define BITCOIN_INDEX_COINSTATSINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <crypto/muhash.h>
+#include <index/base.h>
+#include <serialize.h>
+#include <uint256.h>
+
+class Coin;
+class COutPoint;
+
+/** Statistics on the UTXO set after a block, and on the bets up to that block. */
+struct CoinStatsEntry
+{
+    /** MuHash of the UTXO set (see ApplyCoinHash). */
+    uint256 muhash;
+    uint64_t nTransactionOutputs{0};
+    uint64_t nBogoSize{0};
+    /** Total size of the coins as serialized in the chain state database. */
+    uint64_t nSerializedSize{0};
+    /** Amount in coins that are not name operations. */
+    CAmount nCoinAmount{0};
+    /** Number of coins holding an active name (name_firstupdate and name_update outputs). */
+    uint64_t nNames{0};
+    /** Amount locked in coins that are name operations, including name_new. */
+    CAmount nNameAmount{0};
+    /** Amount placed in bets up to the block. */
+    CAmount nTotalBets{0};
+    /** Amount paid out for winning bets up to the block. */
+    CAmount nTotalPayouts{0};
+    /** Payoff of the winning bets of the block, which the next block pays out. */
+    CAmount nPendingPayouts{0};
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(muhash);
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nBogoSize));
+        READWRITE(VARINT(nSerializedSize));
+        READWRITE(VARINT(nCoinAmount, VarIntMode::NONNEGATIVE_SIGNED));
+        READWRITE(VARINT(nNames));
+        READWRITE(VARINT(nNameAmount, VarIntMode::NONNEGATIVE_SIGNED));
+        READWRITE(VARINT(nTotalBets, VarIntMode::NONNEGATIVE_SIGNED));
+        READWRITE(VARINT(nTotalPayouts, VarIntMode::NONNEGATIVE_SIGNED));
+        READWRITE(VARINT(nPendingPayouts, VarIntMode::NONNEGATIVE_SIGNED));
+    }
+};
+
+/** Add a coin to the MuHash of a UTXO set. */
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+/** Remove a coin from the MuHash of a UTXO set. */
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+/**
+ * CoinStatsIndex maintains statistics on the UTXO set for every block, so
+ * that gettxoutsetinfo does not need to scan the chain state. The statistics
+ * of a block are derived from those of its parent with the block and its undo
+ * data. Entries are keyed by block hash, like those of the block filter
+ * index, so that a reorganisation leaves the entries of the disconnected
+ * blocks behind.
+ *
+ * The MuHash of the UTXO set is only kept in full for the last indexed
+ * block; after a reorganisation it is moved back to the fork point by
+ * removing the coins created by the disconnected blocks and restoring those
+ * they spent.
+ */
+class CoinStatsIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    std::unique_ptr<DB> m_db;
+
+    /** MuHash of the UTXO set after m_muhash_block. */
+    MuHash3072 m_muhash;
+    const CBlockIndex* m_muhash_block{nullptr};
+
+    /** Move m_muhash back to the given ancestor of m_muhash_block. */
+    bool RewindMuHash(const CBlockIndex* target);
+
+protected:
+    bool Init() override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "coinstatsindex"; }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~CoinStatsIndex() override;
+
+    /** Get the statistics after a block. */
+    bool LookupStats(const CBlockIndex* block_index, CoinStatsEntry& stats) const;
+};
+
+/// The global UTXO set statistics index, used by gettxoutsetinfo. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+#endif // BITCOIN_INDEX_COINSTATSINDEX_H
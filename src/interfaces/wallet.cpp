@@ -413,15 +413,16 @@ public:
     }
     WalletBalances getBalances() override
     {
+        const WalletBalance balance = m_wallet.GetBalances();
         WalletBalances result;
-        result.balance = m_wallet.GetBalance();
-        result.unconfirmed_balance = m_wallet.GetUnconfirmedBalance();
-        result.immature_balance = m_wallet.GetImmatureBalance();
+        result.balance = balance.m_mine_trusted;
+        result.unconfirmed_balance = balance.m_mine_untrusted_pending;
+        result.immature_balance = balance.m_mine_immature;
         result.have_watch_only = m_wallet.HaveWatchOnly();
         if (result.have_watch_only) {
-            result.watch_only_balance = m_wallet.GetBalance(ISMINE_WATCH_ONLY);
-            result.unconfirmed_watch_only_balance = m_wallet.GetUnconfirmedWatchOnlyBalance();
-            result.immature_watch_only_balance = m_wallet.GetImmatureWatchOnlyBalance();
+            result.watch_only_balance = balance.m_watchonly_trusted;
+            result.unconfirmed_watch_only_balance = balance.m_watchonly_untrusted_pending;
+            result.immature_watch_only_balance = balance.m_watchonly_immature;
         }
         return result;
     }
@@ -31,6 +31,8 @@
 #include <queue>
 #include <utility>
 
+#include <boost/bind.hpp>
+
 #include <games/modulo/moduloverify.h>
 
 // Unconfirmed transactions in the memory pool often depend on other
@@ -61,7 +63,7 @@ BlockAssembler::Options::Options() {
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
 }
 
-BlockAssembler::BlockAssembler(const CChainParams& params, const Options& options) : chainparams(params)
+BlockAssembler::BlockAssembler(const CChainParams& params, const Options& options) : pblock(nullptr), chainparams(params), pindexPrev(nullptr)
 {
     blockMinFeeRate = options.blockMinFeeRate;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
@@ -98,6 +100,12 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+
+    nBlockBets = 0;
+    nBlockPotentialWin = 0;
+    nBlockNameNew = 0;
+    setBlockLockIds.clear();
+    nBlockNames = 0;
 }
 
 static std::string random_string( size_t length )
@@ -133,7 +141,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     LOCK2(cs_main, mempool.cs);
 
-    CBlockIndex* pindexPrev = chainActive.Tip();
+    pindexPrev = chainActive.Tip();
     assert(pindexPrev != nullptr);
     
     CBlock prevBlock;
@@ -174,7 +182,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
 
-    CAmount getBetFee = 0;
+    txGetBet.reset();
     if (makeBets.size() > 0) 
     {
         CMutableTransaction getBetTx;
@@ -201,26 +209,106 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         
         if(hasWinningBets)
         {
-            int64_t sigOpCost= WITNESS_SCALE_FACTOR * GetLegacySigOpCount(CTransaction(getBetTx));
-            nBlockSigOpsCost += sigOpCost;
-            pblocktemplate->vTxSigOpsCost.push_back(sigOpCost);
+            txGetBet = MakeTransactionRef(std::move(getBetTx));
+            AddGetBetTx();
+        }
+    }
+
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+
+    return FinishBlock(scriptPubKeyIn, nTimeStart, nPackagesSelected, nDescendantsUpdated);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::UpdateBlock(const CScript& scriptPubKeyIn, const std::set<uint256>& added, const std::set<uint256>& removed)
+{
+    int64_t nTimeStart = GetTimeMicros();
 
-            nBlockTx++;
-            int64_t nTxWeight = GetTransactionWeight(getBetTx);
-            nBlockWeight += nTxWeight;
+    LOCK2(cs_main, mempool.cs);
 
-            getBetFee = 0;//applyFee(getBetTx, nTxWeight, sigOpCost);
-            nFees += getBetFee;
-            pblocktemplate->vTxFees.push_back(getBetFee);
+    if (!pblocktemplate || pindexPrev != chainActive.Tip())
+        return nullptr;
 
-           pblock->vtx.emplace_back(MakeTransactionRef(std::move(getBetTx)));
+    // Transactions that left the mempool are dropped from the block, together
+    // with those spending them. The others are added back in the same order,
+    // so that the block is accounted for anew without the dropped ones.
+    CTxMemPool::setEntries setCandidates;
+    bool fRemoved = false;
+    for (size_t i = 1; i < pblock->vtx.size() && !fRemoved; ++i) {
+        fRemoved = removed.count(pblock->vtx[i]->GetHash()) > 0;
+    }
+    if (fRemoved) {
+        std::vector<CTransactionRef> vtx;
+        vtx.swap(pblock->vtx);
+        const bool fWitness = fIncludeWitness;
+        resetBlock();
+        fIncludeWitness = fWitness;
+
+        pblock->vtx.emplace_back();
+        pblocktemplate->vTxFees.assign(1, -1);
+        pblocktemplate->vTxSigOpsCost.assign(1, -1);
+        if (txGetBet) {
+            AddGetBetTx();
+        }
+
+        std::set<uint256> setDropped;
+        for (size_t i = 1; i < vtx.size(); ++i) {
+            const CTransaction& tx = *vtx[i];
+            if (vtx[i] == txGetBet)
+                continue;
+
+            CTxMemPool::txiter it = mempool.mapTx.find(tx.GetHash());
+            bool fDrop = it == mempool.mapTx.end();
+            for (const CTxIn& txin : tx.vin) {
+                fDrop = fDrop || setDropped.count(txin.prevout.hash) > 0;
+            }
+            if (fDrop) {
+                setDropped.insert(tx.GetHash());
+                if (it != mempool.mapTx.end())
+                    setCandidates.insert(it);
+                continue;
+            }
+            AddToBlock(it);
         }
     }
 
+    for (const uint256& hash : added) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it != mempool.mapTx.end() && !inBlock.count(it))
+            setCandidates.insert(it);
+    }
+
+    std::vector<CTxMemPool::txiter> candidates(setCandidates.begin(), setCandidates.end());
+    std::sort(candidates.begin(), candidates.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) {
+        return CompareTxMemPoolEntryByAncestorFee()(*a, *b);
+    });
+
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    addPackageTxs(nPackagesSelected, nDescendantsUpdated, &candidates);
+
+    return FinishBlock(scriptPubKeyIn, nTimeStart, nPackagesSelected, nDescendantsUpdated);
+}
+
+void BlockAssembler::AddGetBetTx()
+{
+    int64_t sigOpCost = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*txGetBet);
+    nBlockSigOpsCost += sigOpCost;
+    pblocktemplate->vTxSigOpsCost.push_back(sigOpCost);
+
+    nBlockTx++;
+    nBlockWeight += GetTransactionWeight(*txGetBet);
+
+    // The winning bets are paid without a fee
+    pblocktemplate->vTxFees.push_back(0);
 
+    pblock->vtx.push_back(txGetBet);
+    UpdateBlockTotals(*txGetBet);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::FinishBlock(const CScript& scriptPubKeyIn, int64_t nTimeStart, int nPackagesSelected, int nDescendantsUpdated)
+{
     int64_t nTime1 = GetTimeMicros();
 
     nLastBlockTx = nBlockTx;
@@ -254,8 +342,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     int64_t nTime2 = GetTimeMicros();
 
     LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
-    makeBets.clear();
-    return std::move(pblocktemplate);
+    // The template is kept to be updated by UpdateBlock
+    return MakeUnique<CBlockTemplate>(*pblocktemplate);
 }
 
 void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
@@ -351,13 +439,28 @@ BlockAssembler::TxAllowedForNamecoin (const CTransaction& tx) const
 bool
 BlockAssembler::DbLockLimitOk (const CTxMemPool::setEntries& candidates) const
 {
-  std::vector<CTransactionRef> vtx;
-  for (const auto& iter : inBlock)
-    vtx.push_back(MakeTransactionRef(iter->GetTx()));
+  /* Count the ids CheckDbLockLimit would for the block with the candidates,
+     adding theirs to the ids of the block.  */
+  std::set<uint256> setNewIds;
+  unsigned int nNames = nBlockNames;
   for (const auto& iter : candidates)
-    vtx.push_back(MakeTransactionRef(iter->GetTx()));
+    {
+      const CTransaction& tx = iter->GetTx ();
+      if (!setBlockLockIds.count (tx.GetHash ()))
+        setNewIds.insert (tx.GetHash ());
+      if (tx.IsNamecoin ())
+        ++nNames;
+      for (const auto& txIn : tx.vin)
+        if (!setBlockLockIds.count (txIn.prevout.hash))
+          setNewIds.insert (txIn.prevout.hash);
+    }
 
-  return CheckDbLockLimit (vtx);
+  const unsigned int nTotalIds = setBlockLockIds.size () + setNewIds.size () + nNames;
+  if (nTotalIds > MAX_BLOCK_DB_LOCKS)
+    return error ("%s : %u locks estimated, that is too much for BDB",
+                  __func__, nTotalIds);
+
+  return true;
 }
 
 bool BlockAssembler::isNameNew(const CTransaction& tx) const
@@ -403,7 +506,15 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     nFees += iter->GetFee();
     inBlock.insert(iter);
 
-    if (iter->GetTx().IsMsgTx() && iter->GetFee() == 0)
+    const CTransaction& tx = iter->GetTx();
+    UpdateBlockTotals(tx);
+    setBlockLockIds.insert(tx.GetHash());
+    for (const CTxIn& txin : tx.vin)
+        setBlockLockIds.insert(txin.prevout.hash);
+    if (tx.IsNamecoin())
+        ++nBlockNames;
+
+    if (tx.IsMsgTx() && iter->GetFee() == 0)
     {
         nFees += internal_miner::getMsgFee(iter->GetTx());
     }
@@ -416,6 +527,13 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     }
 }
 
+void BlockAssembler::UpdateBlockTotals(const CTransaction& tx)
+{
+    if (isNameNew(tx))
+        ++nBlockNameNew;
+    modulo::ver_2::checkBetsPotentialReward(nBlockPotentialWin, nBlockBets, tx);
+}
+
 int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
         indexed_modified_transaction_set &mapModifiedTx)
 {
@@ -443,6 +561,30 @@ int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& already
     return nDescendantsUpdated;
 }
 
+void BlockAssembler::UpdatePackagesForCandidates(const std::vector<CTxMemPool::txiter>& candidates,
+        indexed_modified_transaction_set &mapModifiedTx)
+{
+    for (CTxMemPool::txiter it : candidates) {
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+        CTxMemPoolModifiedEntry modEntry(it);
+        bool fModified = false;
+        for (CTxMemPool::txiter anc : ancestors) {
+            if (!inBlock.count(anc))
+                continue;
+            modEntry.nSizeWithAncestors -= anc->GetTxSize();
+            modEntry.nModFeesWithAncestors -= anc->GetModifiedFee();
+            modEntry.nSigOpCostWithAncestors -= anc->GetSigOpCost();
+            fModified = true;
+        }
+        if (fModified)
+            mapModifiedTx.insert(modEntry);
+    }
+}
+
 // Skip entries in mapTx that are already in a block or are present
 // in mapModifiedTx (which implies that the mapTx ancestor state is
 // stale due to ancestor inclusion in the block)
@@ -479,7 +621,7 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::ve
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
+void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const std::vector<CTxMemPool::txiter>* candidates)
 {
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
@@ -488,10 +630,27 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     CTxMemPool::setEntries failedTx;
 
     // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
+    // and modifying them for their already included ancestors. Only the
+    // candidates are looked at when updating a block.
+    if (candidates) {
+        UpdatePackagesForCandidates(*candidates, mapModifiedTx);
+    } else {
+        UpdatePackagesForAdded(inBlock, mapModifiedTx);
+    }
 
+    // New transactions are taken from mapTx by ancestor score, or from the
+    // candidates, which are sorted the same way
     CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
+    size_t nCandidate = 0;
+    auto sourceEnd = [&]() {
+        return candidates ? nCandidate == candidates->size() : mi == mempool.mapTx.get<ancestor_score>().end();
+    };
+    auto sourceEntry = [&]() {
+        return candidates ? (*candidates)[nCandidate] : mempool.mapTx.project<0>(mi);
+    };
+    auto sourceNext = [&]() {
+        if (candidates) ++nCandidate; else ++mi;
+    };
     CTxMemPool::txiter iter;
 
     // Limit the number of attempts to add transactions to the block when it is
@@ -500,24 +659,11 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
 
-    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
+    while (!sourceEnd() || !mapModifiedTx.empty())
     {
-        unsigned int nameTxnCounter = 0;
-        // get balance of transactions already added to block
-        CAmount sumOfBlockBets{}, potentialWinSum{};
-        for (size_t i=0; i<pblock->vtx.size(); ++i)
-        {
-            if(pblock->vtx[i]) {
-                const CTransaction& txn = *(pblock->vtx[i]);
-                if (isNameNew(txn)) ++nameTxnCounter;
-                modulo::ver_2::checkBetsPotentialReward(potentialWinSum, sumOfBlockBets, txn);
-            }
-        }
-
         // First try to find a new transaction in mapTx to evaluate.
-        if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-                SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
-            ++mi;
+        if (!sourceEnd() && SkipMapTxEntry(sourceEntry(), mapModifiedTx, failedTx)) {
+            sourceNext();
             continue;
         }
 
@@ -526,13 +672,13 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         bool fUsingModified = false;
 
         modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-        if (mi == mempool.mapTx.get<ancestor_score>().end()) {
+        if (sourceEnd()) {
             // We're out of entries in mapTx; use the entry from mapModifiedTx
             iter = modit->iter;
             fUsingModified = true;
         } else {
             // Try to compare the mapTx entry to the mapModifiedTx entry
-            iter = mempool.mapTx.project<0>(mi);
+            iter = sourceEntry();
             if (modit != mapModifiedTx.get<ancestor_score>().end() &&
                     CompareTxMemPoolEntryByAncestorFee()(*modit, CTxMemPoolModifiedEntry(iter))) {
                 // The best entry in mapModifiedTx has higher score
@@ -543,7 +689,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             } else {
                 // Either no entry in mapModifiedTx, or it's worse than mapTx.
                 // Increment mi for the next loop iteration.
-                ++mi;
+                sourceNext();
             }
         }
 
@@ -604,6 +750,8 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         onlyUnconfirmed(ancestors);
         ancestors.insert(iter);
 
+        // Check the package against the bets and name_new of the block
+        CAmount sumOfBlockBets = nBlockBets, potentialWinSum = nBlockPotentialWin;
         bool txnLimitExceeded = false;
         unsigned int localNameTxnCounter = 0;
         for (auto it : ancestors)
@@ -617,7 +765,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             }
         }
 
-        if (!txnLimitExceeded && (localNameTxnCounter + nameTxnCounter) > 1)
+        if (!txnLimitExceeded && (localNameTxnCounter + nBlockNameNew) > 1)
         {
             txnLimitExceeded = true;
         }
@@ -652,6 +800,77 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+/** Number of mempool changes above which the template is assembled anew */
+static const size_t MAX_PENDING_TEMPLATE_CHANGES = 50000;
+
+BlockTemplateUpdater::BlockTemplateUpdater(const CChainParams& params) : chainparams(params)
+{
+    m_conn_added = mempool.NotifyEntryAdded.connect(boost::bind(&BlockTemplateUpdater::TransactionAdded, this, _1));
+    m_conn_removed = mempool.NotifyEntryRemoved.connect(boost::bind(&BlockTemplateUpdater::TransactionRemoved, this, _1, _2));
+}
+
+void BlockTemplateUpdater::TransactionAdded(CTransactionRef tx)
+{
+    std::lock_guard<std::mutex> lock(m_cs_pending);
+    if (m_stale)
+        return;
+    m_added.insert(tx->GetHash());
+    if (m_added.size() + m_removed.size() > MAX_PENDING_TEMPLATE_CHANGES) {
+        m_stale = true;
+        m_added.clear();
+        m_removed.clear();
+    }
+}
+
+void BlockTemplateUpdater::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    std::lock_guard<std::mutex> lock(m_cs_pending);
+    if (m_stale)
+        return;
+    m_added.erase(tx->GetHash());
+    m_removed.insert(tx->GetHash());
+    if (m_added.size() + m_removed.size() > MAX_PENDING_TEMPLATE_CHANGES) {
+        m_stale = true;
+        m_added.clear();
+        m_removed.clear();
+    }
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateUpdater::GetBlockTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+{
+    std::lock_guard<std::mutex> lock(m_cs_update);
+    // The mempool does not change while the pending changes are taken and
+    // the template is updated or created
+    LOCK2(cs_main, mempool.cs);
+
+    std::set<uint256> added, removed;
+    bool fStale;
+    {
+        std::lock_guard<std::mutex> lock_pending(m_cs_pending);
+        added.swap(m_added);
+        removed.swap(m_removed);
+        fStale = m_stale;
+        m_stale = false;
+    }
+
+    if (m_assembler && !fStale && fMineWitnessTx == m_mine_witness_tx) {
+        try {
+            std::unique_ptr<CBlockTemplate> pblocktemplate = m_assembler->UpdateBlock(scriptPubKeyIn, added, removed);
+            if (pblocktemplate)
+                return pblocktemplate;
+        } catch (const std::runtime_error& e) {
+            LogPrintf("%s: %s, creating a new block template\n", __func__, e.what());
+        }
+    }
+
+    m_assembler.reset();
+    std::unique_ptr<BlockAssembler> assembler = MakeUnique<BlockAssembler>(chainparams);
+    std::unique_ptr<CBlockTemplate> pblocktemplate = assembler->CreateNewBlock(scriptPubKeyIn, fMineWitnessTx);
+    m_assembler = std::move(assembler);
+    m_mine_witness_tx = fMineWitnessTx;
+    return pblocktemplate;
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
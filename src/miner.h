@@ -12,8 +12,11 @@
 
 #include <stdint.h>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
+#include <boost/signals2/connection.hpp>
 
 class CBlockIndex;
 class CChainParams;
@@ -140,11 +143,22 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // Running totals of the bets, their potential rewards and the name_new
+    // transactions in the block, and the ids CheckDbLockLimit counts
+    CAmount nBlockBets;
+    CAmount nBlockPotentialWin;
+    unsigned int nBlockNameNew;
+    std::set<uint256> setBlockLockIds;
+    unsigned int nBlockNames;
 
     // Chain context for the block
     int nHeight;
     int64_t nLockTimeCutoff;
     const CChainParams& chainparams;
+    // Tip the block builds on, and the transaction paying the winning bets
+    // of the tip
+    const CBlockIndex* pindexPrev;
+    CTransactionRef txGetBet;
 
 public:
     struct Options {
@@ -159,18 +173,32 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true);
 
+    /** Update the template of the last CreateNewBlock call, with coinbase to
+      * scriptPubKeyIn, for the transactions added to and removed from the
+      * mempool since. Returns nullptr if the tip changed, in which case a new
+      * block has to be created. */
+    std::unique_ptr<CBlockTemplate> UpdateBlock(const CScript& scriptPubKeyIn, const std::set<uint256>& added, const std::set<uint256>& removed);
+
 private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Add the transaction paying the winning bets of the tip to the block */
+    void AddGetBetTx();
+    /** Account for a transaction of the block in the bet and name totals */
+    void UpdateBlockTotals(const CTransaction& tx);
+    /** Add the coinbase and header to the block, and check it */
+    std::unique_ptr<CBlockTemplate> FinishBlock(const CScript& scriptPubKeyIn, int64_t nTimeStart, int nPackagesSelected, int nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
-      * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+      * statistics from the package selection (for logging statistics).
+      * If candidates is given, only its transactions (sorted by ancestor
+      * score) and their ancestors are considered instead of the mempool. */
+    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const std::vector<CTxMemPool::txiter>* candidates = nullptr) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -191,6 +219,9 @@ private:
       * state updated assuming given transactions are inBlock. Returns number
       * of updated descendants. */
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    /** Add the candidates with ancestors in the block to mapModifiedTx, with
+      * ancestor state updated for those ancestors. */
+    void UpdatePackagesForCandidates(const std::vector<CTxMemPool::txiter>& candidates, indexed_modified_transaction_set &mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
     
     /**
      * Verify if a tx can be added from a Namecoin perspective.  This may not
@@ -205,6 +236,44 @@ private:
     bool hasNameNew() const;
 };
 
+/**
+ * Keeps the block template it last returned and patches it with the
+ * transactions that entered and left the mempool since, instead of assembling
+ * the template from the whole mempool again. The template is assembled anew
+ * when the tip changes. Changes in the priority of transactions
+ * (prioritisetransaction) are only taken into account then.
+ */
+class BlockTemplateUpdater
+{
+public:
+    explicit BlockTemplateUpdater(const CChainParams& params);
+
+    BlockTemplateUpdater(const BlockTemplateUpdater&) = delete;
+    BlockTemplateUpdater& operator=(const BlockTemplateUpdater&) = delete;
+
+    /** Get a block template with coinbase to scriptPubKeyIn */
+    std::unique_ptr<CBlockTemplate> GetBlockTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true);
+
+private:
+    const CChainParams& chainparams;
+    //! serializes GetBlockTemplate calls
+    std::mutex m_cs_update;
+    std::unique_ptr<BlockAssembler> m_assembler;
+    bool m_mine_witness_tx = false;
+
+    //! transactions added to and removed from the mempool since the template was updated
+    std::mutex m_cs_pending;
+    std::set<uint256> m_added;
+    std::set<uint256> m_removed;
+    //! set when too many transactions changed to be worth tracking them
+    bool m_stale = false;
+    boost::signals2::scoped_connection m_conn_added;
+    boost::signals2::scoped_connection m_conn_removed;
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
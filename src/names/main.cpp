@@ -733,7 +733,7 @@ CheckNameDB (bool disconnect)
         return;
     }
 
-  pcoinsTip->Flush ();
+  SyncCoinsTip ();
   const bool ok = pcoinsTip->ValidateNameDB ();
 
   if (!ok)
@@ -17,6 +17,7 @@
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
+#include <socketevents.h>
 #include <streams.h>
 #include <sync.h>
 #include <uint256.h>
@@ -143,6 +144,7 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        SocketEventsMode socketEventsMode = DEFAULT_SOCKETEVENTS;
     };
 
     void Init(const Options& connOptions) {
@@ -336,6 +338,11 @@ private:
     void ThreadOpenConnections(std::vector<std::string> connect);
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
+    void DisconnectNodes();
+    void NotifyNumConnectionsChanged();
+    void InactivityCheck(CNode* pnode, int64_t nTime);
+    void SocketRecvData(CNode* pnode);
+    void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -355,6 +362,12 @@ private:
     NodeId GetNewNodeId();
 
     size_t SocketSendData(CNode *pnode) const;
+    //!start watching the socket of a new node for events
+    bool RegisterSocketEvents(CNode* pnode);
+    //!update the events a node's socket is watched for after its send queue or receive pause changed
+    void UpdateSocketEvents(CNode* pnode) const EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend);
+    //!stop watching the socket of a node and close it
+    void CloseSocketDisconnect(CNode* pnode) const;
     //!check is the banlist has unwritten changes
     bool BannedSetIsDirty();
     //!set the "dirty" flag for the banlist
@@ -392,6 +405,7 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+    std::unique_ptr<CSocketEvents> m_socket_events;
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -438,6 +452,11 @@ private:
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
 
+    /** Number of nodes last reported to the UI */
+    unsigned int nPrevNodeCount;
+    /** Time of the last inactivity check of all nodes */
+    int64_t nLastInactivityCheck;
+
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
      *  This takes the place of a feeler connection */
@@ -628,6 +647,7 @@ public:
     std::deque<std::vector<unsigned char>> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
+    int nSocketEvents GUARDED_BY(cs_vSend); // events the socket is watched for
     CCriticalSection cs_vRecv;
 
     CCriticalSection cs_vProcessMsg;
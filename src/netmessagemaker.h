@@ -19,6 +19,9 @@ public:
     {
         CSerializedNetMsg msg;
         msg.command = std::move(sCommand);
+        // Size the payload up front, so that large messages such as blocks
+        // are not copied each time the vector grows.
+        msg.data.reserve(GetSerializeSizeMany(nFlags | nVersion, args...));
         CVectorWriter{ SER_NETWORK, nFlags | nVersion, msg.data, 0, std::forward<Args>(args)... };
         return msg;
     }
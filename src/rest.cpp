@@ -6,14 +6,21 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <core_io.h>
+#include <games/gamesutils.h>
+#include <games/modulo/moduloverify.h>
+#include <blockfilter.h>
+#include <index/blockfilterindex.h>
 #include <index/txindex.h>
 #include <names/common.h>
 #include <names/encoding.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <validation.h>
+#include <httprpc.h>
 #include <httpserver.h>
+#include <key_io.h>
 #include <rpc/blockchain.h>
+#include <rpc/jsonwriter.h>
 #include <rpc/names.h>
 #include <rpc/server.h>
 #include <streams.h>
@@ -24,9 +31,14 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <deque>
+#include <map>
+
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const long MAX_REST_NAMES = 1000; //allow a max of 1000 names to be scanned at once
+static const size_t MAX_BETS_CACHE_SIZE = 100; //settlements of the most recently queried blocks
 
 enum class RetFormat {
     UNDEF,
@@ -321,6 +333,161 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+static bool rest_filter_header(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockfilterheaders/<filtertype>/<count>/<blockhash>.<ext>.");
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(path[0], filtertype))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + path[0]);
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Index is not enabled for filtertype " + path[0]);
+
+    long count = strtol(path[1].c_str(), nullptr, 10);
+    if (count < 1 || count > MAX_BLOCKFILTER_RANGE)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[1]);
+
+    uint256 hash;
+    if (!ParseHashStr(path[2], hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[2]);
+
+    const CBlockIndex* start_index;
+    const CBlockIndex* stop_index;
+    {
+        LOCK(cs_main);
+        start_index = LookupBlockIndex(hash);
+        if (!start_index || !chainActive.Contains(start_index))
+            return RESTERR(req, HTTP_NOT_FOUND, path[2] + " not found");
+        stop_index = chainActive[std::min<int>(start_index->nHeight + count - 1, chainActive.Height())];
+    }
+
+    index->BlockUntilSyncedToCurrentChain();
+    std::vector<uint256> filter_headers;
+    if (!index->LookupFilterHeaderRange(start_index->nHeight, stop_index, filter_headers))
+        return RESTERR(req, HTTP_NOT_FOUND, "Filter headers not found (index may still be syncing)");
+
+    switch (rf) {
+    case RetFormat::BINARY: {
+        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+        for (const uint256& header : filter_headers) {
+            ssHeader << header;
+        }
+
+        std::string binaryHeader = ssHeader.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHeader);
+        return true;
+    }
+    case RetFormat::HEX: {
+        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+        for (const uint256& header : filter_headers) {
+            ssHeader << header;
+        }
+
+        std::string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RetFormat::JSON: {
+        UniValue jsonHeaders(UniValue::VARR);
+        for (const uint256& header : filter_headers) {
+            jsonHeaders.push_back(header.GetHex());
+        }
+
+        std::string strJSON = jsonHeaders.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+static bool rest_block_filter(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/blockfilter/<filtertype>/<blockhash>.<ext>.");
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(path[0], filtertype))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown filtertype " + path[0]);
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Index is not enabled for filtertype " + path[0]);
+
+    uint256 hash;
+    if (!ParseHashStr(path[1], hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[1]);
+
+    const CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        pblockindex = LookupBlockIndex(hash);
+        if (!pblockindex)
+            return RESTERR(req, HTTP_NOT_FOUND, path[1] + " not found");
+    }
+
+    index->BlockUntilSyncedToCurrentChain();
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(pblockindex, filter) || !index->LookupFilterHeader(pblockindex, filter_header))
+        return RESTERR(req, HTTP_NOT_FOUND, "Filter not found (index may still be syncing)");
+
+    switch (rf) {
+    case RetFormat::BINARY: {
+        CDataStream ssResp(SER_NETWORK, PROTOCOL_VERSION);
+        ssResp << filter;
+
+        std::string binaryResp = ssResp.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryResp);
+        return true;
+    }
+    case RetFormat::HEX: {
+        CDataStream ssResp(SER_NETWORK, PROTOCOL_VERSION);
+        ssResp << filter;
+
+        std::string strHex = HexStr(ssResp.begin(), ssResp.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RetFormat::JSON: {
+        UniValue ret(UniValue::VOBJ);
+        ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+        ret.pushKV("header", filter_header.GetHex());
+        std::string strJSON = ret.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
 // A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
 UniValue getblockchaininfo(const JSONRPCRequest& request);
 
@@ -683,6 +850,352 @@ static bool rest_name(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * Write a JSON reply produced with a JSONWriter. Large replies are sent as a
+ * chunked reply while they are produced.
+ */
+static void WriteJSONReply(HTTPRequest* req, const std::function<void(JSONWriter&)>& write)
+{
+    JSONStreamWriter writer([req](const std::string& strChunk) {
+        if (!req->IsChunkedReply()) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->StartChunkedReply(HTTP_OK);
+        }
+        req->WriteReplyChunk(strChunk);
+    });
+    write(writer);
+    const std::string strTail = writer.TakeBuffer() + "\n";
+
+    if (req->IsChunkedReply()) {
+        req->WriteReplyChunk(strTail);
+        req->EndChunkedReply();
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strTail);
+    }
+}
+
+static bool WriteSerializedReply(HTTPRequest* req, RetFormat rf, const CDataStream& ss)
+{
+    switch (rf) {
+    case RetFormat::BINARY: {
+        const std::string binary = ss.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binary);
+        return true;
+    }
+
+    case RetFormat::HEX: {
+        const std::string strHex = HexStr(ss.begin(), ss.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    default:
+        assert(false);
+    }
+    return false;
+}
+
+static bool rest_names(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RetFormat::BINARY && rf != RetFormat::HEX && rf != RetFormat::JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    // The start name may itself contain slashes, so only split off the count.
+    const std::string::size_type pos = param.find('/');
+    const std::string strCount = param.substr(0, pos);
+    const std::string encodedStart = pos == std::string::npos ? "" : param.substr(pos + 1);
+
+    long count = strtol(strCount.c_str(), nullptr, 10);
+    if (count < 1 || count > MAX_REST_NAMES)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Name count out of range: %s", strCount));
+
+    valtype start;
+    if (!DecodeName(start, encodedStart))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid encoded name: " + encodedStart);
+
+    // Only copy the page while holding cs_main; it is formatted afterwards.
+    std::vector<std::pair<valtype, CNameData>> names;
+    {
+        LOCK(cs_main);
+        std::unique_ptr<CNameIterator> iter(pcoinsTip->IterateNames());
+        valtype name;
+        CNameData data;
+        for (iter->seek(start); count > 0 && iter->next(name, data); --count)
+            names.emplace_back(name, data);
+    }
+
+    if (rf == RetFormat::JSON) {
+        WriteJSONReply(req, [&names](JSONWriter& writer) {
+            writer.BeginArray();
+            for (const auto& entry : names)
+                writer.Value(getNameInfo(entry.first, entry.second));
+            writer.EndArray();
+        });
+        return true;
+    }
+
+    CDataStream ssNames(SER_NETWORK, PROTOCOL_VERSION);
+    ssNames << names;
+    return WriteSerializedReply(req, rf, ssNames);
+}
+
+static bool rest_name_history(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string encodedName;
+    const RetFormat rf = ParseDataFormat(encodedName, strURIPart);
+    if (rf != RetFormat::BINARY && rf != RetFormat::HEX && rf != RetFormat::JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    if (!fNameHistory)
+        return RESTERR(req, HTTP_NOT_FOUND, "-namehistory is not enabled");
+
+    valtype plainName;
+    if (!DecodeName(plainName, encodedName))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid encoded name: " + encodedName);
+
+    // Past states of the name, oldest first, followed by its current state
+    std::vector<CNameData> entries;
+    {
+        LOCK(cs_main);
+        CNameData data;
+        if (!pcoinsTip->GetName(plainName, data))
+            return RESTERR(req, HTTP_NOT_FOUND, EncodeNameForMessage(plainName) + " not found");
+        CNameHistory history;
+        if (pcoinsTip->GetNameHistory(plainName, history))
+            entries = history.getData();
+        entries.push_back(data);
+    }
+
+    if (rf == RetFormat::JSON) {
+        WriteJSONReply(req, [&](JSONWriter& writer) {
+            writer.BeginArray();
+            for (const CNameData& data : entries)
+                writer.Value(getNameInfo(plainName, data));
+            writer.EndArray();
+        });
+        return true;
+    }
+
+    CDataStream ssHistory(SER_NETWORK, PROTOCOL_VERSION);
+    ssHistory << entries;
+    return WriteSerializedReply(req, rf, ssHistory);
+}
+
+static bool rest_opreturn(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string hashStr;
+    const RetFormat rf = ParseDataFormat(hashStr, strURIPart);
+
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    if (g_txindex) {
+        g_txindex->BlockUntilSyncedToCurrentChain();
+    }
+
+    CTransactionRef tx;
+    uint256 hashBlock = uint256();
+    if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true))
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+
+    const std::vector<char> payload = tx->loadOpReturn();
+
+    switch (rf) {
+    case RetFormat::BINARY: {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, std::string(payload.begin(), payload.end()));
+        return true;
+    }
+
+    case RetFormat::HEX: {
+        const std::string strHex = HexStr(payload.begin(), payload.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RetFormat::JSON: {
+        UniValue objPayload(UniValue::VOBJ);
+        objPayload.pushKV("txid", hash.GetHex());
+        if (!hashBlock.IsNull())
+            objPayload.pushKV("blockhash", hashBlock.GetHex());
+        objPayload.pushKV("size", (uint64_t)payload.size());
+        objPayload.pushKV("hex", HexStr(payload.begin(), payload.end()));
+        const std::string strJSON = objPayload.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+/**
+ * The bets placed in a block, settled with the block's hash, and the
+ * transaction of the block that pays out the winning bets of its parent.
+ */
+struct CBlockBets {
+    int nHeight;
+    std::vector<CTransactionRef> vBets;
+    /** Payoff of each bet, zero if it lost */
+    std::vector<CAmount> vPayoffs;
+    /** The payout transaction, if the block has one */
+    std::vector<CTransactionRef> vPayouts;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nHeight);
+        READWRITE(vBets);
+        READWRITE(vPayoffs);
+        READWRITE(vPayouts);
+    }
+};
+
+/** Settlements already computed, as they never change for a given block. */
+static Mutex cs_betsCache;
+static std::map<uint256, std::shared_ptr<const CBlockBets>> mapBetsCache GUARDED_BY(cs_betsCache);
+static std::deque<uint256> vBetsCacheOrder GUARDED_BY(cs_betsCache);
+
+static std::shared_ptr<const CBlockBets> SettleBlockBets(const CBlock& block, int nHeight)
+{
+    auto bets = std::make_shared<CBlockBets>();
+    bets->nHeight = nHeight;
+    const uint256 hash = block.GetHash();
+    for (const CTransactionRef& tx : block.vtx) {
+        if (modulo::ver_2::isMakeBetTx(*tx)) {
+            modulo::ver_2::MakeBetWinningProcess winningProcess(*tx, hash);
+            bets->vBets.push_back(tx);
+            bets->vPayoffs.push_back(winningProcess.isMakeBetWinning() ? winningProcess.getMakeBetPayoff() : 0);
+        } else if (modulo::ver_2::isGetBetTx(*tx)) {
+            bets->vPayouts.push_back(tx);
+        }
+    }
+    return bets;
+}
+
+static bool rest_bets(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string hashStr;
+    const RetFormat rf = ParseDataFormat(hashStr, strURIPart);
+    if (rf != RetFormat::BINARY && rf != RetFormat::HEX && rf != RetFormat::JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    std::shared_ptr<const CBlockBets> bets;
+    {
+        LOCK(cs_betsCache);
+        auto it = mapBetsCache.find(hash);
+        if (it != mapBetsCache.end())
+            bets = it->second;
+    }
+
+    if (!bets) {
+        // Only the block's position is looked up under cs_main.
+        CDiskBlockPos pos;
+        int nHeight;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pblockindex = LookupBlockIndex(hash);
+            if (!pblockindex)
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            if (IsBlockPruned(pblockindex))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+            pos = pblockindex->GetBlockPos();
+            nHeight = pblockindex->nHeight;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pos, Params().GetConsensus()) || block.GetHash() != hash)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        bets = SettleBlockBets(block, nHeight);
+
+        LOCK(cs_betsCache);
+        if (mapBetsCache.emplace(hash, bets).second) {
+            vBetsCacheOrder.push_back(hash);
+            if (vBetsCacheOrder.size() > MAX_BETS_CACHE_SIZE) {
+                mapBetsCache.erase(vBetsCacheOrder.front());
+                vBetsCacheOrder.pop_front();
+            }
+        }
+    }
+
+    if (rf != RetFormat::JSON) {
+        CDataStream ssBets(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+        ssBets << *bets;
+        return WriteSerializedReply(req, rf, ssBets);
+    }
+
+    UniValue objBets(UniValue::VOBJ);
+    objBets.pushKV("hash", hash.GetHex());
+    objBets.pushKV("height", bets->nHeight);
+    UniValue betsArr(UniValue::VARR);
+    for (size_t i = 0; i < bets->vBets.size(); ++i) {
+        const CTransaction& tx = *bets->vBets[i];
+        UniValue objBet(UniValue::VOBJ);
+        objBet.pushKV("txid", tx.GetHash().GetHex());
+        objBet.pushKV("bet_type", getBetType(tx));
+        objBet.pushKV("amount", ValueFromAmount(tx.vout[0].nValue));
+        objBet.pushKV("winning", bets->vPayoffs[i] > 0);
+        objBet.pushKV("payoff", ValueFromAmount(bets->vPayoffs[i]));
+        betsArr.push_back(objBet);
+    }
+    objBets.pushKV("bets", betsArr);
+
+    UniValue objPayout(UniValue::VNULL);
+    if (!bets->vPayouts.empty()) {
+        const CTransaction& tx = *bets->vPayouts[0];
+        objPayout.setObject();
+        objPayout.pushKV("txid", tx.GetHash().GetHex());
+        UniValue outputs(UniValue::VARR);
+        for (size_t i = 0; i < tx.vout.size() && i < tx.vin.size(); ++i) {
+            UniValue objOutput(UniValue::VOBJ);
+            objOutput.pushKV("bet_txid", tx.vin[i].prevout.hash.GetHex());
+            objOutput.pushKV("amount", ValueFromAmount(tx.vout[i].nValue));
+            CTxDestination dest;
+            if (ExtractDestination(tx.vout[i].scriptPubKey, dest))
+                objOutput.pushKV("address", EncodeDestination(dest));
+            outputs.push_back(objOutput);
+        }
+        objPayout.pushKV("outputs", outputs);
+    }
+    objBets.pushKV("payout", objPayout);
+
+    const std::string strJSON = objBets.write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
+static bool rest_metrics(HTTPRequest* req, const std::string& strURIPart)
+{
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, RPCStatsToPrometheus());
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -694,14 +1207,22 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blockfilter/", rest_block_filter},
+      {"/rest/blockfilterheaders/", rest_filter_header},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/name/", rest_name},
+      {"/rest/names/", rest_names},
+      {"/rest/namehistory/", rest_name_history},
+      {"/rest/opreturn/", rest_opreturn},
+      {"/rest/bets/", rest_bets},
 };
 
 void StartREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
         RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+    if (gArgs.GetBoolArg("-restmetrics", DEFAULT_REST_METRICS))
+        RegisterHTTPHandler("/rest/metrics", true, rest_metrics);
 }
 
 void InterruptREST()
@@ -712,4 +1233,5 @@ void StopREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
         UnregisterHTTPHandler(uri_prefixes[i].prefix, false);
+    UnregisterHTTPHandler("/rest/metrics", true);
 }
@@ -7,6 +7,7 @@
 
 #include <amount.h>
 #include <base58.h>
+#include <blockfilter.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -14,16 +15,21 @@
 #include <consensus/validation.h>
 #include <validation.h>
 #include <core_io.h>
+#include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
 #include <index/txindex.h>
 #include <key_io.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <primitives/transaction.h>
+#include <random.h>
+#include <rpc/jsonwriter.h>
 #include <rpc/rawtransaction.h>
 #include <rpc/server.h>
 #include <script/descriptor.h>
 #include <script/names.h>
+#include <shutdown.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -45,6 +51,7 @@
 
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <condition_variable>
 
 struct CUpdatedBlock
@@ -114,50 +121,58 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+void blockToJSON(JSONWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
 {
     AssertLockHeld(cs_main);
-    UniValue result(UniValue::VOBJ);
-    result.pushKV("hash", blockindex->GetBlockHash().GetHex());
+    writer.BeginObject();
+    writer.Pair("hash", blockindex->GetBlockHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.pushKV("confirmations", confirmations);
-    result.pushKV("strippedsize", (int)::GetSerializeSize(block, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
-    result.pushKV("size", (int)::GetSerializeSize(block, PROTOCOL_VERSION));
-    result.pushKV("weight", (int)::GetBlockWeight(block));
-    result.pushKV("height", blockindex->nHeight);
-    result.pushKV("version", block.nVersion);
-    result.pushKV("versionHex", strprintf("%08x", block.nVersion));
-    result.pushKV("merkleroot", block.hashMerkleRoot.GetHex());
-    UniValue txs(UniValue::VARR);
+    writer.Pair("confirmations", confirmations);
+    writer.Pair("strippedsize", (int)::GetSerializeSize(block, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
+    writer.Pair("size", (int)::GetSerializeSize(block, PROTOCOL_VERSION));
+    writer.Pair("weight", (int)::GetBlockWeight(block));
+    writer.Pair("height", blockindex->nHeight);
+    writer.Pair("version", block.nVersion);
+    writer.Pair("versionHex", strprintf("%08x", block.nVersion));
+    writer.Pair("merkleroot", block.hashMerkleRoot.GetHex());
+    writer.Key("tx");
+    writer.BeginArray();
     for(const auto& tx : block.vtx)
     {
         if(txDetails)
         {
             UniValue objTx(UniValue::VOBJ);
             TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags(), true);
-            txs.push_back(objTx);
+            writer.Value(objTx);
         }
         else
-            txs.push_back(tx->GetHash().GetHex());
+            writer.Value(tx->GetHash().GetHex());
     }
-    result.pushKV("tx", txs);
-    result.pushKV("time", block.GetBlockTime());
-    result.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
-    result.pushKV("nonce", (uint64_t)block.nNonce);
-    result.pushKV("bits", strprintf("%08x", block.nBits));
-    result.pushKV("difficulty", GetDifficulty(blockindex));
-    result.pushKV("chainwork", blockindex->nChainWork.GetHex());
-    result.pushKV("nTx", (uint64_t)blockindex->nTx);
+    writer.EndArray();
+    writer.Pair("time", block.GetBlockTime());
+    writer.Pair("mediantime", (int64_t)blockindex->GetMedianTimePast());
+    writer.Pair("nonce", (uint64_t)block.nNonce);
+    writer.Pair("bits", strprintf("%08x", block.nBits));
+    writer.Pair("difficulty", GetDifficulty(blockindex));
+    writer.Pair("chainwork", blockindex->nChainWork.GetHex());
+    writer.Pair("nTx", (uint64_t)blockindex->nTx);
 
     if (blockindex->pprev)
-        result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
+        writer.Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
     CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
-        result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
-    return result;
+        writer.Pair("nextblockhash", pnext->GetBlockHash().GetHex());
+    writer.EndObject();
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+{
+    JSONTreeWriter writer;
+    blockToJSON(writer, block, blockindex, txDetails);
+    return writer.GetResult();
 }
 
 static UniValue getblockcount(const JSONRPCRequest& request)
@@ -341,6 +356,147 @@ static UniValue syncwithvalidationinterfacequeue(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue getvalidationinterfaceinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0) {
+        throw std::runtime_error(
+            "getvalidationinterfaceinfo\n"
+            "\nReturns the state of the queue of validation callbacks of each subscriber (wallets, indexes, notifiers).\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",          (string) The subscriber\n"
+            "    \"pending\": n,              (numeric) Callbacks waiting in the queue\n"
+            "    \"max_pending\": n,          (numeric) Largest number of callbacks that waited in the queue\n"
+            "    \"processed\": n,            (numeric) Callbacks delivered\n"
+            "    \"lag\": n,                  (numeric) Time in milliseconds the last delivered callback waited in the queue\n"
+            "    \"max_lag\": n,              (numeric) Longest time in milliseconds a callback waited in the queue\n"
+            "    \"busy\": n,                 (numeric) Time in milliseconds spent in the callbacks\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationinterfaceinfo","")
+            + HelpExampleRpc("getvalidationinterfaceinfo","")
+        );
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const ValidationSubscriberStats& stats : GetMainSignals().GetSubscriberStats()) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("name", stats.name);
+        entry.pushKV("pending", (uint64_t)stats.pending);
+        entry.pushKV("max_pending", (uint64_t)stats.max_pending);
+        entry.pushKV("processed", stats.processed);
+        entry.pushKV("lag", stats.last_lag_micros * 0.001);
+        entry.pushKV("max_lag", stats.max_lag_micros * 0.001);
+        entry.pushKV("busy", stats.busy_micros * 0.001);
+        result.push_back(entry);
+    }
+    return result;
+}
+
+/** The LevelDB databases of the node that can be inspected and compacted, by name. */
+static std::vector<std::pair<std::string, const CDBWrapper*>> GetDatabases()
+{
+    LOCK(cs_main);
+    std::vector<std::pair<std::string, const CDBWrapper*>> databases;
+    if (pcoinsdbview) databases.emplace_back("chainstate", &pcoinsdbview->GetDB());
+    if (pblocktree) databases.emplace_back("blockindex", pblocktree.get());
+    return databases;
+}
+
+static UniValue getdbinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0) {
+        throw std::runtime_error(
+            "getdbinfo\n"
+            "\nReturns the LevelDB tuning of the chain state and block index databases, and the size of their keyspaces.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",              (string) The database (chainstate or blockindex)\n"
+            "    \"block_size\": n,               (numeric) Approximate size in bytes of the data of a table block\n"
+            "    \"block_restart_interval\": n,   (numeric) Number of keys between restart points of the key encoding\n"
+            "    \"bloom_bits\": n,               (numeric) Bits per key of the bloom filter, 0 for none\n"
+            "    \"block_cache_percent\": n,      (numeric) Share of the database cache given to the block cache\n"
+            "    \"memory_usage\": n,             (numeric) Approximate memory used by the database in bytes\n"
+            "    \"keyspaces\": [\n"
+            "      {\n"
+            "        \"name\": \"name\",          (string) The keyspace\n"
+            "        \"prefix\": \"xx\",          (string) The first byte of its keys, in hex\n"
+            "        \"fill_cache\": true|false, (boolean) Whether point reads fill the block cache\n"
+            "        \"size\": n,                 (numeric) Approximate size on disk in bytes\n"
+            "      }\n"
+            "      ,...\n"
+            "    ]\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbinfo", "")
+            + HelpExampleRpc("getdbinfo", "")
+        );
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const auto& database : GetDatabases()) {
+        const DBTuning& tuning = database.second->GetTuning();
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("name", database.first);
+        entry.pushKV("block_size", (uint64_t)tuning.block_size);
+        entry.pushKV("block_restart_interval", tuning.block_restart_interval);
+        entry.pushKV("bloom_bits", tuning.bloom_bits);
+        entry.pushKV("block_cache_percent", tuning.block_cache_percent);
+        entry.pushKV("memory_usage", (uint64_t)database.second->DynamicMemoryUsage());
+        UniValue keyspaces(UniValue::VARR);
+        for (const DBKeyspace& keyspace : tuning.keyspaces) {
+            UniValue obj(UniValue::VOBJ);
+            obj.pushKV("name", keyspace.name);
+            obj.pushKV("prefix", HexStr(&keyspace.prefix, &keyspace.prefix + 1));
+            obj.pushKV("fill_cache", keyspace.fill_cache);
+            obj.pushKV("size", (uint64_t)database.second->EstimateKeyspaceSize(keyspace));
+            keyspaces.push_back(obj);
+        }
+        entry.pushKV("keyspaces", keyspaces);
+        result.push_back(entry);
+    }
+    return result;
+}
+
+static UniValue compactdb(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
+        throw std::runtime_error(
+            "compactdb \"database\" ( \"keyspace\" )\n"
+            "\nCompact a keyspace of a database, or the whole database, so that its records are merged into as few\n"
+            "tables as possible. This is useful after a keyspace has shrunk, for instance after many names expired,\n"
+            "or before a period of heavy reads. The call returns when the compaction is done.\n"
+            "\nArguments:\n"
+            "1. \"database\"   (string, required) The database: chainstate or blockindex\n"
+            "2. \"keyspace\"   (string, optional) The keyspace to compact, as listed by getdbinfo. All keyspaces if omitted\n"
+            "\nExamples:\n"
+            + HelpExampleCli("compactdb", "\"chainstate\" \"namehistory\"")
+            + HelpExampleRpc("compactdb", "\"chainstate\", \"namehistory\"")
+        );
+    }
+
+    const std::string name = request.params[0].get_str();
+    for (const auto& database : GetDatabases()) {
+        if (database.first != name) continue;
+        const DBKeyspace* keyspace = nullptr;
+        if (!request.params[1].isNull()) {
+            keyspace = database.second->FindKeyspace(request.params[1].get_str());
+            if (!keyspace) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown keyspace: " + request.params[1].get_str());
+            }
+        }
+        database.second->Compact(keyspace);
+        return NullUniValue;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database: " + name);
+}
+
 static UniValue getdifficulty(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -447,34 +603,40 @@ static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) EXCLUSIVE_LOCK
     info.pushKV("bip125-replaceable", rbfStatus);
 }
 
-UniValue mempoolToJSON(bool fVerbose)
+void mempoolToJSON(JSONWriter& writer, bool fVerbose)
 {
     if (fVerbose)
     {
         LOCK(mempool.cs);
-        UniValue o(UniValue::VOBJ);
+        writer.BeginObject();
         for (const CTxMemPoolEntry& e : mempool.mapTx)
         {
             const uint256& hash = e.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
             entryToJSON(info, e);
-            o.pushKV(hash.ToString(), info);
+            writer.Pair(hash.ToString(), info);
         }
-        return o;
+        writer.EndObject();
     }
     else
     {
         std::vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
 
-        UniValue a(UniValue::VARR);
+        writer.BeginArray();
         for (const uint256& hash : vtxid)
-            a.push_back(hash.ToString());
-
-        return a;
+            writer.Value(hash.ToString());
+        writer.EndArray();
     }
 }
 
+UniValue mempoolToJSON(bool fVerbose)
+{
+    JSONTreeWriter writer;
+    mempoolToJSON(writer, fVerbose);
+    return writer.GetResult();
+}
+
 static UniValue getrawmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -504,7 +666,9 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
-    return mempoolToJSON(fVerbose);
+    return StreamRPCResult(request, [fVerbose](JSONWriter& writer) {
+        mempoolToJSON(writer, fVerbose);
+    });
 }
 
 static UniValue getmempoolancestors(const JSONRPCRequest& request)
@@ -753,6 +917,146 @@ static UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+static BlockFilterIndex* GetBlockFilterIndexChecked(const UniValue& param)
+{
+    BlockFilterType filtertype = BlockFilterType::BASIC;
+    if (!param.isNull()) {
+        std::string filtertype_name = param.get_str();
+        if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+        }
+    }
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + BlockFilterTypeName(filtertype));
+    }
+    return index;
+}
+
+static UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=basic) The type name of the filter (" + ListBlockFilterTypes() + ")\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",  (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\"   (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+    }
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    BlockFilterIndex* index = GetBlockFilterIndexChecked(request.params[1]);
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        block_index = LookupBlockIndex(block_hash);
+        if (!block_index) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
+static UniValue getblockfilterheaders(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 3) {
+        throw std::runtime_error(
+            "getblockfilterheaders \"blockhash\" count ( \"filtertype\" )\n"
+            "\nRetrieve the BIP 157 filter headers of up to count blocks of the active chain,\n"
+            "starting at the given block.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the first block\n"
+            "2. count           (numeric, required) The number of headers to return (1 to " + std::to_string(MAX_BLOCKFILTER_RANGE) + ")\n"
+            "3. \"filtertype\"    (string, optional, default=basic) The type name of the filter (" + ListBlockFilterTypes() + ")\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"hex\",           (string) the hex-encoded filter header, in chain order\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilterheaders", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" 100")
+            + HelpExampleRpc("getblockfilterheaders", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", 100")
+        );
+    }
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    int count = request.params[1].get_int();
+    if (count < 1 || count > MAX_BLOCKFILTER_RANGE) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Header count out of range");
+    }
+    BlockFilterIndex* index = GetBlockFilterIndexChecked(request.params[2]);
+
+    const CBlockIndex* start_index;
+    const CBlockIndex* stop_index;
+    {
+        LOCK(cs_main);
+        start_index = LookupBlockIndex(block_hash);
+        if (!start_index) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        if (!chainActive.Contains(start_index)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block is not in the active chain");
+        }
+        stop_index = chainActive[std::min(start_index->nHeight + count - 1, chainActive.Height())];
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    std::vector<uint256> filter_headers;
+    if (!index->LookupFilterHeaderRange(start_index->nHeight, stop_index, filter_headers)) {
+        if (!index_ready) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Filter headers not found. Block filters are still in the process of being indexed.");
+        }
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Filter headers not found. This error is unexpected and indicates index corruption.");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const uint256& header : filter_headers) {
+        ret.push_back(header.GetHex());
+    }
+    return ret;
+}
+
 static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
 {
     CBlock block;
@@ -851,11 +1155,21 @@ static UniValue getblock(const JSONRPCRequest& request)
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    return StreamRPCResult(request, [&](JSONWriter& writer) {
+        blockToJSON(writer, block, pblockindex, verbosity >= 2);
+    });
 }
 
+/** The hash of the UTXO set computed by gettxoutsetinfo. */
+enum class CoinStatsHashType {
+    HASH_SERIALIZED_2,
+    MUHASH,
+    NONE,
+};
+
 struct CCoinsStats
 {
+    CoinStatsHashType hashType;
     int nHeight;
     uint256 hashBlock;
     uint64_t nTransactions;
@@ -865,25 +1179,33 @@ struct CCoinsStats
     uint64_t nDiskSize;
     CAmount nCoinAmount;
     CAmount nNameAmount;
+    uint64_t nNames;
 
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nCoinAmount(0), nNameAmount(0) {}
+    explicit CCoinsStats(CoinStatsHashType hashTypeIn) : hashType(hashTypeIn), nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nCoinAmount(0), nNameAmount(0), nNames(0) {}
 };
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, MuHash3072& muhash, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
+    if (stats.hashType == CoinStatsHashType::HASH_SERIALIZED_2) {
+        ss << hash;
+        ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
+    }
     stats.nTransactions++;
     for (const auto& output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+        if (stats.hashType == CoinStatsHashType::HASH_SERIALIZED_2) {
+            ss << VARINT(output.first + 1);
+            ss << output.second.out.scriptPubKey;
+            ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+        } else if (stats.hashType == CoinStatsHashType::MUHASH) {
+            ApplyCoinHash(muhash, COutPoint(hash, output.first), output.second);
+        }
         stats.nTransactionOutputs++;
 
         const CNameScript nameOp(output.second.out.scriptPubKey);
         if (nameOp.isNameOp()) {
             stats.nNameAmount += output.second.out.nValue;
+            if (nameOp.isAnyUpdate()) stats.nNames++;
         } else {
             stats.nCoinAmount += output.second.out.nValue;
         }
@@ -891,7 +1213,9 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
         stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
                            2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
     }
-    ss << VARINT(0u);
+    if (stats.hashType == CoinStatsHashType::HASH_SERIALIZED_2) {
+        ss << VARINT(0u);
+    }
 }
 
 //! Calculate statistics about the unspent transaction output set
@@ -901,6 +1225,7 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
     assert(pcursor);
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    MuHash3072 muhash;
     stats.hashBlock = pcursor->GetBestBlock();
     {
         LOCK(cs_main);
@@ -915,7 +1240,7 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         Coin coin;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
             if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
+                ApplyStats(stats, ss, muhash, prevkey, outputs);
                 outputs.clear();
             }
             prevkey = key.hash;
@@ -926,9 +1251,13 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         pcursor->Next();
     }
     if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+        ApplyStats(stats, ss, muhash, prevkey, outputs);
+    }
+    if (stats.hashType == CoinStatsHashType::HASH_SERIALIZED_2) {
+        stats.hashSerialized = ss.GetHash();
+    } else if (stats.hashType == CoinStatsHashType::MUHASH) {
+        muhash.Finalize(stats.hashSerialized);
     }
-    stats.hashSerialized = ss.GetHash();
     stats.nDiskSize = view->EstimateSize();
     return true;
 }
@@ -982,36 +1311,130 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
     return uint64_t(height);
 }
 
+static CoinStatsHashType ParseHashType(const UniValue& param)
+{
+    if (param.isNull()) return CoinStatsHashType::HASH_SERIALIZED_2;
+    const std::string& hash_type = param.get_str();
+    if (hash_type == "hash_serialized_2") return CoinStatsHashType::HASH_SERIALIZED_2;
+    if (hash_type == "muhash") return CoinStatsHashType::MUHASH;
+    if (hash_type == "none") return CoinStatsHashType::NONE;
+    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type));
+}
+
+static const CBlockIndex* ParseHashOrHeight(const UniValue& param)
+{
+    AssertLockHeld(cs_main);
+    if (param.isNum()) {
+        const int height = param.get_int();
+        if (height < 0 || height > chainActive.Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        }
+        return chainActive[height];
+    }
+    const CBlockIndex* pindex = LookupBlockIndex(ParseHashV(param, "hash_or_height"));
+    if (!pindex) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    }
+    return pindex;
+}
+
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless the statistics are read from the\n"
+            "coin stats index (-coinstatsindex), which is the case for a hash_type other\n"
+            "than hash_serialized_2 or when hash_or_height is given.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"      (string, optional, default=hash_serialized_2) Which UTXO set hash to calculate:\n"
+            "                     \"hash_serialized_2\", \"muhash\" or \"none\"\n"
+            "2. hash_or_height   (string or numeric, optional) The block hash or height of the target block;\n"
+            "                     requires -coinstatsindex (default: the current tip)\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) The hash of the block at the tip of the chain\n"
-            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs (not with the index)\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
-            "  \"total_amount\": {       (json object)\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash (only with hash_type hash_serialized_2)\n"
+            "  \"muhash\": \"hash\",       (string) The MuHash of the UTXO set (only with hash_type muhash)\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (not with the index)\n"
+            "  \"serialized_size\": n,   (numeric) The size of the coins as serialized in the chainstate (only with the index)\n"
+            "  \"names\": n,             (numeric) The number of active names\n"
+            "  \"amount\": {             (json object)\n"
             "    \"coins\": x.xxx,       (numeric) Total amount of coins\n"
             "    \"names\": x.xxx,       (numeric) Amount locked in active names\n"
             "    \"total\": x.xxx        (numeric) Total amount in coins and names\n"
+            "  },\n"
+            "  \"bets\": {               (json object, only with the index)\n"
+            "    \"total\": x.xxx,       (numeric) Amount placed in bets up to the block\n"
+            "    \"paid\": x.xxx,        (numeric) Amount paid out for winning bets up to the block\n"
+            "    \"pending\": x.xxx      (numeric) Payoff of the winning bets of the block, paid out by the next block\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "muhash 1000")
             + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleRpc("gettxoutsetinfo", "\"none\", 1000")
         );
 
     UniValue ret(UniValue::VOBJ);
 
-    CCoinsStats stats;
+    const CoinStatsHashType hash_type = ParseHashType(request.params[0]);
+
+    if (!request.params[1].isNull() || (g_coin_stats_index && hash_type != CoinStatsHashType::HASH_SERIALIZED_2)) {
+        if (!g_coin_stats_index) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Querying specific blocks requires -coinstatsindex");
+        }
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED_2) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_serialized_2 cannot be queried for a specific block");
+        }
+
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = request.params[1].isNull() ? chainActive.Tip() : ParseHashOrHeight(request.params[1]);
+        }
+
+        bool index_ready = g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+
+        CoinStatsEntry stats;
+        if (!g_coin_stats_index->LookupStats(pindex, stats)) {
+            if (!index_ready) {
+                throw JSONRPCError(RPC_MISC_ERROR, "UTXO set statistics are still in the process of being indexed.");
+            }
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "UTXO set statistics of the block not found.");
+        }
+
+        ret.pushKV("height", (int64_t)pindex->nHeight);
+        ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
+        ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
+        ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+        if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.muhash.GetHex());
+        }
+        ret.pushKV("serialized_size", (int64_t)stats.nSerializedSize);
+        ret.pushKV("names", (int64_t)stats.nNames);
+
+        UniValue amount(UniValue::VOBJ);
+        amount.pushKV("coins", ValueFromAmount(stats.nCoinAmount));
+        amount.pushKV("names", ValueFromAmount(stats.nNameAmount));
+        amount.pushKV("total", ValueFromAmount(stats.nCoinAmount + stats.nNameAmount));
+        ret.pushKV("amount", amount);
+
+        UniValue bets(UniValue::VOBJ);
+        bets.pushKV("total", ValueFromAmount(stats.nTotalBets));
+        bets.pushKV("paid", ValueFromAmount(stats.nTotalPayouts));
+        bets.pushKV("pending", ValueFromAmount(stats.nPendingPayouts));
+        ret.pushKV("bets", bets);
+        return ret;
+    }
+
+    CCoinsStats stats(hash_type);
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsdbview.get(), stats)) {
         ret.pushKV("height", (int64_t)stats.nHeight);
@@ -1019,8 +1442,13 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED_2) {
+            ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        } else if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.hashSerialized.GetHex());
+        }
         ret.pushKV("disk_size", stats.nDiskSize);
+        ret.pushKV("names", (int64_t)stats.nNames);
 
         UniValue amount(UniValue::VOBJ);
         amount.pushKV("coins", ValueFromAmount(stats.nCoinAmount));
@@ -2001,33 +2429,156 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
-//! Search for a given set of pubkey scripts
-bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the UTXO set and name database at the current tip to a snapshot file,\n"
+            "which can be used to bootstrap a node with -loadsnapshot.\n"
+            "Note this call may take some time, during which block processing is paused.\n"
+            "\nArguments:\n"
+            "1. \"path\"              (string, required) Path of the output file. Relative paths are prefixed by the datadir.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hex\",      (string) The hash of the block at which the snapshot was taken\n"
+            "  \"base_height\": n,         (numeric) The height of that block\n"
+            "  \"coins\": n,               (numeric) The number of unspent transaction outputs\n"
+            "  \"names\": n,               (numeric) The number of names\n"
+            "  \"name_history\": n,        (numeric) The number of name history entries (0 without -namehistory)\n"
+            "  \"snapshot_hash\": \"hex\",  (string) The hash to pin in the chain parameters for -loadsnapshot\n"
+            "  \"path\": \"path\"           (string) The absolute path of the file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+    }
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    const fs::path temppath = path.string() + ".incomplete";
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+
+    SnapshotMetadata metadata;
+    SnapshotStats stats;
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+
+        CAutoFile file(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Unable to open " + temppath.string());
+        }
+        if (!pcoinsdbview->DumpSnapshot(file, metadata, stats) || !FileCommit(file.Get())) {
+            file.fclose();
+            fs::remove(temppath);
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to write UTXO snapshot");
+        }
+        pindex = LookupBlockIndex(metadata.hashBlock);
+        assert(pindex);
+    }
+    RenameOver(temppath, path);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("base_hash", metadata.hashBlock.GetHex());
+    ret.pushKV("base_height", pindex->nHeight);
+    ret.pushKV("coins", (int64_t)stats.nCoins);
+    ret.pushKV("names", (int64_t)stats.nNames);
+    ret.pushKV("name_history", (int64_t)stats.nHistory);
+    ret.pushKV("snapshot_hash", stats.hashState.GetHex());
+    ret.pushKV("path", path.string());
+    return ret;
+}
+
+ScriptNeedles::ScriptNeedles(std::map<CScript, std::vector<size_t>> scripts)
+    : m_scripts(std::move(scripts)), m_num_sets(0),
+      m_k0(GetRand(std::numeric_limits<uint64_t>::max())), m_k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+    // At least 16 bits per script, so that about 6% of the coins that do
+    // not match pass the filter.
+    size_t filter_size = 1024;
+    while (filter_size < 16 * m_scripts.size()) filter_size *= 2;
+    m_filter.resize(filter_size);
+    for (const auto& script : m_scripts) {
+        m_filter[FilterIndex(script.first)] = true;
+        for (const size_t set : script.second) m_num_sets = std::max(m_num_sets, set + 1);
+    }
+}
+
+size_t ScriptNeedles::FilterIndex(const CScript& script) const
+{
+    return CSipHasher(m_k0, m_k1).Write(script.data(), script.size()).Finalize() & (m_filter.size() - 1);
+}
+
+const std::vector<size_t>* ScriptNeedles::Find(const CScript& script) const
+{
+    if (!m_filter[FilterIndex(script)]) return nullptr;
+    const auto it = m_scripts.find(script);
+    return it == m_scripts.end() ? nullptr : &it->second;
+}
+
+bool FindScriptPubKeys(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, std::atomic<int64_t>& count, const CCoinsViewDB& view, const CDBSnapshot& snapshot, const ScriptNeedles& needles, int threads, std::vector<std::map<COutPoint, Coin>>& out_results)
+{
+    // The coins are split by the first byte of their txid.
+    static constexpr int NUM_RANGES = 256;
+
     scan_progress = 0;
     count = 0;
-    while (cursor->Valid()) {
-        COutPoint key;
-        Coin coin;
-        if (!cursor->GetKey(key) || !cursor->GetValue(coin)) return false;
-        if (++count % 8192 == 0) {
-            boost::this_thread::interruption_point();
-            if (should_abort) {
-                // allow to abort the scan via the abort reference
-                return false;
+    threads = std::max(1, std::min(threads, MAX_SCAN_THREADS));
+    std::atomic<int> next_range{0};
+    std::atomic<int> ranges_done{0};
+    std::atomic<bool> failed{false};
+    std::vector<std::vector<std::map<COutPoint, Coin>>> results(threads, std::vector<std::map<COutPoint, Coin>>(needles.NumSets()));
+
+    auto scan = [&](std::vector<std::map<COutPoint, Coin>>& found) {
+        int range;
+        while (!failed && (range = next_range++) < NUM_RANGES) {
+            uint256 begin, end;
+            *begin.begin() = range;
+            if (range + 1 < NUM_RANGES) *end.begin() = range + 1;
+            std::unique_ptr<CCoinsViewCursor> cursor(view.Cursor(snapshot, begin, end));
+            int64_t range_count = 0;
+            for (; cursor->Valid(); cursor->Next()) {
+                COutPoint key;
+                Coin coin;
+                if (!cursor->GetKey(key) || !cursor->GetValue(coin)) {
+                    failed = true;
+                    return;
+                }
+                if (++range_count % 8192 == 0) {
+                    count += 8192;
+                    if (should_abort || ShutdownRequested()) {
+                        // allow to abort the scan via the abort reference
+                        failed = true;
+                        return;
+                    }
+                }
+                if (const std::vector<size_t>* sets = needles.Find(coin.out.scriptPubKey)) {
+                    for (const size_t set : *sets) found[set].emplace(key, coin);
+                }
             }
+            count += range_count % 8192;
+            scan_progress = (++ranges_done * 100) / NUM_RANGES;
         }
-        if (count % 256 == 0) {
-            // update progress reference every 256 item
-            uint32_t high = 0x100 * *key.hash.begin() + *(key.hash.begin() + 1);
-            scan_progress = (int)(high * 100.0 / 65536.0 + 0.5);
-        }
-        if (needles.count(coin.out.scriptPubKey)) {
-            out_results.emplace(key, coin);
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back(scan, std::ref(results[i]));
+    }
+    scan(results[0]);
+    for (std::thread& worker : workers) worker.join();
+
+    out_results.assign(needles.NumSets(), std::map<COutPoint, Coin>());
+    for (const auto& thread_results : results) {
+        for (size_t set = 0; set < thread_results.size(); ++set) {
+            out_results[set].insert(thread_results[set].begin(), thread_results[set].end());
         }
-        cursor->Next();
     }
-    scan_progress = 100;
-    return true;
+    return !failed;
 }
 
 /** RAII object to prevent concurrency issue when scanning the txout set */
@@ -2090,6 +2641,7 @@ UniValue scantxoutset(const JSONRPCRequest& request)
             "        {                         (object, optional) An object with output descriptor and metadata\n"
             "          \"desc\": \"descriptor\",   (string, required) An output descriptor\n"
             "          \"range\": n,             (numeric, optional) Up to what child index HD chains should be explored (default: 1000)\n"
+            "          \"set\": \"label\",         (string, optional) The scan set of the descriptor, whose outputs are reported separately\n"
             "        },\n"
             "        ...\n"
             "    ]\n"
@@ -2105,7 +2657,17 @@ UniValue scantxoutset(const JSONRPCRequest& request)
             "   }\n"
             "   ,...], \n"
             " \"total_amount\" : x.xxx,          (numeric) The total amount of all found unspent outputs in " + CURRENCY_UNIT + "\n"
+            " \"sets\": [                         (array) The outputs of each labelled scan set, if any scan object has a \"set\"\n"
+            "   {\n"
+            "     \"set\" : \"label\",             (string) The label of the scan set\n"
+            "     \"unspents\": [...],           (array) The unspent outputs of the scan set, as above\n"
+            "     \"total_amount\" : x.xxx,      (numeric) The total amount of the unspent outputs of the scan set\n"
+            "   }\n"
+            "   ,...]\n"
             "]\n"
+            "\nThe top level \"unspents\" and \"total_amount\" report the outputs of the descriptors without \"set\".\n"
+            "All scan sets are searched for in a single pass over the unspent transaction output set, which is split\n"
+            "between -rpcscanthreads threads.\n"
         );
 
     RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VARR});
@@ -2133,13 +2695,15 @@ UniValue scantxoutset(const JSONRPCRequest& request)
         if (!reserver.reserve()) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Scan already in progress, use action \"abort\" or \"status\"");
         }
-        std::set<CScript> needles;
-        CAmount total_in = 0;
+        // Scan set 0 holds the descriptors without a label.
+        std::map<CScript, std::vector<size_t>> script_sets;
+        std::vector<std::string> set_labels(1);
 
         // loop through the scan objects
         for (const UniValue& scanobject : request.params[1].get_array().getValues()) {
             std::string desc_str;
             int range = 1000;
+            size_t set = 0;
             if (scanobject.isStr()) {
                 desc_str = scanobject.get_str();
             } else if (scanobject.isObject()) {
@@ -2151,6 +2715,12 @@ UniValue scantxoutset(const JSONRPCRequest& request)
                     range = range_uni.get_int();
                     if (range < 0 || range > 1000000) throw JSONRPCError(RPC_INVALID_PARAMETER, "range out of range");
                 }
+                UniValue set_uni = find_value(scanobject, "set");
+                if (!set_uni.isNull()) {
+                    const std::string& label = set_uni.get_str();
+                    set = std::find(set_labels.begin() + 1, set_labels.end(), label) - set_labels.begin();
+                    if (set == set_labels.size()) set_labels.push_back(label);
+                }
             } else {
                 throw JSONRPCError(RPC_INVALID_PARAMETER, "Scan object needs to be either a string or an object");
             }
@@ -2166,46 +2736,71 @@ UniValue scantxoutset(const JSONRPCRequest& request)
                 if (!desc->Expand(i, provider, scripts, provider)) {
                     throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys: '%s'", desc_str));
                 }
-                needles.insert(scripts.begin(), scripts.end());
+                for (const CScript& script : scripts) {
+                    std::vector<size_t>& sets = script_sets[script];
+                    if (std::find(sets.begin(), sets.end(), set) == sets.end()) sets.push_back(set);
+                }
             }
         }
 
         // Scan the unspent transaction output set for inputs
-        UniValue unspents(UniValue::VARR);
-        std::vector<CTxOut> input_txos;
-        std::map<COutPoint, Coin> coins;
+        const ScriptNeedles needles(std::move(script_sets));
+        std::vector<std::map<COutPoint, Coin>> coins;
         g_should_abort_scan = false;
         g_scan_progress = 0;
-        int64_t count = 0;
-        std::unique_ptr<CCoinsViewCursor> pcursor;
+        std::atomic<int64_t> count{0};
+        std::unique_ptr<CDBSnapshot> snapshot;
         {
             LOCK(cs_main);
             FlushStateToDisk();
-            pcursor = std::unique_ptr<CCoinsViewCursor>(pcoinsdbview->Cursor());
-            assert(pcursor);
-        }
-        bool res = FindScriptPubKey(g_scan_progress, g_should_abort_scan, count, pcursor.get(), needles, coins);
-        result.pushKV("success", res);
-        result.pushKV("searched_items", count);
-
-        for (const auto& it : coins) {
-            const COutPoint& outpoint = it.first;
-            const Coin& coin = it.second;
-            const CTxOut& txo = coin.out;
-            input_txos.push_back(txo);
-            total_in += txo.nValue;
-
-            UniValue unspent(UniValue::VOBJ);
-            unspent.pushKV("txid", outpoint.hash.GetHex());
-            unspent.pushKV("vout", (int32_t)outpoint.n);
-            unspent.pushKV("scriptPubKey", HexStr(txo.scriptPubKey.begin(), txo.scriptPubKey.end()));
-            unspent.pushKV("amount", ValueFromAmount(txo.nValue));
-            unspent.pushKV("height", (int32_t)coin.nHeight);
-
-            unspents.push_back(unspent);
+            snapshot = pcoinsdbview->GetSnapshot();
         }
-        result.pushKV("unspents", unspents);
-        result.pushKV("total_amount", ValueFromAmount(total_in));
+        const int threads = gArgs.GetArg("-rpcscanthreads", DEFAULT_SCAN_THREADS);
+        bool res = FindScriptPubKeys(g_scan_progress, g_should_abort_scan, count, *pcoinsdbview, *snapshot, needles, threads, coins);
+        coins.resize(set_labels.size());
+
+        return StreamRPCResult(request, [&](JSONWriter& writer) {
+            // Write the unspents and total_amount of a scan set
+            auto write_unspents = [&writer](const std::map<COutPoint, Coin>& set_coins) {
+                CAmount total_in = 0;
+                writer.Key("unspents");
+                writer.BeginArray();
+                for (const auto& it : set_coins) {
+                    const COutPoint& outpoint = it.first;
+                    const Coin& coin = it.second;
+                    const CTxOut& txo = coin.out;
+                    total_in += txo.nValue;
+
+                    UniValue unspent(UniValue::VOBJ);
+                    unspent.pushKV("txid", outpoint.hash.GetHex());
+                    unspent.pushKV("vout", (int32_t)outpoint.n);
+                    unspent.pushKV("scriptPubKey", HexStr(txo.scriptPubKey.begin(), txo.scriptPubKey.end()));
+                    unspent.pushKV("amount", ValueFromAmount(txo.nValue));
+                    unspent.pushKV("height", (int32_t)coin.nHeight);
+
+                    writer.Value(unspent);
+                }
+                writer.EndArray();
+                writer.Pair("total_amount", ValueFromAmount(total_in));
+            };
+
+            writer.BeginObject();
+            writer.Pair("success", res);
+            writer.Pair("searched_items", count.load());
+            write_unspents(coins[0]);
+            if (set_labels.size() > 1) {
+                writer.Key("sets");
+                writer.BeginArray();
+                for (size_t set = 1; set < set_labels.size(); ++set) {
+                    writer.BeginObject();
+                    writer.Pair("set", set_labels[set]);
+                    write_unspents(coins[set]);
+                    writer.EndObject();
+                }
+                writer.EndArray();
+            }
+            writer.EndObject();
+        });
     } else {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid command");
     }
@@ -2224,7 +2819,10 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash","filtertype"} },
+    { "blockchain",         "getblockfilterheaders",  &getblockfilterheaders,  {"blockhash","count","filtertype"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
+    { "blockchain",         "getdbinfo",              &getdbinfo,              {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
@@ -2232,8 +2830,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "getvalidationinterfaceinfo", &getvalidationinterfaceinfo, {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type","hash_or_height"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
+    { "blockchain",         "compactdb",              &compactdb,              {"database","keyspace"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
 
@@ -5,16 +5,29 @@
 #ifndef BITCOIN_RPC_BLOCKCHAIN_H
 #define BITCOIN_RPC_BLOCKCHAIN_H
 
+#include <atomic>
+#include <map>
 #include <vector>
 #include <stdint.h>
 #include <amount.h>
+#include <script/script.h>
 
 class CBlock;
 class CBlockIndex;
+class CCoinsViewDB;
+class CDBSnapshot;
+class Coin;
+class COutPoint;
+class JSONWriter;
 class UniValue;
 
 static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
 
+/** Default for -rpcscanthreads, the number of threads scanning the UTXO set for scantxoutset */
+static const int DEFAULT_SCAN_THREADS = 4;
+/** Maximum number of threads scanning the UTXO set */
+static const int MAX_SCAN_THREADS = 64;
+
 /**
  * Get the difficulty of the net wrt to the given block index.
  *
@@ -28,12 +41,14 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 
 /** Block description to JSON */
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+void blockToJSON(JSONWriter& writer, const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 
 /** Mempool information to JSON */
 UniValue mempoolInfoToJSON();
 
 /** Mempool to JSON */
 UniValue mempoolToJSON(bool fVerbose = false);
+void mempoolToJSON(JSONWriter& writer, bool fVerbose = false);
 
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
@@ -41,4 +56,39 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 /** Used by getblockstats to get feerates at different percentiles by weight  */
 void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
 
+/**
+ * The pubkey scripts searched by FindScriptPubKeys, each with the scan sets
+ * it belongs to. Most coins match none of them, so a bitmap indexed by a
+ * salted hash of the script rules out almost all coins before the scripts
+ * themselves are looked up.
+ */
+class ScriptNeedles
+{
+private:
+    std::map<CScript, std::vector<size_t>> m_scripts;
+    size_t m_num_sets;
+    uint64_t m_k0, m_k1;
+    std::vector<bool> m_filter;
+
+    size_t FilterIndex(const CScript& script) const;
+
+public:
+    /** Build the needles from the scan sets of each script, numbered from 0. */
+    explicit ScriptNeedles(std::map<CScript, std::vector<size_t>> scripts);
+
+    /** The scan sets a script belongs to, or nullptr if it is not searched. */
+    const std::vector<size_t>* Find(const CScript& script) const;
+
+    size_t NumSets() const { return m_num_sets; }
+    size_t size() const { return m_scripts.size(); }
+};
+
+/**
+ * Search the coins of a database snapshot for the given pubkey scripts. The
+ * coins are split into ranges of txids, which are scanned by the given number
+ * of threads. The coins found are returned for each scan set. Returns false if
+ * the scan was aborted or a coin could not be read.
+ */
+bool FindScriptPubKeys(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, std::atomic<int64_t>& count, const CCoinsViewDB& view, const CDBSnapshot& snapshot, const ScriptNeedles& needles, int threads, std::vector<std::map<COutPoint, Coin>>& out_results);
+
 #endif
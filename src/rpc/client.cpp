@@ -30,6 +30,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "makebet", 1 , "range" },
     { "makebet", 2 , "replaceable" },
     { "makebet", 3 , "conf_target" },
+    { "sendbatch", 0 , "requests" },
+    { "sendbatch", 1 , "replaceable" },
+    { "sendbatch", 2 , "conf_target" },
     { "getbet", 3 , "replaceable" },
     { "getbet", 4 , "conf_target" },
     { "storemessage", 1 , "replaceable" },
@@ -95,7 +98,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblock", 1, "verbosity" },
     { "getblock", 1, "verbose" },
     { "getblockheader", 1, "verbose" },
+    { "getblockfilterheaders", 1, "count" },
     { "getchaintxstats", 0, "nblocks" },
+    { "gettxoutsetinfo", 1, "hash_or_height" },
     { "gettransaction", 1, "include_watchonly" },
     { "getrawtransaction", 1, "verbose" },
     { "createrawtransaction", 0, "inputs" },
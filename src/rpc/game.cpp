@@ -12,6 +12,7 @@
 #include <stdint.h>
 #include <amount.h>
 #include <chainparams.h>
+#include <key_io.h>
 #include <net.h>
 #include <rpc/mining.h>
 #include <utilmoneystr.h>
@@ -55,6 +56,30 @@ static UniValue callRPC(std::string args)
     }
 }
 
+/** Build the bet output of a makebet transaction from the parsed bets. */
+static CRecipient createBetRecipient(const std::vector<CAmount>& betAmounts, const std::vector<std::string>& betTypes, int range)
+{
+    const CAmount betSum = betAmountsSum(betAmounts);
+
+    std::string arg=int2hex(range)+std::string("_");
+    std::string msg=HexStr(arg.begin(), arg.end());
+    const std::string plus_msg("+");
+    const std::string at_msg("@");
+
+    for(size_t i=0;i<betTypes.size();++i)
+    {
+        msg+=HexStr(betTypes[i].begin(), betTypes[i].end());
+        std::string amountStr = at_msg + std::to_string(betAmounts[i]);
+        msg+=HexStr(amountStr.begin(), amountStr.end());
+        if(i<betTypes.size()-1)
+        {
+            msg+=HexStr(plus_msg.begin(), plus_msg.end());
+        }
+    }
+
+    return createMakeBetDestination(betSum, msg);
+}
+
 UniValue makebet(const JSONRPCRequest& request)
 {
 	if (request.fHelp || request.params.size() < 1 || request.params.size() > 5)
@@ -105,7 +130,6 @@ UniValue makebet(const JSONRPCRequest& request)
     }
 
     parseBetType(betTypePattern, range, betAmounts, betTypes, isRoulette);
-    const CAmount betSum = betAmountsSum(betAmounts);
 
     CCoinControl coin_control;
     if (!request.params[2].isNull())
@@ -125,23 +149,7 @@ UniValue makebet(const JSONRPCRequest& request)
         }
     }
 
-    std::string arg=int2hex(range)+std::string("_");
-    std::string msg=HexStr(arg.begin(), arg.end());
-    const std::string plus_msg("+");
-    const std::string at_msg("@");
-
-    for(size_t i=0;i<betTypes.size();++i)
-    {
-        msg+=HexStr(betTypes[i].begin(), betTypes[i].end());
-        std::string amountStr = at_msg + std::to_string(betAmounts[i]);
-        msg+=HexStr(amountStr.begin(), amountStr.end());
-        if(i<betTypes.size()-1)
-        {
-            msg+=HexStr(plus_msg.begin(), plus_msg.end());
-        }
-    }
-    
-    const CRecipient recipient = createMakeBetDestination(betSum, msg);
+    const CRecipient recipient = createBetRecipient(betAmounts, betTypes, range);
     LOCK2(cs_main, pwallet->cs_wallet);
 
     CAmount curBalance = pwallet->GetBalance();
@@ -178,11 +186,258 @@ UniValue makebet(const JSONRPCRequest& request)
     return UniValue(UniValue::VSTR, txid);
 }
 
+/** A transaction of a sendbatch call, with the requests it serves. */
+struct BatchTx
+{
+    std::vector<size_t> items;
+    std::vector<CRecipient> recipients;
+    bool isBet;
+    std::unique_ptr<CReserveKey> reservekey;
+    int nChangePosInOut;
+
+    explicit BatchTx(bool isBetIn) : isBet(isBetIn), nChangePosInOut(-1) {}
+};
+
+UniValue sendbatch(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 4)
+    throw std::runtime_error(
+        "sendbatch [{\"bet\":\"type_of_bet\",\"range\":n},{\"address\":\"address\",\"amount\":x},...] ( replaceable conf_target \"estimate_mode\" )\n"
+        "\nMakes bets and payments in a single call.\n"
+        "Each bet gets its own transaction, as the consensus rules require, while all payments are sent in one transaction.\n"
+        "The transactions spend distinct coins, are signed in parallel and are added to the wallet at once.\n"
+        "Before this command walletpassphrase is required. \n"
+
+        "\nArguments:\n"
+        "1. requests                        (array, required) The bets and payments to make, each being one of\n"
+        "     {\n"
+        "       \"bet\":\"type_of_bet\",        (string, required) A bet, as the type_of_bet argument of makebet\n"
+        "       \"range\":n                   (numeric, optional) The range of the bet, as the range argument of makebet\n"
+        "     }\n"
+        "     {\n"
+        "       \"address\":\"address\",      (string, required) The BST address to pay\n"
+        "       \"amount\":x                  (numeric or string, required) The amount to pay in " + CURRENCY_UNIT + "\n"
+        "     }\n"
+        "2. replaceable                     (boolean, optional) Allow the transactions to be replaced by transactions with higher fees via BIP 125\n"
+        "3. conf_target                     (numeric, optional) Confirmation target (in blocks)\n"
+        "4. \"estimate_mode\"               (string, optional, default=UNSET) The fee estimate mode, must be one of:\n"
+        "       \"UNSET\"\n"
+        "       \"ECONOMICAL\"\n"
+        "       \"CONSERVATIVE\"\n"
+
+        "\nResult:\n"
+        "[                                  (array) One entry per request, in the order of the requests\n"
+        "  {\n"
+        "    \"txid\":\"txid\",               (string) The id of the transaction made for the request\n"
+        "    \"vout\":n,                      (numeric) The output of the bet or payment in that transaction\n"
+        "    \"error\":\"message\"            (string) Instead of txid and vout, why the request was not made\n"
+        "  }\n"
+        "  ,...\n"
+        "]\n"
+
+        "\nExamples:\n"
+        + HelpExampleCli("sendbatch", "\"[{\\\"bet\\\":\\\"straight_2@0.1\\\"},{\\\"bet\\\":\\\"1@0.5\\\",\\\"range\\\":6},{\\\"address\\\":\\\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\\\",\\\"amount\\\":0.01}]\"")
+        + HelpExampleRpc("sendbatch", "[{\"bet\":\"straight_2@0.1\"},{\"bet\":\"1@0.5\",\"range\":6},{\"address\":\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\",\"amount\":0.01}]")
+    );
+
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    if(wallet==nullptr)
+    {
+        throw std::runtime_error(std::string("No wallet found"));
+    }
+    CWallet* const pwallet=wallet.get();
+
+    RPCTypeCheckArgument(request.params[0], UniValue::VARR);
+    const UniValue& requests = request.params[0].get_array();
+
+    CCoinControl coin_control;
+    if (!request.params[1].isNull())
+    {
+        coin_control.m_signal_bip125_rbf = request.params[1].get_bool();
+    }
+
+    if (!request.params[2].isNull())
+    {
+        coin_control.m_confirm_target = ParseConfirmTarget(request.params[2]);
+    }
+
+    if (!request.params[3].isNull())
+    {
+        if (!FeeModeFromString(request.params[3].get_str(), coin_control.m_fee_mode)) {
+            throw std::runtime_error("Invalid estimate_mode parameter");
+        }
+    }
+
+    // Group the requests into transactions: one per bet, and one for all payments.
+    std::vector<UniValue> results(requests.size(), UniValue(UniValue::VOBJ));
+    std::vector<BatchTx> batch;
+    int paymentsTx = -1;
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        const UniValue& item = requests[i];
+        try {
+            if (!item.isObject()) {
+                throw std::runtime_error("Request must be an object");
+            }
+            const UniValue& betValue = find_value(item, "bet");
+            const UniValue& addressValue = find_value(item, "address");
+            if (!betValue.isNull())
+            {
+                std::string betTypePattern = betValue.get_str();
+                bool isRoulette = true;
+                int range = 36;//by default roulette range
+                const UniValue& rangeValue = find_value(item, "range");
+                if (!rangeValue.isNull())
+                {
+                    range = rangeValue.get_int();
+                    if (range <= 1) {
+                        throw std::runtime_error(std::string("Range must be greater than 1"));
+                    }
+                    isRoulette = false;
+                }
+                std::vector<CAmount> betAmounts;
+                std::vector<std::string> betTypes;
+                parseBetType(betTypePattern, range, betAmounts, betTypes, isRoulette);
+
+                batch.emplace_back(true);
+                batch.back().items.push_back(i);
+                batch.back().recipients.push_back(createBetRecipient(betAmounts, betTypes, range));
+            }
+            else if (!addressValue.isNull())
+            {
+                CTxDestination dest = DecodeDestination(addressValue.get_str());
+                if (!IsValidDestination(dest)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid BST address");
+                }
+                CAmount nAmount = AmountFromValue(find_value(item, "amount"));
+                if (nAmount <= 0) {
+                    throw JSONRPCError(RPC_TYPE_ERROR, "Invalid amount for send");
+                }
+
+                if (paymentsTx < 0) {
+                    paymentsTx = batch.size();
+                    batch.emplace_back(false);
+                }
+                batch[paymentsTx].items.push_back(i);
+                batch[paymentsTx].recipients.push_back({GetScriptForDestination(dest), nAmount, false});
+            }
+            else
+            {
+                throw std::runtime_error("Request must have a bet or an address");
+            }
+        }
+        catch (const UniValue& objError) {
+            results[i].pushKV("error", find_value(objError, "message").get_str());
+        }
+        catch (const std::exception& e) {
+            results[i].pushKV("error", std::string(e.what()));
+        }
+    }
+
+    // Fund the transactions one after the other, locking the coins each of
+    // them spends so that the next ones select other coins. The coins stay
+    // locked while the transactions are signed without holding the locks.
+    std::vector<size_t> built;
+    std::vector<CMutableTransaction> txs;
+    std::vector<std::vector<CTxOut>> spentOutputs;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        EnsureWalletIsUnlocked(pwallet);
+
+        for (size_t t = 0; t < batch.size(); ++t)
+        {
+            BatchTx& batchTx = batch[t];
+            batchTx.reservekey = MakeUnique<CReserveKey>(pwallet);
+            batchTx.nChangePosInOut = batchTx.isBet ? 1 : -1;
+            CAmount nFeeRequired;
+            std::string strFailReason;
+            CTransactionRef tx;
+            std::string error;
+
+            CAmount rewardSum{}, betsSum{};
+            if (!pwallet->CreateTransaction(batchTx.recipients, nullptr, tx, *batchTx.reservekey, nFeeRequired, batchTx.nChangePosInOut, strFailReason, coin_control, false, batchTx.isBet))
+            {
+                error = std::string("CreateTransaction failed with reason: ")+strFailReason;
+            }
+            else if (batchTx.isBet && !modulo::ver_2::checkBetsPotentialReward(rewardSum, betsSum, *tx))
+            {
+                error = "checkBetsPotentialReward failed with reason: potential reward or sum of bets over limit";
+            }
+            if (!error.empty())
+            {
+                for (const size_t item : batchTx.items) {
+                    results[item].pushKV("error", error);
+                }
+                continue;
+            }
+
+            std::vector<CTxOut> spent;
+            for (const CTxIn& txin : tx->vin)
+            {
+                pwallet->LockCoin(txin.prevout);
+                spent.push_back(pwallet->GetWalletTx(txin.prevout.hash)->tx->vout[txin.prevout.n]);
+            }
+            built.push_back(t);
+            txs.emplace_back(*tx);
+            spentOutputs.push_back(std::move(spent));
+        }
+    }
+
+    const std::vector<bool> signedTxs = pwallet->SignTransactions(txs, spentOutputs, GetNumCores());
+
+    LOCK2(cs_main, pwallet->cs_wallet);
+
+    std::vector<size_t> committed;
+    std::vector<CTransactionRef> commitTxs;
+    for (size_t k = 0; k < txs.size(); ++k)
+    {
+        for (const CTxIn& txin : txs[k].vin) {
+            pwallet->UnlockCoin(txin.prevout);
+        }
+        if (!signedTxs[k])
+        {
+            for (const size_t item : batch[built[k]].items) {
+                results[item].pushKV("error", std::string("CreateTransaction failed with reason: Signing transaction failed"));
+            }
+            continue;
+        }
+        committed.push_back(built[k]);
+        commitTxs.push_back(MakeTransactionRef(std::move(txs[k])));
+    }
+
+    std::vector<CValidationState> states;
+    const bool written = pwallet->CommitTransactions(commitTxs, g_connman.get(), states);
+    for (size_t k = 0; k < commitTxs.size(); ++k)
+    {
+        BatchTx& batchTx = batch[committed[k]];
+        // The transactions are in the wallet even if they could not be written.
+        batchTx.reservekey->KeepKey();
+        for (size_t r = 0; r < batchTx.items.size(); ++r)
+        {
+            UniValue& result = results[batchTx.items[r]];
+            if (!written) {
+                result.pushKV("error", std::string("CommitTransaction failed with reason: the wallet database could not be written"));
+                continue;
+            }
+            const int changePos = batchTx.nChangePosInOut;
+            result.pushKV("txid", commitTxs[k]->GetHash().GetHex());
+            result.pushKV("vout", changePos >= 0 && static_cast<int>(r) >= changePos ? static_cast<int>(r) + 1 : static_cast<int>(r));
+        }
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const UniValue& result : results) {
+        ret.push_back(result);
+    }
+    return ret;
+}
+
 
 static const CRPCCommand commands[] =
 { //  category              name                            actor (function)            argNames
   //  --------------------- ------------------------        -----------------------     ----------
     { "games",             "makebet",                      &makebet,                   {"type_of_bet", "range", "replaceable", "conf_target", "estimate_mode"} },
+    { "games",             "sendbatch",                    &sendbatch,                 {"requests", "replaceable", "conf_target", "estimate_mode"} },
 };
 
 void RegisterGameRPCCommands(CRPCTable &t)
@@ -0,0 +1,156 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/jsonwriter.h>
+
+#include <assert.h>
+
+void JSONTreeWriter::Add(const std::string& key, const UniValue& value)
+{
+    if (vStack.empty()) {
+        result = value;
+    } else if (vStack.back().second.isObject()) {
+        vStack.back().second.pushKV(key, value);
+    } else {
+        vStack.back().second.push_back(value);
+    }
+}
+
+void JSONTreeWriter::BeginObject()
+{
+    vStack.emplace_back(strKey, UniValue(UniValue::VOBJ));
+    strKey.clear();
+}
+
+void JSONTreeWriter::EndObject()
+{
+    assert(!vStack.empty() && vStack.back().second.isObject());
+    std::pair<std::string, UniValue> entry = std::move(vStack.back());
+    vStack.pop_back();
+    Add(entry.first, entry.second);
+}
+
+void JSONTreeWriter::BeginArray()
+{
+    vStack.emplace_back(strKey, UniValue(UniValue::VARR));
+    strKey.clear();
+}
+
+void JSONTreeWriter::EndArray()
+{
+    assert(!vStack.empty() && vStack.back().second.isArray());
+    std::pair<std::string, UniValue> entry = std::move(vStack.back());
+    vStack.pop_back();
+    Add(entry.first, entry.second);
+}
+
+void JSONTreeWriter::Key(const std::string& key)
+{
+    assert(!vStack.empty() && vStack.back().second.isObject());
+    strKey = key;
+}
+
+void JSONTreeWriter::Value(const UniValue& value)
+{
+    Add(strKey, value);
+    strKey.clear();
+}
+
+JSONStreamWriter::JSONStreamWriter(Sink sinkIn, size_t nChunkSizeIn)
+    : sink(std::move(sinkIn)), nChunkSize(nChunkSizeIn), fKeyPending(false), fFlushed(false)
+{
+}
+
+void JSONStreamWriter::BeginValue()
+{
+    if (fKeyPending) {
+        fKeyPending = false;
+        return;
+    }
+    if (!vStack.empty()) {
+        assert(vStack.back().first == ']');
+        if (!vStack.back().second) strBuffer += ',';
+        vStack.back().second = false;
+    }
+}
+
+void JSONStreamWriter::Begin(char chOpen, char chClose)
+{
+    BeginValue();
+    strBuffer += chOpen;
+    vStack.emplace_back(chClose, true);
+}
+
+void JSONStreamWriter::End(char chClose)
+{
+    assert(!vStack.empty() && vStack.back().first == chClose && !fKeyPending);
+    strBuffer += chClose;
+    vStack.pop_back();
+    MaybeFlush();
+}
+
+void JSONStreamWriter::MaybeFlush()
+{
+    if (strBuffer.size() >= nChunkSize) Flush();
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    Begin('{', '}');
+}
+
+void JSONStreamWriter::EndObject()
+{
+    End('}');
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    Begin('[', ']');
+}
+
+void JSONStreamWriter::EndArray()
+{
+    End(']');
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!vStack.empty() && vStack.back().first == '}' && !fKeyPending);
+    if (!vStack.back().second) strBuffer += ',';
+    vStack.back().second = false;
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+    fKeyPending = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    BeginValue();
+    strBuffer += value.write();
+    MaybeFlush();
+}
+
+void JSONStreamWriter::Unwind(size_t nDepth)
+{
+    if (fKeyPending) Value(NullUniValue);
+    while (vStack.size() > nDepth) {
+        End(vStack.back().first);
+    }
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (strBuffer.empty()) return;
+    fFlushed = true;
+    sink(strBuffer);
+    strBuffer.clear();
+}
+
+std::string JSONStreamWriter::TakeBuffer()
+{
+    std::string strResult;
+    strResult.swap(strBuffer);
+    return strResult;
+}
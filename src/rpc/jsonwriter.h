@@ -0,0 +1,122 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONWRITER_H
+#define BITCOIN_RPC_JSONWRITER_H
+
+#include <univalue.h>
+
+#include <functional>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/**
+ * Incremental producer of a JSON value.
+ *
+ * Containers are opened and closed explicitly, and everything below them is
+ * written as complete UniValue values. This lets large results be produced
+ * one element at a time, without holding the whole tree in memory.
+ */
+class JSONWriter
+{
+public:
+    virtual ~JSONWriter() {}
+
+    virtual void BeginObject() = 0;
+    virtual void EndObject() = 0;
+    virtual void BeginArray() = 0;
+    virtual void EndArray() = 0;
+
+    /** Set the key of the next value. Only valid directly inside an object. */
+    virtual void Key(const std::string& key) = 0;
+    /** Write a complete value. */
+    virtual void Value(const UniValue& value) = 0;
+
+    void Pair(const std::string& key, const UniValue& value)
+    {
+        Key(key);
+        Value(value);
+    }
+};
+
+/** JSONWriter that builds a UniValue, for callers that need the whole result. */
+class JSONTreeWriter final : public JSONWriter
+{
+private:
+    /** Open containers, with the key each is stored under in its parent. */
+    std::vector<std::pair<std::string, UniValue>> vStack;
+    std::string strKey;
+    UniValue result;
+
+    void Add(const std::string& key, const UniValue& value);
+
+public:
+    void BeginObject() override;
+    void EndObject() override;
+    void BeginArray() override;
+    void EndArray() override;
+    void Key(const std::string& key) override;
+    void Value(const UniValue& value) override;
+
+    /** The value written so far. Only complete after all containers are closed. */
+    const UniValue& GetResult() const { return result; }
+};
+
+/**
+ * JSONWriter that serializes to compact JSON text (as UniValue::write() does)
+ * and passes it on to a sink in chunks of roughly nChunkSize bytes.
+ */
+class JSONStreamWriter final : public JSONWriter
+{
+public:
+    typedef std::function<void(const std::string&)> Sink;
+
+    /** Default size of the chunks passed to the sink. */
+    static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string strBuffer;
+    /** Closing character of each open container, and whether it has no elements yet. */
+    std::vector<std::pair<char, bool>> vStack;
+    bool fKeyPending;
+    bool fFlushed;
+
+    void BeginValue();
+    void Begin(char chOpen, char chClose);
+    void End(char chClose);
+    void MaybeFlush();
+
+public:
+    explicit JSONStreamWriter(Sink sinkIn, size_t nChunkSizeIn = DEFAULT_CHUNK_SIZE);
+
+    void BeginObject() override;
+    void EndObject() override;
+    void BeginArray() override;
+    void EndArray() override;
+    void Key(const std::string& key) override;
+    void Value(const UniValue& value) override;
+
+    /** Number of containers currently open. */
+    size_t GetDepth() const { return vStack.size(); }
+    /** Whether Key() was called, and its value is still to be written. */
+    bool IsKeyPending() const { return fKeyPending; }
+    /** Whether any text has been passed to the sink yet. */
+    bool HasFlushed() const { return fFlushed; }
+
+    /**
+     * Close all containers above nDepth, writing null for a pending key. Used
+     * to leave well-formed JSON behind when producing a value was aborted.
+     */
+    void Unwind(size_t nDepth);
+
+    /** Pass all buffered text to the sink. */
+    void Flush();
+    /** Return the buffered text instead of passing it to the sink. */
+    std::string TakeBuffer();
+};
+
+#endif // BITCOIN_RPC_JSONWRITER_H
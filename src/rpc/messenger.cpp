@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <rpc/server.h>
+#include <rpc/jsonwriter.h>
 #include <rpc/client.h>
 #include <rpc/util.h>
 #include <consensus/validation.h>
@@ -643,39 +644,42 @@ UniValue listmsgsinceblock(const JSONRPCRequest& request)
 
     TransactionsMap& transactions = pwallet->encrMsgMapWallet;
     std::map<std::string, std::string> &addressBook = pwallet->mapMessengerAddressBook;
-    UniValue txnsList(UniValue::VARR);
 
-    for (auto index = transactions.begin(); index != transactions.end(); ++index)
-    {
-        const TransactionValue &it = index->second;
+    return StreamRPCResult(request, [&](JSONWriter& writer) {
+        writer.BeginObject();
+        writer.Key("transactions");
+        writer.BeginArray();
 
-        if (depth == -1 || it.wltTx.GetDepthInMainChain() < depth)
+        for (auto index = transactions.begin(); index != transactions.end(); ++index)
         {
-            UniValue entry(UniValue::VOBJ);
-
-            time_t t = (it.wltTx.nTimeSmart > 0 ? it.wltTx.nTimeSmart : it.wltTx.nTimeReceived);
-            std::tm *ptm = std::localtime(&t);
-            char buffer[32];
-            std::strftime(buffer, sizeof(buffer), "%d.%m.%Y %H:%M", ptm);
-            entry.pushKV("date", buffer);
-            entry.pushKV("txid", index->first.ToString().c_str());
-            entry.pushKV("block hash", it.wltTx.hashBlock.ToString().c_str());
-
-            auto sender = addressBook.find(it.from);
-            if (sender != addressBook.end())
+            const TransactionValue &it = index->second;
+
+            if (depth == -1 || it.wltTx.GetDepthInMainChain() < depth)
             {
-                entry.pushKV("from", sender->second);
+                UniValue entry(UniValue::VOBJ);
+
+                time_t t = (it.wltTx.nTimeSmart > 0 ? it.wltTx.nTimeSmart : it.wltTx.nTimeReceived);
+                std::tm *ptm = std::localtime(&t);
+                char buffer[32];
+                std::strftime(buffer, sizeof(buffer), "%d.%m.%Y %H:%M", ptm);
+                entry.pushKV("date", buffer);
+                entry.pushKV("txid", index->first.ToString().c_str());
+                entry.pushKV("block hash", it.wltTx.hashBlock.ToString().c_str());
+
+                auto sender = addressBook.find(it.from);
+                if (sender != addressBook.end())
+                {
+                    entry.pushKV("from", sender->second);
+                }
+
+                writer.Value(entry);
             }
-
-            txnsList.push_back(entry);
         }
-    }
-
-    UniValue ret(UniValue::VOBJ);
-    ret.pushKV("transactions", txnsList);
-    ret.pushKV("lastblock", chainActive[chainActive.Height()]->GetBlockHash().GetHex());
 
-    return ret;
+        writer.EndArray();
+        writer.Pair("lastblock", chainActive[chainActive.Height()]->GetBlockHash().GetHex());
+        writer.EndObject();
+    });
 }
 
 static UniValue createmsgtransaction(const JSONRPCRequest& request)
@@ -10,6 +10,7 @@
 #include <names/common.h>
 #include <names/main.h>
 #include <primitives/transaction.h>
+#include <rpc/jsonwriter.h>
 #include <rpc/names.h>
 #include <rpc/server.h>
 #include <script/names.h>
@@ -426,20 +427,24 @@ name_scan (const JSONRPCRequest& request)
   if (request.params.size () >= 2)
     count = request.params[1].get_int ();
 
-  UniValue res(UniValue::VARR);
   if (count <= 0)
-    return res;
+    return UniValue (UniValue::VARR);
 
   MaybeWalletForRequest wallet(request);
   LOCK2 (cs_main, wallet.getLock ());
 
-  valtype name;
-  CNameData data;
-  std::unique_ptr<CNameIterator> iter(pcoinsTip->IterateNames ());
-  for (iter->seek (start); count > 0 && iter->next (name, data); --count)
-    res.push_back (getNameInfo (name, data, wallet));
+  return StreamRPCResult (request, [&] (JSONWriter& writer)
+    {
+      writer.BeginArray ();
 
-  return res;
+      valtype name;
+      CNameData data;
+      std::unique_ptr<CNameIterator> iter(pcoinsTip->IterateNames ());
+      for (iter->seek (start); count > 0 && iter->next (name, data); --count)
+        writer.Value (getNameInfo (name, data, wallet));
+
+      writer.EndArray ();
+    });
 }
 
 /* ************************************************************************** */
@@ -520,70 +525,78 @@ name_filter (const JSONRPCRequest& request)
   /* ******************************************* */
   /* Iterate over names to build up the result.  */
 
-  UniValue names(UniValue::VARR);
-  unsigned count(0);
-
   MaybeWalletForRequest wallet(request);
   LOCK2 (cs_main, wallet.getLock ());
 
-  valtype name;
-  CNameData data;
-  std::unique_ptr<CNameIterator> iter(pcoinsTip->IterateNames ());
-  while (iter->next (name, data))
+  /* The names are written out as they are found, so that large results
+     need not be held in memory in full.  */
+  return StreamRPCResult (request, [&] (JSONWriter& writer)
     {
-      const int age = chainActive.Height () - data.getHeight ();
-      assert (age >= 0);
-      if (maxage != 0 && age >= maxage)
-        continue;
-
-      if (haveRegexp)
+      unsigned count(0);
+      if (!stats)
+        writer.BeginArray ();
+
+      valtype name;
+      CNameData data;
+      std::unique_ptr<CNameIterator> iter(pcoinsTip->IterateNames ());
+      while (iter->next (name, data))
         {
-          try
+          const int age = chainActive.Height () - data.getHeight ();
+          assert (age >= 0);
+          if (maxage != 0 && age >= maxage)
+            continue;
+
+          if (haveRegexp)
             {
-              const std::string nameStr = EncodeName (name, NameEncoding::UTF8);
-              boost::xpressive::smatch matches;
-              if (!boost::xpressive::regex_search (nameStr, matches, regexp))
-                continue;
+              try
+                {
+                  const std::string nameStr
+                      = EncodeName (name, NameEncoding::UTF8);
+                  boost::xpressive::smatch matches;
+                  if (!boost::xpressive::regex_search (nameStr, matches,
+                                                       regexp))
+                    continue;
+                }
+              catch (const InvalidNameString& exc)
+                {
+                  continue;
+                }
             }
-          catch (const InvalidNameString& exc)
+
+          if (from > 0)
             {
+              --from;
               continue;
             }
-        }
+          assert (from == 0);
 
-      if (from > 0)
-        {
-          --from;
-          continue;
-        }
-      assert (from == 0);
+          if (stats)
+            ++count;
+          else
+            writer.Value (getNameInfo (name, data, wallet));
 
-      if (stats)
-        ++count;
-      else
-        names.push_back (getNameInfo (name, data, wallet));
-
-      if (nb > 0)
-        {
-          --nb;
-          if (nb == 0)
-            break;
+          if (nb > 0)
+            {
+              --nb;
+              if (nb == 0)
+                break;
+            }
         }
-    }
 
-  /* ********************************************************** */
-  /* Return the correct result (take stats mode into account).  */
+      /* ********************************************************** */
+      /* Finish the correct result (take stats mode into account).  */
 
-  if (stats)
-    {
-      UniValue res(UniValue::VOBJ);
-      res.pushKV ("blocks", chainActive.Height ());
-      res.pushKV ("count", static_cast<int> (count));
-
-      return res;
-    }
+      if (stats)
+        {
+          UniValue res(UniValue::VOBJ);
+          res.pushKV ("blocks", chainActive.Height ());
+          res.pushKV ("count", static_cast<int> (count));
 
-  return names;
+          writer.Value (res);
+        }
+      else
+        writer.EndArray ();
+    });
 }
 
 /* ************************************************************************** */
@@ -835,7 +848,7 @@ name_checkdb (const JSONRPCRequest& request)
       );
 
   LOCK (cs_main);
-  pcoinsTip->Flush ();
+  SyncCoinsTip ();
   return pcoinsTip->ValidateNameDB ();
 }
 
@@ -6,20 +6,28 @@
 #include <rpc/server.h>
 
 #include <fs.h>
+#include <httpserver.h>
 #include <key_io.h>
+#include <rpc/jsonwriter.h>
 #include <random.h>
 #include <shutdown.h>
 #include <sync.h>
 #include <ui_interface.h>
 #include <util.h>
 #include <utilstrencodings.h>
+#include <validation.h>
 
 #include <boost/bind.hpp>
 #include <boost/signals2/signal.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory> // for unique_ptr
+#include <thread>
 #include <unordered_map>
 
 static CCriticalSection cs_rpcWarmup;
@@ -31,6 +39,110 @@ static RPCTimerInterface* timerInterface = nullptr;
 /* Map of name to timer. */
 static std::map<std::string, std::unique_ptr<RPCTimerBase> > deadlineTimers;
 
+/**
+ * Pool of threads that execute the elements of JSON-RPC batches. The worker
+ * that received a batch executes its elements as well, and enlists at most
+ * -rpcbatchparallelism pool threads to help, so that one large batch cannot
+ * occupy the whole pool.
+ */
+class RPCBatchPool
+{
+private:
+    Mutex cs;
+    std::condition_variable cond;
+    std::deque<std::function<void()>> queue GUARDED_BY(cs);
+    bool running GUARDED_BY(cs);
+    size_t maxQueueDepth GUARDED_BY(cs);
+    std::vector<std::thread> threads;
+
+    void Run()
+    {
+        RenameThread("bitcoin-rpcbatch");
+        while (true) {
+            std::function<void()> task;
+            {
+                WAIT_LOCK(cs, lock);
+                while (running && queue.empty())
+                    cond.wait(lock);
+                // Queued tasks are still run after stopping, as batches wait for them
+                if (queue.empty())
+                    return;
+                task = std::move(queue.front());
+                queue.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    RPCBatchPool() : running(false), maxQueueDepth(0) {}
+
+    void Start(int nThreads)
+    {
+        {
+            LOCK(cs);
+            running = true;
+        }
+        for (int i = 0; i < nThreads; ++i) {
+            threads.emplace_back(&RPCBatchPool::Run, this);
+        }
+    }
+
+    void Stop()
+    {
+        {
+            LOCK(cs);
+            running = false;
+        }
+        cond.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+    }
+
+    /** Queue a task. Returns false if the pool is not running. */
+    bool Submit(std::function<void()> task)
+    {
+        LOCK(cs);
+        if (!running)
+            return false;
+        queue.push_back(std::move(task));
+        maxQueueDepth = std::max(maxQueueDepth, queue.size());
+        cond.notify_one();
+        return true;
+    }
+
+    size_t GetThreadCount() const { return threads.size(); }
+
+    size_t GetQueueDepth()
+    {
+        LOCK(cs);
+        return queue.size();
+    }
+
+    size_t GetMaxQueueDepth()
+    {
+        LOCK(cs);
+        return maxQueueDepth;
+    }
+};
+
+static RPCBatchPool g_rpc_batch_pool;
+static int g_rpc_batch_parallelism = DEFAULT_RPC_BATCH_PARALLELISM;
+
+/** Latency of the calls to one RPC method made from batches. */
+struct RPCBatchMethodStats
+{
+    uint64_t nCalls = 0;
+    int64_t nTotalMicros = 0;
+    int64_t nMaxMicros = 0;
+};
+
+static Mutex cs_rpcBatchStats;
+static uint64_t g_rpc_batches GUARDED_BY(cs_rpcBatchStats) = 0;
+static std::map<std::string, RPCBatchMethodStats> g_rpc_batch_method_stats GUARDED_BY(cs_rpcBatchStats);
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -236,6 +348,189 @@ UniValue stop(const JSONRPCRequest& jsonRequest)
     return "BST server stopping";
 }
 
+static UniValue getrpcbatchinfo(const JSONRPCRequest& jsonRequest)
+{
+    if (jsonRequest.fHelp || jsonRequest.params.size() != 0)
+        throw std::runtime_error(
+            "getrpcbatchinfo\n"
+            "\nReturns details about the execution of JSON-RPC batch requests.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,             (numeric) The number of threads executing batch elements (-rpcbatchthreads)\n"
+            "  \"parallelism\": n,         (numeric) The number of those threads a single batch may use (-rpcbatchparallelism)\n"
+            "  \"queue_depth\": n,         (numeric) The number of tasks currently waiting for a thread\n"
+            "  \"max_queue_depth\": n,     (numeric) The highest queue depth seen\n"
+            "  \"batches\": n,             (numeric) The number of batches executed\n"
+            "  \"methods\": {              (json object) Calls made from batches, by method\n"
+            "    \"method\": {\n"
+            "      \"calls\": n,           (numeric) The number of calls\n"
+            "      \"total_us\": n,        (numeric) Their total execution time, in microseconds\n"
+            "      \"max_us\": n           (numeric) The longest execution time, in microseconds\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcbatchinfo", "")
+            + HelpExampleRpc("getrpcbatchinfo", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("threads", (uint64_t)g_rpc_batch_pool.GetThreadCount());
+    ret.pushKV("parallelism", g_rpc_batch_parallelism);
+    ret.pushKV("queue_depth", (uint64_t)g_rpc_batch_pool.GetQueueDepth());
+    ret.pushKV("max_queue_depth", (uint64_t)g_rpc_batch_pool.GetMaxQueueDepth());
+
+    LOCK(cs_rpcBatchStats);
+    ret.pushKV("batches", g_rpc_batches);
+    UniValue methods(UniValue::VOBJ);
+    for (const auto& entry : g_rpc_batch_method_stats) {
+        UniValue method(UniValue::VOBJ);
+        method.pushKV("calls", entry.second.nCalls);
+        method.pushKV("total_us", entry.second.nTotalMicros);
+        method.pushKV("max_us", entry.second.nMaxMicros);
+        methods.pushKV(entry.first, method);
+    }
+    ret.pushKV("methods", methods);
+    return ret;
+}
+
+static UniValue RPCMethodStatsToJSON(const RPCMethodStats& stats)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("calls", stats.nCalls.load());
+    ret.pushKV("errors", stats.nErrors.load());
+    ret.pushKV("in_flight", stats.nInFlight.load());
+    ret.pushKV("queue_wait", stats.queueWait.ToJSON());
+    ret.pushKV("lock_wait", stats.lockWait.ToJSON());
+    ret.pushKV("execution", stats.execution.ToJSON());
+    return ret;
+}
+
+static UniValue getrpcstats(const JSONRPCRequest& jsonRequest)
+{
+    if (jsonRequest.fHelp || jsonRequest.params.size() > 1)
+        throw std::runtime_error(
+            "getrpcstats ( \"method\" )\n"
+            "\nReturns call counters and latency histograms of the RPC methods, the calls being executed\n"
+            "and the state of the HTTP work queue.\n"
+            "Latencies are in microseconds. Histogram buckets are keyed by their upper bound (\"inf\" for the last\n"
+            "one), count the samples above the previous bound, and are omitted when empty.\n"
+            "\nArguments:\n"
+            "1. \"method\"    (string, optional) Only report this method. By default, methods that were called are reported.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"work_queue\": {            (json object) The HTTP work queue\n"
+            "    \"depth\": n,              (numeric) The number of requests waiting for a thread\n"
+            "    \"max_depth\": n,          (numeric) The maximum number of waiting requests (-rpcworkqueue)\n"
+            "    \"rejected\": n            (numeric) The number of requests rejected because the queue was full\n"
+            "  },\n"
+            "  \"active\": [                (json array) The calls being executed\n"
+            "    {\n"
+            "      \"method\": \"name\",      (string) The method\n"
+            "      \"duration_us\": n       (numeric) How long it has been running\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"methods\": {               (json object) Statistics by method\n"
+            "    \"method\": {\n"
+            "      \"calls\": n,            (numeric) The number of calls\n"
+            "      \"errors\": n,           (numeric) The number of calls that failed\n"
+            "      \"in_flight\": n,        (numeric) The number of calls being executed\n"
+            "      \"queue_wait\": {        (json object) Time between receiving the request and starting the call\n"
+            "        \"count\": n,          (numeric) The number of samples\n"
+            "        \"sum_us\": n,         (numeric) Their sum\n"
+            "        \"buckets\": {         (json object) The number of samples by bucket\n"
+            "          \"bound\": n, ...\n"
+            "        }\n"
+            "      },\n"
+            "      \"lock_wait\": {...},    (json object) Time spent waiting for the main lock (cs_main), as queue_wait\n"
+            "      \"execution\": {...}     (json object) Duration of the calls, as queue_wait\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleCli("getrpcstats", "\"getblock\"")
+            + HelpExampleRpc("getrpcstats", "\"getblock\"")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    const HTTPWorkQueueStats queueStats = GetHTTPWorkQueueStats();
+    UniValue workQueue(UniValue::VOBJ);
+    workQueue.pushKV("depth", (uint64_t)queueStats.nDepth);
+    workQueue.pushKV("max_depth", (uint64_t)queueStats.nMaxDepth);
+    workQueue.pushKV("rejected", queueStats.nRejected);
+    ret.pushKV("work_queue", workQueue);
+    ret.pushKV("active", GetActiveRPCCalls());
+
+    UniValue methods(UniValue::VOBJ);
+    if (!jsonRequest.params[0].isNull()) {
+        const std::string strMethod = jsonRequest.params[0].get_str();
+        const RPCMethodStats* stats = tableRPC.getStats(strMethod);
+        if (!stats)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown method: " + strMethod);
+        methods.pushKV(strMethod, RPCMethodStatsToJSON(*stats));
+    } else {
+        for (const std::string& strMethod : tableRPC.listCommands()) {
+            const RPCMethodStats* stats = tableRPC.getStats(strMethod);
+            if (stats->nCalls.load() == 0) continue;
+            methods.pushKV(strMethod, RPCMethodStatsToJSON(*stats));
+        }
+    }
+    ret.pushKV("methods", methods);
+    return ret;
+}
+
+std::string RPCStatsToPrometheus()
+{
+    std::string out;
+    const HTTPWorkQueueStats queueStats = GetHTTPWorkQueueStats();
+    out += "# HELP bst_http_work_queue_depth Requests waiting for an HTTP worker thread.\n";
+    out += "# TYPE bst_http_work_queue_depth gauge\n";
+    out += strprintf("bst_http_work_queue_depth %u\n", queueStats.nDepth);
+    out += "# HELP bst_http_work_queue_max_depth Maximum number of waiting requests (-rpcworkqueue).\n";
+    out += "# TYPE bst_http_work_queue_max_depth gauge\n";
+    out += strprintf("bst_http_work_queue_max_depth %u\n", queueStats.nMaxDepth);
+    out += "# HELP bst_http_work_queue_rejected_total Requests rejected because the work queue was full.\n";
+    out += "# TYPE bst_http_work_queue_rejected_total counter\n";
+    out += strprintf("bst_http_work_queue_rejected_total %u\n", queueStats.nRejected);
+
+    std::vector<std::pair<std::string, const RPCMethodStats*>> vStats;
+    for (const std::string& strMethod : tableRPC.listCommands()) {
+        const RPCMethodStats* stats = tableRPC.getStats(strMethod);
+        if (stats->nCalls.load() != 0) vStats.emplace_back(strMethod, stats);
+    }
+
+    out += "# HELP bst_rpc_calls_total RPC calls, by method.\n";
+    out += "# TYPE bst_rpc_calls_total counter\n";
+    for (const auto& entry : vStats)
+        out += strprintf("bst_rpc_calls_total{method=\"%s\"} %u\n", entry.first, entry.second->nCalls.load());
+    out += "# HELP bst_rpc_errors_total Failed RPC calls, by method.\n";
+    out += "# TYPE bst_rpc_errors_total counter\n";
+    for (const auto& entry : vStats)
+        out += strprintf("bst_rpc_errors_total{method=\"%s\"} %u\n", entry.first, entry.second->nErrors.load());
+    out += "# HELP bst_rpc_in_flight RPC calls being executed, by method.\n";
+    out += "# TYPE bst_rpc_in_flight gauge\n";
+    for (const auto& entry : vStats)
+        out += strprintf("bst_rpc_in_flight{method=\"%s\"} %d\n", entry.first, entry.second->nInFlight.load());
+
+    const struct {
+        const char* name;
+        const char* help;
+        const RPCLatencyHistogram RPCMethodStats::*histogram;
+    } histograms[] = {
+        {"bst_rpc_queue_wait_seconds", "Time between receiving an RPC request and starting the call.", &RPCMethodStats::queueWait},
+        {"bst_rpc_lock_wait_seconds", "Time RPC calls spent waiting for cs_main.", &RPCMethodStats::lockWait},
+        {"bst_rpc_execution_seconds", "Duration of RPC calls.", &RPCMethodStats::execution},
+    };
+    for (const auto& histogram : histograms) {
+        out += strprintf("# HELP %s %s\n", histogram.name, histogram.help);
+        out += strprintf("# TYPE %s histogram\n", histogram.name);
+        for (const auto& entry : vStats)
+            (entry.second->*histogram.histogram).ToPrometheus(out, histogram.name, strprintf("method=\"%s\"", entry.first));
+    }
+    return out;
+}
+
 static UniValue uptime(const JSONRPCRequest& jsonRequest)
 {
     if (jsonRequest.fHelp || jsonRequest.params.size() > 1)
@@ -263,6 +558,8 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "help",                   &help,                   {"command"}  },
     { "control",            "stop",                   &stop,                   {}  },
     { "control",            "uptime",                 &uptime,                 {}  },
+    { "control",            "getrpcbatchinfo",        &getrpcbatchinfo,        {}  },
+    { "control",            "getrpcstats",            &getrpcstats,            {"method"}  },
 };
 // clang-format on
 
@@ -275,6 +572,7 @@ CRPCTable::CRPCTable()
 
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
+        mapStats[pcmd->name] = MakeUnique<RPCMethodStats>();
     }
 }
 
@@ -297,6 +595,7 @@ bool CRPCTable::appendCommand(const std::string& name, const CRPCCommand* pcmd)
         return false;
 
     mapCommands[name] = pcmd;
+    mapStats[name] = MakeUnique<RPCMethodStats>();
     return true;
 }
 
@@ -304,6 +603,10 @@ void StartRPC()
 {
     LogPrint(BCLog::RPC, "Starting RPC\n");
     fRPCRunning = true;
+    int nBatchThreads = std::max((int)gArgs.GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 0);
+    g_rpc_batch_parallelism = std::max((int)gArgs.GetArg("-rpcbatchparallelism", DEFAULT_RPC_BATCH_PARALLELISM), 0);
+    LogPrint(BCLog::RPC, "Starting %d threads for RPC batches\n", nBatchThreads);
+    g_rpc_batch_pool.Start(nBatchThreads);
     g_rpcSignals.Started();
 }
 
@@ -317,6 +620,7 @@ void InterruptRPC()
 void StopRPC()
 {
     LogPrint(BCLog::RPC, "Stopping RPC\n");
+    g_rpc_batch_pool.Stop();
     deadlineTimers.clear();
     DeleteAuthCookie();
     g_rpcSignals.Stopped();
@@ -381,6 +685,17 @@ void JSONRPCRequest::parse(const UniValue& valRequest)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array or object");
 }
 
+UniValue StreamRPCResult(const JSONRPCRequest& request, const std::function<void(JSONWriter&)>& write)
+{
+    if (request.resultWriter) {
+        write(*request.resultWriter);
+        return NullUniValue;
+    }
+    JSONTreeWriter writer;
+    write(writer);
+    return writer.GetResult();
+}
+
 bool IsDeprecatedRPCEnabled(const std::string& method)
 {
     const std::vector<std::string> enabled_methods = gArgs.GetArgs("-deprecatedrpc");
@@ -411,11 +726,73 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
+/**
+ * A batch being executed. Threads claim elements by index until none are
+ * left; the replies are stored by index to keep them in request order.
+ */
+struct RPCBatch
+{
+    const JSONRPCRequest& jreq;
+    const UniValue& vReq;
+    std::vector<UniValue> vReplies;
+    std::atomic<size_t> nNext;
+
+    Mutex cs;
+    std::condition_variable cond;
+    size_t nDone GUARDED_BY(cs);
+
+    RPCBatch(const JSONRPCRequest& jreqIn, const UniValue& vReqIn) :
+        jreq(jreqIn), vReq(vReqIn), vReplies(vReqIn.size()), nNext(0), nDone(0) {}
+
+    /** Execute elements until all have been claimed. */
+    void Execute()
+    {
+        // jreq and vReq belong to the thread that waits for the batch, so they
+        // are only accessed while an element is still unfinished.
+        for (size_t i = nNext++; i < vReplies.size(); i = nNext++) {
+            const UniValue& method = find_value(vReq[i], "method");
+            int64_t nStart = GetTimeMicros();
+            vReplies[i] = JSONRPCExecOne(jreq, vReq[i]);
+            int64_t nMicros = GetTimeMicros() - nStart;
+            if (method.isStr() && tableRPC[method.get_str()]) {
+                LOCK(cs_rpcBatchStats);
+                RPCBatchMethodStats& stats = g_rpc_batch_method_stats[method.get_str()];
+                ++stats.nCalls;
+                stats.nTotalMicros += nMicros;
+                stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+            }
+
+            LOCK(cs);
+            if (++nDone == vReplies.size())
+                cond.notify_all();
+        }
+    }
+};
+
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
+    {
+        LOCK(cs_rpcBatchStats);
+        ++g_rpc_batches;
+    }
+
+    // Helpers that only get to run after all elements have been claimed
+    // return right away, so the batch does not wait for them.
+    auto batch = std::make_shared<RPCBatch>(jreq, vReq);
+    size_t nHelpers = vReq.size() > 1 ? std::min((size_t)g_rpc_batch_parallelism, vReq.size() - 1) : 0;
+    for (size_t i = 0; i < nHelpers; ++i) {
+        if (!g_rpc_batch_pool.Submit([batch] { batch->Execute(); }))
+            break;
+    }
+    batch->Execute();
+    {
+        WAIT_LOCK(batch->cs, lock);
+        while (batch->nDone < batch->vReplies.size())
+            batch->cond.wait(lock);
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    ret.push_backV(batch->vReplies);
 
     return ret.write() + "\n";
 }
@@ -470,6 +847,49 @@ static inline JSONRPCRequest transformNamedArguments(const JSONRPCRequest& in, c
     return out;
 }
 
+namespace {
+
+/**
+ * Records the statistics of an RPC call, from its construction right before
+ * the call until its destruction, however the call ends. Waits for cs_main
+ * on the executing thread are accounted to the call meanwhile.
+ */
+class RPCCallRecorder
+{
+private:
+    RPCMethodStats& stats;
+    const int64_t nStart;
+    LockWaitTracker lockWait;
+    LockWaitTracker* const prevLockWait;
+    RPCActiveCall activeCall;
+    bool fSuccess;
+
+public:
+    RPCCallRecorder(RPCMethodStats& statsIn, const JSONRPCRequest& request)
+        : stats(statsIn), nStart(GetTimeMicros()), lockWait{&cs_main, 0},
+          prevLockWait(GetLockWaitTracker()), activeCall(request.strMethod), fSuccess(false)
+    {
+        if (request.nTimeReceived != 0)
+            stats.queueWait.Add(nStart - request.nTimeReceived);
+        ++stats.nCalls;
+        ++stats.nInFlight;
+        SetLockWaitTracker(&lockWait);
+    }
+
+    ~RPCCallRecorder()
+    {
+        SetLockWaitTracker(prevLockWait);
+        stats.lockWait.Add(lockWait.nWaitMicros);
+        stats.execution.Add(GetTimeMicros() - nStart);
+        if (!fSuccess) ++stats.nErrors;
+        --stats.nInFlight;
+    }
+
+    void SetSuccess() { fSuccess = true; }
+};
+
+} // namespace
+
 UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 {
     // Return immediately if in warmup
@@ -486,14 +906,18 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    RPCCallRecorder recorder(*tableRPC.mapStats.at(request.strMethod), request);
     try
     {
         // Execute, convert arguments to array if necessary
+        UniValue result;
         if (request.params.isObject()) {
-            return pcmd->actor(transformNamedArguments(request, pcmd->argNames));
+            result = pcmd->actor(transformNamedArguments(request, pcmd->argNames));
         } else {
-            return pcmd->actor(request);
+            result = pcmd->actor(request);
         }
+        recorder.SetSuccess();
+        return result;
     }
     catch (const std::exception& e)
     {
@@ -501,6 +925,14 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
     }
 }
 
+const RPCMethodStats* CRPCTable::getStats(const std::string& name) const
+{
+    auto it = mapStats.find(name);
+    if (it == mapStats.end())
+        return nullptr;
+    return it->second.get();
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
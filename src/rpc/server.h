@@ -8,18 +8,26 @@
 
 #include <amount.h>
 #include <rpc/protocol.h>
+#include <rpc/stats.h>
 #include <uint256.h>
 
+#include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <stdint.h>
 #include <string>
 
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** Default for -rpcbatchthreads, the size of the pool executing batch requests */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+/** Default for -rpcbatchparallelism, the number of pool threads a single batch may use */
+static const int DEFAULT_RPC_BATCH_PARALLELISM = 2;
 
 class CRPCCommand;
+class JSONWriter;
 
 namespace RPCServer
 {
@@ -46,11 +54,23 @@ public:
     std::string URI;
     std::string authUser;
     std::string peerAddr;
+    /** Where the result may be streamed to, if the caller supports it (see StreamRPCResult). */
+    JSONWriter* resultWriter;
+    /** When the request was received (GetTimeMicros), or 0 if unknown. Used to measure queueing. */
+    int64_t nTimeReceived;
 
-    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
+    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false), resultWriter(nullptr), nTimeReceived(0) {}
     void parse(const UniValue& valRequest);
 };
 
+/**
+ * Produce the result of an RPC call with a JSONWriter, for handlers whose
+ * results can be large. If the request has a resultWriter, the result is
+ * written to it as it is produced and NullUniValue is returned. Otherwise
+ * it is collected into a UniValue, which is returned.
+ */
+UniValue StreamRPCResult(const JSONRPCRequest& request, const std::function<void(JSONWriter&)>& write);
+
 /** Query whether RPC is running */
 bool IsRPCRunning();
 
@@ -144,6 +164,8 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    /** Statistics of each command. Only changed together with mapCommands, so reading needs no lock. */
+    std::map<std::string, std::unique_ptr<RPCMethodStats>> mapStats;
 public:
     CRPCTable();
     const CRPCCommand* operator[](const std::string& name) const;
@@ -163,6 +185,9 @@ public:
     */
     std::vector<std::string> listCommands() const;
 
+    /** Statistics of a command, or nullptr if it does not exist. */
+    const RPCMethodStats* getStats(const std::string& name) const;
+
 
     /**
      * Appends a CRPCCommand to the dispatch table.
@@ -201,8 +226,16 @@ extern std::string HelpExampleRpc(const std::string& methodname, const std::stri
 void StartRPC();
 void InterruptRPC();
 void StopRPC();
+/**
+ * Execute a batch of requests and return the serialized array of replies, in
+ * request order. Elements are executed in parallel on the batch thread pool
+ * while the RPC server is running, and sequentially otherwise.
+ */
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
 
+/** The statistics reported by getrpcstats, in the Prometheus text exposition format. */
+std::string RPCStatsToPrometheus();
+
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
 
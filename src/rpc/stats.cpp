@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/stats.h>
+
+#include <sync.h>
+#include <tinyformat.h>
+#include <utiltime.h>
+
+#include <univalue.h>
+
+#include <map>
+#include <utility>
+
+const int64_t RPC_LATENCY_BUCKET_BOUNDS[RPC_LATENCY_BUCKETS - 1] = {
+    50, 100, 250, 500,
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000,
+};
+
+RPCLatencyHistogram::RPCLatencyHistogram() : nCount(0), nSumMicros(0)
+{
+    for (size_t i = 0; i < RPC_LATENCY_BUCKETS; ++i) {
+        vBuckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void RPCLatencyHistogram::Add(int64_t nMicros)
+{
+    if (nMicros < 0) nMicros = 0;
+    size_t i = 0;
+    while (i < RPC_LATENCY_BUCKETS - 1 && nMicros > RPC_LATENCY_BUCKET_BOUNDS[i]) ++i;
+    vBuckets[i].fetch_add(1, std::memory_order_relaxed);
+    nSumMicros.fetch_add(nMicros, std::memory_order_relaxed);
+    nCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+UniValue RPCLatencyHistogram::ToJSON() const
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("count", GetCount());
+    ret.pushKV("sum_us", GetSumMicros());
+    UniValue buckets(UniValue::VOBJ);
+    for (size_t i = 0; i < RPC_LATENCY_BUCKETS; ++i) {
+        const uint64_t n = GetBucket(i);
+        if (n == 0) continue;
+        buckets.pushKV(i < RPC_LATENCY_BUCKETS - 1 ? std::to_string(RPC_LATENCY_BUCKET_BOUNDS[i]) : "inf", n);
+    }
+    ret.pushKV("buckets", buckets);
+    return ret;
+}
+
+void RPCLatencyHistogram::ToPrometheus(std::string& out, const std::string& name, const std::string& labels) const
+{
+    // Prometheus buckets are cumulative.
+    uint64_t nCumulative = 0;
+    for (size_t i = 0; i < RPC_LATENCY_BUCKETS; ++i) {
+        nCumulative += GetBucket(i);
+        const std::string le = i < RPC_LATENCY_BUCKETS - 1 ? strprintf("%g", RPC_LATENCY_BUCKET_BOUNDS[i] / 1e6) : "+Inf";
+        out += strprintf("%s_bucket{%s,le=\"%s\"} %u\n", name, labels, le, nCumulative);
+    }
+    out += strprintf("%s_sum{%s} %.6f\n", name, labels, GetSumMicros() / 1e6);
+    out += strprintf("%s_count{%s} %u\n", name, labels, nCumulative);
+}
+
+namespace {
+
+Mutex cs_activeCalls;
+uint64_t g_next_active_call GUARDED_BY(cs_activeCalls) = 0;
+/** Method and start time of the calls being executed, in order of their start. */
+std::map<uint64_t, std::pair<std::string, int64_t>> g_active_calls GUARDED_BY(cs_activeCalls);
+
+} // namespace
+
+RPCActiveCall::RPCActiveCall(const std::string& method)
+{
+    const int64_t nNow = GetTimeMicros();
+    LOCK(cs_activeCalls);
+    nId = g_next_active_call++;
+    g_active_calls.emplace(nId, std::make_pair(method, nNow));
+}
+
+RPCActiveCall::~RPCActiveCall()
+{
+    LOCK(cs_activeCalls);
+    g_active_calls.erase(nId);
+}
+
+UniValue GetActiveRPCCalls()
+{
+    const int64_t nNow = GetTimeMicros();
+    UniValue ret(UniValue::VARR);
+    LOCK(cs_activeCalls);
+    for (const auto& entry : g_active_calls) {
+        UniValue call(UniValue::VOBJ);
+        call.pushKV("method", entry.second.first);
+        call.pushKV("duration_us", nNow - entry.second.second);
+        ret.push_back(call);
+    }
+    return ret;
+}
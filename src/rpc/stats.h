@@ -0,0 +1,81 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_STATS_H
+#define BITCOIN_RPC_STATS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class UniValue;
+
+/** Number of buckets of an RPCLatencyHistogram, the last of which is unbounded. */
+static const size_t RPC_LATENCY_BUCKETS = 18;
+/** Upper bounds of the other buckets, in microseconds. */
+extern const int64_t RPC_LATENCY_BUCKET_BOUNDS[RPC_LATENCY_BUCKETS - 1];
+
+/**
+ * Histogram of latencies, which can be updated from any thread without
+ * locking. A reader may see an update partially applied (e.g. the count
+ * without the sum), which is fine for monitoring.
+ */
+class RPCLatencyHistogram
+{
+private:
+    std::atomic<uint64_t> vBuckets[RPC_LATENCY_BUCKETS];
+    std::atomic<uint64_t> nCount;
+    std::atomic<uint64_t> nSumMicros;
+
+public:
+    RPCLatencyHistogram();
+    RPCLatencyHistogram(const RPCLatencyHistogram&) = delete;
+    RPCLatencyHistogram& operator=(const RPCLatencyHistogram&) = delete;
+
+    void Add(int64_t nMicros);
+
+    uint64_t GetCount() const { return nCount.load(std::memory_order_relaxed); }
+    uint64_t GetSumMicros() const { return nSumMicros.load(std::memory_order_relaxed); }
+    /** Number of samples in bucket i (not cumulative). */
+    uint64_t GetBucket(size_t i) const { return vBuckets[i].load(std::memory_order_relaxed); }
+
+    /** {"count", "sum_us", "buckets": {"<upper bound in us>" or "inf": count}}, omitting empty buckets. */
+    UniValue ToJSON() const;
+    /**
+     * Append the histogram in the Prometheus text format, as metric name with
+     * the given labels (e.g. method="getblock"). Bounds are in seconds.
+     */
+    void ToPrometheus(std::string& out, const std::string& name, const std::string& labels) const;
+};
+
+/** Counters of one RPC method. */
+struct RPCMethodStats
+{
+    std::atomic<uint64_t> nCalls{0};
+    std::atomic<uint64_t> nErrors{0};
+    std::atomic<int> nInFlight{0};
+    /** Time from receiving the HTTP request to starting the call. */
+    RPCLatencyHistogram queueWait;
+    /** Time spent waiting for cs_main during the call. */
+    RPCLatencyHistogram lockWait;
+    /** Duration of the call, including lockWait. */
+    RPCLatencyHistogram execution;
+};
+
+/** Registers an RPC call in the list of calls being executed, for as long as it exists. */
+class RPCActiveCall
+{
+private:
+    uint64_t nId;
+
+public:
+    explicit RPCActiveCall(const std::string& method);
+    ~RPCActiveCall();
+};
+
+/** The RPC calls being executed, with how long they have been running. */
+UniValue GetActiveRPCCalls();
+
+#endif // BITCOIN_RPC_STATS_H
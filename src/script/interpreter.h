@@ -128,8 +128,13 @@ struct PrecomputedTransactionData
     uint256 hashPrevouts, hashSequence, hashOutputs;
     bool ready = false;
 
+    /**
+     * The hashes are only computed for transactions with witness, unless
+     * force is set, as when signing a transaction whose witnesses are not
+     * filled in yet.
+     */
     template <class T>
-    explicit PrecomputedTransactionData(const T& tx);
+    explicit PrecomputedTransactionData(const T& tx, bool force = false);
 };
 
 enum class SigVersion
@@ -11,9 +11,15 @@
 #include <script/standard.h>
 #include <uint256.h>
 
+#include <atomic>
+#include <thread>
+
 typedef std::vector<unsigned char> valtype;
 
-MutableTransactionSignatureCreator::MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn) : txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), checker(txTo, nIn, amountIn) {}
+int g_signing_threads = 1;
+
+MutableTransactionSignatureCreator::MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn) : txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), txdata(nullptr), checker(txTo, nIn, amountIn) {}
+MutableTransactionSignatureCreator::MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, const PrecomputedTransactionData* txdataIn, int nHashTypeIn) : txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), txdata(txdataIn), checker(txTo, nIn, amountIn, *txdataIn) {}
 
 bool MutableTransactionSignatureCreator::CreateSig(const SigningProvider& provider, std::vector<unsigned char>& vchSig, const CKeyID& address, const CScript& scriptCode, SigVersion sigversion) const
 {
@@ -25,7 +31,7 @@ bool MutableTransactionSignatureCreator::CreateSig(const SigningProvider& provid
     if (sigversion == SigVersion::WITNESS_V0 && !key.IsCompressed())
         return false;
 
-    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion);
+    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion, txdata);
     if (!key.Sign(hash, vchSig))
         return false;
     vchSig.push_back((unsigned char)nHashType);
@@ -236,6 +242,35 @@ bool ProduceSignature(const SigningProvider& provider, const BaseSignatureCreato
     return sigdata.complete;
 }
 
+void ProduceSignatures(const SigningProvider& provider, const CMutableTransaction& tx, const std::vector<CTxOut>& spent_outputs, int nHashType, std::vector<SignatureData>& sigdata, int threads)
+{
+    assert(spent_outputs.size() == tx.vin.size());
+    assert(sigdata.size() == tx.vin.size());
+
+    // Key origins are only kept for partially signed transactions, and
+    // looking them up may need locks that the caller holds (the wallet's).
+    const HidingSigningProvider signing_provider(&provider, false /* hide_secret */, true /* hide_origin */);
+    const PrecomputedTransactionData txdata(tx, true /* force */);
+    std::atomic<unsigned int> next{0};
+    auto sign = [&]() {
+        for (unsigned int i = next++; i < tx.vin.size(); i = next++) {
+            const CTxOut& spent = spent_outputs[i];
+            if (spent.IsNull()) continue;
+            ProduceSignature(signing_provider, MutableTransactionSignatureCreator(&tx, i, spent.nValue, &txdata, nHashType), spent.scriptPubKey, sigdata[i]);
+        }
+    };
+
+    // Key stores take their own lock and signing does not modify the
+    // secp256k1 context, so the inputs can be signed concurrently.
+    const int max_threads = std::min<size_t>(std::max(threads, 1), tx.vin.size() / MIN_INPUTS_PER_SIGNING_THREAD);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < max_threads; ++i) {
+        workers.emplace_back(sign);
+    }
+    sign();
+    for (std::thread& worker : workers) worker.join();
+}
+
 bool SignPSBTInput(const SigningProvider& provider, const CMutableTransaction& tx, PSBTInput& input, int index, int sighash)
 {
     // if this input has a final scriptsig or scriptwitness, don't do anything with it
@@ -83,10 +83,13 @@ class MutableTransactionSignatureCreator : public BaseSignatureCreator {
     unsigned int nIn;
     int nHashType;
     CAmount amount;
+    const PrecomputedTransactionData* txdata;
     const MutableTransactionSignatureChecker checker;
 
 public:
     MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn = SIGHASH_ALL);
+    /** Compute signature hashes with the hashes of txdata, which must be ready and outlive the creator. */
+    MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, const PrecomputedTransactionData* txdataIn, int nHashTypeIn = SIGHASH_ALL);
     const BaseSignatureChecker& Checker() const override { return checker; }
     bool CreateSig(const SigningProvider& provider, std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode, SigVersion sigversion) const override;
 };
@@ -699,6 +702,24 @@ struct PartiallySignedTransaction
 /** Produce a script signature using a generic signature creator. */
 bool ProduceSignature(const SigningProvider& provider, const BaseSignatureCreator& creator, const CScript& scriptPubKey, SignatureData& sigdata);
 
+/** Default for -signingthreads (0 = as many threads as cores) */
+static const int DEFAULT_SIGNING_THREADS = 0;
+/** Inputs that a signing thread is given at least, so that small transactions are signed in the calling thread */
+static const unsigned int MIN_INPUTS_PER_SIGNING_THREAD = 16;
+/** Number of threads signing the inputs of a transaction, set from -signingthreads */
+extern int g_signing_threads;
+
+/**
+ * Produce the signatures of the inputs of a transaction with up to the given
+ * number of threads. spent_outputs holds the output spent by each input;
+ * inputs whose spent output is null are skipped. sigdata holds one entry per
+ * input with what is already known of it (see DataFromTransaction) and
+ * receives its signatures, without key origins. The signature hashes share
+ * their midstates across inputs. tx is not modified; apply the results with
+ * UpdateInput. The provider must not need locks held by the caller.
+ */
+void ProduceSignatures(const SigningProvider& provider, const CMutableTransaction& tx, const std::vector<CTxOut>& spent_outputs, int nHashType, std::vector<SignatureData>& sigdata, int threads);
+
 /** Produce a script signature for a transaction. */
 bool SignSignature(const SigningProvider &provider, const CScript& fromPubKey, CMutableTransaction& txTo, unsigned int nIn, const CAmount& amount, int nHashType);
 bool SignSignature(const SigningProvider &provider, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType);
@@ -0,0 +1,257 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <socketevents.h>
+
+#include <netbase.h>
+#include <sync.h>
+#include <util.h>
+#include <utilmemory.h>
+
+#include <assert.h>
+#include <map>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+std::string GetSocketEventsModeName(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SocketEventsMode::SELECT: return "select";
+    case SocketEventsMode::EPOLL: return "epoll";
+    }
+    assert(false);
+}
+
+bool ParseSocketEventsMode(const std::string& name, SocketEventsMode& mode)
+{
+    if (name == "select") {
+        mode = SocketEventsMode::SELECT;
+        return true;
+    }
+#ifdef USE_EPOLL
+    if (name == "epoll") {
+        mode = SocketEventsMode::EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string ListSocketEventsModes()
+{
+#ifdef USE_EPOLL
+    return "select, epoll";
+#else
+    return "select";
+#endif
+}
+
+namespace {
+
+/**
+ * Backend based on select(). The sets of descriptors are rebuilt from all
+ * registered sockets on each call, and are limited to FD_SETSIZE.
+ */
+class SelectSocketEvents final : public CSocketEvents
+{
+private:
+    struct Entry
+    {
+        void* data;
+        int events;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<SOCKET, Entry> mapSockets;
+
+public:
+    SocketEventsMode GetMode() const override { return SocketEventsMode::SELECT; }
+
+    bool IsSupportedSocket(SOCKET hSocket) const override { return IsSelectableSocket(hSocket); }
+
+    bool Add(SOCKET hSocket, void* data, int events) override
+    {
+        if (!IsSelectableSocket(hSocket)) return false;
+        LOCK(cs);
+        mapSockets[hSocket] = Entry{data, events};
+        return true;
+    }
+
+    bool Modify(SOCKET hSocket, void* data, int events) override
+    {
+        LOCK(cs);
+        auto it = mapSockets.find(hSocket);
+        if (it == mapSockets.end()) return false;
+        it->second = Entry{data, events};
+        return true;
+    }
+
+    void Remove(SOCKET hSocket) override
+    {
+        LOCK(cs);
+        mapSockets.erase(hSocket);
+    }
+
+    bool Wait(int64_t nTimeoutMs, std::vector<SocketEvent>& vEvents) override
+    {
+        vEvents.clear();
+
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        fd_set fdsetError;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        bool have_fds = false;
+
+        std::vector<std::pair<SOCKET, Entry>> vSockets;
+        {
+            LOCK(cs);
+            vSockets.assign(mapSockets.begin(), mapSockets.end());
+        }
+        for (const auto& socket : vSockets) {
+            if (socket.second.events & SOCKET_EVENT_RECV) FD_SET(socket.first, &fdsetRecv);
+            if (socket.second.events & SOCKET_EVENT_SEND) FD_SET(socket.first, &fdsetSend);
+            FD_SET(socket.first, &fdsetError);
+            hSocketMax = std::max(hSocketMax, socket.first);
+            have_fds = true;
+        }
+
+        struct timeval timeout;
+        timeout.tv_sec = nTimeoutMs / 1000;
+        timeout.tv_usec = (nTimeoutMs % 1000) * 1000;
+
+        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (nSelect == SOCKET_ERROR) {
+            for (const auto& socket : vSockets) {
+                vEvents.push_back(SocketEvent{socket.second.data, SOCKET_EVENT_ERR});
+            }
+            return false;
+        }
+
+        for (const auto& socket : vSockets) {
+            int events = SOCKET_EVENT_NONE;
+            if (FD_ISSET(socket.first, &fdsetRecv)) events |= SOCKET_EVENT_RECV;
+            if (FD_ISSET(socket.first, &fdsetSend)) events |= SOCKET_EVENT_SEND;
+            if (FD_ISSET(socket.first, &fdsetError)) events |= SOCKET_EVENT_ERR;
+            if (events != SOCKET_EVENT_NONE) {
+                vEvents.push_back(SocketEvent{socket.second.data, events});
+            }
+        }
+        return true;
+    }
+};
+
+#ifdef USE_EPOLL
+/** Maximum number of events returned by a single epoll_wait() call. */
+static const int MAX_EPOLL_EVENTS = 1024;
+
+/**
+ * Backend based on epoll. Sockets stay registered with the kernel, so that
+ * waiting only costs in proportion to the number of ready sockets.
+ */
+class EPollSocketEvents final : public CSocketEvents
+{
+private:
+    int epollfd;
+    std::vector<epoll_event> vReady;
+
+    static uint32_t ToEPollEvents(int events)
+    {
+        uint32_t result = 0;
+        if (events & SOCKET_EVENT_RECV) result |= EPOLLIN;
+        if (events & SOCKET_EVENT_SEND) result |= EPOLLOUT;
+        return result;
+    }
+
+    bool Control(int op, SOCKET hSocket, void* data, int events)
+    {
+        epoll_event event;
+        event.events = ToEPollEvents(events);
+        event.data.ptr = data;
+        if (epoll_ctl(epollfd, op, hSocket, &event) != 0) {
+            LogPrintf("epoll_ctl failed: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+        return true;
+    }
+
+public:
+    explicit EPollSocketEvents(int epollfdIn) : epollfd(epollfdIn), vReady(MAX_EPOLL_EVENTS) {}
+
+    ~EPollSocketEvents() override
+    {
+        close(epollfd);
+    }
+
+    SocketEventsMode GetMode() const override { return SocketEventsMode::EPOLL; }
+
+    bool IsSupportedSocket(SOCKET hSocket) const override { return hSocket != INVALID_SOCKET; }
+
+    bool Add(SOCKET hSocket, void* data, int events) override
+    {
+        return Control(EPOLL_CTL_ADD, hSocket, data, events);
+    }
+
+    bool Modify(SOCKET hSocket, void* data, int events) override
+    {
+        return Control(EPOLL_CTL_MOD, hSocket, data, events);
+    }
+
+    void Remove(SOCKET hSocket) override
+    {
+        epoll_event event; // ignored, but required before Linux 2.6.9
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, hSocket, &event);
+    }
+
+    bool Wait(int64_t nTimeoutMs, std::vector<SocketEvent>& vEvents) override
+    {
+        vEvents.clear();
+
+        int nReady = epoll_wait(epollfd, vReady.data(), vReady.size(), nTimeoutMs);
+        if (nReady < 0) {
+            return errno == EINTR;
+        }
+
+        vEvents.reserve(nReady);
+        for (int i = 0; i < nReady; ++i) {
+            const epoll_event& event = vReady[i];
+            int events = SOCKET_EVENT_NONE;
+            if (event.events & EPOLLIN) events |= SOCKET_EVENT_RECV;
+            if (event.events & EPOLLOUT) events |= SOCKET_EVENT_SEND;
+            if (event.events & (EPOLLERR | EPOLLHUP)) events |= SOCKET_EVENT_ERR;
+            vEvents.push_back(SocketEvent{event.data.ptr, events});
+        }
+        return true;
+    }
+};
+#endif // USE_EPOLL
+
+} // namespace
+
+std::unique_ptr<CSocketEvents> MakeSocketEvents(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SocketEventsMode::SELECT:
+        return MakeUnique<SelectSocketEvents>();
+    case SocketEventsMode::EPOLL:
+#ifdef USE_EPOLL
+    {
+        int epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd == -1) {
+            LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(errno));
+            return nullptr;
+        }
+        return MakeUnique<EPollSocketEvents>(epollfd);
+    }
+#else
+        return nullptr;
+#endif
+    }
+    assert(false);
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <compat.h>
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#if defined(HAVE_SYS_EPOLL_H) && !defined(WIN32)
+#define USE_EPOLL
+#endif
+
+/** Mechanism used to wait for socket readiness. */
+enum class SocketEventsMode {
+    SELECT,
+    EPOLL,
+};
+
+/** Default for -socketevents */
+#ifdef USE_EPOLL
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SocketEventsMode::EPOLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SocketEventsMode::SELECT;
+#endif
+
+/** Readiness a socket is watched for, and reported with. */
+enum SocketEventFlags : int {
+    SOCKET_EVENT_NONE = 0,
+    SOCKET_EVENT_RECV = (1 << 0),
+    SOCKET_EVENT_SEND = (1 << 1),
+    /** Always reported when it occurs, whatever the socket is watched for. */
+    SOCKET_EVENT_ERR  = (1 << 2),
+};
+
+/** A socket reported ready by CSocketEvents::Wait. */
+struct SocketEvent
+{
+    void* data;
+    int events;
+};
+
+/** Name of a socket events mode, as accepted by -socketevents. */
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+/** Parse a -socketevents value. Returns false for unknown or unsupported modes. */
+bool ParseSocketEventsMode(const std::string& name, SocketEventsMode& mode);
+/** Comma-separated list of the modes supported on this platform. */
+std::string ListSocketEventsModes();
+
+/**
+ * Waits for readiness on a set of sockets.
+ *
+ * Sockets are registered once, together with an opaque pointer that is
+ * returned with their events, and with the readiness they should be watched
+ * for. Wait() is level triggered: a socket is reported for as long as it is
+ * ready for something it is watched for, so the owner only needs to adjust
+ * the watched events when its own state changes (e.g. when data is queued
+ * for sending). The per-call cost of Wait() depends on the backend: select()
+ * has to pass every registered socket to the kernel on each call, while
+ * epoll only returns the sockets that are ready.
+ *
+ * A socket must be removed before it is closed, as its descriptor may be
+ * reused right away. Sockets may be added, modified and removed from any
+ * thread, while Wait() is meant to be called from a single thread.
+ */
+class CSocketEvents
+{
+public:
+    virtual ~CSocketEvents() {}
+
+    virtual SocketEventsMode GetMode() const = 0;
+
+    /** Whether a socket can be registered with this backend at all. */
+    virtual bool IsSupportedSocket(SOCKET hSocket) const = 0;
+
+    /** Start watching a socket. */
+    virtual bool Add(SOCKET hSocket, void* data, int events) = 0;
+    /** Change the events a registered socket is watched for. */
+    virtual bool Modify(SOCKET hSocket, void* data, int events) = 0;
+    /** Stop watching a socket. */
+    virtual void Remove(SOCKET hSocket) = 0;
+
+    /**
+     * Wait up to nTimeoutMs milliseconds for registered sockets to become
+     * ready, and report them in vEvents. Returns false if waiting failed, in
+     * which case sockets that may have caused the failure are reported as
+     * having an error.
+     */
+    virtual bool Wait(int64_t nTimeoutMs, std::vector<SocketEvent>& vEvents) = 0;
+};
+
+/** Create a socket events backend. Returns nullptr if it cannot be set up. */
+std::unique_ptr<CSocketEvents> MakeSocketEvents(SocketEventsMode mode);
+
+#endif // BITCOIN_SOCKETEVENTS_H
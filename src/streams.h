@@ -176,7 +176,7 @@ public:
     }
 
     template<typename T>
-    VectorReader& operator>>(T& obj)
+    VectorReader& operator>>(T&& obj)
     {
         // Unserialize from this stream
         ::Unserialize(*this, obj);
@@ -211,6 +211,14 @@ public:
             throw std::ios_base::failure("VectorReader::seek(): end of data");
         }
     }
+
+    void ignore(size_t n)
+    {
+        if (n > m_data.size() - m_pos) {
+            throw std::ios_base::failure("VectorReader::ignore(): end of data");
+        }
+        m_pos += n;
+    }
 };
 
 /** Double ended buffer combining vector and stream-like interfaces.
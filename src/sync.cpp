@@ -24,6 +24,18 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+static thread_local LockWaitTracker* g_lock_wait_tracker = nullptr;
+
+LockWaitTracker* GetLockWaitTracker()
+{
+    return g_lock_wait_tracker;
+}
+
+void SetLockWaitTracker(LockWaitTracker* tracker)
+{
+    g_lock_wait_tracker = tracker;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -7,6 +7,7 @@
 #define BITCOIN_SYNC_H
 
 #include <threadsafety.h>
+#include <utiltime.h>
 
 #include <condition_variable>
 #include <thread>
@@ -113,6 +114,21 @@ typedef AnnotatedMixin<std::mutex> Mutex;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Time a thread spent waiting for one particular mutex, accumulated while the
+ * tracker is installed with SetLockWaitTracker(). Used to attribute the
+ * contention on cs_main to the RPC call being executed.
+ */
+struct LockWaitTracker
+{
+    const void* cs;
+    int64_t nWaitMicros;
+};
+
+/** The current thread's LockWaitTracker, or nullptr if there is none. */
+LockWaitTracker* GetLockWaitTracker();
+void SetLockWaitTracker(LockWaitTracker* tracker);
+
 /** Wrapper around std::unique_lock style lock for Mutex. */
 template <typename Mutex, typename Base = typename Mutex::UniqueLock>
 class SCOPED_LOCKABLE UniqueLock : public Base
@@ -121,14 +137,19 @@ private:
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()));
-#ifdef DEBUG_LOCKCONTENTION
         if (!Base::try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
-            Base::lock();
-#ifdef DEBUG_LOCKCONTENTION
+            LockWaitTracker* tracker = GetLockWaitTracker();
+            if (tracker && tracker->cs == (void*)(Base::mutex())) {
+                int64_t nStart = GetTimeMicros();
+                Base::lock();
+                tracker->nWaitMicros += GetTimeMicros() - nStart;
+            } else {
+                Base::lock();
+            }
         }
-#endif
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -0,0 +1,117 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilter.h>
+#include <chainparams.h>
+#include <index/blockfilterindex.h>
+#include <script/standard.h>
+#include <test/test_bitcoin.h>
+#include <undo.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilter_index_tests)
+
+static bool CheckFilterLookups(BlockFilterIndex& filter_index, const CBlockIndex* block_index,
+                               uint256& last_header)
+{
+    BlockFilter expected_filter;
+    {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockFromDisk(block, block_index, Params().GetConsensus())) {
+            BOOST_ERROR("ReadBlockFromDisk failed");
+            return false;
+        }
+        if (block_index->nHeight > 0 && !UndoReadFromDisk(block_undo, block_index)) {
+            BOOST_ERROR("UndoReadFromDisk failed");
+            return false;
+        }
+        expected_filter = BlockFilter(filter_index.GetFilterType(), block, block_undo);
+    }
+
+    BlockFilter filter;
+    uint256 filter_header;
+    std::vector<BlockFilter> filters;
+    std::vector<uint256> filter_headers;
+
+    BOOST_CHECK(filter_index.LookupFilter(block_index, filter));
+    BOOST_CHECK(filter_index.LookupFilterHeader(block_index, filter_header));
+    BOOST_CHECK(filter_index.LookupFilterRange(block_index->nHeight, block_index, filters));
+    BOOST_CHECK(filter_index.LookupFilterHeaderRange(block_index->nHeight, block_index, filter_headers));
+
+    BOOST_CHECK(filter.GetFilterType() == expected_filter.GetFilterType());
+    BOOST_CHECK(filter.GetBlockHash() == block_index->GetBlockHash());
+    BOOST_CHECK(filter.GetEncodedFilter() == expected_filter.GetEncodedFilter());
+    BOOST_CHECK_EQUAL(filter_header, expected_filter.ComputeHeader(last_header));
+    BOOST_CHECK_EQUAL(filters.size(), 1U);
+    BOOST_CHECK_EQUAL(filter_headers.size(), 1U);
+    BOOST_CHECK(filters.front().GetEncodedFilter() == expected_filter.GetEncodedFilter());
+    BOOST_CHECK_EQUAL(filter_headers.front(), filter_header);
+
+    last_header = filter_header;
+    return true;
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilter_index_initial_sync, TestChain100Setup)
+{
+    for (BlockFilterType filter_type : AllBlockFilterTypes()) {
+        BlockFilterIndex filter_index(filter_type, 1 << 20, true);
+
+        // BlockUntilSyncedToCurrentChain should return false before index is started.
+        BOOST_CHECK(!filter_index.BlockUntilSyncedToCurrentChain());
+
+        filter_index.Start();
+
+        // Allow filter index to catch up with the block index.
+        constexpr int64_t timeout_ms = 10 * 1000;
+        int64_t time_start = GetTimeMillis();
+        while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+            BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+            MilliSleep(100);
+        }
+
+        // Check that filter index has all blocks that were in the chain before it started,
+        // and that the filter headers chain up.
+        uint256 last_header;
+        const CBlockIndex* tip;
+        {
+            LOCK(cs_main);
+            tip = chainActive.Tip();
+        }
+        for (const CBlockIndex* block_index = tip->GetAncestor(0);
+             block_index != nullptr;
+             block_index = block_index == tip ? nullptr : tip->GetAncestor(block_index->nHeight + 1)) {
+            CheckFilterLookups(filter_index, block_index, last_header);
+        }
+
+        std::vector<uint256> filter_headers;
+        BOOST_CHECK(filter_index.LookupFilterHeaderRange(0, tip, filter_headers));
+        BOOST_CHECK_EQUAL(filter_headers.size(), static_cast<size_t>(tip->nHeight + 1));
+        BOOST_CHECK_EQUAL(filter_headers.back(), last_header);
+
+        // Check that new blocks make it into the index.
+        CScript coinbase_script_pub_key = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+        for (int i = 0; i < 5; i++) {
+            std::vector<CMutableTransaction> no_txns;
+            const CBlock& block = CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+
+            BOOST_CHECK(filter_index.BlockUntilSyncedToCurrentChain());
+            const CBlockIndex* block_index;
+            {
+                LOCK(cs_main);
+                block_index = LookupBlockIndex(block.GetHash());
+            }
+            BOOST_REQUIRE(block_index);
+            CheckFilterLookups(filter_index, block_index, last_header);
+        }
+
+        filter_index.Stop(); // Stop thread before calling destructor
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 
 #include <blockfilter.h>
 #include <core_io.h>
+#include <script/names.h>
 #include <serialize.h>
 #include <streams.h>
 #include <univalue.h>
@@ -90,6 +91,53 @@ BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockfilter_extended_test)
+{
+    const CScript address = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1)
+                                      << OP_EQUALVERIFY << OP_CHECKSIG;
+    const valtype name(5, 'n'), value(3, 'v'), rand(20, 'r');
+    const valtype data(4, 40);
+
+    const CScript name_script = CNameScript::buildNameFirstupdate(address, name, value, rand);
+    const CScript data_script = CScript() << OP_RETURN << data;
+
+    CMutableTransaction tx;
+    tx.vout.emplace_back(100, name_script);
+    tx.vout.emplace_back(0, data_script);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    CBlockUndo block_undo;
+
+    BlockFilter basic_filter(BlockFilterType::BASIC, block, block_undo);
+    BlockFilter extended_filter(BlockFilterType::EXTENDED, block, block_undo);
+
+    // The full name script is in both filters.
+    const GCSFilter::Element script_element(name_script.begin(), name_script.end());
+    BOOST_CHECK(basic_filter.GetFilter().Match(script_element));
+    BOOST_CHECK(extended_filter.GetFilter().Match(script_element));
+
+    // The name, its address and the OP_RETURN data are only in the extended filter.
+    const GCSFilter::Element address_element(address.begin(), address.end());
+    for (const GCSFilter::Element& element : {name, address_element, data}) {
+        BOOST_CHECK(!basic_filter.GetFilter().Match(element));
+        BOOST_CHECK(extended_filter.GetFilter().Match(element));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::BASIC), "basic");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::EXTENDED), "extended");
+
+    BlockFilterType filter_type;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filter_type));
+    BOOST_CHECK(filter_type == BlockFilterType::BASIC);
+    BOOST_CHECK(BlockFilterTypeByName("extended", filter_type));
+    BOOST_CHECK(filter_type == BlockFilterType::EXTENDED);
+    BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
+}
+
 BOOST_AUTO_TEST_CASE(blockfilters_json_test)
 {
     UniValue json;
@@ -848,4 +848,58 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_partial_flush)
+{
+    CCoinsView root;
+    CCoinsViewCacheTest base(&root);
+    CCoinsViewCacheTest cache(&base);
+
+    const COutPoint a(InsecureRand256(), 0);
+    const COutPoint b(InsecureRand256(), 1);
+    const COutPoint c(InsecureRand256(), 2);
+    CTxOut txout;
+    txout.nValue = 1000;
+    txout.scriptPubKey.assign(1, OP_TRUE);
+
+    // Sync writes everything and keeps the entries as clean cache.
+    cache.AddCoin(a, Coin(txout, 1, false), false);
+    cache.AddCoin(b, Coin(txout, 1, false), false);
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(base.HaveCoinInCache(a));
+    BOOST_CHECK(base.HaveCoinInCache(b));
+    BOOST_CHECK_EQUAL(cache.map().size(), 2U);
+    BOOST_CHECK_EQUAL(cache.map().at(a).flags, 0);
+    BOOST_CHECK_EQUAL(cache.map().at(b).flags, 0);
+    cache.SelfTest();
+
+    // While a partial flush is pending, nothing it touches leaves the cache
+    // and new entries are not marked FRESH.
+    BOOST_CHECK(cache.SpendCoin(a));
+    CCoinsMap dirty;
+    CNameCache names;
+    cache.BeginPartialFlush(dirty, names);
+    BOOST_CHECK(cache.IsPartialFlushPending());
+    BOOST_CHECK_EQUAL(dirty.size(), 1U);
+    BOOST_CHECK(dirty.at(a).coin.IsSpent());
+    BOOST_CHECK_EQUAL(cache.map().at(a).flags, 0);
+    cache.AddCoin(c, Coin(txout, 2, false), false);
+    BOOST_CHECK_EQUAL(cache.map().at(c).flags, CCoinsCacheEntry::DIRTY);
+    cache.Uncache(b);
+    BOOST_CHECK_EQUAL(cache.EvictLRU(0), 0U);
+    BOOST_CHECK_EQUAL(cache.map().size(), 3U);
+    BOOST_CHECK(base.BatchWrite(dirty, uint256(), names));
+    cache.EndPartialFlush();
+    BOOST_CHECK(!cache.IsPartialFlushPending());
+    BOOST_CHECK(!base.HaveCoin(a));
+    BOOST_CHECK_EQUAL(cache.map().count(a), 0U);
+    cache.SelfTest();
+
+    // Eviction only drops unmodified entries.
+    BOOST_CHECK_EQUAL(cache.EvictLRU(0), 1U);
+    BOOST_CHECK_EQUAL(cache.map().count(b), 0U);
+    BOOST_CHECK_EQUAL(cache.map().count(c), 1U);
+    BOOST_CHECK(cache.HaveCoin(b));
+    cache.SelfTest();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
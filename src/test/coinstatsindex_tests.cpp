@@ -0,0 +1,118 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <index/coinstatsindex.h>
+#include <script/standard.h>
+#include <test/test_bitcoin.h>
+#include <txdb.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+/** Compare the statistics of the index for the tip with a scan of the chain state. */
+static void CheckTipStats(CoinStatsIndex& index)
+{
+    const CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    FlushStateToDisk();
+
+    MuHash3072 muhash;
+    uint64_t txouts = 0;
+    CAmount amount = 0;
+    std::unique_ptr<CCoinsViewCursor> cursor(pcoinsdbview->Cursor());
+    BOOST_CHECK_EQUAL(cursor->GetBestBlock(), tip->GetBlockHash());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(outpoint) && cursor->GetValue(coin));
+        ApplyCoinHash(muhash, outpoint, coin);
+        ++txouts;
+        amount += coin.out.nValue;
+    }
+    uint256 expected_muhash;
+    muhash.Finalize(expected_muhash);
+
+    CoinStatsEntry stats;
+    BOOST_REQUIRE(index.LookupStats(tip, stats));
+    BOOST_CHECK_EQUAL(stats.muhash, expected_muhash);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, txouts);
+    BOOST_CHECK_EQUAL(stats.nCoinAmount, amount);
+    BOOST_CHECK_EQUAL(stats.nNames, 0U);
+    BOOST_CHECK_EQUAL(stats.nNameAmount, 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex coin_stats_index(1 << 20, true);
+
+    // BlockUntilSyncedToCurrentChain should return false before index is started.
+    BOOST_CHECK(!coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+    coin_stats_index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Every block of the chain has an entry, with one more coin than its parent.
+    {
+        LOCK(cs_main);
+        for (int height = 0; height <= chainActive.Height(); ++height) {
+            CoinStatsEntry stats;
+            BOOST_REQUIRE(coin_stats_index.LookupStats(chainActive[height], stats));
+            BOOST_CHECK_EQUAL(stats.nTransactionOutputs, static_cast<uint64_t>(height));
+        }
+    }
+    CheckTipStats(coin_stats_index);
+
+    // Check that new blocks make it into the index.
+    CScript coinbase_script_pub_key = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    for (int i = 0; i < 3; i++) {
+        std::vector<CMutableTransaction> no_txns;
+        CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+        BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+        CheckTipStats(coin_stats_index);
+    }
+
+    // Replace the last two blocks, so that the UTXO set hash is moved back to
+    // the fork point before the new blocks are indexed.
+    CBlockIndex* stale_tip;
+    {
+        LOCK(cs_main);
+        stale_tip = chainActive.Tip();
+        CValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), stale_tip->pprev));
+    }
+    CValidationState state;
+    BOOST_REQUIRE(ActivateBestChain(state, Params()));
+
+    const CScript other_script_pub_key = CScript() << OP_TRUE;
+    for (int i = 0; i < 3; i++) {
+        std::vector<CMutableTransaction> no_txns;
+        CreateAndProcessBlock(no_txns, other_script_pub_key);
+        BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+        CheckTipStats(coin_stats_index);
+    }
+
+    // The entries of the disconnected blocks are kept.
+    CoinStatsEntry stats;
+    BOOST_CHECK(coin_stats_index.LookupStats(stale_tip, stats));
+
+    coin_stats_index.Stop(); // Stop thread before calling destructor
+}
+
+BOOST_AUTO_TEST_SUITE_END()
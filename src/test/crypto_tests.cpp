@@ -4,6 +4,7 @@
 
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -11,6 +12,7 @@
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
 #include <random.h>
+#include <streams.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
 
@@ -562,4 +564,75 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+static std::string HashNum3072(const Num3072& num)
+{
+    unsigned char data[Num3072::BYTE_SIZE];
+    num.ToBytes(data);
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+    return HexStr(hash, hash + sizeof(hash));
+}
+
+static std::string FinalizeMuHash(MuHash3072 muhash)
+{
+    uint256 out;
+    muhash.Finalize(out);
+    return HexStr(out.begin(), out.end());
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    // Arithmetic modulo 2^3072 - 1103717; the expected values were computed independently.
+    unsigned char a[Num3072::BYTE_SIZE], b[Num3072::BYTE_SIZE], max[Num3072::BYTE_SIZE];
+    for (size_t i = 0; i < Num3072::BYTE_SIZE; ++i) {
+        a[i] = i & 0xff;
+        b[i] = (i * 7 + 3) & 0xff;
+        max[i] = 0xff;
+    }
+    Num3072 product(a);
+    product.Multiply(Num3072(b));
+    BOOST_CHECK_EQUAL(HashNum3072(product), "8c077f7ac8cb7b61939ae46bb0a1801de023c18369427c06aa0ae2033965dd21");
+    Num3072 quotient(a);
+    quotient.Divide(Num3072(b));
+    BOOST_CHECK_EQUAL(HashNum3072(quotient), "660e2a5afc2b37c6298d7a13e03a60fa82c00b3584e35d3674c2437be3e36f09");
+    Num3072 square(max);
+    square.Multiply(Num3072(max));
+    BOOST_CHECK_EQUAL(HashNum3072(square), "1724303002e50c85bf36a6bd1a272587537b966f26b9e3d54b0a2e09d6ded663");
+    quotient.Multiply(Num3072(b));
+    BOOST_CHECK_EQUAL(HashNum3072(quotient), HashNum3072(Num3072(a)));
+
+    const unsigned char e1[1] = {1}, e2[1] = {2}, e3[1] = {3}, e123[3] = {1, 2, 3};
+    BOOST_CHECK_EQUAL(FinalizeMuHash(MuHash3072()), "c85525462fdcf30a2c18d6f4b92923000974355c2477f59594d2c205a1d25add");
+    BOOST_CHECK_EQUAL(FinalizeMuHash(MuHash3072(e123, 3)), "b6f71a4f0bda68c747ab5e2720289ba1e42f7b7508b7e4a4c848ed01d3f0e6ef");
+    MuHash3072 acc;
+    acc.Insert(e1, 1).Insert(e2, 1).Remove(e3, 1);
+    BOOST_CHECK_EQUAL(FinalizeMuHash(acc), "85f8a860eaac0f5abd1541d41d1c16fb6b974b752cc715165ffbc3f15223f1ce");
+
+    // The hash only depends on the set, not on the order of the operations.
+    for (int i = 0; i < 10; ++i) {
+        std::vector<uint256> elements;
+        for (int j = 0; j < 4; ++j) elements.push_back(InsecureRand256());
+        MuHash3072 x, y, z;
+        x.Insert(elements[0].begin(), 32).Insert(elements[1].begin(), 32).Insert(elements[2].begin(), 32);
+        y.Remove(elements[3].begin(), 32).Insert(elements[2].begin(), 32).Insert(elements[3].begin(), 32);
+        y.Insert(elements[1].begin(), 32).Insert(elements[0].begin(), 32);
+        z = MuHash3072(elements[2].begin(), 32);
+        z *= MuHash3072(elements[0].begin(), 32);
+        z *= MuHash3072(elements[1].begin(), 32);
+        z *= MuHash3072(elements[3].begin(), 32);
+        z /= MuHash3072(elements[3].begin(), 32);
+        BOOST_CHECK_EQUAL(FinalizeMuHash(x), FinalizeMuHash(y));
+        BOOST_CHECK_EQUAL(FinalizeMuHash(x), FinalizeMuHash(z));
+        BOOST_CHECK(FinalizeMuHash(x) != FinalizeMuHash(MuHash3072(elements[0].begin(), 32)));
+    }
+
+    // Serialization keeps the numerator and the denominator.
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << acc;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 acc2;
+    ss >> acc2;
+    BOOST_CHECK_EQUAL(FinalizeMuHash(acc2), FinalizeMuHash(acc));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include <test/test_bitcoin.h>
 
 #include <memory>
+#include <thread>
 
 #include <boost/test/unit_test.hpp>
 
@@ -119,6 +120,89 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+// Test that the reused serialization buffers handle values of any size
+BOOST_AUTO_TEST_CASE(dbwrapper_reused_buffers)
+{
+    for (const bool obfuscate : {false, true}) {
+        fs::path ph = SetDataDir(std::string("dbwrapper_reused_buffers").append(obfuscate ? "_true" : "_false"));
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        // A value larger than the buffers kept for reuse, next to small ones.
+        const std::vector<unsigned char> large(DBWRAPPER_MAX_REUSED_BUFFER_SIZE + 1, 0xab);
+        const std::string large_key(DBWRAPPER_MAX_REUSED_BUFFER_SIZE + 1, 'l');
+        const uint256 small = InsecureRand256();
+        BOOST_CHECK(dbw.Write('a', small));
+        BOOST_CHECK(dbw.Write('b', large));
+        BOOST_CHECK(dbw.Write(large_key, small));
+
+        std::vector<unsigned char> large_res;
+        uint256 small_res;
+        BOOST_CHECK(dbw.Read('b', large_res));
+        BOOST_CHECK(large_res == large);
+        BOOST_CHECK(dbw.Read('a', small_res));
+        BOOST_CHECK(small_res == small);
+        BOOST_CHECK(dbw.Read(large_key, small_res));
+        BOOST_CHECK(small_res == small);
+        BOOST_CHECK(dbwrapper_private::GetThreadBuffers().value.capacity() <= DBWRAPPER_MAX_REUSED_BUFFER_SIZE);
+        BOOST_CHECK(dbwrapper_private::GetThreadBuffers().key.capacity() <= DBWRAPPER_MAX_REUSED_BUFFER_SIZE);
+
+        // A value that is too short for the type read fails to deserialize,
+        // without affecting the next read.
+        BOOST_CHECK(dbw.Write('c', std::vector<unsigned char>(3)));
+        BOOST_CHECK(!dbw.Read('c', small_res));
+        BOOST_CHECK(dbw.Read('a', small_res));
+        BOOST_CHECK(small_res == small);
+
+        // Each thread has its own buffers.
+        bool thread_ok = false;
+        std::thread thread([&] {
+            uint256 res;
+            thread_ok = dbw.Read('a', res) && res == small;
+        });
+        thread.join();
+        BOOST_CHECK(thread_ok);
+    }
+}
+
+// Test the tuning and keyspaces of a database
+BOOST_AUTO_TEST_CASE(dbwrapper_keyspaces)
+{
+    fs::path ph = SetDataDir("dbwrapper_keyspaces");
+    DBTuning tuning;
+    tuning.block_size = 16 * 1024;
+    tuning.bloom_bits = 0;
+    tuning.keyspaces.emplace_back("small", 's');
+    tuning.keyspaces.emplace_back("large", 'l', false);
+    CDBWrapper dbw(ph, (1 << 20), true, false, true, tuning);
+
+    BOOST_CHECK_EQUAL(dbw.GetTuning().block_size, 16U * 1024);
+    BOOST_CHECK_EQUAL(dbw.GetTuning().keyspaces.size(), 2U);
+    const DBKeyspace* small = dbw.FindKeyspace("small");
+    const DBKeyspace* large = dbw.FindKeyspace("large");
+    BOOST_REQUIRE(small && large);
+    BOOST_CHECK_EQUAL(small->prefix, 's');
+    BOOST_CHECK(small->fill_cache && !large->fill_cache);
+    BOOST_CHECK(!dbw.FindKeyspace("other"));
+
+    // Point reads of both keyspaces work, whether or not they fill the cache.
+    for (uint32_t i = 0; i < 100; ++i) {
+        BOOST_CHECK(dbw.Write(std::make_pair('s', i), i));
+        BOOST_CHECK(dbw.Write(std::make_pair('l', i), std::vector<unsigned char>(1000, i)));
+    }
+    dbw.Compact(large);
+    dbw.Compact(nullptr);
+    for (uint32_t i = 0; i < 100; ++i) {
+        uint32_t small_res;
+        std::vector<unsigned char> large_res;
+        BOOST_CHECK(dbw.Read(std::make_pair('s', i), small_res));
+        BOOST_CHECK_EQUAL(small_res, i);
+        BOOST_CHECK(dbw.Read(std::make_pair('l', i), large_res));
+        BOOST_CHECK(large_res == std::vector<unsigned char>(1000, i));
+        BOOST_CHECK(dbw.Exists(std::make_pair('l', i)));
+    }
+    BOOST_CHECK(!dbw.Exists(std::make_pair('l', 100U)));
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
@@ -4,10 +4,16 @@
 
 #include <rpc/server.h>
 #include <rpc/client.h>
+#include <rpc/jsonwriter.h>
+#include <rpc/stats.h>
 
+#include <chainparams.h>
 #include <core_io.h>
 #include <key_io.h>
 #include <netbase.h>
+#include <sync.h>
+#include <utiltime.h>
+#include <validation.h>
 
 #include <test/test_bitcoin.h>
 
@@ -18,6 +24,9 @@
 
 #include <rpc/blockchain.h>
 
+#include <future>
+#include <thread>
+
 UniValue CallRPC(std::string args)
 {
     std::vector<std::string> vArgs;
@@ -39,6 +48,25 @@ UniValue CallRPC(std::string args)
     }
 }
 
+/** Call an RPC with a result writer, and return the JSON text it produced. */
+static std::string CallRPCStreamed(std::string args)
+{
+    std::vector<std::string> vArgs;
+    boost::split(vArgs, args, boost::is_any_of(" \t"));
+    std::string strMethod = vArgs[0];
+    vArgs.erase(vArgs.begin());
+    std::string strResult;
+    JSONStreamWriter writer([&strResult](const std::string& strChunk) { strResult += strChunk; }, 1);
+    JSONRPCRequest request;
+    request.strMethod = strMethod;
+    request.params = RPCConvertValues(strMethod, vArgs);
+    request.resultWriter = &writer;
+    BOOST_CHECK(tableRPC[strMethod]);
+    UniValue result = tableRPC[strMethod]->actor(request);
+    BOOST_CHECK(result.isNull());
+    writer.Flush();
+    return strResult;
+}
 
 BOOST_FIXTURE_TEST_SUITE(rpc_tests, TestingSetup)
 
@@ -416,4 +444,199 @@ BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
     }
 }
 
+BOOST_AUTO_TEST_CASE(rpc_jsonwriter)
+{
+    std::string strStreamed;
+    int nChunks = 0;
+    JSONStreamWriter stream([&](const std::string& strChunk) { strStreamed += strChunk; ++nChunks; }, 16);
+    JSONTreeWriter tree;
+    for (JSONWriter* writer : std::vector<JSONWriter*>{&stream, &tree}) {
+        writer->BeginObject();
+        writer->Pair("name", "d/\"quoted\"");
+        writer->Key("list");
+        writer->BeginArray();
+        writer->Value(1);
+        writer->BeginObject();
+        writer->EndObject();
+        writer->BeginArray();
+        writer->EndArray();
+        writer->Value(NullUniValue);
+        writer->EndArray();
+        writer->Pair("flag", true);
+        writer->EndObject();
+    }
+    BOOST_CHECK_EQUAL(stream.GetDepth(), 0U);
+    stream.Flush();
+    BOOST_CHECK(nChunks > 1);
+    BOOST_CHECK_EQUAL(strStreamed, "{\"name\":\"d/\\\"quoted\\\"\",\"list\":[1,{},[],null],\"flag\":true}");
+    BOOST_CHECK_EQUAL(strStreamed, tree.GetResult().write());
+
+    // Nothing reaches the sink before a chunk is full.
+    JSONStreamWriter aborted([](const std::string&) { BOOST_ERROR("unexpected flush"); });
+    aborted.BeginObject();
+    aborted.Key("result");
+    aborted.BeginArray();
+    aborted.BeginObject();
+    aborted.Key("pending");
+    BOOST_CHECK(aborted.IsKeyPending());
+    BOOST_CHECK(!aborted.HasFlushed());
+
+    // Unwinding an aborted value leaves well-formed JSON behind.
+    aborted.Unwind(1);
+    BOOST_CHECK_EQUAL(aborted.GetDepth(), 1U);
+    aborted.Pair("error", "failed");
+    aborted.EndObject();
+    BOOST_CHECK_EQUAL(aborted.TakeBuffer(), "{\"result\":[{\"pending\":null}],\"error\":\"failed\"}");
+}
+
+BOOST_AUTO_TEST_CASE(rpc_stream_result)
+{
+    // Streamed results are the same as the results returned in full.
+    const std::string strGenesis = Params().GenesisBlock().GetHash().GetHex();
+    for (const std::string& strCommand : {"getblock " + strGenesis + " 1", "getblock " + strGenesis + " 2", std::string("getrawmempool"), std::string("getrawmempool true")}) {
+        BOOST_CHECK_EQUAL(CallRPCStreamed(strCommand), CallRPC(strCommand).write());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_parallel)
+{
+    if (RPCIsInWarmup(nullptr)) SetRPCWarmupFinished();
+
+    // A batch of calls, with an unknown method in the middle
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 50; ++i) {
+        UniValue params(UniValue::VARR);
+        params.push_back(i);
+        UniValue req(UniValue::VOBJ);
+        req.pushKV("method", i == 25 ? "nonexistent" : "echo");
+        req.pushKV("params", params);
+        req.pushKV("id", i);
+        vReq.push_back(req);
+    }
+    JSONRPCRequest jreq;
+    const std::string strSequential = JSONRPCExecBatch(jreq, vReq);
+
+    gArgs.ForceSetArg("-rpcbatchthreads", "4");
+    gArgs.ForceSetArg("-rpcbatchparallelism", "3");
+    StartRPC();
+    const std::string strParallel = JSONRPCExecBatch(jreq, vReq);
+    const UniValue info = CallRPC("getrpcbatchinfo");
+    InterruptRPC();
+    StopRPC();
+    gArgs.ForceSetArg("-rpcbatchthreads", std::to_string(DEFAULT_RPC_BATCH_THREADS));
+    gArgs.ForceSetArg("-rpcbatchparallelism", std::to_string(DEFAULT_RPC_BATCH_PARALLELISM));
+
+    // Replies are in request order, whichever thread executed them
+    BOOST_CHECK_EQUAL(strParallel, strSequential);
+    UniValue replies;
+    BOOST_CHECK(replies.read(strParallel));
+    BOOST_CHECK_EQUAL(replies.size(), 50U);
+    for (int i = 0; i < 50; ++i) {
+        BOOST_CHECK_EQUAL(find_value(replies[i], "id").get_int(), i);
+        if (i == 25) {
+            BOOST_CHECK_EQUAL(find_value(find_value(replies[i], "error"), "code").get_int(), RPC_METHOD_NOT_FOUND);
+        } else {
+            BOOST_CHECK_EQUAL(find_value(replies[i], "result")[0].get_int(), i);
+        }
+    }
+
+    BOOST_CHECK_EQUAL(find_value(info, "threads").get_int(), 4);
+    BOOST_CHECK_EQUAL(find_value(info, "parallelism").get_int(), 3);
+    BOOST_CHECK(find_value(info, "batches").get_int() >= 2);
+    BOOST_CHECK(find_value(find_value(find_value(info, "methods"), "echo"), "calls").get_int() >= 98);
+    BOOST_CHECK(find_value(find_value(info, "methods"), "nonexistent").isNull());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_latency_histogram)
+{
+    RPCLatencyHistogram histogram;
+    histogram.Add(0);
+    histogram.Add(50);
+    histogram.Add(51);
+    histogram.Add(20000000);
+    BOOST_CHECK_EQUAL(histogram.GetCount(), 4U);
+    BOOST_CHECK_EQUAL(histogram.GetSumMicros(), 20000101U);
+    BOOST_CHECK_EQUAL(histogram.GetBucket(0), 2U);
+    BOOST_CHECK_EQUAL(histogram.GetBucket(1), 1U);
+    BOOST_CHECK_EQUAL(histogram.GetBucket(RPC_LATENCY_BUCKETS - 1), 1U);
+    BOOST_CHECK_EQUAL(find_value(histogram.ToJSON(), "buckets").write(), "{\"50\":2,\"100\":1,\"inf\":1}");
+
+    // Prometheus buckets are cumulative, with bounds in seconds
+    std::string strMetrics;
+    histogram.ToPrometheus(strMetrics, "test_seconds", "method=\"x\"");
+    BOOST_CHECK(strMetrics.find("test_seconds_bucket{method=\"x\",le=\"5e-05\"} 2\n") != std::string::npos);
+    BOOST_CHECK(strMetrics.find("test_seconds_bucket{method=\"x\",le=\"0.0001\"} 3\n") != std::string::npos);
+    BOOST_CHECK(strMetrics.find("test_seconds_bucket{method=\"x\",le=\"10\"} 3\n") != std::string::npos);
+    BOOST_CHECK(strMetrics.find("test_seconds_bucket{method=\"x\",le=\"+Inf\"} 4\n") != std::string::npos);
+    BOOST_CHECK(strMetrics.find("test_seconds_sum{method=\"x\"} 20.000101\n") != std::string::npos);
+    BOOST_CHECK(strMetrics.find("test_seconds_count{method=\"x\"} 4\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_stats)
+{
+    if (RPCIsInWarmup(nullptr)) SetRPCWarmupFinished();
+
+    const RPCMethodStats* echoStats = tableRPC.getStats("echo");
+    const RPCMethodStats* hashStats = tableRPC.getStats("getblockhash");
+    const RPCMethodStats* countStats = tableRPC.getStats("getblockcount");
+    BOOST_REQUIRE(echoStats && hashStats && countStats);
+    BOOST_CHECK(!tableRPC.getStats("nonexistent"));
+    const uint64_t nEchoCalls = echoStats->nCalls;
+    const uint64_t nEchoQueueWait = echoStats->queueWait.GetSumMicros();
+    const uint64_t nHashErrors = hashStats->nErrors;
+    const uint64_t nCountLockWait = countStats->lockWait.GetSumMicros();
+
+    JSONRPCRequest request;
+    request.strMethod = "echo";
+    request.params = UniValue(UniValue::VARR);
+    request.nTimeReceived = GetTimeMicros() - 10000;
+    tableRPC.execute(request);
+    BOOST_CHECK_EQUAL(echoStats->nCalls, nEchoCalls + 1);
+    BOOST_CHECK(echoStats->queueWait.GetSumMicros() >= nEchoQueueWait + 10000);
+    BOOST_CHECK_EQUAL(echoStats->nInFlight, 0);
+
+    // Failed calls are counted as errors
+    request.strMethod = "getblockhash";
+    request.params.push_back(-1);
+    BOOST_CHECK_THROW(tableRPC.execute(request), UniValue);
+    BOOST_CHECK_EQUAL(hashStats->nErrors, nHashErrors + 1);
+
+    // Waiting for cs_main while another thread holds it is accounted to the call
+    std::promise<void> locked;
+    std::thread holder([&locked] {
+        LOCK(cs_main);
+        locked.set_value();
+        MilliSleep(100);
+    });
+    locked.get_future().wait();
+    request.strMethod = "getblockcount";
+    request.params = UniValue(UniValue::VARR);
+    tableRPC.execute(request);
+    holder.join();
+    BOOST_CHECK(countStats->lockWait.GetSumMicros() >= nCountLockWait + 50000);
+
+    request.strMethod = "getrpcstats";
+    const UniValue stats = tableRPC.execute(request);
+    const UniValue& methods = find_value(stats, "methods");
+    BOOST_CHECK(find_value(methods, "echo").isObject());
+    BOOST_CHECK(find_value(methods, "getblockcount").isObject());
+    BOOST_CHECK_EQUAL(find_value(find_value(find_value(methods, "echo"), "execution"), "count").get_int64(), (int64_t)echoStats->execution.GetCount());
+    BOOST_CHECK_EQUAL(find_value(find_value(stats, "work_queue"), "depth").get_int(), 0);
+    // The call reporting the statistics is itself being executed
+    const UniValue& active = find_value(stats, "active");
+    BOOST_REQUIRE_EQUAL(active.size(), 1U);
+    BOOST_CHECK_EQUAL(find_value(active[0], "method").get_str(), "getrpcstats");
+
+    request.params.push_back("echo");
+    BOOST_CHECK_EQUAL(find_value(tableRPC.execute(request), "methods").size(), 1U);
+    request.params.setArray();
+    request.params.push_back("nonexistent");
+    BOOST_CHECK_THROW(tableRPC.execute(request), UniValue);
+
+    const std::string strMetrics = RPCStatsToPrometheus();
+    BOOST_CHECK(strMetrics.find("# TYPE bst_rpc_execution_seconds histogram\n") != std::string::npos);
+    BOOST_CHECK(strMetrics.find(strprintf("bst_rpc_calls_total{method=\"echo\"} %u\n", echoStats->nCalls.load())) != std::string::npos);
+    BOOST_CHECK(strMetrics.find("bst_http_work_queue_rejected_total 0\n") != std::string::npos);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
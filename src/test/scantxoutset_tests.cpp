@@ -0,0 +1,83 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <dbwrapper.h>
+#include <rpc/blockchain.h>
+#include <test/test_bitcoin.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(scantxoutset_tests)
+
+BOOST_AUTO_TEST_CASE(script_needles)
+{
+    const CScript a = CScript() << OP_TRUE;
+    const CScript b = CScript() << OP_2;
+    std::map<CScript, std::vector<size_t>> scripts;
+    scripts[a] = {0, 2};
+    const ScriptNeedles needles(scripts);
+    BOOST_CHECK_EQUAL(needles.NumSets(), 3U);
+    BOOST_CHECK_EQUAL(needles.size(), 1U);
+    const std::vector<size_t>* sets = needles.Find(a);
+    BOOST_REQUIRE(sets);
+    BOOST_CHECK(*sets == std::vector<size_t>({0, 2}));
+    BOOST_CHECK(!needles.Find(b));
+}
+
+BOOST_FIXTURE_TEST_CASE(find_script_pub_keys, TestChain100Setup)
+{
+    // Pay a few blocks to another script, so that the scan sets differ.
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CScript other_script = CScript() << OP_TRUE;
+    for (int i = 0; i < 5; ++i) {
+        CreateAndProcessBlock({}, other_script);
+    }
+    FlushStateToDisk();
+
+    // Count the expected coins with a plain cursor.
+    std::map<COutPoint, Coin> coinbase_coins, other_coins;
+    int64_t total = 0;
+    std::unique_ptr<CCoinsViewCursor> cursor(pcoinsdbview->Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(outpoint) && cursor->GetValue(coin));
+        ++total;
+        if (coin.out.scriptPubKey == coinbase_script) coinbase_coins.emplace(outpoint, coin);
+        if (coin.out.scriptPubKey == other_script) other_coins.emplace(outpoint, coin);
+    }
+    BOOST_CHECK(!coinbase_coins.empty());
+    BOOST_CHECK_EQUAL(other_coins.size(), 5U);
+
+    // Set 0 searches both scripts, set 1 only the other one.
+    std::map<CScript, std::vector<size_t>> scripts;
+    scripts[coinbase_script] = {0};
+    scripts[other_script] = {0, 1};
+    const ScriptNeedles needles(scripts);
+    const std::unique_ptr<CDBSnapshot> snapshot = pcoinsdbview->GetSnapshot();
+
+    // Coins created after the snapshot are not found.
+    CreateAndProcessBlock({}, other_script);
+    FlushStateToDisk();
+
+    for (const int threads : {1, 3, 8}) {
+        std::atomic<int> progress{0};
+        std::atomic<bool> abort{false};
+        std::atomic<int64_t> count{0};
+        std::vector<std::map<COutPoint, Coin>> results;
+        BOOST_CHECK(FindScriptPubKeys(progress, abort, count, *pcoinsdbview, *snapshot, needles, threads, results));
+        BOOST_CHECK_EQUAL(progress.load(), 100);
+        BOOST_CHECK_EQUAL(count.load(), total);
+        BOOST_REQUIRE_EQUAL(results.size(), 2U);
+        BOOST_CHECK_EQUAL(results[0].size(), coinbase_coins.size() + other_coins.size());
+        for (const auto& coin : coinbase_coins) BOOST_CHECK(results[0].count(coin.first));
+        BOOST_REQUIRE_EQUAL(results[1].size(), other_coins.size());
+        for (const auto& coin : other_coins) BOOST_CHECK(results[1].count(coin.first));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
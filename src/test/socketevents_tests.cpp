@@ -0,0 +1,118 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netbase.h>
+#include <socketevents.h>
+#include <test/test_bitcoin.h>
+
+#include <string.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(socketevents_tests, BasicTestingSetup)
+
+/** Connect a pair of loopback TCP sockets. */
+static bool ConnectLoopback(SOCKET& hClient, SOCKET& hPeer)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+
+    SOCKET hListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    bool fConnected = hListen != INVALID_SOCKET &&
+        bind(hListen, (struct sockaddr*)&addr, sizeof(addr)) != SOCKET_ERROR &&
+        listen(hListen, 1) != SOCKET_ERROR &&
+        getsockname(hListen, (struct sockaddr*)&addr, &len) != SOCKET_ERROR &&
+        (hClient = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) != INVALID_SOCKET &&
+        connect(hClient, (struct sockaddr*)&addr, sizeof(addr)) != SOCKET_ERROR &&
+        (hPeer = accept(hListen, nullptr, nullptr)) != INVALID_SOCKET &&
+        SetSocketNonBlocking(hPeer, true);
+    CloseSocket(hListen);
+    return fConnected;
+}
+
+static int EventsFor(const std::vector<SocketEvent>& vEvents, void* data)
+{
+    int events = SOCKET_EVENT_NONE;
+    for (const SocketEvent& event : vEvents) {
+        if (event.data == data) events |= event.events;
+    }
+    return events;
+}
+
+static void CheckSocketEvents(SocketEventsMode mode)
+{
+    std::unique_ptr<CSocketEvents> events = MakeSocketEvents(mode);
+    BOOST_REQUIRE(events);
+    BOOST_CHECK(events->GetMode() == mode);
+
+    SOCKET hClient = INVALID_SOCKET, hPeer = INVALID_SOCKET;
+    BOOST_REQUIRE(ConnectLoopback(hClient, hPeer));
+    int data;
+    std::vector<SocketEvent> vEvents;
+
+    // Nothing to receive yet.
+    BOOST_CHECK(events->Add(hPeer, &data, SOCKET_EVENT_RECV));
+    BOOST_CHECK(events->Wait(0, vEvents));
+    BOOST_CHECK_EQUAL(EventsFor(vEvents, &data), SOCKET_EVENT_NONE);
+
+    // Data is reported for as long as it has not been received.
+    const char ch = 'x';
+    BOOST_CHECK_EQUAL(send(hClient, &ch, 1, 0), 1);
+    BOOST_CHECK(events->Wait(1000, vEvents));
+    BOOST_CHECK_EQUAL(EventsFor(vEvents, &data), SOCKET_EVENT_RECV);
+    BOOST_CHECK(events->Wait(1000, vEvents));
+    BOOST_CHECK_EQUAL(EventsFor(vEvents, &data), SOCKET_EVENT_RECV);
+
+    // While only watched for sending, pending data is not reported.
+    BOOST_CHECK(events->Modify(hPeer, &data, SOCKET_EVENT_SEND));
+    BOOST_CHECK(events->Wait(1000, vEvents));
+    BOOST_CHECK_EQUAL(EventsFor(vEvents, &data), SOCKET_EVENT_SEND);
+
+    char buf;
+    BOOST_CHECK_EQUAL(recv(hPeer, &buf, 1, 0), 1);
+    BOOST_CHECK(events->Modify(hPeer, &data, SOCKET_EVENT_RECV));
+    BOOST_CHECK(events->Wait(0, vEvents));
+    BOOST_CHECK_EQUAL(EventsFor(vEvents, &data), SOCKET_EVENT_NONE);
+
+    // Removed sockets are not reported anymore.
+    BOOST_CHECK_EQUAL(send(hClient, &ch, 1, 0), 1);
+    events->Remove(hPeer);
+    BOOST_CHECK(events->Wait(0, vEvents));
+    BOOST_CHECK_EQUAL(EventsFor(vEvents, &data), SOCKET_EVENT_NONE);
+
+    CloseSocket(hClient);
+    CloseSocket(hPeer);
+}
+
+BOOST_AUTO_TEST_CASE(socketevents_select)
+{
+    CheckSocketEvents(SocketEventsMode::SELECT);
+}
+
+#ifdef USE_EPOLL
+BOOST_AUTO_TEST_CASE(socketevents_epoll)
+{
+    CheckSocketEvents(SocketEventsMode::EPOLL);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(socketevents_modes)
+{
+    SocketEventsMode mode;
+    BOOST_CHECK(ParseSocketEventsMode("select", mode));
+    BOOST_CHECK(mode == SocketEventsMode::SELECT);
+    BOOST_CHECK_EQUAL(GetSocketEventsModeName(mode), "select");
+#ifdef USE_EPOLL
+    BOOST_CHECK(ParseSocketEventsMode("epoll", mode));
+    BOOST_CHECK(mode == SocketEventsMode::EPOLL);
+    BOOST_CHECK_EQUAL(GetSocketEventsModeName(mode), "epoll");
+#endif
+    BOOST_CHECK(!ParseSocketEventsMode("poll", mode));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
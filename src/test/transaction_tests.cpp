@@ -507,6 +507,51 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     threadGroup.join_all();
 }
 
+// Inputs signed on several threads with shared signature hash midstates get
+// the signatures they get when signed one by one.
+BOOST_AUTO_TEST_CASE(test_produce_signatures)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKeyPubKey(key, key.GetPubKey());
+    const CScript p2pkh = GetScriptForDestination(key.GetPubKey().GetID());
+    const CScript p2wpkh = GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey().GetID()));
+
+    CMutableTransaction mtx;
+    std::vector<CTxOut> spent_outputs;
+    for (uint32_t i = 0; i < 200; i++) {
+        mtx.vin.emplace_back(COutPoint(uint256S("0000000000000000000000000000000000000000000000000000000000000100"), i));
+        spent_outputs.emplace_back(1000 + i, i % 2 ? p2wpkh : p2pkh);
+    }
+    mtx.vout.emplace_back(1000, CScript() << OP_1);
+    // The input with a null spent output is left unsigned.
+    spent_outputs[7].SetNull();
+
+    std::vector<SignatureData> sigdata(mtx.vin.size());
+    ProduceSignatures(keystore, mtx, spent_outputs, SIGHASH_ALL, sigdata, 4);
+
+    CMutableTransaction expected = mtx;
+    for (uint32_t i = 0; i < mtx.vin.size(); i++) {
+        if (i == 7) {
+            BOOST_CHECK(!sigdata[i].complete);
+            continue;
+        }
+        BOOST_CHECK(sigdata[i].complete);
+        UpdateInput(mtx.vin[i], sigdata[i]);
+        BOOST_CHECK(SignSignature(keystore, spent_outputs[i].scriptPubKey, expected, i, spent_outputs[i].nValue, SIGHASH_ALL));
+    }
+    BOOST_CHECK_EQUAL(CTransaction(mtx).GetWitnessHash(), CTransaction(expected).GetWitnessHash());
+    BOOST_CHECK(mtx.vin[7].scriptSig.empty());
+
+    const CTransaction tx(mtx);
+    const PrecomputedTransactionData txdata(tx);
+    for (uint32_t i = 0; i < tx.vin.size(); i++) {
+        if (i == 7) continue;
+        BOOST_CHECK(VerifyScript(tx.vin[i].scriptSig, spent_outputs[i].scriptPubKey, &tx.vin[i].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, i, spent_outputs[i].nValue, txdata)));
+    }
+}
+
 SignatureData CombineSignatures(const CMutableTransaction& input1, const CMutableTransaction& input2, const CTransactionRef tx)
 {
     SignatureData sigdata;
@@ -0,0 +1,172 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <names/common.h>
+#include <names/encoding.h>
+#include <script/names.h>
+#include <streams.h>
+#include <txdb.h>
+#include <util.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxo_snapshot_tests, TestingSetup)
+
+namespace {
+
+CNameData MakeNameData(const valtype& name, const valtype& value, unsigned nHeight)
+{
+    const CScript addr = CScript() << OP_TRUE;
+    const CScript script = CNameScript::buildNameFirstupdate(addr, name, value, valtype(20, 'x'));
+    CNameData data;
+    data.fromScript(nHeight, COutPoint(InsecureRand256(), 0), CNameScript(script));
+    return data;
+}
+
+void CheckSameState(const CCoinsViewDB& a, const CCoinsViewDB& b, const std::vector<COutPoint>& outpoints, const std::vector<valtype>& names)
+{
+    BOOST_CHECK(a.GetBestBlock() == b.GetBestBlock());
+    for (const COutPoint& outpoint : outpoints) {
+        Coin coinA, coinB;
+        BOOST_CHECK(a.GetCoin(outpoint, coinA));
+        BOOST_CHECK(b.GetCoin(outpoint, coinB));
+        BOOST_CHECK(coinA.out == coinB.out);
+        BOOST_CHECK_EQUAL(coinA.nHeight, coinB.nHeight);
+    }
+    for (const valtype& name : names) {
+        CNameData dataA, dataB;
+        BOOST_CHECK(a.GetName(name, dataA));
+        BOOST_CHECK(b.GetName(name, dataB));
+        BOOST_CHECK(dataA == dataB);
+
+        std::set<valtype> expireA, expireB;
+        BOOST_CHECK(a.GetNamesForHeight(dataA.getHeight(), expireA));
+        BOOST_CHECK(b.GetNamesForHeight(dataB.getHeight(), expireB));
+        BOOST_CHECK(expireA == expireB);
+        BOOST_CHECK(expireB.count(name) == 1);
+
+        CNameHistory historyA, historyB;
+        BOOST_CHECK_EQUAL(a.GetNameHistory(name, historyA), b.GetNameHistory(name, historyB));
+        BOOST_CHECK(historyA.getData() == historyB.getData());
+    }
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_roundtrip)
+{
+    const bool fOldNameHistory = fNameHistory;
+    fNameHistory = true;
+
+    CCoinsViewDB source(1 << 20, true);
+    std::vector<COutPoint> outpoints;
+    std::vector<valtype> names;
+    {
+        CCoinsViewCache cache(&source);
+        CTxOut txout;
+        txout.scriptPubKey = CScript() << OP_TRUE;
+        for (int i = 0; i < 100; ++i) {
+            txout.nValue = InsecureRandRange(1000000);
+            outpoints.emplace_back(InsecureRand256(), InsecureRandRange(10));
+            cache.AddCoin(outpoints.back(), Coin(txout, 1 + i, false), false);
+        }
+        for (int i = 0; i < 10; ++i) {
+            names.push_back(DecodeName(strprintf("snapshot-name-%d", i), NameEncoding::ASCII));
+            cache.SetName(names.back(), MakeNameData(names.back(), valtype(1, 'a'), 10 + i), false);
+        }
+        // Update the first name to create a name history entry.
+        cache.SetName(names[0], MakeNameData(names[0], valtype(1, 'b'), 50), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    const fs::path path = GetDataDir() / "snapshot.dat";
+    SnapshotMetadata metadata;
+    SnapshotStats stats;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(source.DumpSnapshot(file, metadata, stats));
+    }
+    BOOST_CHECK(metadata.hashBlock == source.GetBestBlock());
+    BOOST_CHECK(metadata.fNameHistory);
+    BOOST_CHECK_EQUAL(stats.nCoins, 100U);
+    BOOST_CHECK_EQUAL(stats.nNames, 10U);
+    BOOST_CHECK_EQUAL(stats.nExpiry, 10U);
+    BOOST_CHECK_EQUAL(stats.nHistory, 1U);
+
+    // Verifying without writing leaves the target untouched.
+    CCoinsViewDB target(1 << 20, true);
+    SnapshotMetadata loadedMetadata;
+    SnapshotStats loadedStats;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(target.LoadSnapshot(file, loadedMetadata, loadedStats, false));
+    }
+    BOOST_CHECK(loadedMetadata.hashBlock == metadata.hashBlock);
+    BOOST_CHECK(loadedStats.hashState == stats.hashState);
+    BOOST_CHECK(loadedStats.hashHistory == stats.hashHistory);
+    BOOST_CHECK(target.GetBestBlock().IsNull());
+
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(target.LoadSnapshot(file, loadedMetadata, loadedStats, true));
+    }
+    BOOST_CHECK(!target.HasPartialSnapshot());
+    CheckSameState(source, target, outpoints, names);
+
+    // A chainstate that is not empty is refused.
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(!target.LoadSnapshot(file, loadedMetadata, loadedStats, true));
+    }
+
+    // Without -namehistory, the history records are skipped but still checked,
+    // and the state hash does not depend on them.
+    fNameHistory = false;
+    CCoinsViewDB noHistory(1 << 20, true);
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(noHistory.LoadSnapshot(file, loadedMetadata, loadedStats, true));
+    }
+    BOOST_CHECK(loadedStats.hashState == stats.hashState);
+    SnapshotStats noHistoryStats;
+    {
+        CAutoFile file(fsbridge::fopen(path.string() + ".nohistory", "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(noHistory.DumpSnapshot(file, loadedMetadata, noHistoryStats));
+    }
+    BOOST_CHECK(!loadedMetadata.fNameHistory);
+    BOOST_CHECK_EQUAL(noHistoryStats.nHistory, 0U);
+    BOOST_CHECK(noHistoryStats.hashState == stats.hashState);
+
+    // Corrupting a single byte is detected.
+    {
+        FILE* f = fsbridge::fopen(path, "rb+");
+        BOOST_CHECK(f != nullptr);
+        BOOST_CHECK_EQUAL(fseek(f, 100, SEEK_SET), 0);
+        const int c = fgetc(f);
+        BOOST_CHECK_EQUAL(fseek(f, 100, SEEK_SET), 0);
+        fputc(c ^ 0x01, f);
+        fclose(f);
+    }
+    fNameHistory = true;
+    CCoinsViewDB corrupted(1 << 20, true);
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        bool fLoaded;
+        try {
+            fLoaded = corrupted.LoadSnapshot(file, loadedMetadata, loadedStats, false);
+        } catch (const std::ios_base::failure&) {
+            fLoaded = false;
+        }
+        BOOST_CHECK(!fLoaded);
+    }
+
+    fNameHistory = fOldNameHistory;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <scheduler.h>
+#include <test/test_bitcoin.h>
+#include <utiltime.h>
+#include <validationinterface.h>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+/** Records the heights of the tips it is notified of, and can be held up. */
+class TipRecorder : public CValidationInterface
+{
+public:
+    std::atomic<bool> m_hold{false};
+    std::vector<int> m_heights;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override
+    {
+        while (m_hold) MilliSleep(1);
+        m_heights.push_back(pindexNew->nHeight);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(subscriber_queues)
+{
+    CScheduler scheduler;
+    boost::thread_group threads;
+    for (int i = 0; i < 2; ++i) {
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    }
+    GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+
+    TipRecorder slow, fast;
+    RegisterValidationInterface(&slow, "slow");
+    RegisterValidationInterface(&fast, "fast");
+
+    std::vector<CBlockIndex> blocks(20);
+    for (size_t i = 0; i < blocks.size(); ++i) blocks[i].nHeight = i;
+
+    // A held up subscriber does not delay the other one.
+    slow.m_hold = true;
+    for (const CBlockIndex& block : blocks) {
+        GetMainSignals().UpdatedBlockTip(&block, nullptr, false);
+    }
+    SyncWithValidationInterfaceQueue(fast);
+    BOOST_CHECK_EQUAL(fast.m_heights.size(), blocks.size());
+    BOOST_CHECK(slow.m_heights.size() < blocks.size());
+    BOOST_CHECK(GetMainSignals().CallbacksPending() > 0);
+
+    std::vector<ValidationSubscriberStats> stats = GetMainSignals().GetSubscriberStats();
+    BOOST_REQUIRE_EQUAL(stats.size(), 2U);
+    BOOST_CHECK_EQUAL(stats[0].name, "slow");
+    BOOST_CHECK_EQUAL(stats[1].name, "fast");
+    BOOST_CHECK_EQUAL(stats[1].processed, blocks.size());
+    BOOST_CHECK_EQUAL(stats[1].pending, 0U);
+    BOOST_CHECK(stats[0].pending > 0);
+
+    // Each subscriber receives the callbacks in order.
+    slow.m_hold = false;
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), 0U);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        BOOST_CHECK_EQUAL(slow.m_heights.at(i), (int)i);
+        BOOST_CHECK_EQUAL(fast.m_heights.at(i), (int)i);
+    }
+
+    // Only subscribers behind by more than the limit are waited for.
+    slow.m_hold = true;
+    GetMainSignals().UpdatedBlockTip(&blocks[0], nullptr, false);
+    GetMainSignals().SyncWithLaggingSubscribers(1);
+    slow.m_hold = false;
+    SyncWithValidationInterfaceQueue(slow);
+
+    // An unregistered subscriber receives no more callbacks, and syncing
+    // with it returns immediately.
+    UnregisterValidationInterface(&slow);
+    GetMainSignals().UpdatedBlockTip(&blocks[1], nullptr, false);
+    SyncWithValidationInterfaceQueue(slow);
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(slow.m_heights.size(), blocks.size() + 1);
+    BOOST_CHECK_EQUAL(fast.m_heights.size(), blocks.size() + 2);
+    BOOST_CHECK_EQUAL(GetMainSignals().GetSubscriberStats().size(), 1U);
+
+    UnregisterAllValidationInterfaces();
+    threads.interrupt_all();
+    threads.join_all();
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
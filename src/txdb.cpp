@@ -32,6 +32,7 @@ static const char DB_NAME_EXPIRY = 'x';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_HEAD_BLOCKS = 'H';
+static const char DB_SNAPSHOT_BASE = 'S';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
@@ -60,7 +61,32 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true)
+DBTuning GetChainstateDBTuning()
+{
+    DBTuning tuning;
+    tuning.keyspaces.emplace_back("coins", DB_COIN);
+    tuning.keyspaces.emplace_back("names", DB_NAME);
+    // Name histories are large and only read by RPCs, so reading them should
+    // not evict the coins and names that block validation looks up.
+    tuning.keyspaces.emplace_back("namehistory", DB_NAME_HISTORY, false);
+    tuning.keyspaces.emplace_back("nameexpiry", DB_NAME_EXPIRY);
+    return tuning;
+}
+
+DBTuning GetBlockTreeDBTuning()
+{
+    DBTuning tuning;
+    // The block index is read in full at startup and then only appended to,
+    // so larger blocks make the scan cheaper and the cache is better spent
+    // on write buffers.
+    tuning.block_size = 16 * 1024;
+    tuning.block_cache_percent = 25;
+    tuning.keyspaces.emplace_back("blockindex", DB_BLOCK_INDEX);
+    tuning.keyspaces.emplace_back("blockfiles", DB_BLOCK_FILES);
+    return tuning;
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, GetChainstateDBTuning())
 {
 }
 
@@ -248,7 +274,7 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe, false, GetBlockTreeDBTuning()) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -278,14 +304,34 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
        that restriction.  */
     i->pcursor->Seek(DB_COIN);
     // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
+    i->CacheKey();
+    return i;
+}
+
+CCoinsViewCursor *CCoinsViewDB::Cursor(const CDBSnapshot& snapshot, const uint256& hashBegin, const uint256& hashEnd) const
+{
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(snapshot), GetBestBlock(), hashEnd);
+    const COutPoint first(hashBegin, 0);
+    i->pcursor->Seek(CoinEntry(&first));
+    i->CacheKey();
+    return i;
+}
+
+std::unique_ptr<CDBSnapshot> CCoinsViewDB::GetSnapshot() const
+{
+    return MakeUnique<CDBSnapshot>(db);
+}
+
+void CCoinsViewDBCursor::CacheKey()
+{
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
+        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else if (!hashEnd.IsNull() && !(keyTmp.second.hash < hashEnd)) {
+        keyTmp.first = 0; // Past the end of the range
     } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        keyTmp.first = entry.key;
     }
-    return i;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -316,12 +362,7 @@ bool CCoinsViewDBCursor::Valid() const
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    CoinEntry entry(&keyTmp.second);
-    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
-        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
-    } else {
-        keyTmp.first = entry.key;
-    }
+    CacheKey();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -512,6 +553,226 @@ CNameCache::writeBatch (CDBBatch& batch) const
       batch.Erase (std::make_pair (DB_NAME_EXPIRY, i->first));
 }
 
+namespace {
+
+/** Serialize obj to the snapshot file and into the hash committing to it.  */
+template<typename T>
+void WriteSnapshotItem(CAutoFile& file, CHashWriter& hasher, const T& obj)
+{
+    file << obj;
+    hasher << obj;
+}
+
+/** Read obj from the snapshot file and add it to the hash committing to it.  */
+template<typename T>
+void ReadSnapshotItem(CAutoFile& file, CHashWriter& hasher, T& obj)
+{
+    file >> obj;
+    hasher << obj;
+}
+
+}
+
+bool CCoinsViewDB::DumpSnapshot(CAutoFile& file, SnapshotMetadata& metadata, SnapshotStats& stats) const
+{
+    metadata.hashBlock = GetBestBlock();
+    metadata.fNameHistory = fNameHistory;
+    if (metadata.hashBlock.IsNull())
+        return error("%s: chainstate has no best block", __func__);
+    stats = SnapshotStats();
+
+    CHashWriter hashState(SER_GETHASH, 0);
+    CHashWriter hashHistory(SER_GETHASH, 0);
+    hashState << metadata.hashBlock;
+    file << metadata;
+
+    std::unique_ptr<CCoinsViewCursor> pcoins(Cursor());
+    for (; pcoins->Valid(); pcoins->Next()) {
+        boost::this_thread::interruption_point();
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcoins->GetKey(outpoint) || !pcoins->GetValue(coin))
+            return error("%s: unable to read coin", __func__);
+        WriteSnapshotItem(file, hashState, DB_COIN);
+        WriteSnapshotItem(file, hashState, outpoint);
+        WriteSnapshotItem(file, hashState, coin);
+        ++stats.nCoins;
+    }
+
+    std::unique_ptr<CNameIterator> pnames(IterateNames());
+    valtype name;
+    CNameData data;
+    while (pnames->next(name, data)) {
+        boost::this_thread::interruption_point();
+        WriteSnapshotItem(file, hashState, DB_NAME);
+        WriteSnapshotItem(file, hashState, name);
+        WriteSnapshotItem(file, hashState, data);
+        ++stats.nNames;
+    }
+
+    /* It seems that there are no "const iterators" for LevelDB.  Since we
+       only need read operations on it, use a const-cast to get around
+       that restriction.  */
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    for (pcursor->Seek(DB_NAME_EXPIRY); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CNameCache::ExpireEntry> key;
+        if (!pcursor->GetKey(key) || key.first != DB_NAME_EXPIRY)
+            break;
+        WriteSnapshotItem(file, hashState, DB_NAME_EXPIRY);
+        WriteSnapshotItem(file, hashState, key.second);
+        ++stats.nExpiry;
+    }
+
+    if (fNameHistory) {
+        for (pcursor->Seek(DB_NAME_HISTORY); pcursor->Valid(); pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            std::pair<char, valtype> key;
+            if (!pcursor->GetKey(key) || key.first != DB_NAME_HISTORY)
+                break;
+            CNameHistory history;
+            if (!pcursor->GetValue(history))
+                return error("%s: unable to read history of name %s",
+                             __func__, EncodeNameForMessage(key.second));
+            WriteSnapshotItem(file, hashHistory, DB_NAME_HISTORY);
+            WriteSnapshotItem(file, hashHistory, key.second);
+            WriteSnapshotItem(file, hashHistory, history);
+            ++stats.nHistory;
+        }
+    }
+
+    if (GetBestBlock() != metadata.hashBlock)
+        return error("%s: chainstate changed while writing the snapshot", __func__);
+
+    stats.hashState = hashState.GetHash();
+    if (fNameHistory)
+        stats.hashHistory = hashHistory.GetHash();
+    file << '\0';
+    file << stats;
+    return true;
+}
+
+bool CCoinsViewDB::LoadSnapshot(CAutoFile& file, SnapshotMetadata& metadata, SnapshotStats& stats, bool fWrite)
+{
+    if (fWrite && (!GetBestBlock().IsNull() || !GetHeadBlocks().empty() || HasPartialSnapshot()))
+        return error("%s: chainstate database is not empty", __func__);
+
+    file >> metadata;
+    if (fNameHistory && !metadata.fNameHistory)
+        return error("%s: -namehistory requires a snapshot including the name history", __func__);
+
+    CHashWriter hashState(SER_GETHASH, 0);
+    CHashWriter hashHistory(SER_GETHASH, 0);
+    hashState << metadata.hashBlock;
+    stats = SnapshotStats();
+
+    CDBBatch batch(db);
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+
+    // Until the final batch is written, the database only contains part of
+    // the snapshot.  Mark it as such so that an interrupted load is detected
+    // at the next startup instead of looking like an empty chainstate.
+    if (fWrite)
+        batch.Write(DB_SNAPSHOT_BASE, metadata.hashBlock);
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        char chType;
+        file >> chType;
+        if (chType == '\0')
+            break;
+
+        switch (chType)
+        {
+        case DB_COIN:
+        {
+            COutPoint outpoint;
+            Coin coin;
+            hashState << chType;
+            ReadSnapshotItem(file, hashState, outpoint);
+            ReadSnapshotItem(file, hashState, coin);
+            if (coin.IsSpent())
+                return error("%s: spent coin in snapshot", __func__);
+            if (fWrite)
+                batch.Write(CoinEntry(&outpoint), coin);
+            ++stats.nCoins;
+            break;
+        }
+
+        case DB_NAME:
+        {
+            valtype name;
+            CNameData data;
+            hashState << chType;
+            ReadSnapshotItem(file, hashState, name);
+            ReadSnapshotItem(file, hashState, data);
+            if (fWrite)
+                batch.Write(std::make_pair(DB_NAME, name), data);
+            ++stats.nNames;
+            break;
+        }
+
+        case DB_NAME_EXPIRY:
+        {
+            CNameCache::ExpireEntry entry;
+            hashState << chType;
+            ReadSnapshotItem(file, hashState, entry);
+            if (fWrite)
+                batch.Write(std::make_pair(DB_NAME_EXPIRY, entry));
+            ++stats.nExpiry;
+            break;
+        }
+
+        case DB_NAME_HISTORY:
+        {
+            valtype name;
+            CNameHistory history;
+            hashHistory << chType;
+            ReadSnapshotItem(file, hashHistory, name);
+            ReadSnapshotItem(file, hashHistory, history);
+            if (fWrite && fNameHistory)
+                batch.Write(std::make_pair(DB_NAME_HISTORY, name), history);
+            ++stats.nHistory;
+            break;
+        }
+
+        default:
+            return error("%s: unknown record type %d in snapshot", __func__, chType);
+        }
+
+        if (batch.SizeEstimate() > batch_size) {
+            LogPrint(BCLog::COINDB, "Writing partial snapshot batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+    }
+
+    SnapshotStats trailer;
+    file >> trailer;
+    stats.hashState = hashState.GetHash();
+    if (metadata.fNameHistory)
+        stats.hashHistory = hashHistory.GetHash();
+    if (trailer.nCoins != stats.nCoins || trailer.nNames != stats.nNames
+        || trailer.nExpiry != stats.nExpiry || trailer.nHistory != stats.nHistory)
+        return error("%s: record counts do not match the snapshot trailer", __func__);
+    if (trailer.hashState != stats.hashState || trailer.hashHistory != stats.hashHistory)
+        return error("%s: snapshot contents do not match their hash", __func__);
+
+    if (!fWrite)
+        return true;
+
+    batch.Erase(DB_SNAPSHOT_BASE);
+    batch.Write(DB_BEST_BLOCK, metadata.hashBlock);
+    LogPrint(BCLog::COINDB, "Writing final snapshot batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+    return db.WriteBatch(batch, true);
+}
+
+bool CCoinsViewDB::HasPartialSnapshot() const
+{
+    return db.Exists(DB_SNAPSHOT_BASE);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
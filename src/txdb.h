@@ -37,9 +37,86 @@ static const int64_t nMaxBlockDBCache = 2;
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to all block filter index caches combined in MiB.
+static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
+/** Version of the UTXO snapshot file format written by dumptxoutset. */
+static const uint32_t SNAPSHOT_VERSION = 1;
+/** Magic bytes at the start of a UTXO snapshot file. */
+static const char SNAPSHOT_MAGIC[4] = {'b', 's', 't', 'u'};
+
+/** Header of a UTXO snapshot file. */
+struct SnapshotMetadata
+{
+    //! Block whose resulting chainstate is contained in the snapshot
+    uint256 hashBlock;
+    //! Whether the snapshot includes the name history records
+    bool fNameHistory;
+
+    SnapshotMetadata() : fNameHistory(false) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        s << SNAPSHOT_VERSION;
+        s << hashBlock;
+        s << fNameHistory;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        char magic[sizeof(SNAPSHOT_MAGIC)];
+        s.read(magic, sizeof(magic));
+        if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+            throw std::ios_base::failure("Not a UTXO snapshot file");
+        uint32_t nVersion;
+        s >> nVersion;
+        if (nVersion != SNAPSHOT_VERSION)
+            throw std::ios_base::failure(strprintf("Unsupported UTXO snapshot version %u", nVersion));
+        s >> hashBlock;
+        s >> fNameHistory;
+    }
+};
+
+/**
+ * Trailer of a UTXO snapshot file.  hashState commits to the base block
+ * and all coin, name and name expiry records, and is the value pinned in
+ * the chain parameters.  The optional name history is committed to
+ * separately, so that a snapshot can be checked against the pinned hash
+ * independently of -namehistory.
+ */
+struct SnapshotStats
+{
+    uint64_t nCoins;
+    uint64_t nNames;
+    uint64_t nExpiry;
+    uint64_t nHistory;
+    uint256 hashState;
+    uint256 hashHistory;
+
+    SnapshotStats() : nCoins(0), nNames(0), nExpiry(0), nHistory(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nCoins);
+        READWRITE(nNames);
+        READWRITE(nExpiry);
+        READWRITE(nHistory);
+        READWRITE(hashState);
+        READWRITE(hashHistory);
+    }
+};
+
+/** LevelDB tuning and keyspaces of the coin database (chainstate/). */
+DBTuning GetChainstateDBTuning();
+
+/** LevelDB tuning and keyspaces of the block database (blocks/index/). */
+DBTuning GetBlockTreeDBTuning();
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
 {
@@ -58,11 +135,32 @@ public:
     CNameIterator* IterateNames() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CNameCache &names) override;
     CCoinsViewCursor *Cursor() const override;
+    /**
+     * Iterate over the coins of a snapshot of the database whose txid is in
+     * [hashBegin, hashEnd), in database order. A null hashEnd iterates up to
+     * the last coin. The snapshot must outlive the cursor.
+     */
+    CCoinsViewCursor *Cursor(const CDBSnapshot& snapshot, const uint256& hashBegin, const uint256& hashEnd) const;
+    //! Take a snapshot of the database, for use with the ranged Cursor().
+    std::unique_ptr<CDBSnapshot> GetSnapshot() const;
     bool ValidateNameDB() const override;
+    //! The underlying database, for maintenance such as compaction.
+    const CDBWrapper& GetDB() const { return db; }
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    //! Write the coins and name state at the current best block to a snapshot file.
+    bool DumpSnapshot(CAutoFile& file, SnapshotMetadata& metadata, SnapshotStats& stats) const;
+    /**
+     * Read a snapshot file and check it against its own trailer.  If fWrite
+     * is set, the records are also written to this (empty) database and the
+     * best block is set to the snapshot's base block at the very end.
+     */
+    bool LoadSnapshot(CAutoFile& file, SnapshotMetadata& metadata, SnapshotStats& stats, bool fWrite);
+    //! Whether an earlier LoadSnapshot was interrupted before it completed.
+    bool HasPartialSnapshot() const;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -79,10 +177,15 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, const uint256 &hashEndIn = uint256()):
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), hashEnd(hashEndIn) {}
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    //! Txid at which iteration stops, or null to iterate up to the last coin.
+    uint256 hashEnd;
+
+    //! Cache the key at the current position, or invalidate the cursor past the last record.
+    void CacheKey();
 
     friend class CCoinsViewDB;
 };
@@ -42,9 +42,11 @@
 #include <internal_miner.h>
 #include <warnings.h>
 
+#include <atomic>
 #include <future>
 #include <sstream>
 #include <map>
+#include <thread>
 #include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -230,6 +232,7 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+bool fBackgroundFlush = DEFAULT_BACKGROUND_FLUSH;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
@@ -1531,7 +1534,27 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+/** Abort with a message */
+static bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
+{
+    SetMiscWarning(strMessage);
+    LogPrintf("*** %s\n", strMessage);
+    uiInterface.ThreadSafeMessageBox(
+        userMessage.empty() ? _("Error: A fatal internal error occurred, see debug.log for details") : userMessage,
+        "", CClientUIInterface::MSG_ERROR);
+    StartShutdown();
+    return false;
+}
+
+static bool AbortNode(CValidationState& state, const std::string& strMessage, const std::string& userMessage="")
+{
+    AbortNode(strMessage, userMessage);
+    return state.Error(strMessage);
+}
+
+} // namespace
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
 {
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
@@ -1562,26 +1585,6 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
-/** Abort with a message */
-static bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
-{
-    SetMiscWarning(strMessage);
-    LogPrintf("*** %s\n", strMessage);
-    uiInterface.ThreadSafeMessageBox(
-        userMessage.empty() ? _("Error: A fatal internal error occurred, see debug.log for details") : userMessage,
-        "", CClientUIInterface::MSG_ERROR);
-    StartShutdown();
-    return false;
-}
-
-static bool AbortNode(CValidationState& state, const std::string& strMessage, const std::string& userMessage="")
-{
-    AbortNode(strMessage, userMessage);
-    return state.Error(strMessage);
-}
-
-} // namespace
-
 /**
  * Restore the UTXO in a Coin at a given COutPoint
  * @param undo The Coin to be restored.
@@ -2224,6 +2227,76 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     return true;
 }
 
+namespace {
+
+/**
+ * Commits the dirty part of pcoinsTip to pcoinsdbview from a background
+ * thread (-backgroundflush).  The snapshot is taken with BeginPartialFlush,
+ * so pcoinsTip keeps serving all reads while the database is written in
+ * -dbbatchsize chunks under the usual DB_HEAD_BLOCKS protection.  All
+ * methods must be called with cs_main held; the writer thread only touches
+ * its own snapshot and the database.
+ */
+class CCoinsTipWriter
+{
+private:
+    std::thread m_thread;
+    std::atomic<bool> m_done{false};
+    bool m_ok{true};
+    CCoinsMap m_coins;
+    CNameCache m_names;
+    uint256 m_hash_block;
+    CBlockLocator m_locator;
+
+    void ThreadWrite()
+    {
+        int64_t nStart = GetTimeMillis();
+        size_t nCount = m_coins.size();
+        try {
+            m_ok = pcoinsdbview->BatchWrite(m_coins, m_hash_block, m_names);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            m_ok = false;
+        }
+        m_coins.clear();
+        m_names.clear();
+        LogPrint(BCLog::COINDB, "Background flush of %u coins at %s took %dms\n", (unsigned int)nCount, m_hash_block.ToString(), GetTimeMillis() - nStart);
+        m_done = true;
+    }
+
+public:
+    bool IsRunning() const { return m_thread.joinable(); }
+    bool IsDone() const { return IsRunning() && m_done; }
+
+    void Start()
+    {
+        AssertLockHeld(cs_main);
+        assert(!IsRunning());
+        pcoinsTip->BeginPartialFlush(m_coins, m_names);
+        m_hash_block = pcoinsTip->GetBestBlock();
+        m_locator = chainActive.GetLocator();
+        m_done = false;
+        m_thread = std::thread(&TraceThread<std::function<void()>>, "coinsflush", std::bind(&CCoinsTipWriter::ThreadWrite, this));
+    }
+
+    /** Wait for a running write (if any) and release the snapshot in pcoinsTip. */
+    bool Finish()
+    {
+        AssertLockHeld(cs_main);
+        if (!IsRunning()) return true;
+        m_thread.join();
+        pcoinsTip->EndPartialFlush();
+        if (!m_ok) return false;
+        // Update best block in wallet (so we can detect restored wallets).
+        GetMainSignals().ChainStateFlushed(m_locator);
+        return true;
+    }
+};
+
+CCoinsTipWriter g_coins_writer;
+
+} // namespace
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -2241,6 +2314,9 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
     std::set<int> setFilesToPrune;
     bool full_flush_completed = false;
     try {
+    if (g_coins_writer.IsDone() && !g_coins_writer.Finish()) {
+        return AbortNode(state, "Failed to write to coin database");
+    }
     {
         bool fFlushForPrune = false;
         bool fDoFullFlush = false;
@@ -2320,11 +2396,41 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
-                return AbortNode(state, "Failed to write to coin database");
+            if (!fBackgroundFlush) {
+                // Flush the chainstate (which may refer to block index entries).
+                if (!pcoinsTip->Flush())
+                    return AbortNode(state, "Failed to write to coin database");
+                full_flush_completed = true;
+            } else if (mode == FlushStateMode::PERIODIC && !fFlushForPrune) {
+                // Write the dirty entries in the background and keep the cache
+                // warm.  Clean entries are evicted by age once that is done.
+                if (!g_coins_writer.IsRunning()) {
+                    g_coins_writer.Start();
+                }
+            } else {
+                // The caller needs the chainstate on disk (or memory) now.
+                if (!g_coins_writer.Finish())
+                    return AbortNode(state, "Failed to write to coin database");
+                // If the cache is merely too large, dropping clean entries
+                // may be enough.
+                if (fCacheCritical) {
+                    pcoinsTip->EvictLRU((8 * nTotalSpace) / 10);
+                }
+                if (!fCacheCritical || pcoinsTip->DynamicMemoryUsage() > nTotalSpace) {
+                    if (!pcoinsTip->Sync())
+                        return AbortNode(state, "Failed to write to coin database");
+                    full_flush_completed = true;
+                    if (fCacheCritical) {
+                        pcoinsTip->EvictLRU((8 * nTotalSpace) / 10);
+                    }
+                }
+            }
             nLastFlush = nNow;
-            full_flush_completed = true;
+        }
+        // Under memory pressure, make room by dropping the least recently
+        // used clean entries once no background write is pending.
+        if (fBackgroundFlush && fCacheLarge && !g_coins_writer.IsRunning()) {
+            pcoinsTip->EvictLRU((8 * nTotalSpace) / 10);
         }
     }
     if (full_flush_completed) {
@@ -2345,6 +2451,14 @@ void FlushStateToDisk() {
     }
 }
 
+bool SyncCoinsTip() {
+    LOCK(cs_main);
+    if (!g_coins_writer.Finish()) {
+        return false;
+    }
+    return pcoinsTip->Sync();
+}
+
 void PruneAndFlush() {
     CValidationState state;
     fCheckForPruning = true;
@@ -2849,15 +2963,15 @@ bool CChainState::ActivateBestChain(CValidationState &state, const CChainParams&
     do {
         boost::this_thread::interruption_point();
 
-        if (GetMainSignals().CallbacksPending() > 10) {
-            // Block until the validation queue drains. This should largely
-            // never happen in normal operation, however may happen during
-            // reindex, causing memory blowup if we run too far ahead.
-            // Note that if a validationinterface callback ends up calling
-            // ActivateBestChain this may lead to a deadlock! We should
-            // probably have a DEBUG_LOCKORDER test for this in the future.
-            SyncWithValidationInterfaceQueue();
-        }
+        // Block until the validation queues that are more than 10 callbacks
+        // behind drain. This should largely never happen in normal operation,
+        // however may happen during reindex, causing memory blowup if we run
+        // too far ahead. Only the subscribers that fall behind are waited
+        // for, so that one slow subscriber does not hold up the others.
+        // Note that if a validationinterface callback ends up calling
+        // ActivateBestChain this may lead to a deadlock! We should
+        // probably have a DEBUG_LOCKORDER test for this in the future.
+        GetMainSignals().SyncWithLaggingSubscribers(10);
 
         {
             LOCK(cs_main);
@@ -3265,7 +3379,7 @@ bool CheckDbLockLimit(const std::vector<CTransactionRef>& vtx)
     }
 
     const unsigned nTotalIds = setTxIds.size() + nNames;
-    if (nTotalIds > 4500)
+    if (nTotalIds > MAX_BLOCK_DB_LOCKS)
         return error("%s : %u locks estimated, that is too much for BDB",
                      __func__, nTotalIds);
 
@@ -4233,6 +4347,54 @@ bool LoadChainTip(const CChainParams& chainparams)
     return true;
 }
 
+bool LoadUTXOSnapshot(const CChainParams& chainparams, CCoinsViewDB& view, const fs::path& path)
+{
+    AssertLockHeld(cs_main);
+
+    // First pass: check the file against its own trailer and the pinned
+    // hash without touching the database.
+    SnapshotMetadata metadata;
+    SnapshotStats stats;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s: unable to open %s", __func__, path.string());
+        try {
+            if (!view.LoadSnapshot(file, metadata, stats, false))
+                return false;
+        } catch (const std::exception& e) {
+            return error("%s: unable to read %s: %s", __func__, path.string(), e.what());
+        }
+    }
+
+    const CBlockIndex* pindex = LookupBlockIndex(metadata.hashBlock);
+    if (!pindex || !(pindex->nStatus & BLOCK_HAVE_DATA))
+        return error("%s: snapshot base block %s is not in the block index", __func__, metadata.hashBlock.ToString());
+    const MapSnapshotHashes& pinned = chainparams.Snapshots().mapSnapshotHashes;
+    const auto it = pinned.find(pindex->nHeight);
+    if (it == pinned.end() || it->second != stats.hashState)
+        return error("%s: snapshot hash %s at height %d does not match the chain parameters", __func__, stats.hashState.ToString(), pindex->nHeight);
+
+    // Second pass: write the records.  The file is verified again while
+    // reading, and the best block is only set once everything matched.
+    const uint256 hashState = stats.hashState;
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: unable to open %s", __func__, path.string());
+    try {
+        if (!view.LoadSnapshot(file, metadata, stats, true))
+            return false;
+    } catch (const std::exception& e) {
+        return error("%s: unable to read %s: %s", __func__, path.string(), e.what());
+    }
+    if (stats.hashState != hashState)
+        return error("%s: %s changed while loading", __func__, path.string());
+
+    LogPrintf("Loaded UTXO snapshot at height %d: %u coins, %u names, %u name history entries\n",
+              pindex->nHeight, stats.nCoins, stats.nNames, stats.nHistory);
+    return true;
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0, false);
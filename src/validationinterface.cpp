@@ -15,25 +15,83 @@
 #include <atomic>
 #include <future>
 
-#include <boost/signals2/signal.hpp>
+#include <boost/bind.hpp>
+
+/**
+ * A registered CValidationInterface, with its own queue of background
+ * callbacks. The queues of all subscribers share the threads of the
+ * scheduler.
+ */
+struct ValidationSubscriber {
+    CValidationInterface* const m_callbacks;
+    const std::string m_name;
+    SingleThreadedSchedulerClient m_queue;
+    //! Cleared when the subscriber is unregistered, dropping its queued callbacks
+    std::atomic<bool> m_connected{true};
+
+    std::atomic<size_t> m_max_pending{0};
+    std::atomic<uint64_t> m_processed{0};
+    std::atomic<int64_t> m_last_lag_micros{0};
+    std::atomic<int64_t> m_max_lag_micros{0};
+    std::atomic<int64_t> m_busy_micros{0};
+
+    ValidationSubscriber(CValidationInterface* callbacks, const std::string& name, CScheduler* scheduler)
+        : m_callbacks(callbacks), m_name(name), m_queue(scheduler) {}
+
+    /** Deliver a callback queued at queued_micros. Runs serially, from m_queue. */
+    void Deliver(const std::function<void (CValidationInterface&)>& func, int64_t queued_micros)
+    {
+        if (!m_connected) return;
+        const int64_t start = GetTimeMicros();
+        m_last_lag_micros = start - queued_micros;
+        if (m_last_lag_micros > m_max_lag_micros) m_max_lag_micros = m_last_lag_micros.load();
+        func(*m_callbacks);
+        m_busy_micros += GetTimeMicros() - start;
+        ++m_processed;
+    }
+};
 
 struct MainSignalsInstance {
-    boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef>&, const std::vector<CTransactionRef>&)> BlockConnected;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *, const std::vector<CTransactionRef>&)> BlockDisconnected;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionRemovedFromMempool;
-    boost::signals2::signal<void (const CBlockLocator &)> ChainStateFlushed;
-    boost::signals2::signal<void (int64_t nBestBlockTime, CConnman* connman)> Broadcast;
-    boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
-    boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
-
-    // We are not allowed to assume the scheduler only runs in one thread,
-    // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
+    CScheduler* const m_scheduler;
+
+    Mutex m_mutex;
+    std::vector<std::shared_ptr<ValidationSubscriber>> m_subscribers GUARDED_BY(m_mutex);
+    // Unregistered subscribers, whose queues must outlive the scheduler
+    // tasks that may still refer to them.
+    std::vector<std::shared_ptr<ValidationSubscriber>> m_retired GUARDED_BY(m_mutex);
+
+    // Queue of CallFunctionInValidationInterfaceQueue while there is no
+    // subscriber.
     SingleThreadedSchedulerClient m_schedulerClient;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_scheduler(pscheduler), m_schedulerClient(pscheduler) {}
+
+    std::vector<std::shared_ptr<ValidationSubscriber>> GetSubscribers()
+    {
+        LOCK(m_mutex);
+        return m_subscribers;
+    }
+
+    /** Queue a callback for every subscriber. */
+    void Enqueue(std::function<void (CValidationInterface&)> func)
+    {
+        const int64_t now = GetTimeMicros();
+        for (const auto& subscriber : GetSubscribers()) {
+            subscriber->m_queue.AddToProcessQueue([subscriber, func, now] {
+                subscriber->Deliver(func, now);
+            });
+            const size_t pending = subscriber->m_queue.CallbacksPending();
+            if (pending > subscriber->m_max_pending) subscriber->m_max_pending = pending;
+        }
+    }
+
+    /** Call a function for every subscriber, on the calling thread. */
+    void Call(const std::function<void (CValidationInterface&)>& func)
+    {
+        for (const auto& subscriber : GetSubscribers()) {
+            if (subscriber->m_connected) func(*subscriber->m_callbacks);
+        }
+    }
 };
 
 static CMainSignals g_signals;
@@ -49,13 +107,52 @@ void CMainSignals::UnregisterBackgroundSignalScheduler() {
 
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
+        std::vector<std::shared_ptr<ValidationSubscriber>> subscribers;
+        {
+            LOCK(m_internals->m_mutex);
+            subscribers = m_internals->m_subscribers;
+            subscribers.insert(subscribers.end(), m_internals->m_retired.begin(), m_internals->m_retired.end());
+        }
+        for (const auto& subscriber : subscribers) {
+            subscriber->m_queue.EmptyQueue();
+        }
         m_internals->m_schedulerClient.EmptyQueue();
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    size_t pending = m_internals->m_schedulerClient.CallbacksPending();
+    for (const auto& subscriber : m_internals->GetSubscribers()) {
+        pending += subscriber->m_queue.CallbacksPending();
+    }
+    return pending;
+}
+
+void CMainSignals::SyncWithLaggingSubscribers(size_t max_pending) {
+    for (const auto& subscriber : m_internals->GetSubscribers()) {
+        if (subscriber->m_queue.CallbacksPending() > max_pending) {
+            LogPrint(BCLog::BENCH, "%s: waiting for %s to catch up\n", __func__, subscriber->m_name);
+            SyncWithValidationInterfaceQueue(*subscriber->m_callbacks);
+        }
+    }
+}
+
+std::vector<ValidationSubscriberStats> CMainSignals::GetSubscriberStats() {
+    std::vector<ValidationSubscriberStats> result;
+    if (!m_internals) return result;
+    for (const auto& subscriber : m_internals->GetSubscribers()) {
+        ValidationSubscriberStats stats;
+        stats.name = subscriber->m_name;
+        stats.pending = subscriber->m_queue.CallbacksPending();
+        stats.max_pending = subscriber->m_max_pending;
+        stats.processed = subscriber->m_processed;
+        stats.last_lag_micros = subscriber->m_last_lag_micros;
+        stats.max_lag_micros = subscriber->m_max_lag_micros;
+        stats.busy_micros = subscriber->m_busy_micros;
+        result.push_back(std::move(stats));
+    }
+    return result;
 }
 
 void CMainSignals::RegisterWithMempoolSignals(CTxMemPool& pool) {
@@ -71,47 +168,53 @@ CMainSignals& GetMainSignals()
     return g_signals;
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3, _4));
-    g_signals.m_internals->BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->TransactionRemovedFromMempool.connect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->ChainStateFlushed.connect(boost::bind(&CValidationInterface::ChainStateFlushed, pwalletIn, _1));
-    g_signals.m_internals->Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.m_internals->NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& name) {
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_mutex);
+    internals.m_subscribers.push_back(std::make_shared<ValidationSubscriber>(pwalletIn, name, internals.m_scheduler));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.m_internals->Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->ChainStateFlushed.disconnect(boost::bind(&CValidationInterface::ChainStateFlushed, pwalletIn, _1));
-    g_signals.m_internals->TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3, _4));
-    g_signals.m_internals->BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_mutex);
+    for (auto it = internals.m_subscribers.begin(); it != internals.m_subscribers.end(); ++it) {
+        if ((*it)->m_callbacks == pwalletIn) {
+            (*it)->m_connected = false;
+            internals.m_retired.push_back(*it);
+            internals.m_subscribers.erase(it);
+            return;
+        }
+    }
 }
 
 void UnregisterAllValidationInterfaces() {
     if (!g_signals.m_internals) {
         return;
     }
-    g_signals.m_internals->BlockChecked.disconnect_all_slots();
-    g_signals.m_internals->Broadcast.disconnect_all_slots();
-    g_signals.m_internals->ChainStateFlushed.disconnect_all_slots();
-    g_signals.m_internals->TransactionAddedToMempool.disconnect_all_slots();
-    g_signals.m_internals->BlockConnected.disconnect_all_slots();
-    g_signals.m_internals->BlockDisconnected.disconnect_all_slots();
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect_all_slots();
-    g_signals.m_internals->UpdatedBlockTip.disconnect_all_slots();
-    g_signals.m_internals->NewPoWValidBlock.disconnect_all_slots();
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_mutex);
+    for (const auto& subscriber : internals.m_subscribers) {
+        subscriber->m_connected = false;
+        internals.m_retired.push_back(subscriber);
+    }
+    internals.m_subscribers.clear();
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    const std::vector<std::shared_ptr<ValidationSubscriber>> subscribers = internals.GetSubscribers();
+    if (subscribers.empty()) {
+        internals.m_schedulerClient.AddToProcessQueue(std::move(func));
+        return;
+    }
+    // Call func from the last queue that reaches it.
+    auto remaining = std::make_shared<std::atomic<size_t>>(subscribers.size());
+    auto shared_func = std::make_shared<std::function<void ()>>(std::move(func));
+    for (const auto& subscriber : subscribers) {
+        subscriber->m_queue.AddToProcessQueue([subscriber, remaining, shared_func] {
+            if (--*remaining == 0) (*shared_func)();
+        });
+    }
 }
 
 void SyncWithValidationInterfaceQueue() {
@@ -124,10 +227,25 @@ void SyncWithValidationInterfaceQueue() {
     promise.get_future().wait();
 }
 
+void SyncWithValidationInterfaceQueue(const CValidationInterface& subscriber) {
+    AssertLockNotHeld(cs_main);
+    std::shared_ptr<ValidationSubscriber> queue;
+    for (const auto& registered : g_signals.m_internals->GetSubscribers()) {
+        if (registered->m_callbacks == &subscriber) queue = registered;
+    }
+    if (!queue) return;
+    // Block until the subscriber's queue drains
+    std::promise<void> promise;
+    queue->m_queue.AddToProcessQueue([queue, &promise] {
+        promise.set_value();
+    });
+    promise.get_future().wait();
+}
+
 void CMainSignals::MempoolEntryRemoved(CTransactionRef ptx, MemPoolRemovalReason reason) {
     if (reason != MemPoolRemovalReason::BLOCK && reason != MemPoolRemovalReason::CONFLICT) {
-        m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-            m_internals->TransactionRemovedFromMempool(ptx);
+        m_internals->Enqueue([ptx](CValidationInterface& callbacks) {
+            callbacks.TransactionRemovedFromMempool(ptx);
         });
     }
 }
@@ -137,43 +255,49 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
     // the chain actually updates. One way to ensure this is for the caller to invoke this signal
     // in the same critical section where the chain is updated
 
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+    m_internals->Enqueue([pindexNew, pindexFork, fInitialDownload](CValidationInterface& callbacks) {
+        callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     });
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx) {
-    m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-        m_internals->TransactionAddedToMempool(ptx);
+    m_internals->Enqueue([ptx](CValidationInterface& callbacks) {
+        callbacks.TransactionAddedToMempool(ptx);
     });
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>>& pvtxConflicted, const std::shared_ptr<const std::vector<CTransactionRef>> &pvNameConflicts) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, pindex, pvtxConflicted, pvNameConflicts, this] {
-        m_internals->BlockConnected(pblock, pindex, *pvtxConflicted, *pvNameConflicts);
+    m_internals->Enqueue([pblock, pindex, pvtxConflicted, pvNameConflicts](CValidationInterface& callbacks) {
+        callbacks.BlockConnected(pblock, pindex, *pvtxConflicted, *pvNameConflicts);
     });
 }
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindexDelete, const std::shared_ptr<const std::vector<CTransactionRef>> &pvNameConflicts) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, pindexDelete, pvNameConflicts, this] {
-        m_internals->BlockDisconnected(pblock, pindexDelete, *pvNameConflicts);
+    m_internals->Enqueue([pblock, pindexDelete, pvNameConflicts](CValidationInterface& callbacks) {
+        callbacks.BlockDisconnected(pblock, pindexDelete, *pvNameConflicts);
     });
 }
 
 void CMainSignals::ChainStateFlushed(const CBlockLocator &locator) {
-    m_internals->m_schedulerClient.AddToProcessQueue([locator, this] {
-        m_internals->ChainStateFlushed(locator);
+    m_internals->Enqueue([locator](CValidationInterface& callbacks) {
+        callbacks.ChainStateFlushed(locator);
     });
 }
 
 void CMainSignals::Broadcast(int64_t nBestBlockTime, CConnman* connman) {
-    m_internals->Broadcast(nBestBlockTime, connman);
+    m_internals->Call([nBestBlockTime, connman](CValidationInterface& callbacks) {
+        callbacks.ResendWalletTransactions(nBestBlockTime, connman);
+    });
 }
 
 void CMainSignals::BlockChecked(const CBlock& block, const CValidationState& state) {
-    m_internals->BlockChecked(block, state);
+    m_internals->Call([&block, &state](CValidationInterface& callbacks) {
+        callbacks.BlockChecked(block, state);
+    });
 }
 
 void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &block) {
-    m_internals->NewPoWValidBlock(pindex, block);
+    m_internals->Call([pindex, &block](CValidationInterface& callbacks) {
+        callbacks.NewPoWValidBlock(pindex, block);
+    });
 }
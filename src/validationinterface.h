@@ -11,6 +11,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 extern CCriticalSection cs_main;
 class CBlock;
@@ -26,16 +28,25 @@ class CScheduler;
 class CTxMemPool;
 enum class MemPoolRemovalReason;
 
+/** Default for -callbackthreads, the number of threads delivering validation interface callbacks */
+static const int DEFAULT_CALLBACK_THREADS = 2;
+/** Maximum number of threads delivering validation interface callbacks */
+static const int MAX_CALLBACK_THREADS = 16;
+
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
+/**
+ * Register a wallet to receive updates from core. Each subscriber has its own
+ * queue of background callbacks, so that a slow subscriber only delays its
+ * own callbacks. The name identifies the subscriber in the queue statistics.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& name = "");
 /** Unregister a wallet from core */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
 /**
- * Pushes a function to callback onto the notification queue, guaranteeing any
+ * Pushes a function to callback onto the notification queues, guaranteeing any
  * callbacks generated prior to now are finished when the function is called.
  *
  * Be very careful blocking on func to be called if any locks are held -
@@ -54,6 +65,11 @@ void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
  *     promise.get_future().wait();
  */
 void SyncWithValidationInterfaceQueue() LOCKS_EXCLUDED(cs_main);
+/**
+ * Like SyncWithValidationInterfaceQueue(), but only waits for the callbacks of
+ * a single subscriber. Returns immediately if it is not registered.
+ */
+void SyncWithValidationInterfaceQueue(const CValidationInterface& subscriber) LOCKS_EXCLUDED(cs_main);
 
 /**
  * Implement this to subscribe to events generated in validation
@@ -68,7 +84,8 @@ void SyncWithValidationInterfaceQueue() LOCKS_EXCLUDED(cs_main);
  * UpdatedBlockTip() callback may depend on an operation performed in
  * the BlockConnected() callback without worrying about explicit
  * synchronization. No ordering should be assumed across
- * ValidationInterface() subscribers.
+ * ValidationInterface() subscribers: the callbacks of different
+ * subscribers may run concurrently.
  */
 class CValidationInterface {
 protected:
@@ -147,9 +164,25 @@ protected:
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
-    friend void ::RegisterValidationInterface(CValidationInterface*);
-    friend void ::UnregisterValidationInterface(CValidationInterface*);
-    friend void ::UnregisterAllValidationInterfaces();
+    friend class CMainSignals;
+};
+
+/** Statistics on the callback queue of a validation interface subscriber */
+struct ValidationSubscriberStats
+{
+    std::string name;
+    //! Callbacks waiting in the queue
+    size_t pending;
+    //! Largest number of callbacks that waited in the queue
+    size_t max_pending;
+    //! Callbacks delivered
+    uint64_t processed;
+    //! Time the last delivered callback waited in the queue
+    int64_t last_lag_micros;
+    //! Longest time a callback waited in the queue
+    int64_t max_lag_micros;
+    //! Time spent in the callbacks
+    int64_t busy_micros;
 };
 
 struct MainSignalsInstance;
@@ -157,10 +190,11 @@ class CMainSignals {
 private:
     std::unique_ptr<MainSignalsInstance> m_internals;
 
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterValidationInterface(CValidationInterface*, const std::string&);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
     friend void ::CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+    friend void ::SyncWithValidationInterfaceQueue(const CValidationInterface& subscriber);
 
     void MempoolEntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
 
@@ -172,7 +206,15 @@ public:
     /** Call any remaining callbacks on the calling thread */
     void FlushBackgroundCallbacks();
 
+    /** Number of callbacks waiting in the queues of all subscribers */
     size_t CallbacksPending();
+    /**
+     * Block until the queue of every subscriber with more than max_pending
+     * callbacks waiting has caught up, so that a subscriber falling behind
+     * does not let its queue grow without bounds.
+     */
+    void SyncWithLaggingSubscribers(size_t max_pending) LOCKS_EXCLUDED(cs_main);
+    std::vector<ValidationSubscriberStats> GetSubscriberStats();
 
     /** Register with mempool to call TransactionRemovedFromMempool callbacks */
     void RegisterWithMempoolSignals(CTxMemPool& pool);
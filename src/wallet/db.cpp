@@ -54,6 +54,41 @@ void CheckUniqueFileid(const BerkeleyEnvironment& env, const std::string& filena
 
 CCriticalSection cs_db;
 std::map<std::string, BerkeleyEnvironment> g_dbenvs GUARDED_BY(cs_db); //!< Map from directory name to open db environment.
+
+int ReadAtDbCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange)
+{
+    // Read at cursor
+    Dbt datKey;
+    unsigned int fFlags = DB_NEXT;
+    if (setRange) {
+        datKey.set_data(ssKey.data());
+        datKey.set_size(ssKey.size());
+        fFlags = DB_SET_RANGE;
+    }
+    Dbt datValue;
+    datKey.set_flags(DB_DBT_MALLOC);
+    datValue.set_flags(DB_DBT_MALLOC);
+    int ret = pcursor->get(&datKey, &datValue, fFlags);
+    if (ret != 0)
+        return ret;
+    else if (datKey.get_data() == nullptr || datValue.get_data() == nullptr)
+        return 99999;
+
+    // Convert to streams
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write((char*)datKey.get_data(), datKey.get_size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+    // Clear and free memory
+    memory_cleanse(datKey.get_data(), datKey.get_size());
+    memory_cleanse(datValue.get_data(), datValue.get_size());
+    free(datKey.get_data());
+    free(datValue.get_data());
+    return 0;
+}
 } // namespace
 
 BerkeleyEnvironment* GetWalletEnv(DbType type, const fs::path& wallet_path, std::string& database_filename)
@@ -79,6 +114,25 @@ BerkeleyEnvironment* GetWalletEnv(DbType type, const fs::path& wallet_path, std:
     return &g_dbenvs.emplace(std::piecewise_construct, std::forward_as_tuple(env_directory.string()), std::forward_as_tuple(env_directory)).first->second;
 }
 
+fs::path GetWalletLogPath(const fs::path& env_directory, const std::string& database_filename)
+{
+    return env_directory / (fs::path(database_filename).stem().string() + "log.dat");
+}
+
+void BerkeleyDatabase::InitLog(const fs::path& wallet_path)
+{
+    // A wallet given as the path of a data file stays in that file.
+    if (fs::is_regular_file(wallet_path)) {
+        return;
+    }
+    // An existing log always takes precedence, as the BerkeleyDB file next to
+    // it is only a copy of the wallet from before it was migrated.
+    fs::path log_path = GetWalletLogPath(env->Directory(), strFile);
+    if (fs::exists(log_path) || gArgs.GetArg("-walletbackend", DEFAULT_WALLET_BACKEND) == "log") {
+        m_log = MakeUnique<LogDatabase>(log_path);
+    }
+}
+
 //
 // BerkeleyBatch
 //
@@ -252,6 +306,13 @@ bool BerkeleyBatch::Recover(const fs::path& file_path, void *callbackDataIn, boo
     std::string filename;
     BerkeleyEnvironment* env = GetWalletEnv(DbType::WALLET, file_path, filename);
 
+    if (fs::exists(GetWalletLogPath(env->Directory(), filename))) {
+        // Incomplete records at the end of a log are dropped when it is
+        // opened, there is nothing else to salvage.
+        LogPrintf("%s is stored in a log database, nothing to salvage\n", filename);
+        return true;
+    }
+
     // Recovery procedure:
     // move wallet file to walletfilename.timestamp.bak
     // Call Salvage with fAggressive=true to
@@ -346,6 +407,11 @@ bool BerkeleyBatch::VerifyDatabaseFile(const fs::path& file_path, std::string& w
     BerkeleyEnvironment* env = GetWalletEnv(DbType::WALLET, file_path, walletFile);
     fs::path walletDir = env->Directory();
 
+    // Log databases are checked as they are read
+    if (fs::exists(GetWalletLogPath(walletDir, walletFile))) {
+        return true;
+    }
+
     if (fs::exists(walletDir / walletFile))
     {
         std::string backup_filename;
@@ -443,7 +509,7 @@ void BerkeleyEnvironment::CheckpointLSN(const std::string& strFile)
 }
 
 
-BerkeleyBatch::BerkeleyBatch(BerkeleyDatabase& database, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr)
+BerkeleyBatch::BerkeleyBatch(BerkeleyDatabase& database, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr), m_log(nullptr), m_log_txn_active(false)
 {
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
     fFlushOnClose = fFlushOnCloseIn;
@@ -458,6 +524,33 @@ BerkeleyBatch::BerkeleyBatch(BerkeleyDatabase& database, const char* pszMode, bo
     if (fCreate)
         nFlags |= DB_CREATE;
 
+    if (database.m_log) {
+        LOCK(cs_db);
+        LogDatabase& log = *database.m_log;
+        const bool fOpened = !log.IsOpen();
+        if (fOpened) {
+            // Switching a wallet to the log backend copies its records once
+            if (!fs::exists(log.GetPath()) && fs::exists(env->Directory() / strFilename) &&
+                !MigrateToLog(database, log.GetPath())) {
+                throw std::runtime_error(strprintf("BerkeleyBatch: Failed to migrate database %s", strFilename));
+            }
+            TryCreateDirectories(env->Directory());
+            std::string error;
+            if (!log.Open(error)) {
+                throw std::runtime_error(strprintf("BerkeleyBatch: %s", error));
+            }
+        }
+        m_log = &log;
+        strFile = strFilename;
+        if (fOpened && fCreate && !Exists(std::string("version"))) {
+            bool fTmp = fReadOnly;
+            fReadOnly = false;
+            WriteVersion(CLIENT_VERSION);
+            fReadOnly = fTmp;
+        }
+        return;
+    }
+
     {
         LOCK(cs_db);
         if (!env->Open(false /* retry */))
@@ -524,7 +617,8 @@ BerkeleyBatch::BerkeleyBatch(BerkeleyDatabase& database, const char* pszMode, bo
 
 void BerkeleyBatch::Flush()
 {
-    if (activeTxn)
+    // Log databases are synced by PeriodicFlush and in the background
+    if (activeTxn || m_log)
         return;
 
     // Flush database activity from memory pool to disk log
@@ -542,6 +636,11 @@ void BerkeleyDatabase::IncrementUpdateCounter()
 
 void BerkeleyBatch::Close()
 {
+    if (m_log) {
+        TxnAbort();
+        m_log = nullptr;
+        return;
+    }
     if (!pdb)
         return;
     if (activeTxn)
@@ -604,6 +703,34 @@ bool BerkeleyBatch::Rewrite(BerkeleyDatabase& database, const char* pszSkip)
     if (database.IsDummy()) {
         return true;
     }
+    if (database.m_log) {
+        // Erase the skipped records, then compact the log so that neither
+        // they nor any overwritten record remain in the file.
+        LogPrintf("BerkeleyBatch::Rewrite: Rewriting %s...\n", database.m_log->GetPath().filename().string());
+        bool fSuccess = true;
+        {
+            BerkeleyBatch db(database);
+            if (pszSkip) {
+                const size_t skip_size = strlen(pszSkip);
+                LogDatabase::Changes changes;
+                CDataStream ssKey(pszSkip, pszSkip + skip_size, SER_DISK, CLIENT_VERSION);
+                CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+                std::unique_ptr<Cursor> cursor = db.GetCursor();
+                bool setRange = true;
+                while (db.ReadAtCursor(*cursor, ssKey, ssValue, setRange) == 0 &&
+                       strncmp(ssKey.data(), pszSkip, std::min(ssKey.size(), skip_size)) == 0) {
+                    changes[CSerializeData(ssKey.begin(), ssKey.end())].erase = true;
+                    setRange = false;
+                }
+                fSuccess = database.m_log->Apply(changes);
+            }
+            fSuccess = fSuccess && db.WriteVersion(CLIENT_VERSION);
+        }
+        fSuccess = fSuccess && database.m_log->Compact();
+        if (!fSuccess)
+            LogPrintf("BerkeleyBatch::Rewrite: Failed to rewrite database file %s\n", database.m_log->GetPath().string());
+        return fSuccess;
+    }
     BerkeleyEnvironment *env = database.env;
     const std::string& strFile = database.strFile;
     while (true) {
@@ -633,17 +760,15 @@ bool BerkeleyBatch::Rewrite(BerkeleyDatabase& database, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    std::unique_ptr<Cursor> pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
                             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-                            int ret1 = db.ReadAtCursor(pcursor, ssKey, ssValue);
+                            int ret1 = db.ReadAtCursor(*pcursor, ssKey, ssValue);
                             if (ret1 == DB_NOTFOUND) {
-                                pcursor->close();
                                 break;
                             } else if (ret1 != 0) {
-                                pcursor->close();
                                 fSuccess = false;
                                 break;
                             }
@@ -661,6 +786,7 @@ bool BerkeleyBatch::Rewrite(BerkeleyDatabase& database, const char* pszSkip)
                             if (ret2 > 0)
                                 fSuccess = false;
                         }
+                    pcursor.reset();
                     if (fSuccess) {
                         db.Close();
                         env->CloseDb(strFile);
@@ -734,6 +860,9 @@ bool BerkeleyBatch::PeriodicFlush(BerkeleyDatabase& database)
     if (database.IsDummy()) {
         return true;
     }
+    if (database.m_log) {
+        return database.m_log->Sync();
+    }
     bool ret = false;
     BerkeleyEnvironment *env = database.env;
     const std::string& strFile = database.strFile;
@@ -782,6 +911,11 @@ bool BerkeleyDatabase::Backup(const std::string& strDest)
     if (IsDummy()) {
         return false;
     }
+    if (m_log) {
+        // Make sure the log exists before copying it
+        BerkeleyBatch batch(*this, "r");
+        return m_log->Backup(strDest);
+    }
     while (true)
     {
         {
@@ -821,6 +955,13 @@ bool BerkeleyDatabase::Backup(const std::string& strDest)
 void BerkeleyDatabase::Flush(bool shutdown)
 {
     if (!IsDummy()) {
+        if (m_log) {
+            if (shutdown) {
+                m_log->Close();
+            } else if (!m_log->Sync()) {
+                LogPrintf("BerkeleyDatabase::Flush: Error syncing %s\n", m_log->GetPath().string());
+            }
+        }
         env->Flush(shutdown);
         if (shutdown) {
             LOCK(cs_db);
@@ -832,7 +973,161 @@ void BerkeleyDatabase::Flush(bool shutdown)
 
 void BerkeleyDatabase::ReloadDbEnv()
 {
-    if (!IsDummy()) {
+    if (!IsDummy() && !m_log) {
         env->ReloadDbEnv();
     }
 }
+
+bool BerkeleyBatch::MigrateToLog(BerkeleyDatabase& database, const fs::path& log_path)
+{
+    BerkeleyEnvironment* env = database.env;
+    const std::string& strFile = database.strFile;
+    LogPrintf("Migrating %s to %s...\n", strFile, log_path.string());
+    int64_t nStart = GetTimeMillis();
+
+    LogDatabase::Index records;
+    {
+        LOCK(cs_db);
+        if (!env->Open(false /* retry */)) {
+            LogPrintf("BerkeleyBatch::MigrateToLog: Failed to open database environment %s\n", env->Directory().string());
+            return false;
+        }
+        Db* pdb = env->mapDb[strFile];
+        std::unique_ptr<Db> pdb_temp;
+        if (pdb == nullptr) {
+            pdb_temp = MakeUnique<Db>(env->dbenv.get(), 0);
+            bool fMockDb = env->IsMock();
+            int ret = pdb_temp->open(nullptr,                         // Txn pointer
+                                     fMockDb ? nullptr : strFile.c_str(),  // Filename
+                                     fMockDb ? strFile.c_str() : "main",   // Logical db name
+                                     DB_BTREE,                             // Database type
+                                     DB_THREAD,                            // Flags
+                                     0);
+            if (ret != 0) {
+                LogPrintf("BerkeleyBatch::MigrateToLog: Error %d, can't open database %s\n", ret, strFile);
+                pdb_temp->close(0);
+                return false;
+            }
+            pdb = pdb_temp.get();
+        }
+
+        Dbc* pcursor = nullptr;
+        bool fSuccess = pdb->cursor(nullptr, &pcursor, 0) == 0;
+        if (fSuccess) {
+            Cursor cursor(pcursor);
+            while (true) {
+                CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+                CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+                int ret = ReadAtDbCursor(pcursor, ssKey, ssValue, false);
+                if (ret == DB_NOTFOUND) {
+                    break;
+                } else if (ret != 0) {
+                    fSuccess = false;
+                    break;
+                }
+                records.emplace(CSerializeData(ssKey.begin(), ssKey.end()), CSerializeData(ssValue.begin(), ssValue.end()));
+            }
+        }
+        if (pdb_temp) {
+            pdb_temp->close(0);
+        }
+        if (!fSuccess) {
+            LogPrintf("BerkeleyBatch::MigrateToLog: Error reading %s\n", strFile);
+            return false;
+        }
+    }
+
+    // The BerkeleyDB file is left in place as a backup.
+    if (!LogDatabase::WriteFile(log_path, records)) {
+        LogPrintf("BerkeleyBatch::MigrateToLog: Error writing %s\n", log_path.string());
+        return false;
+    }
+    LogPrintf("Migrated %u records of %s in %dms\n", records.size(), strFile, GetTimeMillis() - nStart);
+    return true;
+}
+
+std::unique_ptr<BerkeleyBatch::Cursor> BerkeleyBatch::GetCursor()
+{
+    if (m_log)
+        return MakeUnique<Cursor>();
+    if (!pdb)
+        return nullptr;
+    Dbc* pcursor = nullptr;
+    int ret = pdb->cursor(nullptr, &pcursor, 0);
+    if (ret != 0)
+        return nullptr;
+    return MakeUnique<Cursor>(pcursor);
+}
+
+int BerkeleyBatch::ReadAtCursor(Cursor& cursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange)
+{
+    if (!m_log)
+        return ReadAtDbCursor(cursor.m_dbc, ssKey, ssValue, setRange);
+
+    // Records written by an active transaction are not visible to cursors,
+    // as with BerkeleyDB cursors opened outside of it.
+    CSerializeData key, value;
+    bool found;
+    if (setRange) {
+        found = m_log->Next(CSerializeData(ssKey.begin(), ssKey.end()), true, key, value);
+    } else {
+        found = m_log->Next(cursor.m_key, !cursor.m_started, key, value);
+    }
+    if (!found)
+        return DB_NOTFOUND;
+    cursor.m_started = true;
+    cursor.m_key = key;
+
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write(key.data(), key.size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write(value.data(), value.size());
+    return 0;
+}
+
+bool BerkeleyBatch::ReadLog(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    CSerializeData value;
+    auto it = m_log_txn.find(key);
+    if (it != m_log_txn.end()) {
+        if (it->second.erase)
+            return false;
+        value = it->second.value;
+    } else if (!m_log->Read(key, value)) {
+        return false;
+    }
+    ssValue.write(value.data(), value.size());
+    return true;
+}
+
+bool BerkeleyBatch::WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    if (!fOverwrite && ExistsLog(ssKey))
+        return false;
+    LogDatabase::Changes changes;
+    LogDatabase::Change& change = (m_log_txn_active ? m_log_txn : changes)[CSerializeData(ssKey.begin(), ssKey.end())];
+    change.erase = false;
+    change.value.assign(ssValue.begin(), ssValue.end());
+    return m_log_txn_active || m_log->Apply(changes);
+}
+
+bool BerkeleyBatch::EraseLog(const CDataStream& ssKey)
+{
+    LogDatabase::Changes changes;
+    LogDatabase::Change& change = (m_log_txn_active ? m_log_txn : changes)[CSerializeData(ssKey.begin(), ssKey.end())];
+    change.erase = true;
+    change.value.clear();
+    return m_log_txn_active || m_log->Apply(changes);
+}
+
+bool BerkeleyBatch::ExistsLog(const CDataStream& ssKey)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    auto it = m_log_txn.find(key);
+    if (it != m_log_txn.end())
+        return !it->second.erase;
+    return m_log->Exists(key);
+}
@@ -13,6 +13,7 @@
 #include <sync.h>
 #include <util.h>
 #include <version.h>
+#include <wallet/logdb.h>
 
 #include <atomic>
 #include <map>
@@ -24,6 +25,7 @@
 
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
+static const char* const DEFAULT_WALLET_BACKEND = "bdb";
 
 enum class DbType
 {
@@ -97,8 +99,13 @@ public:
 /** Get BerkeleyEnvironment and database filename given a wallet path. */
 BerkeleyEnvironment* GetWalletEnv(DbType type, const fs::path& wallet_path, std::string& database_filename);
 
+/** Get the path of the log database replacing database_filename in env_directory. */
+fs::path GetWalletLogPath(const fs::path& env_directory, const std::string& database_filename);
+
 /** An instance of this class represents one database.
- * For BerkeleyDB this is just a (env, strFile) tuple.
+ * For BerkeleyDB this is just a (env, strFile) tuple. Wallets in a directory
+ * may instead be stored in a LogDatabase (see -walletbackend), in which case
+ * the environment is only used to migrate their BerkeleyDB file.
  **/
 class BerkeleyDatabase
 {
@@ -119,6 +126,8 @@ public:
             env->Close();
             env->Reset();
             env->MakeMock();
+        } else {
+            InitLog(wallet_path);
         }
     }
 
@@ -170,6 +179,11 @@ private:
     /** BerkeleyDB specific */
     BerkeleyEnvironment *env;
     std::string strFile;
+    /** Log database holding the records instead of strFile, if any */
+    std::unique_ptr<LogDatabase> m_log;
+
+    /** Use a log database if there is one, or if -walletbackend selects it */
+    void InitLog(const fs::path& wallet_path);
 
     /** Return whether this database handle is a dummy for testing.
      * Only to be used at a low level, application should ideally not care
@@ -189,6 +203,15 @@ protected:
     bool fReadOnly;
     bool fFlushOnClose;
     BerkeleyEnvironment *env;
+    LogDatabase* m_log;
+    //! changes of the active transaction on a log database
+    LogDatabase::Changes m_log_txn;
+    bool m_log_txn_active;
+
+    bool ReadLog(const CDataStream& ssKey, CDataStream& ssValue);
+    bool WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite);
+    bool EraseLog(const CDataStream& ssKey);
+    bool ExistsLog(const CDataStream& ssKey);
 
 public:
     explicit BerkeleyBatch(BerkeleyDatabase& database, const char* pszMode = "r+", bool fFlushOnCloseIn=true);
@@ -208,18 +231,31 @@ public:
     static bool VerifyEnvironment(const fs::path& file_path, std::string& errorStr);
     /* verifies the database file */
     static bool VerifyDatabaseFile(const fs::path& file_path, std::string& warningStr, std::string& errorStr, BerkeleyEnvironment::recoverFunc_type recoverFunc);
+    /* copies the records of the BerkeleyDB file of database to a new log database at log_path */
+    static bool MigrateToLog(BerkeleyDatabase& database, const fs::path& log_path);
 
 public:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pdb && !m_log)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (m_log) {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            if (!ReadLog(ssKey, ssValue))
+                return false;
+            try {
+                ssValue >> value;
+                return true;
+            } catch (const std::exception&) {
+                return false;
+            }
+        }
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Read
@@ -248,7 +284,7 @@ public:
     template <typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!pdb)
+        if (!pdb && !m_log)
             return true;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
@@ -263,6 +299,8 @@ public:
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+        if (m_log)
+            return WriteLog(ssKey, ssValue, fOverwrite);
         Dbt datValue(ssValue.data(), ssValue.size());
 
         // Write
@@ -277,7 +315,7 @@ public:
     template <typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !m_log)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
@@ -286,6 +324,8 @@ public:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (m_log)
+            return EraseLog(ssKey);
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Erase
@@ -299,13 +339,15 @@ public:
     template <typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !m_log)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (m_log)
+            return ExistsLog(ssKey);
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Exists
@@ -316,55 +358,39 @@ public:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
+    /** A cursor over the records of a database, in key order */
+    class Cursor
     {
-        if (!pdb)
-            return nullptr;
-        Dbc* pcursor = nullptr;
-        int ret = pdb->cursor(nullptr, &pcursor, 0);
-        if (ret != 0)
-            return nullptr;
-        return pcursor;
-    }
+    public:
+        explicit Cursor(Dbc* dbc = nullptr) : m_dbc(dbc) {}
+        ~Cursor() { if (m_dbc) m_dbc->close(); }
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange = false)
-    {
-        // Read at cursor
-        Dbt datKey;
-        unsigned int fFlags = DB_NEXT;
-        if (setRange) {
-            datKey.set_data(ssKey.data());
-            datKey.set_size(ssKey.size());
-            fFlags = DB_SET_RANGE;
-        }
-        Dbt datValue;
-        datKey.set_flags(DB_DBT_MALLOC);
-        datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
-        if (ret != 0)
-            return ret;
-        else if (datKey.get_data() == nullptr || datValue.get_data() == nullptr)
-            return 99999;
-
-        // Convert to streams
-        ssKey.SetType(SER_DISK);
-        ssKey.clear();
-        ssKey.write((char*)datKey.get_data(), datKey.get_size());
-        ssValue.SetType(SER_DISK);
-        ssValue.clear();
-        ssValue.write((char*)datValue.get_data(), datValue.get_size());
-
-        // Clear and free memory
-        memory_cleanse(datKey.get_data(), datKey.get_size());
-        memory_cleanse(datValue.get_data(), datValue.get_size());
-        free(datKey.get_data());
-        free(datValue.get_data());
-        return 0;
-    }
+        Cursor(const Cursor&) = delete;
+        Cursor& operator=(const Cursor&) = delete;
+
+    private:
+        friend class BerkeleyBatch;
+        Dbc* m_dbc;
+        //! key of the last record read from a log database
+        CSerializeData m_key;
+        bool m_started = false;
+    };
+
+    std::unique_ptr<Cursor> GetCursor();
+
+    /** Read the next record, or the first one at or after ssKey if setRange is set.
+     * Returns 0 on success and DB_NOTFOUND past the last record. */
+    int ReadAtCursor(Cursor& cursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange = false);
 
 public:
     bool TxnBegin()
     {
+        if (m_log) {
+            if (m_log_txn_active)
+                return false;
+            m_log_txn_active = true;
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = env->TxnBegin();
@@ -376,6 +402,14 @@ public:
 
     bool TxnCommit()
     {
+        if (m_log) {
+            if (!m_log_txn_active)
+                return false;
+            m_log_txn_active = false;
+            bool ret = m_log->Apply(m_log_txn);
+            m_log_txn.clear();
+            return ret;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -385,6 +419,13 @@ public:
 
     bool TxnAbort()
     {
+        if (m_log) {
+            if (!m_log_txn_active)
+                return false;
+            m_log_txn_active = false;
+            m_log_txn.clear();
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
@@ -77,6 +77,7 @@ void WalletInit::AddWalletOptions() const
     gArgs.AddArg("-txconfirmtarget=<n>", strprintf("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)", DEFAULT_TX_CONFIRM_TARGET), false, OptionsCategory::WALLET);
     gArgs.AddArg("-upgradewallet", "Upgrade wallet to latest format on startup", false, OptionsCategory::WALLET);
     gArgs.AddArg("-wallet=<path>", "Specify wallet database path. Can be specified multiple times to load multiple wallets. Path is interpreted relative to <walletdir> if it is not absolute, and will be created if it does not exist (as a directory containing a wallet.dat file and log files). For backwards compatibility this will also accept names of existing data files in <walletdir>.)", false, OptionsCategory::WALLET);
+    gArgs.AddArg("-walletbackend=<backend>", strprintf("Store new wallets, and migrate existing ones, in the given database backend (\"bdb\" or \"log\", an append-only log held in memory, default: \"%s\"). Wallets already stored in a log stay there", DEFAULT_WALLET_BACKEND), false, OptionsCategory::WALLET);
     gArgs.AddArg("-walletbroadcast",  strprintf("Make the wallet broadcast transactions (default: %u)", DEFAULT_WALLETBROADCAST), false, OptionsCategory::WALLET);
     gArgs.AddArg("-walletdir=<dir>", "Specify directory to hold wallets (default: <datadir>/wallets if it exists, otherwise <datadir>)", false, OptionsCategory::WALLET);
     gArgs.AddArg("-walletnotify=<cmd>", "Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)", false, OptionsCategory::WALLET);
@@ -139,6 +140,11 @@ bool WalletInit::ParameterInteraction() const
         }
     }
 
+    const std::string wallet_backend = gArgs.GetArg("-walletbackend", DEFAULT_WALLET_BACKEND);
+    if (wallet_backend != "bdb" && wallet_backend != "log") {
+        return InitError(strprintf(_("Unknown -walletbackend value: %s"), wallet_backend));
+    }
+
     if (gArgs.GetBoolArg("-sysperms", false))
         return InitError("-sysperms is not allowed in combination with enabled wallet functionality");
     if (gArgs.GetArg("-prune", 0) && gArgs.GetBoolArg("-rescan", false))
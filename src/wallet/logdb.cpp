@@ -0,0 +1,450 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/logdb.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <serialize.h>
+#include <streams.h>
+#include <util.h>
+#include <version.h>
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+//! Magic bytes at the start of a log database file
+const char LOG_MAGIC[8] = {'b', 's', 't', 'w', 'l', 'o', 'g', 0};
+const uint32_t LOG_FORMAT_VERSION = 1;
+const size_t LOG_HEADER_SIZE = sizeof(LOG_MAGIC) + 4;
+//! Size of the size and checksum preceding each frame
+const size_t FRAME_HEADER_SIZE = 8;
+//! Size of the frames the records are grouped in when a log is rewritten
+const size_t REWRITE_FRAME_SIZE = 1 << 20;
+
+enum LogOp : uint8_t {
+    LOG_OP_WRITE = 1,
+    LOG_OP_ERASE = 2,
+};
+
+uint32_t FrameChecksum(const char* begin, const char* end)
+{
+    const uint256 hash = Hash(begin, end);
+    return ReadLE32(hash.begin());
+}
+
+/** The number of bytes a record takes in a frame, used to tell how much of the log is live */
+uint64_t RecordSize(const CSerializeData& key, const CSerializeData& value)
+{
+    return 1 + GetSizeOfCompactSize(key.size()) + key.size() + GetSizeOfCompactSize(value.size()) + value.size();
+}
+
+/** Turn a payload into a frame by prepending its size and checksum. */
+void SealFrame(CSerializeData& frame)
+{
+    const uint32_t size = frame.size() - FRAME_HEADER_SIZE;
+    WriteLE32((unsigned char*)&frame[0], size);
+    WriteLE32((unsigned char*)&frame[4], FrameChecksum(frame.data() + FRAME_HEADER_SIZE, frame.data() + frame.size()));
+}
+
+void SerializeFrame(const LogDatabase::Changes& changes, CSerializeData& frame)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss.resize(FRAME_HEADER_SIZE);
+    for (const auto& change : changes) {
+        if (change.second.erase) {
+            ss << uint8_t(LOG_OP_ERASE) << change.first;
+        } else {
+            ss << uint8_t(LOG_OP_WRITE) << change.first << change.second.value;
+        }
+    }
+    frame.assign(ss.begin(), ss.end());
+    SealFrame(frame);
+}
+
+bool ParseFrame(const CSerializeData& payload, LogDatabase::Changes& changes)
+{
+    try {
+        CDataStream ss(payload.begin(), payload.end(), SER_DISK, CLIENT_VERSION);
+        while (!ss.empty()) {
+            uint8_t op;
+            CSerializeData key;
+            ss >> op >> key;
+            LogDatabase::Change& change = changes[key];
+            change.erase = op == LOG_OP_ERASE;
+            change.value.clear();
+            if (op == LOG_OP_WRITE) {
+                ss >> change.value;
+            } else if (op != LOG_OP_ERASE) {
+                return false;
+            }
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+bool WriteHeader(FILE* file)
+{
+    unsigned char header[LOG_HEADER_SIZE];
+    memcpy(header, LOG_MAGIC, sizeof(LOG_MAGIC));
+    WriteLE32(header + sizeof(LOG_MAGIC), LOG_FORMAT_VERSION);
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+/** Write a log holding records to an empty file. */
+bool WriteRecords(FILE* file, const LogDatabase::Index& records)
+{
+    if (!WriteHeader(file)) return false;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    CSerializeData frame;
+    auto flush = [&]() {
+        if (ss.size() == FRAME_HEADER_SIZE) return true;
+        frame.assign(ss.begin(), ss.end());
+        SealFrame(frame);
+        ss.resize(FRAME_HEADER_SIZE);
+        return fwrite(frame.data(), 1, frame.size(), file) == frame.size();
+    };
+    ss.resize(FRAME_HEADER_SIZE);
+    for (const auto& record : records) {
+        ss << uint8_t(LOG_OP_WRITE) << record.first << record.second;
+        if (ss.size() >= REWRITE_FRAME_SIZE && !flush()) return false;
+    }
+    return flush() && fflush(file) == 0;
+}
+
+} // namespace
+
+bool LogKeyCompare::operator()(const CSerializeData& a, const CSerializeData& b) const
+{
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+        [](char x, char y) { return (unsigned char)x < (unsigned char)y; });
+}
+
+LogDatabase::LogDatabase(const fs::path& path) : m_path(path)
+{
+}
+
+LogDatabase::~LogDatabase()
+{
+    Close();
+}
+
+bool LogDatabase::IsOpen() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_file != nullptr;
+}
+
+bool LogDatabase::Open(std::string& error)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file) return true;
+
+    FILE* file = fsbridge::fopen(m_path, "rb+");
+    if (!file) {
+        file = fsbridge::fopen(m_path, "wb+");
+        if (!file || !WriteHeader(file) || !FileCommit(file)) {
+            if (file) fclose(file);
+            error = strprintf("Error creating %s", m_path.string());
+            return false;
+        }
+        rewind(file);
+    }
+
+    unsigned char header[LOG_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) {
+        fclose(file);
+        error = strprintf("%s is not a wallet log", m_path.string());
+        return false;
+    }
+    if (ReadLE32(header + sizeof(LOG_MAGIC)) > LOG_FORMAT_VERSION) {
+        fclose(file);
+        error = strprintf("%s was written by a newer version", m_path.string());
+        return false;
+    }
+
+    // Replay the frames. The first frame that is incomplete or fails its
+    // checksum was being written when the process stopped; it and anything
+    // after it are dropped.
+    m_index.clear();
+    m_live = 0;
+    uint64_t pos = LOG_HEADER_SIZE;
+    uint64_t frames = 0;
+    CSerializeData payload;
+    while (true) {
+        unsigned char frame_header[FRAME_HEADER_SIZE];
+        if (fread(frame_header, 1, sizeof(frame_header), file) != sizeof(frame_header)) break;
+        const uint32_t size = ReadLE32(frame_header);
+        if (size > MAX_LOG_FRAME_SIZE) break;
+        payload.resize(size);
+        if (fread(payload.data(), 1, size, file) != size) break;
+        if (ReadLE32(frame_header + 4) != FrameChecksum(payload.data(), payload.data() + size)) break;
+        Changes changes;
+        if (!ParseFrame(payload, changes)) break;
+        ApplyIndex(changes);
+        pos += FRAME_HEADER_SIZE + size;
+        ++frames;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const uint64_t file_size = ftell(file);
+    if (file_size > pos) {
+        LogPrintf("%s: dropping %u bytes of incomplete records at the end of %s\n", __func__, file_size - pos, m_path.string());
+        if (!TruncateFile(file, pos) || !FileCommit(file)) {
+            fclose(file);
+            error = strprintf("Error truncating %s", m_path.string());
+            return false;
+        }
+    }
+    fseek(file, pos, SEEK_SET);
+    LogPrint(BCLog::DB, "%s: read %u records from %u frames of %s\n", __func__, m_index.size(), frames, m_path.string());
+
+    m_file = file;
+    m_size = pos;
+    m_written = m_synced = 0;
+    m_compact_size = LOG_COMPACT_MIN_SIZE;
+    m_stop = false;
+    m_thread = std::thread(&LogDatabase::ThreadMaintain, this);
+    return true;
+}
+
+void LogDatabase::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_file) return;
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+    if (!Sync()) {
+        LogPrintf("%s: error syncing %s\n", __func__, m_path.string());
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fclose(m_file);
+    m_file = nullptr;
+    m_index.clear();
+    m_size = m_live = 0;
+}
+
+bool LogDatabase::Read(const CSerializeData& key, CSerializeData& value) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it == m_index.end()) return false;
+    value = it->second;
+    return true;
+}
+
+bool LogDatabase::Exists(const CSerializeData& key) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_index.count(key) != 0;
+}
+
+bool LogDatabase::Next(const CSerializeData& key, bool inclusive, CSerializeData& next_key, CSerializeData& value) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = inclusive ? m_index.lower_bound(key) : m_index.upper_bound(key);
+    if (it == m_index.end()) return false;
+    next_key = it->first;
+    value = it->second;
+    return true;
+}
+
+bool LogDatabase::Apply(const Changes& changes)
+{
+    if (changes.empty()) return true;
+    CSerializeData frame;
+    SerializeFrame(changes, frame);
+    if (frame.size() - FRAME_HEADER_SIZE > MAX_LOG_FRAME_SIZE) {
+        LogPrintf("%s: %u bytes of records are too many for one write\n", __func__, frame.size());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file) return false;
+    if (fwrite(frame.data(), 1, frame.size(), m_file) != frame.size() || fflush(m_file) != 0) {
+        // Do not leave part of the frame behind, later frames would be
+        // dropped along with it.
+        LogPrintf("%s: error writing to %s\n", __func__, m_path.string());
+        clearerr(m_file);
+        TruncateFile(m_file, m_size);
+        fseek(m_file, m_size, SEEK_SET);
+        return false;
+    }
+    m_size += frame.size();
+    m_written += frame.size();
+    ApplyIndex(changes);
+    if (NeedsCompaction()) m_cv.notify_all();
+    return true;
+}
+
+void LogDatabase::ApplyIndex(const Changes& changes)
+{
+    for (const auto& change : changes) {
+        auto it = m_index.find(change.first);
+        if (it != m_index.end()) {
+            m_live -= RecordSize(it->first, it->second);
+            if (change.second.erase) {
+                m_index.erase(it);
+                continue;
+            }
+            it->second = change.second.value;
+        } else if (change.second.erase) {
+            continue;
+        } else {
+            it = m_index.emplace(change.first, change.second.value).first;
+        }
+        m_live += RecordSize(it->first, it->second);
+    }
+}
+
+bool LogDatabase::NeedsCompaction() const
+{
+    return !m_compacting && m_size >= m_compact_size && m_size > 2 * (LOG_HEADER_SIZE + m_live);
+}
+
+bool LogDatabase::Sync()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const uint64_t target = m_written;
+    while (m_synced < target) {
+        if (!m_file) return false;
+        if (m_syncing) {
+            // Another thread is syncing; its fsync may cover our frames.
+            m_cv.wait(lock);
+            continue;
+        }
+        m_syncing = true;
+        const uint64_t written = m_written;
+        FILE* file = m_file;
+        lock.unlock();
+        const bool ok = FileCommit(file);
+        lock.lock();
+        m_syncing = false;
+        if (ok) m_synced = std::max(m_synced, written);
+        m_cv.notify_all();
+        if (!ok) return false;
+    }
+    return true;
+}
+
+bool LogDatabase::Compact()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return !m_compacting; });
+    if (!m_file) return false;
+    m_compacting = true;
+    // Write the records of a snapshot of the index without blocking
+    // writers, then copy the frames they appended in the meantime.
+    const Index snapshot = m_index;
+    const uint64_t snapshot_size = m_size;
+    lock.unlock();
+
+    const fs::path tmp_path = m_path.string() + ".compact";
+    FILE* file = fsbridge::fopen(tmp_path, "wb");
+    bool ok = file && WriteRecords(file, snapshot);
+
+    lock.lock();
+    if (ok && m_size > snapshot_size) {
+        std::vector<char> tail(m_size - snapshot_size);
+        ok = fseek(m_file, snapshot_size, SEEK_SET) == 0 &&
+             fread(tail.data(), 1, tail.size(), m_file) == tail.size() &&
+             fwrite(tail.data(), 1, tail.size(), file) == tail.size();
+        fseek(m_file, m_size, SEEK_SET);
+    }
+    ok = ok && FileCommit(file);
+    if (file) fclose(file);
+    if (ok) {
+        while (m_syncing) m_cv.wait(lock);
+        fclose(m_file);
+        ok = RenameOver(tmp_path, m_path);
+        m_file = fsbridge::fopen(m_path, "rb+");
+        if (!m_file) {
+            LogPrintf("%s: error reopening %s\n", __func__, m_path.string());
+            m_compacting = false;
+            m_cv.notify_all();
+            return false;
+        }
+        fseek(m_file, 0, SEEK_END);
+        const uint64_t old_size = m_size;
+        m_size = ftell(m_file);
+        if (ok) {
+            m_synced = m_written;
+            LogPrint(BCLog::DB, "%s: compacted %s from %u to %u bytes\n", __func__, m_path.string(), old_size, m_size);
+        }
+    }
+    if (!ok) {
+        LogPrintf("%s: error compacting %s\n", __func__, m_path.string());
+        fs::remove(tmp_path);
+    }
+    // Do not try again before the log grew by half again.
+    m_compact_size = std::max(LOG_COMPACT_MIN_SIZE, m_size + m_size / 2);
+    m_compacting = false;
+    m_cv.notify_all();
+    return ok;
+}
+
+bool LogDatabase::Backup(const fs::path& dest)
+{
+    if (!Sync()) return false;
+    fs::path path_dest(dest);
+    if (fs::is_directory(path_dest)) path_dest /= m_path.filename();
+
+    // Hold the lock so that neither writes nor compaction change the file
+    // while it is copied.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file) return false;
+    try {
+        if (fs::equivalent(m_path, path_dest)) {
+            LogPrintf("cannot backup to wallet source file %s\n", path_dest.string());
+            return false;
+        }
+
+        fs::copy_file(m_path, path_dest, fs::copy_option::overwrite_if_exists);
+        LogPrintf("copied %s to %s\n", m_path.filename().string(), path_dest.string());
+        return true;
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("error copying %s to %s - %s\n", m_path.filename().string(), path_dest.string(), fsbridge::get_filesystem_error_message(e));
+        return false;
+    }
+}
+
+bool LogDatabase::WriteFile(const fs::path& path, const Index& records)
+{
+    const fs::path tmp_path = path.string() + ".new";
+    FILE* file = fsbridge::fopen(tmp_path, "wb");
+    if (!file) return false;
+    bool ok = WriteRecords(file, records) && FileCommit(file);
+    fclose(file);
+    ok = ok && RenameOver(tmp_path, path);
+    if (!ok) fs::remove(tmp_path);
+    return ok;
+}
+
+void LogDatabase::ThreadMaintain()
+{
+    RenameThread("bst-walletlog");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+        m_cv.wait_for(lock, std::chrono::milliseconds(LOG_SYNC_INTERVAL_MS));
+        if (m_stop) break;
+        const bool compact = NeedsCompaction();
+        const bool sync = m_synced < m_written;
+        lock.unlock();
+        if (compact) {
+            Compact();
+        } else if (sync && !Sync()) {
+            LogPrintf("%s: error syncing %s\n", __func__, m_path.string());
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_LOGDB_H
+#define BITCOIN_WALLET_LOGDB_H
+
+#include <fs.h>
+#include <support/allocators/zeroafterfree.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+/** Size a log database file has to reach before it is compacted. */
+static const uint64_t LOG_COMPACT_MIN_SIZE = 1 << 20;
+/** Maximum time written records stay in the OS cache before they are synced to disk. */
+static const int64_t LOG_SYNC_INTERVAL_MS = 1000;
+/** Maximum size of a group of records written at once. */
+static const uint32_t MAX_LOG_FRAME_SIZE = 256 << 20;
+
+/** Orders keys as unsigned bytes, as BerkeleyDB does. */
+struct LogKeyCompare
+{
+    bool operator()(const CSerializeData& a, const CSerializeData& b) const;
+};
+
+/**
+ * A key/value database stored as an append-only log of records, with all
+ * records held in an in-memory index. Each write, and each database
+ * transaction, appends a frame of records protected by a checksum, so that
+ * a frame torn by a crash is dropped when the log is read back.
+ *
+ * Frames reach the OS when they are written. Sync() makes them durable, and
+ * concurrent callers share a single fsync. Frames that no one syncs are
+ * synced by a background thread within LOG_SYNC_INTERVAL_MS, which also
+ * compacts the log, writing the live records to a new file, once most of it
+ * is overwritten or erased records.
+ */
+class LogDatabase
+{
+public:
+    typedef std::map<CSerializeData, CSerializeData, LogKeyCompare> Index;
+
+    /** A write of a database transaction, or an erasure if erase is set */
+    struct Change
+    {
+        bool erase;
+        CSerializeData value;
+    };
+    typedef std::map<CSerializeData, Change, LogKeyCompare> Changes;
+
+    explicit LogDatabase(const fs::path& path);
+    ~LogDatabase();
+
+    LogDatabase(const LogDatabase&) = delete;
+    LogDatabase& operator=(const LogDatabase&) = delete;
+
+    const fs::path& GetPath() const { return m_path; }
+    bool IsOpen() const;
+
+    /** Read the log, or create it, and start the background thread. */
+    bool Open(std::string& error);
+    /** Sync the log and stop the background thread. */
+    void Close();
+
+    bool Read(const CSerializeData& key, CSerializeData& value) const;
+    bool Exists(const CSerializeData& key) const;
+    /** Find the first key after key, or at or after it if inclusive is set. */
+    bool Next(const CSerializeData& key, bool inclusive, CSerializeData& next_key, CSerializeData& value) const;
+    /** Append changes as one frame and apply them to the index. */
+    bool Apply(const Changes& changes);
+
+    /** Make the frames written so far durable. */
+    bool Sync();
+    /** Replace the log with a new file holding only its live records. */
+    bool Compact();
+    /** Copy the log to dest, a file or a directory. */
+    bool Backup(const fs::path& dest);
+
+    /** Write records as a new log at path. */
+    static bool WriteFile(const fs::path& path, const Index& records);
+
+private:
+    const fs::path m_path;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    FILE* m_file = nullptr;
+    Index m_index;
+    //! size of the file
+    uint64_t m_size = 0;
+    //! size the records of the index take in the file
+    uint64_t m_live = 0;
+    //! bytes ever written to the log, and those known to be synced
+    uint64_t m_written = 0;
+    uint64_t m_synced = 0;
+    bool m_syncing = false;
+    bool m_compacting = false;
+    //! size the file has to reach before compaction is tried again
+    uint64_t m_compact_size = LOG_COMPACT_MIN_SIZE;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    void ApplyIndex(const Changes& changes);
+    bool NeedsCompaction() const;
+    void ThreadMaintain();
+};
+
+#endif // BITCOIN_WALLET_LOGDB_H
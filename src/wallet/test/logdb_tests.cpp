@@ -0,0 +1,245 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/test_bitcoin.h>
+#include <wallet/db.h>
+#include <wallet/logdb.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(logdb_tests, BasicTestingSetup)
+
+template <typename T>
+static CSerializeData Serialized(const T& obj)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << obj;
+    return CSerializeData(ss.begin(), ss.end());
+}
+
+static void Put(LogDatabase::Changes& changes, const std::string& key, const std::string& value)
+{
+    LogDatabase::Change& change = changes[Serialized(key)];
+    change.erase = false;
+    change.value = Serialized(value);
+}
+
+static bool ReadString(const LogDatabase& log, const std::string& key, std::string& value)
+{
+    CSerializeData data;
+    if (!log.Read(Serialized(key), data)) return false;
+    CDataStream ss(data.begin(), data.end(), SER_DISK, CLIENT_VERSION);
+    ss >> value;
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(logdb_replay)
+{
+    fs::path path = SetDataDir("logdb_replay") / "test.log";
+    std::string error;
+    std::string value;
+    {
+        LogDatabase log(path);
+        BOOST_CHECK(log.Open(error));
+        LogDatabase::Changes changes;
+        Put(changes, "a", "1");
+        Put(changes, "b", "2");
+        Put(changes, "c", "3");
+        BOOST_CHECK(log.Apply(changes));
+        changes.clear();
+        Put(changes, "a", "4");
+        changes[Serialized(std::string("b"))].erase = true;
+        BOOST_CHECK(log.Apply(changes));
+        BOOST_CHECK(log.Sync());
+    }
+
+    LogDatabase log(path);
+    BOOST_CHECK(log.Open(error));
+    BOOST_CHECK(ReadString(log, "a", value) && value == "4");
+    BOOST_CHECK(!log.Exists(Serialized(std::string("b"))));
+    BOOST_CHECK(ReadString(log, "c", value) && value == "3");
+
+    // Keys are visited in order
+    CSerializeData key, data;
+    BOOST_CHECK(log.Next(CSerializeData(), true, key, data));
+    BOOST_CHECK(key == Serialized(std::string("a")));
+    BOOST_CHECK(log.Next(key, false, key, data));
+    BOOST_CHECK(key == Serialized(std::string("c")));
+    BOOST_CHECK(!log.Next(key, false, key, data));
+}
+
+BOOST_AUTO_TEST_CASE(logdb_torn_tail)
+{
+    fs::path path = SetDataDir("logdb_torn_tail") / "test.log";
+    std::string error;
+    std::string value;
+    uint64_t complete_size;
+    {
+        LogDatabase log(path);
+        BOOST_CHECK(log.Open(error));
+        LogDatabase::Changes changes;
+        Put(changes, "a", "1");
+        BOOST_CHECK(log.Apply(changes));
+        log.Close();
+        complete_size = fs::file_size(path);
+        BOOST_CHECK(log.Open(error));
+        changes.clear();
+        Put(changes, "b", std::string(100, 'x'));
+        BOOST_CHECK(log.Apply(changes));
+    }
+
+    // Lose the end of the second frame, as a crash while writing it would
+    fs::resize_file(path, fs::file_size(path) - 10);
+    {
+        LogDatabase log(path);
+        BOOST_CHECK(log.Open(error));
+        BOOST_CHECK_EQUAL(fs::file_size(path), complete_size);
+        BOOST_CHECK(ReadString(log, "a", value) && value == "1");
+        BOOST_CHECK(!log.Exists(Serialized(std::string("b"))));
+        LogDatabase::Changes changes;
+        Put(changes, "c", "3");
+        BOOST_CHECK(log.Apply(changes));
+    }
+
+    // A frame failing its checksum is dropped as well
+    {
+        FILE* file = fsbridge::fopen(path, "rb+");
+        BOOST_REQUIRE(file);
+        fseek(file, -1, SEEK_END);
+        fputc('?', file);
+        fclose(file);
+    }
+    LogDatabase log(path);
+    BOOST_CHECK(log.Open(error));
+    BOOST_CHECK(ReadString(log, "a", value) && value == "1");
+    BOOST_CHECK(!log.Exists(Serialized(std::string("c"))));
+
+    // Files that are not logs are refused
+    fs::path other = path.parent_path() / "other.log";
+    FILE* file = fsbridge::fopen(other, "wb");
+    BOOST_REQUIRE(file);
+    fputs("not a log database", file);
+    fclose(file);
+    LogDatabase other_log(other);
+    BOOST_CHECK(!other_log.Open(error));
+}
+
+BOOST_AUTO_TEST_CASE(logdb_compact)
+{
+    fs::path path = SetDataDir("logdb_compact") / "test.log";
+    std::string error;
+    std::string value;
+    LogDatabase log(path);
+    BOOST_CHECK(log.Open(error));
+    for (int i = 0; i < 1000; ++i) {
+        LogDatabase::Changes changes;
+        Put(changes, "key" + std::to_string(i % 10), std::string(100, 'a' + i % 26));
+        BOOST_CHECK(log.Apply(changes));
+    }
+    const uint64_t size = fs::file_size(path);
+    BOOST_CHECK(log.Compact());
+    BOOST_CHECK(fs::file_size(path) * 50 < size);
+
+    // Writes after compaction go to the new file
+    LogDatabase::Changes changes;
+    Put(changes, "new", "value");
+    BOOST_CHECK(log.Apply(changes));
+    log.Close();
+
+    BOOST_CHECK(log.Open(error));
+    BOOST_CHECK(ReadString(log, "key9", value) && value == std::string(100, 'a' + 999 % 26));
+    BOOST_CHECK(ReadString(log, "new", value) && value == "value");
+}
+
+BOOST_AUTO_TEST_CASE(logdb_batch)
+{
+    fs::path dir = SetDataDir("logdb_batch") / "wallet";
+    gArgs.ForceSetArg("-walletbackend", "log");
+    std::string value;
+    {
+        BerkeleyDatabase database(DbType::WALLET, dir);
+        BerkeleyBatch batch(database, "cr+");
+        int version;
+        BOOST_CHECK(batch.ReadVersion(version));
+        BOOST_CHECK(batch.Write(std::string("a"), std::string("1")));
+        BOOST_CHECK(!batch.Write(std::string("a"), std::string("2"), false /* fOverwrite */));
+        BOOST_CHECK(batch.Read(std::string("a"), value) && value == "1");
+
+        // Changes of a transaction are seen by it, and by others once committed
+        BOOST_CHECK(batch.TxnBegin());
+        BOOST_CHECK(batch.Write(std::string("b"), std::string("2")));
+        BOOST_CHECK(batch.Erase(std::string("a")));
+        BOOST_CHECK(batch.Exists(std::string("b")));
+        BOOST_CHECK(!batch.Exists(std::string("a")));
+        BOOST_CHECK(batch.TxnAbort());
+        BOOST_CHECK(!batch.Exists(std::string("b")));
+        BOOST_CHECK(batch.Exists(std::string("a")));
+
+        BOOST_CHECK(batch.TxnBegin());
+        BOOST_CHECK(batch.Write(std::string("pool1"), std::string("p")));
+        BOOST_CHECK(batch.Write(std::string("pool2"), std::string("p")));
+        BOOST_CHECK(batch.Write(std::string("c"), std::string("3")));
+        BOOST_CHECK(batch.TxnCommit());
+
+        std::unique_ptr<BerkeleyBatch::Cursor> cursor = batch.GetCursor();
+        BOOST_REQUIRE(cursor);
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        std::vector<std::string> keys;
+        while (batch.ReadAtCursor(*cursor, ssKey, ssValue) == 0) {
+            std::string key;
+            ssKey >> key;
+            keys.push_back(key);
+        }
+        BOOST_CHECK(keys == std::vector<std::string>({"a", "c", "pool1", "pool2", "version"}));
+    }
+
+    // Records whose key starts with the skipped prefix are dropped by a rewrite
+    {
+        BerkeleyDatabase database(DbType::WALLET, dir);
+        BOOST_CHECK(database.Rewrite("\x05pool"));
+        BerkeleyBatch batch(database);
+        BOOST_CHECK(!batch.Exists(std::string("pool1")));
+        BOOST_CHECK(!batch.Exists(std::string("pool2")));
+        BOOST_CHECK(batch.Read(std::string("c"), value) && value == "3");
+    }
+
+    // The messenger database has a log of its own
+    {
+        BerkeleyDatabase database(DbType::MSG_WALLET, dir);
+        BerkeleyBatch batch(database, "cr+");
+        BOOST_CHECK(!batch.Exists(std::string("c")));
+    }
+    BOOST_CHECK(fs::exists(dir / "walletlog.dat"));
+    BOOST_CHECK(fs::exists(dir / "msg_walletlog.dat"));
+
+    // An existing log is used whatever the backend option says
+    gArgs.ForceSetArg("-walletbackend", DEFAULT_WALLET_BACKEND);
+    BerkeleyDatabase database(DbType::WALLET, dir);
+    BerkeleyBatch batch(database);
+    BOOST_CHECK(batch.Read(std::string("c"), value) && value == "3");
+}
+
+BOOST_AUTO_TEST_CASE(logdb_migrate)
+{
+    fs::path path = SetDataDir("logdb_migrate") / "walletlog.dat";
+    std::unique_ptr<BerkeleyDatabase> database = BerkeleyDatabase::CreateMock(DbType::WALLET);
+    {
+        BerkeleyBatch batch(*database, "cr+");
+        BOOST_CHECK(batch.Write(std::string("a"), std::string("1")));
+        BOOST_CHECK(batch.Write(std::make_pair(std::string("key"), 5), std::string("2")));
+    }
+    BOOST_CHECK(BerkeleyBatch::MigrateToLog(*database, path));
+
+    LogDatabase log(path);
+    std::string error;
+    std::string value;
+    BOOST_CHECK(log.Open(error));
+    BOOST_CHECK(ReadString(log, "a", value) && value == "1");
+    CSerializeData data;
+    BOOST_CHECK(log.Read(Serialized(std::make_pair(std::string("key"), 5)), data));
+    BOOST_CHECK(log.Exists(Serialized(std::string("version"))));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
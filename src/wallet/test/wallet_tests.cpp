@@ -11,6 +11,7 @@
 #include <vector>
 
 #include <consensus/validation.h>
+#include <index/blockfilterindex.h>
 #include <rpc/server.h>
 #include <test/test_bitcoin.h>
 #include <validation.h>
@@ -109,6 +110,79 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+// Verify ScanForWalletTransactions only reads the blocks matching the wallet's
+// scripts in the block filter index, including scripts of keys added to the
+// key pool after the block was passed over.
+BOOST_FIXTURE_TEST_CASE(rescan_blockfilter, TestChain100Setup)
+{
+    BOOST_REQUIRE(InitBlockFilterIndex(BlockFilterType::EXTENDED, 1 << 20, true));
+    BlockFilterIndex& filter_index = *GetBlockFilterIndex(BlockFilterType::EXTENDED);
+    filter_index.Start();
+
+    // An HD wallet whose key pool holds the first two external keys.
+    CWallet wallet("mock", WalletDatabase::CreateMock(DbType::WALLET), WalletDatabase::CreateMock(DbType::MSG_WALLET));
+    CPubKey used_key, topped_up_key;
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.SetMinVersion(FEATURE_LATEST);
+        wallet.SetHDSeed(wallet.GenerateNewSeed());
+        BOOST_REQUIRE(wallet.TopUpKeyPool(2));
+
+        CKey seed;
+        BOOST_REQUIRE(wallet.GetKey(wallet.GetHDChain().seed_id, seed));
+        CExtKey masterKey, accountKey, chainKey, childKey;
+        masterKey.SetSeed(seed.begin(), seed.size());
+        masterKey.Derive(accountKey, 0x80000000);
+        accountKey.Derive(chainKey, 0x80000000);
+        chainKey.Derive(childKey, 0x80000001);
+        used_key = childKey.key.GetPubKey();
+        chainKey.Derive(childKey, 0x80000003);
+        topped_up_key = childKey.key.GetPubKey();
+        BOOST_REQUIRE(wallet.HaveKey(used_key.GetID()));
+        BOOST_REQUIRE(!wallet.HaveKey(topped_up_key.GetID()));
+    }
+
+    // Pay the second key in the pool, which tops the pool up, and in the next
+    // block a key the pool did not have yet.
+    const CScript other_script = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CBlockIndex* const start = chainActive.Tip();
+    std::vector<uint256> expected;
+    for (int i = 0; i < 10; ++i) {
+        const CScript script = i == 4 ? GetScriptForDestination(used_key.GetID()) : i == 5 ? GetScriptForDestination(topped_up_key.GetID()) : other_script;
+        const CBlock block = CreateAndProcessBlock({}, script);
+        if (script != other_script) {
+            expected.push_back(block.vtx[0]->GetHash());
+        }
+    }
+
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Only blocks the wallet has seen are passed over.
+    wallet.ChainStateFlushed(chainActive.GetLocator());
+
+    {
+        WalletRescanReserver reserver(&wallet);
+        reserver.reserve();
+        CBlockIndex* const nullBlock = nullptr;
+        BOOST_CHECK_EQUAL(nullBlock, wallet.ScanForWalletTransactions(start, nullptr, reserver));
+    }
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), expected.size());
+        for (const uint256& hash : expected) {
+            BOOST_CHECK(wallet.GetWalletTx(hash));
+        }
+    }
+
+    filter_index.Stop();
+    DestroyBlockFilterIndex(BlockFilterType::EXTENDED);
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
@@ -377,6 +451,288 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2U);
 }
 
+static std::set<COutPoint> GetAvailableOutPoints(CWallet& wallet)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+    std::vector<COutput> available;
+    wallet.AvailableCoins(available);
+    std::set<COutPoint> outpoints;
+    for (const COutput& coin : available) {
+        outpoints.emplace(coin.tx->GetHash(), coin.i);
+    }
+    return outpoints;
+}
+
+// The unspent outputs index kept up to date as transactions are added,
+// spent and abandoned gives the same coins as an index rebuilt from scratch.
+BOOST_FIXTURE_TEST_CASE(AvailableCoinsIndex, ListCoinsTestingSetup)
+{
+    const std::set<COutPoint> initial = GetAvailableOutPoints(*wallet);
+    BOOST_CHECK_EQUAL(initial.size(), 1U);
+
+    // A confirmed spend replaces the coinbase output with its change.
+    AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+    std::set<COutPoint> available = GetAvailableOutPoints(*wallet);
+    BOOST_CHECK_EQUAL(available.size(), 2U);
+    wallet->MarkDirty();
+    BOOST_CHECK(GetAvailableOutPoints(*wallet) == available);
+
+    // An unconfirmed spend of all coins leaves only its change.
+    CTransactionRef tx;
+    {
+        CReserveKey reservekey(wallet.get());
+        CAmount fee;
+        int changePos = -1;
+        std::string error;
+        CCoinControl dummy;
+        CRecipient recipient{GetScriptForRawPubKey({}), 60 * COIN, false /* subtract fee */};
+        BOOST_REQUIRE(wallet->CreateTransaction({recipient}, nullptr, tx, reservekey, fee, changePos, error, dummy));
+        CValidationState state;
+        BOOST_REQUIRE(wallet->CommitTransaction(tx, {}, {}, reservekey, nullptr, state));
+    }
+    std::set<COutPoint> spending = GetAvailableOutPoints(*wallet);
+    for (const COutPoint& outpoint : available) {
+        BOOST_CHECK(!spending.count(outpoint));
+    }
+    wallet->MarkDirty();
+    BOOST_CHECK(GetAvailableOutPoints(*wallet) == spending);
+
+    // Once the spend is dropped from the mempool and abandoned, the coins it
+    // spent are available again.
+    mempool.clear();
+    BOOST_CHECK(wallet->AbandonTransaction(tx->GetHash()));
+    BOOST_CHECK(GetAvailableOutPoints(*wallet) == available);
+    wallet->MarkDirty();
+    BOOST_CHECK(GetAvailableOutPoints(*wallet) == available);
+}
+
+// Return the wallet's balances from its running totals, after checking them
+// against the balances counted from scratch.
+static WalletBalance CheckBalances(CWallet& wallet)
+{
+    const WalletBalance balance = wallet.GetBalances();
+    wallet.MarkDirty();
+    const WalletBalance counted = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(balance.m_mine_trusted, counted.m_mine_trusted);
+    BOOST_CHECK_EQUAL(balance.m_mine_untrusted_pending, counted.m_mine_untrusted_pending);
+    BOOST_CHECK_EQUAL(balance.m_mine_immature, counted.m_mine_immature);
+    BOOST_CHECK_EQUAL(balance.m_watchonly_trusted, counted.m_watchonly_trusted);
+    BOOST_CHECK_EQUAL(balance.m_watchonly_untrusted_pending, counted.m_watchonly_untrusted_pending);
+    BOOST_CHECK_EQUAL(balance.m_watchonly_immature, counted.m_watchonly_immature);
+    return balance;
+}
+
+// The balances kept as running totals as transactions are committed, leave
+// the mempool, are abandoned and as blocks are connected are those counted
+// from every transaction.
+BOOST_FIXTURE_TEST_CASE(BalanceCache, ListCoinsTestingSetup)
+{
+    const WalletBalance initial = CheckBalances(*wallet);
+    BOOST_CHECK_EQUAL(initial.m_mine_trusted, wallet->GetBalance());
+    BOOST_CHECK(initial.m_mine_trusted > 0);
+
+    // An unconfirmed spend of our own, in the mempool, leaves its change
+    // trusted.
+    wallet->SetBroadcastTransactions(true);
+    CTransactionRef tx;
+    CAmount fee;
+    {
+        CReserveKey reservekey(wallet.get());
+        int changePos = -1;
+        std::string error;
+        CCoinControl dummy;
+        CKey key;
+        key.MakeNewKey(true);
+        CRecipient recipient{GetScriptForDestination(key.GetPubKey().GetID()), 1 * COIN, false /* subtract fee */};
+        BOOST_REQUIRE(wallet->CreateTransaction({recipient}, nullptr, tx, reservekey, fee, changePos, error, dummy));
+        CValidationState state;
+        BOOST_REQUIRE(wallet->CommitTransaction(tx, {}, {}, reservekey, nullptr, state));
+    }
+    BOOST_CHECK(mempool.exists(tx->GetHash()));
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), initial.m_mine_trusted - 1 * COIN - fee);
+    BOOST_CHECK_EQUAL(CheckBalances(*wallet).m_mine_trusted, initial.m_mine_trusted - 1 * COIN - fee);
+
+    // Out of the mempool, its change is no longer trusted, and the coin it
+    // spends stays spent until it is abandoned.
+    mempool.clear();
+    wallet->TransactionRemovedFromMempool(tx);
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), 0);
+    BOOST_CHECK_EQUAL(CheckBalances(*wallet).m_mine_trusted, 0);
+    BOOST_CHECK(wallet->AbandonTransaction(tx->GetHash()));
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), initial.m_mine_trusted);
+    BOOST_CHECK_EQUAL(CheckBalances(*wallet).m_mine_trusted, initial.m_mine_trusted);
+
+    // A new coinbase paying to the wallet is immature, while the new tip
+    // matures the oldest immature coinbase.
+    const CBlock block = CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    {
+        LOCK(cs_main);
+        wallet->BlockConnected(std::make_shared<const CBlock>(block), chainActive.Tip(), {}, {});
+    }
+    const CAmount matured = wallet->GetBalance() - initial.m_mine_trusted;
+    BOOST_CHECK(matured > 0);
+    BOOST_CHECK_EQUAL(wallet->GetImmatureBalance(), initial.m_mine_immature + block.vtx[0]->GetValueOut() - matured);
+    const WalletBalance connected = CheckBalances(*wallet);
+    BOOST_CHECK_EQUAL(connected.m_mine_trusted, initial.m_mine_trusted + matured);
+    BOOST_CHECK_EQUAL(connected.m_mine_immature, initial.m_mine_immature + block.vtx[0]->GetValueOut() - matured);
+}
+
+// Transactions funded with distinct coins and signed in parallel are the
+// ones signed one by one, and are all added to the wallet at once.
+BOOST_FIXTURE_TEST_CASE(SignAndCommitTransactions, ListCoinsTestingSetup)
+{
+    const CScript script = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    AddTx(CRecipient{script, 10 * COIN, false /* subtract fee */});
+    AddTx(CRecipient{script, 10 * COIN, false /* subtract fee */});
+
+    std::vector<CMutableTransaction> txs;
+    std::vector<std::vector<CTxOut>> spent_outputs;
+    std::vector<std::unique_ptr<CReserveKey>> reservekeys;
+    {
+        LOCK2(cs_main, wallet->cs_wallet);
+        for (int i = 0; i < 3; ++i) {
+            reservekeys.push_back(MakeUnique<CReserveKey>(wallet.get()));
+            CTransactionRef tx;
+            CAmount fee;
+            int changePos = -1;
+            std::string error;
+            CCoinControl dummy;
+            CRecipient recipient{GetScriptForRawPubKey({}), 5 * COIN, false /* subtract fee */};
+            BOOST_REQUIRE(wallet->CreateTransaction({recipient}, nullptr, tx, *reservekeys.back(), fee, changePos, error, dummy, false /* sign */));
+            std::vector<CTxOut> spent;
+            for (const CTxIn& txin : tx->vin) {
+                wallet->LockCoin(txin.prevout);
+                spent.push_back(wallet->GetWalletTx(txin.prevout.hash)->tx->vout[txin.prevout.n]);
+            }
+            txs.emplace_back(*tx);
+            spent_outputs.push_back(std::move(spent));
+        }
+    }
+
+    std::vector<CMutableTransaction> expected = txs;
+    const std::vector<bool> signed_txs = wallet->SignTransactions(txs, spent_outputs, 2);
+    BOOST_CHECK(signed_txs == std::vector<bool>(3, true));
+    {
+        LOCK(wallet->cs_wallet);
+        for (size_t i = 0; i < txs.size(); ++i) {
+            BOOST_REQUIRE(wallet->SignTransaction(expected[i]));
+            BOOST_CHECK_EQUAL(txs[i].GetHash(), expected[i].GetHash());
+            for (const CTxIn& txin : txs[i].vin) {
+                wallet->UnlockCoin(txin.prevout);
+            }
+        }
+    }
+
+    // A transaction whose spent outputs are not known is not signed.
+    std::vector<CMutableTransaction> unknown(1, expected[0]);
+    BOOST_CHECK(wallet->SignTransactions(unknown, {{}}, 2) == std::vector<bool>(1, false));
+
+    std::vector<CTransactionRef> commit_txs;
+    for (const CMutableTransaction& tx : txs) {
+        commit_txs.push_back(MakeTransactionRef(tx));
+    }
+    std::vector<CValidationState> states;
+    BOOST_CHECK(wallet->CommitTransactions(commit_txs, nullptr, states));
+    BOOST_CHECK_EQUAL(states.size(), 3U);
+    LOCK2(cs_main, wallet->cs_wallet);
+    for (const CTransactionRef& tx : commit_txs) {
+        BOOST_CHECK(wallet->GetWalletTx(tx->GetHash()));
+        for (const CTxIn& txin : tx->vin) {
+            BOOST_CHECK(wallet->IsSpent(txin.prevout.hash, txin.prevout.n));
+        }
+    }
+}
+
+// The inputs of large transactions are signed on several threads while the
+// caller holds cs_wallet.
+BOOST_FIXTURE_TEST_CASE(SignTransactionParallel, ListCoinsTestingSetup)
+{
+    const CScript script = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    const std::vector<CRecipient> recipients(2 * MIN_INPUTS_PER_SIGNING_THREAD, CRecipient{script, COIN, false /* subtract fee */});
+    CTransactionRef tx;
+    {
+        CReserveKey reservekey(wallet.get());
+        CAmount fee;
+        int changePos = -1;
+        std::string error;
+        CCoinControl dummy;
+        BOOST_REQUIRE(wallet->CreateTransaction(recipients, nullptr, tx, reservekey, fee, changePos, error, dummy));
+        CValidationState state;
+        BOOST_REQUIRE(wallet->CommitTransaction(tx, {}, {}, reservekey, nullptr, state));
+    }
+
+    CMutableTransaction spend;
+    for (uint32_t i = 0; i < tx->vout.size(); ++i) {
+        if (tx->vout[i].scriptPubKey == script) {
+            spend.vin.emplace_back(COutPoint(tx->GetHash(), i));
+        }
+    }
+    BOOST_REQUIRE_EQUAL(spend.vin.size(), recipients.size());
+    spend.vout.emplace_back(recipients.size() * COIN / 2, GetScriptForRawPubKey({}));
+
+    const int signing_threads = g_signing_threads;
+    g_signing_threads = 4;
+    {
+        LOCK(wallet->cs_wallet);
+        BOOST_CHECK(wallet->SignTransaction(spend));
+    }
+    g_signing_threads = signing_threads;
+
+    for (const CTxIn& txin : spend.vin) {
+        BOOST_CHECK(!txin.scriptSig.empty());
+    }
+}
+
+// A key pool top-up holds the keys a serial derivation gives, in order, and
+// skips the keys the wallet already has.
+BOOST_FIXTURE_TEST_CASE(TopUpKeyPoolHD, WalletTestingSetup)
+{
+    const unsigned int pool_size = DEFAULT_KEYPOOL_SIZE;
+    const uint32_t hardened = 0x80000000;
+    LOCK(m_wallet.cs_wallet);
+    m_wallet.SetMinVersion(FEATURE_LATEST);
+    m_wallet.SetHDSeed(m_wallet.GenerateNewSeed());
+
+    CKey seed;
+    BOOST_REQUIRE(m_wallet.GetKey(m_wallet.GetHDChain().seed_id, seed));
+    CExtKey masterKey, accountKey, externalKey, internalKey;
+    masterKey.SetSeed(seed.begin(), seed.size());
+    masterKey.Derive(accountKey, hardened);
+    accountKey.Derive(externalKey, hardened);
+    accountKey.Derive(internalKey, hardened + 1);
+
+    std::vector<CPubKey> external, internal;
+    for (uint32_t i = 0; i <= pool_size; ++i) {
+        CExtKey childKey;
+        externalKey.Derive(childKey, i | hardened);
+        external.push_back(childKey.key.GetPubKey());
+        internalKey.Derive(childKey, i | hardened);
+        internal.push_back(childKey.key.GetPubKey());
+        if (i == 5) {
+            BOOST_REQUIRE(m_wallet.AddKeyPubKey(childKey.key, internal.back()));
+        }
+    }
+    internal.erase(internal.begin() + 5);
+
+    // Replace the keys of the mock database, which other tests may have left.
+    BOOST_REQUIRE(m_wallet.NewKeyPool());
+    BOOST_CHECK_EQUAL(m_wallet.GetKeyPoolSize(), 2 * pool_size);
+    BOOST_CHECK_EQUAL(m_wallet.GetHDChain().nExternalChainCounter, pool_size);
+    BOOST_CHECK_EQUAL(m_wallet.GetHDChain().nInternalChainCounter, pool_size + 1);
+    for (unsigned int i = 0; i < pool_size; ++i) {
+        BOOST_CHECK(m_wallet.HaveKey(external[i].GetID()));
+        BOOST_CHECK_EQUAL(m_wallet.mapKeyMetadata[external[i].GetID()].hdKeypath, "m/0'/0'/" + std::to_string(i) + "'");
+        BOOST_CHECK(m_wallet.HaveKey(internal[i].GetID()));
+    }
+    BOOST_CHECK(!m_wallet.HaveKey(external[pool_size].GetID()));
+
+    CPubKey pubkey;
+    BOOST_REQUIRE(m_wallet.GetKeyFromPool(pubkey, false));
+    BOOST_CHECK(pubkey == external[0]);
+    BOOST_REQUIRE(m_wallet.GetKeyFromPool(pubkey, true));
+    BOOST_CHECK(pubkey == internal[0]);
+}
+
 BOOST_FIXTURE_TEST_CASE(wallet_disableprivkeys, TestChain100Setup)
 {
     std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>("dummy", WalletDatabase::CreateDummy(), WalletDatabase::CreateDummy());
@@ -11,6 +11,7 @@
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
 #include <fs.h>
+#include <index/blockfilterindex.h>
 #include <key.h>
 #include <key_io.h>
 #include <keystore.h>
@@ -35,7 +36,13 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <mutex>
+#include <thread>
+#include <tuple>
 #include <version.h>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -262,6 +269,86 @@ void CWallet::DeriveNewChildKey(WalletBatch &batch, CKeyMetadata& metadata, CKey
         throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
 }
 
+/**
+ * Keys written by each database transaction of a key pool top-up. Each key
+ * takes three records, which must stay within the lock table of the database
+ * environment (see BerkeleyEnvironment::Open).
+ */
+static const size_t KEYPOOL_TXN_SIZE = 10000;
+
+/** Keys generated by each thread of GenerateNewKeys, at least */
+static const int64_t MIN_KEYS_PER_GENERATION_THREAD = 64;
+
+void CWallet::GenerateNewKeys(int64_t count, bool internal, std::vector<NewKey>& keys)
+{
+    assert(!IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS));
+    AssertLockHeld(cs_wallet);
+    const bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY);
+    const int64_t nCreationTime = GetTime();
+    const bool hd = IsHDEnabled();
+    internal = internal && CanSupportFeature(FEATURE_HD_SPLIT);
+
+    // derive m/0'/0' (external chain) OR m/0'/1' (internal chain) once
+    CExtKey chainChildKey;
+    if (hd) {
+        CKey seed;
+        if (!GetKey(hdChain.seed_id, seed))
+            throw std::runtime_error(std::string(__func__) + ": seed not found");
+        CExtKey masterKey;
+        CExtKey accountKey;
+        masterKey.SetSeed(seed.begin(), seed.size());
+        masterKey.Derive(accountKey, BIP32_HARDENED_KEY_LIMIT);
+        accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
+    }
+    uint32_t& counter = internal ? hdChain.nInternalChainCounter : hdChain.nExternalChainCounter;
+    const std::string keypath = internal ? "m/0'/1'/" : "m/0'/0'/";
+
+    while (count > 0) {
+        std::vector<NewKey> generated(count);
+        const uint32_t first = counter;
+        std::atomic<int64_t> next{0};
+        auto generate = [&]() {
+            for (int64_t i = next++; i < count; i = next++) {
+                NewKey& key = generated[i];
+                key.metadata = CKeyMetadata(nCreationTime);
+                if (hd) {
+                    // derive the hardened child key at m/0'/<c>'/<n>', without
+                    // the fingerprint of its parent, which a key pool key does not keep
+                    ChainCode chaincode;
+                    chainChildKey.key.Derive(key.secret, chaincode, (first + i) | BIP32_HARDENED_KEY_LIMIT, chainChildKey.chaincode);
+                    key.metadata.hdKeypath = keypath + std::to_string(first + i) + "'";
+                    key.metadata.hd_seed_id = hdChain.seed_id;
+                } else {
+                    key.secret.MakeNewKey(fCompressed);
+                }
+                key.pubkey = key.secret.GetPubKey();
+                assert(key.secret.VerifyPubKey(key.pubkey));
+            }
+        };
+        const int threads = std::min<int64_t>(GetNumCores(), count / MIN_KEYS_PER_GENERATION_THREAD);
+        std::vector<std::thread> workers;
+        for (int i = 1; i < threads; ++i) {
+            workers.emplace_back(generate);
+        }
+        generate();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        // skip keys already known to the wallet, and derive as many more
+        if (hd) {
+            counter += count;
+        }
+        for (NewKey& key : generated) {
+            if (hd && HaveKey(key.pubkey.GetID())) {
+                continue;
+            }
+            keys.push_back(std::move(key));
+            --count;
+        }
+    }
+}
+
 bool CWallet::AddKeyPubKeyWithDB(WalletBatch &batch, const CKey& secret, const CPubKey &pubkey)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
@@ -1057,6 +1144,9 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        // Outputs may have become ours, so let the next use rebuild the index.
+        m_unspent_outputs_valid = false;
+        m_balance_valid = false;
     }
 }
 
@@ -1093,6 +1183,12 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 {
     LOCK(cs_wallet);
     WalletBatch batch(*database, "r+", fFlushOnClose);
+    return AddToWallet(wtxIn, batch);
+}
+
+bool CWallet::AddToWallet(const CWalletTx& wtxIn, WalletBatch& batch)
+{
+    AssertLockHeld(cs_wallet);
 
     uint256 hash = wtxIn.GetHash();
 
@@ -1107,6 +1203,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         wtx.nOrderPos = IncOrderPosNext(&batch);
         wtx.m_it_wtxOrdered = wtxOrdered.insert(std::make_pair(wtx.nOrderPos, &wtx));
         wtx.nTimeSmart = ComputeTimeSmart(wtx);
+        wtx.m_balance = WalletBalance();
         AddToSpends(hash);
     }
 
@@ -1157,6 +1254,20 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     // Break debit/credit balance caches:
     wtx.MarkDirty();
 
+    // Count the transaction again, with the transactions whose outputs it
+    // spends and, as their trust depends on it, those spending its outputs.
+    MarkBalanceDirty(hash);
+    if (!wtx.IsCoinBase()) {
+        for (const CTxIn& txin : wtx.tx->vin) {
+            MarkBalanceDirty(txin.prevout.hash);
+        }
+    }
+    for (auto it = mapTxSpends.lower_bound(COutPoint(hash, 0)); it != mapTxSpends.end() && it->first.hash == hash; ++it) {
+        MarkBalanceDirty(it->second);
+    }
+
+    UpdateUnspentOutputs(wtx);
+
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -1182,6 +1293,7 @@ void CWallet::LoadToWallet(const CWalletTx& wtxIn)
     if (/* insertion took place */ ins.second) {
         wtx.m_it_wtxOrdered = wtxOrdered.insert(std::make_pair(wtx.nOrderPos, &wtx));
     }
+    m_balance_valid = false;
     AddToSpends(hash);
     for (const CTxIn& txin : wtx.tx->vin) {
         auto it = mapWallet.find(txin.prevout.hash);
@@ -1417,8 +1529,94 @@ void CWallet::MarkInputsDirty(const CTransactionRef& tx)
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
             it->second.MarkDirty();
+            MarkBalanceDirty(txin.prevout.hash);
+            // The spend may no longer count, if the spending transaction was
+            // abandoned or conflicted.
+            if (m_unspent_outputs_valid && txin.prevout.n < it->second.tx->vout.size() &&
+                IsMine(it->second.tx->vout[txin.prevout.n]) != ISMINE_NO && !IsSpent(txin.prevout.hash, txin.prevout.n)) {
+                m_unspent_outputs.insert(txin.prevout);
+            }
+        }
+    }
+}
+
+void CWallet::UpdateUnspentOutputs(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    if (!m_unspent_outputs_valid) {
+        return;
+    }
+
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) != ISMINE_NO && !IsSpent(hash, i)) {
+            m_unspent_outputs.insert(COutPoint(hash, i));
+        }
+    }
+
+    if (wtx.IsCoinBase() || wtx.IsMsgTx()) {
+        return;
+    }
+    for (const CTxIn& txin : wtx.tx->vin) {
+        auto it = m_unspent_outputs.find(txin.prevout);
+        if (it != m_unspent_outputs.end() && IsSpent(txin.prevout.hash, txin.prevout.n)) {
+            m_unspent_outputs.erase(it);
+        }
+    }
+}
+
+void CWallet::EnsureUnspentOutputs() const
+{
+    AssertLockHeld(cs_wallet);
+    if (m_unspent_outputs_valid) {
+        return;
+    }
+
+    m_unspent_outputs.clear();
+    for (const auto& entry : mapWallet) {
+        const CWalletTx& wtx = entry.second;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+            if (IsMine(wtx.tx->vout[i]) != ISMINE_NO && !IsSpent(entry.first, i)) {
+                m_unspent_outputs.insert(COutPoint(entry.first, i));
+            }
         }
     }
+    m_unspent_outputs_valid = true;
+}
+
+void CWallet::MarkBalanceDirty(const uint256& hash) const
+{
+    AssertLockHeld(cs_wallet);
+    if (m_balance_valid) {
+        m_balance_dirty.insert(hash);
+    }
+}
+
+void CWallet::CountBalance(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    m_balance -= wtx.m_balance;
+    wtx.m_balance = WalletBalance();
+
+    const int depth = wtx.GetDepthInMainChain();
+    if (wtx.IsTrusted()) {
+        wtx.m_balance.m_mine_trusted = wtx.GetAvailableCredit(true, ISMINE_SPENDABLE);
+        wtx.m_balance.m_watchonly_trusted = wtx.GetAvailableCredit(true, ISMINE_WATCH_ONLY);
+    } else if (depth == 0 && wtx.InMempool()) {
+        wtx.m_balance.m_mine_untrusted_pending = wtx.GetAvailableCredit(true, ISMINE_SPENDABLE);
+        wtx.m_balance.m_watchonly_untrusted_pending = wtx.GetAvailableCredit(true, ISMINE_WATCH_ONLY);
+    }
+    wtx.m_balance.m_mine_immature = wtx.GetImmatureCredit();
+    wtx.m_balance.m_watchonly_immature = wtx.GetImmatureWatchOnlyCredit();
+    m_balance += wtx.m_balance;
+
+    if ((depth == 0 && wtx.InMempool()) || wtx.IsImmatureCoinBase()) {
+        m_balance_tip_dependent.insert(wtx.GetHash());
+    } else {
+        m_balance_tip_dependent.erase(wtx.GetHash());
+    }
 }
 
 bool CWallet::AbandonTransaction(const uint256& hashTx)
@@ -1457,6 +1655,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.setAbandoned();
             wtx.MarkDirty();
+            MarkBalanceDirty(now);
             batch.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
@@ -1514,6 +1713,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
+            MarkBalanceDirty(now);
             batch.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1559,6 +1759,7 @@ void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx) {
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
         it->second.fInMempool = true;
+        MarkBalanceDirty(it->first);
     }
 }
 
@@ -1571,6 +1772,7 @@ void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx) {
 
     if (it != mapWallet.end()) {
         it->second.fInMempool = false;
+        MarkBalanceDirty(hash);
     }
 
     if (ptx->IsMsgTx())
@@ -1650,10 +1852,10 @@ void CWallet::BlockUntilSyncedToCurrentChain() {
         }
     }
 
-    // ...otherwise put a callback in the validation interface queue and wait
-    // for the queue to drain enough to execute it (indicating we are caught up
-    // at least with the time we entered this function).
-    SyncWithValidationInterfaceQueue();
+    // ...otherwise put a callback in the validation interface queue of this
+    // wallet and wait for the queue to drain enough to execute it (indicating
+    // we are caught up at least with the time we entered this function).
+    SyncWithValidationInterfaceQueue(*this);
 }
 
 
@@ -2057,6 +2259,191 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
 
 }
 
+/** Blocks a wallet rescan requests ahead of the block it scans, at most */
+static const size_t RESCAN_PREFETCH_BLOCKS = 16;
+
+/** Add the output scripts a wallet matches for a public key to elements. */
+static void AddPubKeyFilterElements(GCSFilter::ElementSet& elements, const CPubKey& pubkey)
+{
+    for (const CScript& script : {GetScriptForRawPubKey(pubkey), GetScriptForDestination(pubkey.GetID())}) {
+        elements.emplace(script.begin(), script.end());
+    }
+    if (pubkey.IsCompressed()) {
+        const CScript witness = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+        const CScript p2sh = GetScriptForDestination(CScriptID(witness));
+        elements.emplace(witness.begin(), witness.end());
+        elements.emplace(p2sh.begin(), p2sh.end());
+    }
+}
+
+void CWallet::GetFilterElements(GCSFilter::ElementSet& elements) const
+{
+    LOCK(cs_KeyStore);
+    for (const CKeyID& keyid : GetKeys()) {
+        CPubKey pubkey;
+        if (GetPubKey(keyid, pubkey)) {
+            AddPubKeyFilterElements(elements, pubkey);
+        }
+    }
+    for (const auto& entry : mapWatchKeys) {
+        AddPubKeyFilterElements(elements, entry.second);
+    }
+    for (const auto& entry : mapScripts) {
+        const CScript& script = entry.second;
+        for (const CScript& spk : {script, GetScriptForDestination(CScriptID(script)), GetScriptForDestination(WitnessV0ScriptHash(script))}) {
+            elements.emplace(spk.begin(), spk.end());
+        }
+    }
+    for (const CScript& script : setWatchOnly) {
+        elements.emplace(script.begin(), script.end());
+    }
+}
+
+namespace {
+/**
+ * Reads the blocks a wallet rescan requests on a separate thread, in order.
+ * With a block filter index, only the blocks whose filter matches the
+ * wallet's scripts are read. It does not take cs_main, which the caller of
+ * the rescan may hold, so the positions of the blocks come with the requests.
+ */
+class RescanPrefetcher
+{
+public:
+    struct Block
+    {
+        CBlockIndex* pindex = nullptr;
+        //! the filter of the block, if the index has it
+        std::unique_ptr<BlockFilter> filter;
+        //! whether the block has to be scanned
+        bool matched = true;
+        //! the generation of the elements the filter was matched against
+        uint64_t generation = 0;
+        //! the block, if it has to be scanned and could be read
+        std::unique_ptr<CBlock> block;
+    };
+
+    RescanPrefetcher(const BlockFilterIndex* filter_index, GCSFilter::ElementSet elements)
+        : m_filter_index(filter_index), m_elements(std::move(elements))
+    {
+        m_thread = std::thread([this] { ThreadPrefetch(); });
+    }
+
+    ~RescanPrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_interrupt = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+    /**
+     * Request the next block of the rescan, stored at pos. Unless filter is
+     * set, the block is read whatever its filter.
+     */
+    void Request(CBlockIndex* pindex, const CDiskBlockPos& pos, bool filter)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_requests.emplace_back(pindex, pos, filter);
+            ++m_queued;
+        }
+        m_cv.notify_all();
+    }
+
+    /** Number of requested blocks not yet returned by Next. */
+    size_t Queued() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_queued;
+    }
+
+    /** Wait for the oldest requested block. Returns false if there is none. */
+    bool Next(Block& block)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_queued == 0) {
+            return false;
+        }
+        m_cv.wait(lock, [this] { return !m_results.empty(); });
+        block = std::move(m_results.front());
+        m_results.pop_front();
+        --m_queued;
+        return true;
+    }
+
+    /** Whether a block that was passed over matches the elements added since. */
+    bool Rematch(const Block& block)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (block.matched || block.generation == m_generation) {
+            return block.matched;
+        }
+        return block.filter->GetFilter().MatchAny(m_elements);
+    }
+
+    /** Match the given elements as well, from the next block on. */
+    void AddElements(const GCSFilter::ElementSet& elements)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_elements.insert(elements.begin(), elements.end());
+        ++m_generation;
+    }
+
+private:
+    void ThreadPrefetch()
+    {
+        const Consensus::Params& consensus = Params().GetConsensus();
+        while (true) {
+            Block block;
+            CDiskBlockPos pos;
+            bool filter_block;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this] { return m_interrupt || !m_requests.empty(); });
+                if (m_interrupt) {
+                    return;
+                }
+                std::tie(block.pindex, pos, filter_block) = m_requests.front();
+                m_requests.pop_front();
+            }
+            if (m_filter_index && filter_block) {
+                std::unique_ptr<BlockFilter> filter = MakeUnique<BlockFilter>();
+                if (m_filter_index->LookupFilter(block.pindex, *filter)) {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    block.matched = filter->GetFilter().MatchAny(m_elements);
+                    block.generation = m_generation;
+                    block.filter = std::move(filter);
+                }
+            }
+            if (block.matched) {
+                block.block = MakeUnique<CBlock>();
+                if (!ReadBlockFromDisk(*block.block, pos, consensus) || block.block->GetHash() != block.pindex->GetBlockHash()) {
+                    block.block.reset();
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_results.push_back(std::move(block));
+            }
+            m_cv.notify_all();
+        }
+    }
+
+    const BlockFilterIndex* const m_filter_index;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    GCSFilter::ElementSet m_elements;
+    uint64_t m_generation = 0;
+    std::deque<std::tuple<CBlockIndex*, CDiskBlockPos, bool>> m_requests;
+    std::deque<Block> m_results;
+    size_t m_queued = 0;
+    bool m_interrupt = false;
+    std::thread m_thread;
+};
+} // namespace
+
 /**
  * Scan active chain for relevant transactions after importing keys. This should
  * be called whenever new keys are added to the wallet, with the oldest key
@@ -2117,6 +2504,32 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
 
     if (pindex) WalletLogPrintf("Rescan started from block %d...\n", pindex->nHeight);
 
+    // Blocks whose filter matches none of the wallet's scripts are passed
+    // over. Encrypted messages to the wallet match no filter, so the blocks
+    // after the last one the wallet has recorded as seen are read in full.
+    const BlockFilterIndex* filter_index = GetBlockFilterIndex(BlockFilterType::EXTENDED);
+    GCSFilter::ElementSet elements;
+    int64_t pool_index;
+    int seen_height = -1;
+    if (filter_index) {
+        CBlockLocator locator;
+        if (WalletBatch(*database).ReadBestBlock(locator)) {
+            LOCK(cs_main);
+            const CBlockIndex* const seen = FindForkInGlobalIndex(chainActive, locator);
+            seen_height = seen ? seen->nHeight : -1;
+        }
+    }
+    {
+        LOCK(cs_wallet);
+        if (filter_index) {
+            GetFilterElements(elements);
+        }
+        pool_index = m_max_keypool_index;
+    }
+    if (filter_index) {
+        WalletLogPrintf("Rescan reads only the blocks matching %u scripts in the %s block filter index\n", elements.size(), BlockFilterTypeName(filter_index->GetFilterType()));
+    }
+
     {
         fAbortRescan = false;
         ShowProgress(strprintf("%s " + _("Rescanning..."), GetDisplayName()), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
@@ -2134,8 +2547,35 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             }
         }
         double progress_current = progress_begin;
+        RescanPrefetcher prefetcher(filter_index, std::move(elements));
+        CBlockIndex* last_requested = nullptr;
+        size_t blocks_read = 0;
         while (pindex && !fAbortRescan && !ShutdownRequested())
         {
+            {
+                LOCK(cs_main);
+                // keep the prefetcher ahead of the scan, along the active chain
+                while (prefetcher.Queued() < RESCAN_PREFETCH_BLOCKS) {
+                    CBlockIndex* next = last_requested == nullptr ? pindexStart : last_requested == pindexStop ? nullptr : chainActive.Next(last_requested);
+                    if (next == nullptr) {
+                        break;
+                    }
+                    prefetcher.Request(next, next->GetBlockPos(), next->nHeight <= seen_height);
+                    last_requested = next;
+                }
+                if (pindexStop == nullptr && tip != chainActive.Tip()) {
+                    tip = chainActive.Tip();
+                    // in case the tip has changed, update progress max
+                    progress_end = GuessVerificationProgress(chainParams.TxData(), tip);
+                }
+            }
+            RescanPrefetcher::Block entry;
+            if (!prefetcher.Next(entry)) {
+                pindex = nullptr;
+                break;
+            }
+            pindex = entry.pindex;
+
             if (pindex->nHeight % 100 == 0 && progress_end - progress_begin > 0.0) {
                 ShowProgress(strprintf("%s " + _("Rescanning..."), GetDisplayName()), std::max(1, std::min(99, (int)((progress_current - progress_begin) / (progress_end - progress_begin) * 100))));
             }
@@ -2144,33 +2584,45 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                 WalletLogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, progress_current);
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            // a block passed over before keys were added to the wallet may match them
+            if (!entry.matched && prefetcher.Rematch(entry)) {
+                entry.matched = true;
+                entry.block = MakeUnique<CBlock>();
+                if (!ReadBlockFromDisk(*entry.block, pindex, chainParams.GetConsensus())) {
+                    entry.block.reset();
+                }
+            }
+
+            if (entry.matched && entry.block) {
+                ++blocks_read;
                 LOCK2(cs_main, cs_wallet);
-                if (pindex && !chainActive.Contains(pindex)) {
+                if (!chainActive.Contains(pindex)) {
                     // Abort scan if current block is no longer active, to prevent
                     // marking transactions as coming from the wrong block.
                     ret = pindex;
                     break;
                 }
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    SyncTransaction(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+                for (size_t posInBlock = 0; posInBlock < entry.block->vtx.size(); ++posInBlock) {
+                    SyncTransaction(entry.block->vtx[posInBlock], pindex, posInBlock, fUpdate);
                 }
-            } else {
+                // match the keys the key pool was topped up with from now on
+                if (filter_index && m_max_keypool_index != pool_index) {
+                    GCSFilter::ElementSet added;
+                    for (const auto& pool_key : m_pool_key_to_index) {
+                        CPubKey pubkey;
+                        if (pool_key.second > pool_index && GetPubKey(pool_key.first, pubkey)) {
+                            AddPubKeyFilterElements(added, pubkey);
+                        }
+                    }
+                    prefetcher.AddElements(added);
+                    pool_index = m_max_keypool_index;
+                }
+            } else if (entry.matched) {
                 ret = pindex;
             }
-            if (pindex == pindexStop) {
-                break;
-            }
             {
                 LOCK(cs_main);
-                pindex = chainActive.Next(pindex);
                 progress_current = GuessVerificationProgress(chainParams.TxData(), pindex);
-                if (pindexStop == nullptr && tip != chainActive.Tip()) {
-                    tip = chainActive.Tip();
-                    // in case the tip has changed, update progress max
-                    progress_end = GuessVerificationProgress(chainParams.TxData(), tip);
-                }
             }
         }
         if (pindex && fAbortRescan) {
@@ -2178,6 +2630,9 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
         } else if (pindex && ShutdownRequested()) {
             WalletLogPrintf("Rescan interrupted by shutdown request at block %d. Progress=%f\n", pindex->nHeight, progress_current);
         }
+        if (filter_index) {
+            WalletLogPrintf("Rescan read %u blocks\n", blocks_read);
+        }
         ShowProgress(strprintf("%s " + _("Rescanning..."), GetDisplayName()), 100); // hide progress dialog in GUI
     }
     return ret;
@@ -2210,7 +2665,9 @@ void CWallet::ReacceptWalletTransactions()
         CWalletTx& wtx = *(item.second);
 
         CValidationState state;
-        wtx.AcceptToMemoryPool(maxTxFee, state);
+        if (wtx.AcceptToMemoryPool(maxTxFee, state)) {
+            MarkBalanceDirty(wtx.GetHash());
+        }
 
         const uint256 hash = wtx.GetHash();
         if (wtx.IsMsgTx() && TransactionCanBeAbandoned(hash)) {
@@ -2257,6 +2714,28 @@ std::set<uint256> CWalletTx::GetConflicts() const
     return result;
 }
 
+WalletBalance& WalletBalance::operator+=(const WalletBalance& other)
+{
+    m_mine_trusted += other.m_mine_trusted;
+    m_mine_untrusted_pending += other.m_mine_untrusted_pending;
+    m_mine_immature += other.m_mine_immature;
+    m_watchonly_trusted += other.m_watchonly_trusted;
+    m_watchonly_untrusted_pending += other.m_watchonly_untrusted_pending;
+    m_watchonly_immature += other.m_watchonly_immature;
+    return *this;
+}
+
+WalletBalance& WalletBalance::operator-=(const WalletBalance& other)
+{
+    m_mine_trusted -= other.m_mine_trusted;
+    m_mine_untrusted_pending -= other.m_mine_untrusted_pending;
+    m_mine_immature -= other.m_mine_immature;
+    m_watchonly_trusted -= other.m_watchonly_trusted;
+    m_watchonly_untrusted_pending -= other.m_watchonly_untrusted_pending;
+    m_watchonly_immature -= other.m_watchonly_immature;
+    return *this;
+}
+
 CAmount CWalletTx::GetDebit(const isminefilter& filter, bool fExcludeNames) const
 {
     if (tx->vin.empty())
@@ -2503,8 +2982,53 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
+WalletBalance CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+
+    const CBlockIndex* tip = chainActive.Tip();
+    if (m_balance_valid && tip != m_balance_tip) {
+        if (!tip || !m_balance_tip || tip->GetAncestor(m_balance_tip->nHeight) != m_balance_tip) {
+            // Confirmed and conflicted transactions changed depth.
+            m_balance_valid = false;
+        } else {
+            m_balance_dirty.insert(m_balance_tip_dependent.begin(), m_balance_tip_dependent.end());
+        }
+    }
+    m_balance_tip = tip;
+
+    if (!m_balance_valid) {
+        m_balance = WalletBalance();
+        m_balance_dirty.clear();
+        m_balance_tip_dependent.clear();
+        for (const auto& entry : mapWallet) {
+            entry.second.m_balance = WalletBalance();
+            CountBalance(entry.second);
+        }
+        m_balance_valid = true;
+        return m_balance;
+    }
+
+    for (const uint256& hash : m_balance_dirty) {
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            CountBalance(it->second);
+        }
+    }
+    m_balance_dirty.clear();
+    return m_balance;
+}
+
 CAmount CWallet::GetBalance(const isminefilter& filter, const int min_depth) const
 {
+    // Trusted transactions are at depth 0 or more, so the running totals
+    // answer any lower min_depth.
+    if (min_depth <= 0 && (filter & ~ISMINE_ALL) == 0) {
+        const WalletBalance balance = GetBalances();
+        return ((filter & ISMINE_SPENDABLE) ? balance.m_mine_trusted : 0) +
+               ((filter & ISMINE_WATCH_ONLY) ? balance.m_watchonly_trusted : 0);
+    }
+
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
@@ -2522,60 +3046,22 @@ CAmount CWallet::GetBalance(const isminefilter& filter, const int min_depth) con
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().m_mine_untrusted_pending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().m_mine_immature;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit(true, ISMINE_WATCH_ONLY);
-        }
-    }
-    return nTotal;
+    return GetBalances().m_watchonly_untrusted_pending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().m_watchonly_immature;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2643,10 +3129,21 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
     vCoins.clear();
     CAmount nTotal = 0;
 
-    for (const auto& entry : mapWallet)
+    EnsureUnspentOutputs();
+    auto next = m_unspent_outputs.begin();
+    while (next != m_unspent_outputs.end())
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx* pcoin = &entry.second;
+        // Visit the candidate outputs of one transaction at a time.
+        const auto first = next;
+        const uint256& wtxid = first->hash;
+        while (next != m_unspent_outputs.end() && next->hash == wtxid) {
+            ++next;
+        }
+
+        auto entry = mapWallet.find(wtxid);
+        if (entry == mapWallet.end())
+            continue;
+        const CWalletTx* pcoin = &entry->second;
 
         if (!CheckFinalTx(*pcoin->tx))
             continue;
@@ -2703,14 +3200,15 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
         if (nDepth < nMinDepth || nDepth > nMaxDepth)
             continue;
 
-        for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
+        for (auto output = first; output != next; ++output) {
+            const unsigned int i = output->n;
             if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
                 continue;
 
-            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
                 continue;
 
-            if (IsLockedCoin(entry.first, i))
+            if (IsLockedCoin(wtxid, i))
                 continue;
 
             if (IsSpent(wtxid, i))
@@ -2947,20 +3445,21 @@ bool CWallet::SignTransaction(CMutableTransaction &tx)
     AssertLockHeld(cs_wallet); // mapWallet
 
     // sign the new tx
-    int nIn = 0;
-    for (auto& input : tx.vin) {
+    std::vector<CTxOut> spent_outputs;
+    for (const auto& input : tx.vin) {
         std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(input.prevout.hash);
         if(mi == mapWallet.end() || input.prevout.n >= mi->second.tx->vout.size()) {
             return false;
         }
-        const CScript& scriptPubKey = mi->second.tx->vout[input.prevout.n].scriptPubKey;
-        const CAmount& amount = mi->second.tx->vout[input.prevout.n].nValue;
-        SignatureData sigdata;
-        if (!ProduceSignature(*this, MutableTransactionSignatureCreator(&tx, nIn, amount, SIGHASH_ALL), scriptPubKey, sigdata)) {
+        spent_outputs.push_back(mi->second.tx->vout[input.prevout.n]);
+    }
+    std::vector<SignatureData> sigdata(tx.vin.size());
+    ProduceSignatures(*this, tx, spent_outputs, SIGHASH_ALL, sigdata, g_signing_threads);
+    for (size_t nIn = 0; nIn < tx.vin.size(); ++nIn) {
+        if (!sigdata[nIn].complete) {
             return false;
         }
-        UpdateInput(input, sigdata);
-        nIn++;
+        UpdateInput(tx.vin[nIn], sigdata[nIn]);
     }
     return true;
 }
@@ -3444,21 +3943,21 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend,
 
         if (sign)
         {
-            int nIn = 0;
-            for (const auto& coin : selected_coins)
-            {
-                const CScript& scriptPubKey = coin.txout.scriptPubKey;
-                SignatureData sigdata;
+            std::vector<CTxOut> spent_outputs;
+            for (const auto& coin : selected_coins) {
+                spent_outputs.push_back(coin.txout);
+            }
+            std::vector<SignatureData> sigdata(txNew.vin.size());
+            ProduceSignatures(*this, txNew, spent_outputs, SIGHASH_ALL, sigdata, g_signing_threads);
 
-                if (!ProduceSignature(*this, MutableTransactionSignatureCreator(&txNew, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
+            for (size_t nIn = 0; nIn < txNew.vin.size(); ++nIn)
+            {
+                if (!sigdata[nIn].complete)
                 {
                     strFailReason = _("Signing transaction failed");
                     return false;
-                } else {
-                    UpdateInput(txNew.vin.at(nIn), sigdata);
                 }
-
-                nIn++;
+                UpdateInput(txNew.vin.at(nIn), sigdata[nIn]);
             }
         }
 
@@ -3546,6 +4045,88 @@ bool CWallet::CommitTransaction(CTransactionRef tx, mapValue_t mapValue, std::ve
                 WalletLogPrintf("CommitTransaction(): Transaction cannot be broadcast immediately, %s\n", FormatStateMessage(state));
                 // TODO: if we expect the failure to be long term or permanent, instead delete wtx from the wallet and return failure.
             } else {
+                MarkBalanceDirty(wtx.GetHash());
+                wtx.RelayWalletTransaction(connman);
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<bool> CWallet::SignTransactions(std::vector<CMutableTransaction>& txs, const std::vector<std::vector<CTxOut>>& spent_outputs, int threads) const
+{
+    assert(spent_outputs.size() == txs.size());
+    std::vector<char> signed_txs(txs.size(), 0);
+    std::atomic<size_t> next{0};
+
+    auto sign = [&]() {
+        for (size_t i = next++; i < txs.size(); i = next++) {
+            CMutableTransaction& tx = txs[i];
+            if (spent_outputs[i].size() != tx.vin.size()) continue;
+            std::vector<SignatureData> sigdata(tx.vin.size());
+            ProduceSignatures(*this, tx, spent_outputs[i], SIGHASH_ALL, sigdata, 1);
+            bool complete = true;
+            for (size_t nIn = 0; nIn < tx.vin.size(); ++nIn) {
+                complete = complete && sigdata[nIn].complete;
+            }
+            if (!complete) continue;
+            for (size_t nIn = 0; nIn < tx.vin.size(); ++nIn) {
+                UpdateInput(tx.vin[nIn], sigdata[nIn]);
+            }
+            signed_txs[i] = true;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads && static_cast<size_t>(i) < txs.size(); ++i) {
+        workers.emplace_back(sign);
+    }
+    sign();
+    for (std::thread& worker : workers) worker.join();
+
+    return std::vector<bool>(signed_txs.begin(), signed_txs.end());
+}
+
+bool CWallet::CommitTransactions(const std::vector<CTransactionRef>& txs, CConnman* connman, std::vector<CValidationState>& states)
+{
+    LOCK2(cs_main, cs_wallet);
+    states.assign(txs.size(), CValidationState());
+
+    {
+        WalletBatch batch(*database, "r+");
+        const bool txn = batch.TxnBegin();
+        if (!txn) {
+            WalletLogPrintf("CommitTransactions(): Could not begin a database transaction, writing transactions one by one\n");
+        }
+        for (const CTransactionRef& tx : txs) {
+            CWalletTx wtxNew(this, tx);
+            wtxNew.fTimeReceivedIsTxTime = true;
+            wtxNew.fFromMe = true;
+
+            WalletLogPrintf("CommitTransactions:\n%s", wtxNew.tx->ToString()); /* Continued */
+            AddToWallet(wtxNew, batch);
+
+            if (!wtxNew.IsMsgTx()) {
+                for (const CTxIn& txin : wtxNew.tx->vin) {
+                    CWalletTx &coin = mapWallet.at(txin.prevout.hash);
+                    coin.BindWallet(this);
+                    NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
+                }
+            }
+        }
+        if (txn && !batch.TxnCommit()) {
+            WalletLogPrintf("CommitTransactions(): Could not commit the database transaction\n");
+            return false;
+        }
+    }
+
+    if (fBroadcastTransactions) {
+        for (size_t i = 0; i < txs.size(); ++i) {
+            CWalletTx& wtx = mapWallet.at(txs[i]->GetHash());
+            if (!wtx.AcceptToMemoryPool(maxTxFee, states[i])) {
+                WalletLogPrintf("CommitTransactions(): Transaction %s cannot be broadcast immediately, %s\n", wtx.GetHash().ToString(), FormatStateMessage(states[i]));
+            } else {
+                MarkBalanceDirty(wtx.GetHash());
                 wtx.RelayWalletTransaction(connman);
             }
         }
@@ -3864,19 +4445,46 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
-        WalletBatch batch(*database);
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            if (i < missingInternal) {
-                internal = true;
+        if (missingInternal + missingExternal == 0) {
+            return true;
+        }
+
+        // Generate the keys first, then write them with their metadata and
+        // pool entries in as few database transactions as the environment
+        // allows.
+        std::vector<NewKey> keys;
+        keys.reserve(missingInternal + missingExternal);
+        GenerateNewKeys(missingExternal, false, keys);
+        GenerateNewKeys(missingInternal, true, keys);
+
+        // These write through their own batch, which would wait for the
+        // transaction below.
+        if (CanSupportFeature(FEATURE_COMPRPUBKEY)) {
+            SetMinVersion(FEATURE_COMPRPUBKEY);
+        }
+        for (const NewKey& key : keys) {
+            for (const CScript& script : {GetScriptForDestination(key.pubkey.GetID()), GetScriptForRawPubKey(key.pubkey)}) {
+                if (HaveWatchOnly(script)) {
+                    RemoveWatchOnly(script);
+                }
             }
+        }
+
+        WalletBatch batch(*database);
+        bool txn = batch.TxnBegin();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            const NewKey& key = keys[i];
+            const bool internal = i >= static_cast<size_t>(missingExternal);
 
             assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
             int64_t index = ++m_max_keypool_index;
 
-            CPubKey pubkey(GenerateNewKey(batch, internal));
-            if (!batch.WritePool(index, CKeyPool(pubkey, internal))) {
+            mapKeyMetadata[key.pubkey.GetID()] = key.metadata;
+            UpdateTimeFirstKey(key.metadata.nCreateTime);
+            if (!AddKeyPubKeyWithDB(batch, key.secret, key.pubkey)) {
+                throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+            }
+            if (!batch.WritePool(index, CKeyPool(key.pubkey, internal))) {
                 throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
             }
 
@@ -3885,11 +4493,23 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             } else {
                 setExternalKeyPool.insert(index);
             }
-            m_pool_key_to_index[pubkey.GetID()] = index;
+            m_pool_key_to_index[key.pubkey.GetID()] = index;
+
+            if (txn && (i + 1) % KEYPOOL_TXN_SIZE == 0) {
+                if (!batch.TxnCommit()) {
+                    throw std::runtime_error(std::string(__func__) + ": writing generated keys failed");
+                }
+                txn = batch.TxnBegin();
+            }
+        }
+        // update the chain model in the database
+        if (IsHDEnabled() && !batch.WriteHDChain(hdChain)) {
+            throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
         }
-        if (missingInternal + missingExternal > 0) {
-            WalletLogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size() + set_pre_split_keypool.size(), setInternalKeyPool.size());
+        if (txn && !batch.TxnCommit()) {
+            throw std::runtime_error(std::string(__func__) + ": writing generated keys failed");
         }
+        WalletLogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size() + set_pre_split_keypool.size(), setInternalKeyPool.size());
     }
     return true;
 }
@@ -4844,7 +5464,7 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(const std::string& name,
     uiInterface.LoadWallet(walletInstance);
 
     // Register with the validation interface. It's ok to do this after rescan since we're still holding cs_main.
-    RegisterValidationInterface(walletInstance.get());
+    RegisterValidationInterface(walletInstance.get(), "wallet " + walletInstance->GetDisplayName());
 
     walletInstance->SetBroadcastTransactions(gArgs.GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
 
@@ -7,6 +7,7 @@
 #define BITCOIN_WALLET_WALLET_H
 
 #include <amount.h>
+#include <blockfilter.h>
 #include <outputtype.h>
 #include <policy/feerate.h>
 #include <streams.h>
@@ -290,6 +291,20 @@ public:
     bool IsImmatureCoinBase() const EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
+/** Balances of a wallet, or the amounts a wallet transaction adds to them */
+struct WalletBalance
+{
+    CAmount m_mine_trusted = 0;                 //!< Trusted, at depth 0 or more
+    CAmount m_mine_untrusted_pending = 0;       //!< Untrusted, but in the mempool (pending)
+    CAmount m_mine_immature = 0;                //!< Immature coinbases in the main chain
+    CAmount m_watchonly_trusted = 0;
+    CAmount m_watchonly_untrusted_pending = 0;
+    CAmount m_watchonly_immature = 0;
+
+    WalletBalance& operator+=(const WalletBalance& other);
+    WalletBalance& operator-=(const WalletBalance& other);
+};
+
 //Get the marginal bytes of spending the specified output
 int CalculateMaximumSignedInputSize(const CTxOut& txout, const CWallet* pwallet, bool use_max_sig = false);
 
@@ -373,6 +388,8 @@ public:
     mutable CAmount nImmatureWatchCreditCached;
     mutable CAmount nAvailableWatchCreditCached;
     mutable CAmount nChangeCached;
+    //! What this transaction currently adds to the wallet's cached balances
+    mutable WalletBalance m_balance;
 
     CWalletTx(const CWallet* pwalletIn, CTransactionRef arg) : CMerkleTx(std::move(arg))
     {
@@ -409,6 +426,7 @@ public:
         nAvailableWatchCreditCached = 0;
         nImmatureWatchCreditCached = 0;
         nChangeCached = 0;
+        m_balance = WalletBalance();
         nOrderPos = -1;
     }
 
@@ -709,6 +727,46 @@ private:
     /* Mark a transaction's inputs dirty, thus forcing the outputs to be recomputed */
     void MarkInputsDirty(const CTransactionRef& tx);
 
+    /**
+     * Outputs of wallet transactions that are ours and may be unspent, so
+     * that AvailableCoins only visits the candidate coins instead of every
+     * transaction in mapWallet. This is a superset of the available coins:
+     * outputs are added with their transaction or when a transaction
+     * spending them is abandoned or conflicted, and removed once spent. It
+     * is rebuilt from mapWallet on first use and after MarkDirty(), which
+     * key and script imports call.
+     */
+    mutable std::set<COutPoint> m_unspent_outputs;
+    mutable bool m_unspent_outputs_valid = false;
+
+    /* Add the unspent outputs of a transaction that are ours to m_unspent_outputs, and remove those it spends */
+    void UpdateUnspentOutputs(const CWalletTx& wtx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /* Rebuild m_unspent_outputs from mapWallet if it is not valid */
+    void EnsureUnspentOutputs() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /**
+     * Running totals of the balances (at min_depth 0) of the transactions in
+     * mapWallet, each of which holds what it adds to them in m_balance. The
+     * transactions whose balance may have changed are put in m_balance_dirty
+     * and only those are counted again. The balances of the transactions in
+     * m_balance_tip_dependent, those in the mempool and the immature
+     * coinbases, also change with the tip; the transactions in the mempool
+     * may become final, the coinbases mature. A reorganization, or
+     * MarkDirty(), counts every transaction again.
+     */
+    mutable WalletBalance m_balance;
+    mutable bool m_balance_valid = false;
+    mutable const CBlockIndex* m_balance_tip = nullptr;
+    mutable std::set<uint256> m_balance_dirty;
+    mutable std::set<uint256> m_balance_tip_dependent;
+
+    /* Count the balance of a transaction again */
+    void MarkBalanceDirty(const uint256& hash) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /* Replace what a transaction adds to m_balance with its current balance */
+    void CountBalance(const CWalletTx& wtx) const EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
     /* Used by TransactionAddedToMemorypool/BlockConnected/Disconnected/ScanForWalletTransactions.
@@ -724,6 +782,22 @@ private:
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(WalletBatch &batch, CKeyMetadata& metadata, CKey& secret, bool internal = false) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
+    /* a key generated for the key pool, see GenerateNewKeys */
+    struct NewKey
+    {
+        CKey secret;
+        CPubKey pubkey;
+        CKeyMetadata metadata;
+    };
+
+    /**
+     * Generate count new keys on several threads and append them to keys.
+     * HD keys are derived at the next indexes of the chain, skipping keys
+     * already known to the wallet. The chain counters are only advanced in
+     * memory, nothing is written to the database.
+     */
+    void GenerateNewKeys(int64_t count, bool internal, std::vector<NewKey>& keys) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     std::set<int64_t> setInternalKeyPool;
     std::set<int64_t> setExternalKeyPool;
     std::set<int64_t> set_pre_split_keypool;
@@ -977,6 +1051,7 @@ public:
     void AddEncrMsgToWalletIfNeeded(const CTransactionRef &ptx, const CBlockIndex *pIndex, int posInBlock);
     void AddEncrMsgToWallet(const std::string& from, const std::string& subject, CWalletTx& wtxIn, const CBlockIndex *pIndex, int posInBlock);
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
+    bool AddToWallet(const CWalletTx& wtxIn, WalletBatch& batch) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void LoadToWallet(const CWalletTx& wtxIn);
     void LoadEncrMsgToWallet(const std::string& from, const std::string& subject, const CWalletTx& wtxIn);
     void LoadMsgToHistory(const uint256& hash, const std::string& addr, const std::string& subject, const std::vector<unsigned char>& data, int64_t time);
@@ -986,11 +1061,18 @@ public:
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindexDelete, const std::vector<CTransactionRef>& vNameConflicts) override;
     int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver& reserver, bool fUpdate = false);
+    /**
+     * Add the output scripts of the wallet's keys, scripts and watch-only
+     * scripts to elements, to be matched against block filters.
+     */
+    void GetFilterElements(GCSFilter::ElementSet& elements) const;
     void TransactionRemovedFromMempool(const CTransactionRef &ptx) override;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     // ResendWalletTransactionsBefore may only be called if fBroadcastTransactions!
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /** Return the balances of the wallet, from the running totals kept up to date with the wallet and the tip */
+    WalletBalance GetBalances() const;
     CAmount GetBalance(const isminefilter& filter=ISMINE_SPENDABLE, const int min_depth=0) const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -1027,6 +1109,21 @@ public:
                            std::string& strFailReason, const CCoinControl& coin_control, bool sign = true, bool isMakeBetTx = false);
     bool CommitTransaction(CTransactionRef tx, mapValue_t mapValue, std::vector<std::pair<std::string, std::string>> orderForm, CReserveKey& reservekey, CConnman* connman, CValidationState& state);
 
+    /**
+     * Sign transactions created by CreateTransaction without signing, with up
+     * to the given number of threads, each signing one transaction at a time.
+     * spent_outputs holds the outputs spent by the inputs of each transaction.
+     * Only the key store is used, so cs_wallet does not need to be held.
+     * @return whether each transaction could be fully signed
+     */
+    std::vector<bool> SignTransactions(std::vector<CMutableTransaction>& txs, const std::vector<std::vector<CTxOut>>& spent_outputs, int threads) const;
+    /**
+     * Add several transactions to the wallet in a single database transaction,
+     * then broadcast them in order. Unlike CommitTransaction, the keys reserved
+     * for their change are kept by the caller.
+     */
+    bool CommitTransactions(const std::vector<CTransactionRef>& txs, CConnman* connman, std::vector<CValidationState>& states);
+
     bool DummySignTx(CMutableTransaction &txNew, const std::set<CTxOut> &txouts, bool use_max_sig = false) const
     {
         std::vector<CTxOut> v_txouts(txouts.size());
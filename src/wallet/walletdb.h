@@ -27,6 +27,8 @@
  * - BerkeleyEnvironment is an environment in which the database exists.
  * - BerkeleyDatabase represents a wallet database.
  * - BerkeleyBatch is a low-level database batch update.
+ * - LogDatabase is an append-only log with an in-memory index that BerkeleyDatabase and
+ *   BerkeleyBatch use instead of BerkeleyDB for wallets stored with -walletbackend=log.
  */
 
 static const bool DEFAULT_FLUSHWALLET = true;
@@ -20,3 +20,12 @@ bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyBlockTransactions(const CBlock &block)
+{
+    for (const CTransactionRef& ptx : block.vtx) {
+        if (!NotifyTransaction(*ptx))
+            return false;
+    }
+    return true;
+}
@@ -34,6 +34,8 @@ public:
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    /** Notify the transactions of a connected or disconnected block at once (with -zmqbatchblocks). */
+    virtual bool NotifyBlockTransactions(const CBlock &block);
 
 protected:
     void *psocket;
@@ -15,7 +15,7 @@ void zmqError(const char *str)
     LogPrint(BCLog::ZMQ, "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(nullptr)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(nullptr), fBatchBlocks(DEFAULT_ZMQ_BATCH_BLOCKS)
 {
 }
 
@@ -48,6 +48,10 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
+    factories["pubnameop"] = CZMQAbstractNotifier::Create<CZMQPublishNameOperationNotifier>;
+    factories["pubbetsettled"] = CZMQAbstractNotifier::Create<CZMQPublishBetSettledNotifier>;
+    factories["pubmsgtx"] = CZMQAbstractNotifier::Create<CZMQPublishMessageTransactionNotifier>;
+    factories["pubdata"] = CZMQAbstractNotifier::Create<CZMQPublishDataNotifier>;
 
     for (const auto& entry : factories)
     {
@@ -67,6 +71,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     {
         notificationInterface = new CZMQNotificationInterface();
         notificationInterface->notifiers = notifiers;
+        notificationInterface->fBatchBlocks = gArgs.GetBoolArg("-zmqbatchblocks", DEFAULT_ZMQ_BATCH_BLOCKS);
 
         if (!notificationInterface->Initialize())
         {
@@ -174,20 +179,40 @@ void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef&
     }
 }
 
-void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted, const std::vector<CTransactionRef>& vNameConflicts)
+void CZMQNotificationInterface::NotifyBlockTransactions(const CBlock& block)
 {
-    for (const CTransactionRef& ptx : pblock->vtx) {
-        // Do a normal notify for each transaction added in the block
-        TransactionAddedToMempool(ptx);
+    if (!fBatchBlocks) {
+        for (const CTransactionRef& ptx : block.vtx) {
+            TransactionAddedToMempool(ptx);
+        }
+        return;
+    }
+
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    {
+        CZMQAbstractNotifier *notifier = *i;
+        if (notifier->NotifyBlockTransactions(block))
+        {
+            i++;
+        }
+        else
+        {
+            notifier->Shutdown();
+            i = notifiers.erase(i);
+        }
     }
 }
 
+void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted, const std::vector<CTransactionRef>& vNameConflicts)
+{
+    // Do a normal notify for each transaction added in the block
+    NotifyBlockTransactions(*pblock);
+}
+
 void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexDelete, const std::vector<CTransactionRef>& vNameConflicts)
 {
-    for (const CTransactionRef& ptx : pblock->vtx) {
-        // Do a normal notify for each transaction removed in block disconnection
-        TransactionAddedToMempool(ptx);
-    }
+    // Do a normal notify for each transaction removed in block disconnection
+    NotifyBlockTransactions(*pblock);
 }
 
 CZMQNotificationInterface* g_zmq_notification_interface = nullptr;
@@ -13,6 +13,9 @@
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+/** Default for -zmqbatchblocks, publishing the transactions of a block in a single message per topic */
+static const bool DEFAULT_ZMQ_BATCH_BLOCKS = false;
+
 class CZMQNotificationInterface final : public CValidationInterface
 {
 public:
@@ -35,7 +38,11 @@ protected:
 private:
     CZMQNotificationInterface();
 
+    /** Notify the transactions of a block, one by one or at once with -zmqbatchblocks. */
+    void NotifyBlockTransactions(const CBlock& block);
+
     void *pcontext;
+    bool fBatchBlocks;
     std::list<CZMQAbstractNotifier*> notifiers;
 };
 
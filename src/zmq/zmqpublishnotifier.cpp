@@ -4,18 +4,26 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <games/modulo/moduloverify.h>
+#include <script/names.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
 #include <util.h>
 #include <rpc/server.h>
 
+#include <algorithm>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_NAMEOP    = "nameop";
+static const char *MSG_BETSETTLED = "betsettled";
+static const char *MSG_MSGTX     = "msgtx";
+static const char *MSG_DATA      = "data";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -60,6 +68,32 @@ static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
     return 0;
 }
 
+// Internal function to send a multipart message with the parts of a vector
+static int zmq_send_multipart(void *sock, const char *command, const std::vector<std::vector<unsigned char>>& parts, const unsigned char* msgseq, size_t seqsize)
+{
+    if (zmq_send(sock, command, strlen(command), ZMQ_SNDMORE) == -1) {
+        zmqError("Unable to send ZMQ msg");
+        return -1;
+    }
+    for (const std::vector<unsigned char>& part : parts) {
+        if (zmq_send(sock, part.data(), part.size(), ZMQ_SNDMORE) == -1) {
+            zmqError("Unable to send ZMQ msg");
+            return -1;
+        }
+    }
+    if (zmq_send(sock, msgseq, seqsize, 0) == -1) {
+        zmqError("Unable to send ZMQ msg");
+        return -1;
+    }
+    return 0;
+}
+
+/** Append a hash in the byte order of its hex representation, as hashtx does. */
+static void AppendHash(std::vector<unsigned char>& data, const uint256& hash)
+{
+    std::reverse_copy(hash.begin(), hash.end(), std::back_inserter(data));
+}
+
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 {
     assert(!psocket);
@@ -146,6 +180,45 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
+bool CZMQAbstractPublishNotifier::SendMultipartMessage(const char *command, const std::vector<std::vector<unsigned char>>& data)
+{
+    assert(psocket);
+
+    unsigned char msgseq[sizeof(uint32_t)];
+    WriteLE32(&msgseq[0], nSequence);
+    int rc = zmq_send_multipart(psocket, command, data, msgseq, sizeof(msgseq));
+    if (rc == -1)
+        return false;
+
+    /* increment memory only sequence number after sending */
+    nSequence++;
+
+    return true;
+}
+
+bool CZMQAbstractPublishTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+{
+    std::vector<std::vector<unsigned char>> data;
+    EncodeTransaction(transaction, data);
+    for (const std::vector<unsigned char>& message : data) {
+        if (!SendMessage(GetCommand(), message.data(), message.size()))
+            return false;
+    }
+    return true;
+}
+
+bool CZMQAbstractPublishTransactionNotifier::NotifyBlockTransactions(const CBlock &block)
+{
+    std::vector<std::vector<unsigned char>> data;
+    for (const CTransactionRef& ptx : block.vtx) {
+        EncodeTransaction(*ptx, data);
+    }
+    if (data.empty())
+        return true;
+    LogPrint(BCLog::ZMQ, "zmq: Publish %u %s messages of block %s\n", data.size(), GetCommand(), block.GetHash().GetHex());
+    return SendMultipartMessage(GetCommand(), data);
+}
+
 bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     uint256 hash = pindex->GetBlockHash();
@@ -156,14 +229,17 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     return SendMessage(MSG_HASHBLOCK, data, 32);
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+const char* CZMQPublishHashTransactionNotifier::GetCommand() const
+{
+    return MSG_HASHTX;
+}
+
+void CZMQPublishHashTransactionNotifier::EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const
 {
     uint256 hash = transaction.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashtx %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTX, data, 32);
+    data.emplace_back();
+    AppendHash(data.back(), hash);
 }
 
 bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
@@ -187,11 +263,105 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+const char* CZMQPublishRawTransactionNotifier::GetCommand() const
+{
+    return MSG_RAWTX;
+}
+
+void CZMQPublishRawTransactionNotifier::EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const
 {
     uint256 hash = transaction.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    data.emplace_back();
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), data.back(), 0) << transaction;
+}
+
+const char* CZMQPublishNameOperationNotifier::GetCommand() const
+{
+    return MSG_NAMEOP;
+}
+
+void CZMQPublishNameOperationNotifier::EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const
+{
+    if (!transaction.IsNamecoin())
+        return;
+
+    /* txid, LE 4byte output index, 1byte name opcode, name and value, the
+       latter two prefixed by their compact size */
+    const uint256 hash = transaction.GetHash();
+    for (uint32_t n = 0; n < transaction.vout.size(); ++n) {
+        const CNameScript nameOp(transaction.vout[n].scriptPubKey);
+        if (!nameOp.isNameOp() || !nameOp.isAnyUpdate())
+            continue;
+        LogPrint(BCLog::ZMQ, "zmq: Publish nameop %s:%u\n", hash.GetHex(), n);
+        data.emplace_back();
+        AppendHash(data.back(), hash);
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data.back(), data.back().size())
+            << n << static_cast<uint8_t>(nameOp.getNameOp()) << nameOp.getOpName() << nameOp.getOpValue();
+    }
+}
+
+const char* CZMQPublishBetSettledNotifier::GetCommand() const
+{
+    return MSG_BETSETTLED;
+}
+
+void CZMQPublishBetSettledNotifier::EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const
+{
+    if (!modulo::ver_2::isGetBetTx(transaction))
+        return;
+
+    /* txid of the getbet, then for each payout the txid of the bet and the
+       LE 8byte amount paid out */
+    const uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish betsettled %s\n", hash.GetHex());
+    data.emplace_back();
+    std::vector<unsigned char>& message = data.back();
+    AppendHash(message, hash);
+    for (size_t i = 0; i < transaction.vin.size() && i < transaction.vout.size(); ++i) {
+        AppendHash(message, transaction.vin[i].prevout.hash);
+        unsigned char amount[sizeof(uint64_t)];
+        WriteLE64(amount, transaction.vout[i].nValue);
+        message.insert(message.end(), amount, amount + sizeof(amount));
+    }
+}
+
+const char* CZMQPublishMessageTransactionNotifier::GetCommand() const
+{
+    return MSG_MSGTX;
+}
+
+void CZMQPublishMessageTransactionNotifier::EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const
+{
+    if (!transaction.IsMsgTx())
+        return;
+
+    /* txid, then the encrypted message as stored in the OP_RETURN output */
+    const uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish msgtx %s\n", hash.GetHex());
+    const std::vector<char> payload = transaction.loadOpReturn();
+    data.emplace_back();
+    AppendHash(data.back(), hash);
+    data.back().insert(data.back().end(), payload.begin(), payload.end());
+}
+
+const char* CZMQPublishDataNotifier::GetCommand() const
+{
+    return MSG_DATA;
+}
+
+void CZMQPublishDataNotifier::EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const
+{
+    if (transaction.IsCoinBase() || transaction.IsMsgTx() || modulo::ver_2::isMakeBetTx(transaction) || modulo::ver_2::isGetBetTx(transaction))
+        return;
+    const std::vector<char> payload = transaction.loadOpReturn();
+    if (payload.empty())
+        return;
+
+    /* txid, then the OP_RETURN payload */
+    const uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish data %s\n", hash.GetHex());
+    data.emplace_back();
+    AppendHash(data.back(), hash);
+    data.back().insert(data.back().end(), payload.begin(), payload.end());
 }
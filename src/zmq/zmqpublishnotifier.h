@@ -7,6 +7,8 @@
 
 #include <zmq/zmqabstractnotifier.h>
 
+#include <vector>
+
 class CBlockIndex;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
@@ -24,20 +26,46 @@ public:
     */
     bool SendMessage(const char *command, const void* data, size_t size);
 
+    /* send zmq multipart message
+       parts:
+          * command
+          * one part for each data item
+          * message sequence number
+    */
+    bool SendMultipartMessage(const char *command, const std::vector<std::vector<unsigned char>>& data);
+
     bool Initialize(void *pcontext) override;
     void Shutdown() override;
 };
 
+/**
+ * Base class of the notifiers publishing zero or more messages per
+ * transaction. With -zmqbatchblocks, the messages of all the transactions of
+ * a block are published as the data parts of a single multipart message.
+ */
+class CZMQAbstractPublishTransactionNotifier : public CZMQAbstractPublishNotifier
+{
+protected:
+    virtual const char* GetCommand() const = 0;
+    /** Append the messages to publish for a transaction to data. */
+    virtual void EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const = 0;
+
+public:
+    bool NotifyTransaction(const CTransaction &transaction) override;
+    bool NotifyBlockTransactions(const CBlock &block) override;
+};
+
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
     bool NotifyBlock(const CBlockIndex *pindex) override;
 };
 
-class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
+class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishTransactionNotifier
 {
-public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+protected:
+    const char* GetCommand() const override;
+    void EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const override;
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
@@ -46,10 +74,43 @@ public:
     bool NotifyBlock(const CBlockIndex *pindex) override;
 };
 
-class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
+class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishTransactionNotifier
 {
-public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+protected:
+    const char* GetCommand() const override;
+    void EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const override;
+};
+
+/** Publishes the name_firstupdate and name_update outputs of transactions */
+class CZMQPublishNameOperationNotifier : public CZMQAbstractPublishTransactionNotifier
+{
+protected:
+    const char* GetCommand() const override;
+    void EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const override;
+};
+
+/** Publishes the payouts of getbet transactions */
+class CZMQPublishBetSettledNotifier : public CZMQAbstractPublishTransactionNotifier
+{
+protected:
+    const char* GetCommand() const override;
+    void EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const override;
+};
+
+/** Publishes the payloads of messenger transactions */
+class CZMQPublishMessageTransactionNotifier : public CZMQAbstractPublishTransactionNotifier
+{
+protected:
+    const char* GetCommand() const override;
+    void EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const override;
+};
+
+/** Publishes the OP_RETURN payloads of data transactions */
+class CZMQPublishDataNotifier : public CZMQAbstractPublishTransactionNotifier
+{
+protected:
+    const char* GetCommand() const override;
+    void EncodeTransaction(const CTransaction &transaction, std::vector<std::vector<unsigned char>>& data) const override;
 };
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H